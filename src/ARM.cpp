@@ -28,6 +28,9 @@
 #include "Platform.h"
 #include "GPU.h"
 #include "ARMJIT_Memory.h"
+#ifdef JIT_ENABLED
+#include "JITLockstep.h"
+#endif
 
 namespace melonDS
 {
@@ -130,9 +133,64 @@ ARMv5::ARMv5(melonDS::NDS& nds, std::optional<GDBArgs> gdb, bool jit) : ARM(0, j
     PU_Map = PU_PrivMap;
 }
 
+template <CPUExecuteMode mode>
+static u8 ARM7BusRead8(melonDS::NDS& nds, u32 addr)
+{
+    if constexpr (mode == CPUExecuteMode::InterpreterThreadedARM7)
+        nds.ARM7BusAccess(addr);
+    return nds.ARM7Read8(addr);
+}
+
+template <CPUExecuteMode mode>
+static u16 ARM7BusRead16(melonDS::NDS& nds, u32 addr)
+{
+    if constexpr (mode == CPUExecuteMode::InterpreterThreadedARM7)
+        nds.ARM7BusAccess(addr);
+    return nds.ARM7Read16(addr);
+}
+
+template <CPUExecuteMode mode>
+static u32 ARM7BusRead32(melonDS::NDS& nds, u32 addr)
+{
+    if constexpr (mode == CPUExecuteMode::InterpreterThreadedARM7)
+        nds.ARM7BusAccess(addr);
+    return nds.ARM7Read32(addr);
+}
+
+template <CPUExecuteMode mode>
+static void ARM7BusWrite8(melonDS::NDS& nds, u32 addr, u8 val)
+{
+    if constexpr (mode == CPUExecuteMode::InterpreterThreadedARM7)
+        nds.ARM7BusAccess(addr);
+    nds.ARM7Write8(addr, val);
+}
+
+template <CPUExecuteMode mode>
+static void ARM7BusWrite16(melonDS::NDS& nds, u32 addr, u16 val)
+{
+    if constexpr (mode == CPUExecuteMode::InterpreterThreadedARM7)
+        nds.ARM7BusAccess(addr);
+    nds.ARM7Write16(addr, val);
+}
+
+template <CPUExecuteMode mode>
+static void ARM7BusWrite32(melonDS::NDS& nds, u32 addr, u32 val)
+{
+    if constexpr (mode == CPUExecuteMode::InterpreterThreadedARM7)
+        nds.ARM7BusAccess(addr);
+    nds.ARM7Write32(addr, val);
+}
+
+template <CPUExecuteMode mode>
+static const ARMv4::BusFuncs ARM7Bus =
+{
+    ARM7BusRead8<mode>, ARM7BusRead16<mode>, ARM7BusRead32<mode>,
+    ARM7BusWrite8<mode>, ARM7BusWrite16<mode>, ARM7BusWrite32<mode>,
+};
+
 ARMv4::ARMv4(melonDS::NDS& nds, std::optional<GDBArgs> gdb, bool jit) : ARM(1, jit, gdb, nds)
 {
-    //
+    Bus = &ARM7Bus<CPUExecuteMode::Interpreter>;
 }
 
 ARMv5::~ARMv5()
@@ -589,6 +647,51 @@ void ARM::CheckGdbIncoming()
     GdbCheckA();
 }
 
+template <CPUExecuteMode mode>
+inline void ARMv5::InterpretInstr()
+{
+    if (CPSR & 0x20) // THUMB
+    {
+        if constexpr (mode == CPUExecuteMode::InterpreterGDB)
+            GdbCheckC();
+
+        // prefetch
+        R[15] += 2;
+        CurInstr = NextInstr[0];
+        NextInstr[0] = NextInstr[1];
+        if (R[15] & 0x2) { NextInstr[1] >>= 16; CodeCycles = 0; }
+        else             NextInstr[1] = CodeRead32(R[15], false);
+
+        // actually execute
+        u32 icode = (CurInstr >> 6) & 0x3FF;
+        ARMInterpreter::THUMBInstrTable[icode](this);
+    }
+    else
+    {
+        if constexpr (mode == CPUExecuteMode::InterpreterGDB)
+            GdbCheckC();
+
+        // prefetch
+        R[15] += 4;
+        CurInstr = NextInstr[0];
+        NextInstr[0] = NextInstr[1];
+        NextInstr[1] = CodeRead32(R[15], false);
+
+        // actually execute
+        if (CheckCondition(CurInstr >> 28))
+        {
+            u32 icode = ((CurInstr >> 4) & 0xF) | ((CurInstr >> 16) & 0xFF0);
+            ARMInterpreter::ARMInstrTable[icode](this);
+        }
+        else if ((CurInstr & 0xFE000000) == 0xFA000000)
+        {
+            ARMInterpreter::A_BLX_IMM(this);
+        }
+        else
+            AddCycles_C();
+    }
+}
+
 template <CPUExecuteMode mode>
 void ARMv5::Execute()
 {
@@ -617,24 +720,51 @@ void ARMv5::Execute()
     while (NDS.ARM9Timestamp < NDS.ARM9Target)
     {
 #ifdef JIT_ENABLED
-        if constexpr (mode == CPUExecuteMode::JIT)
+        if constexpr (mode == CPUExecuteMode::JIT || mode == CPUExecuteMode::InterpreterLockstep)
         {
-            u32 instrAddr = R[15] - ((CPSR&0x20)?2:4);
-
-            if ((instrAddr < FastBlockLookupStart || instrAddr >= (FastBlockLookupStart + FastBlockLookupSize))
-                && !NDS.JIT.SetupExecutableRegion(0, instrAddr, FastBlockLookup, FastBlockLookupStart, FastBlockLookupSize))
+            if constexpr (mode == CPUExecuteMode::JIT)
             {
-                NDS.ARM9Timestamp = NDS.ARM9Target;
-                Log(LogLevel::Error, "ARMv5 PC in non executable region %08X\n", R[15]);
-                return;
-            }
+                u32 instrAddr = R[15] - ((CPSR&0x20)?2:4);
 
-            JitBlockEntry block = NDS.JIT.LookUpBlock(0, FastBlockLookup,
-                instrAddr - FastBlockLookupStart, instrAddr);
-            if (block)
-                ARM_Dispatch(this, block);
+                if ((instrAddr < FastBlockLookupStart || instrAddr >= (FastBlockLookupStart + FastBlockLookupSize))
+                    && !NDS.JIT.SetupExecutableRegion(0, instrAddr, FastBlockLookup, FastBlockLookupStart, FastBlockLookupSize))
+                {
+                    if (NDS.Lockstep)
+                        NDS.Lockstep->RecordBail(*this);
+                    NDS.ARM9Timestamp = NDS.ARM9Target;
+                    Log(LogLevel::Error, "ARMv5 PC in non executable region %08X\n", R[15]);
+                    return;
+                }
+
+                JitBlockEntry block = NDS.JIT.LookUpBlock(0, FastBlockLookup,
+                    instrAddr - FastBlockLookupStart, instrAddr);
+                if (block)
+                    ARM_Dispatch(this, block);
+                else
+                    NDS.JIT.CompileBlock(this);
+
+                if (NDS.Lockstep)
+                    NDS.Lockstep->RecordBlock(*this, instrAddr, !block);
+            }
             else
-                NDS.JIT.CompileBlock(this);
+            {
+                const JITLockstep::Block* replay = NDS.Lockstep->NextBlock(*this);
+                if (!replay)
+                {
+                    NDS.ARM9Timestamp = NDS.ARM9Target;
+                    return;
+                }
+
+                // go through the instructions the JIT went through, it doesn't look at IRQs inside a block
+                FillPipeline();
+                for (u32 addr : *replay->Instrs)
+                {
+                    if (R[15] - ((CPSR&0x20)?2:4) != addr)
+                        break;
+                    InterpretInstr<mode>();
+                }
+                NDS.Lockstep->CheckBlock(*this, *replay);
+            }
 
             if (StopExecution)
             {
@@ -657,46 +787,7 @@ void ARMv5::Execute()
         else
 #endif
         {
-            if (CPSR & 0x20) // THUMB
-            {
-                if constexpr (mode == CPUExecuteMode::InterpreterGDB)
-                    GdbCheckC();
-
-                // prefetch
-                R[15] += 2;
-                CurInstr = NextInstr[0];
-                NextInstr[0] = NextInstr[1];
-                if (R[15] & 0x2) { NextInstr[1] >>= 16; CodeCycles = 0; }
-                else             NextInstr[1] = CodeRead32(R[15], false);
-
-                // actually execute
-                u32 icode = (CurInstr >> 6) & 0x3FF;
-                ARMInterpreter::THUMBInstrTable[icode](this);
-            }
-            else
-            {
-                if constexpr (mode == CPUExecuteMode::InterpreterGDB)
-                    GdbCheckC();
-
-                // prefetch
-                R[15] += 4;
-                CurInstr = NextInstr[0];
-                NextInstr[0] = NextInstr[1];
-                NextInstr[1] = CodeRead32(R[15], false);
-
-                // actually execute
-                if (CheckCondition(CurInstr >> 28))
-                {
-                    u32 icode = ((CurInstr >> 4) & 0xF) | ((CurInstr >> 16) & 0xFF0);
-                    ARMInterpreter::ARMInstrTable[icode](this);
-                }
-                else if ((CurInstr & 0xFE000000) == 0xFA000000)
-                {
-                    ARMInterpreter::A_BLX_IMM(this);
-                }
-                else
-                    AddCycles_C();
-            }
+            InterpretInstr<mode>();
 
             // TODO optimize this shit!!!
             if (Halted)
@@ -718,6 +809,9 @@ void ARMv5::Execute()
 
         NDS.ARM9Timestamp += Cycles;
         Cycles = 0;
+
+        if constexpr (mode == CPUExecuteMode::InterpreterThreadedARM7)
+            NDS.PublishARM9Progress();
     }
 
     if (Halted == 2)
@@ -725,13 +819,57 @@ void ARMv5::Execute()
 }
 template void ARMv5::Execute<CPUExecuteMode::Interpreter>();
 template void ARMv5::Execute<CPUExecuteMode::InterpreterGDB>();
+template void ARMv5::Execute<CPUExecuteMode::InterpreterThreadedARM7>();
 #ifdef JIT_ENABLED
 template void ARMv5::Execute<CPUExecuteMode::JIT>();
+template void ARMv5::Execute<CPUExecuteMode::InterpreterLockstep>();
 #endif
 
+template <CPUExecuteMode mode>
+inline void ARMv4::InterpretInstr()
+{
+    if (CPSR & 0x20) // THUMB
+    {
+        if constexpr (mode == CPUExecuteMode::InterpreterGDB)
+            GdbCheckC();
+
+        // prefetch
+        R[15] += 2;
+        CurInstr = NextInstr[0];
+        NextInstr[0] = NextInstr[1];
+        NextInstr[1] = CodeRead16(R[15]);
+
+        // actually execute
+        u32 icode = (CurInstr >> 6);
+        ARMInterpreter::THUMBInstrTable[icode](this);
+    }
+    else
+    {
+        if constexpr (mode == CPUExecuteMode::InterpreterGDB)
+            GdbCheckC();
+
+        // prefetch
+        R[15] += 4;
+        CurInstr = NextInstr[0];
+        NextInstr[0] = NextInstr[1];
+        NextInstr[1] = CodeRead32(R[15]);
+
+        // actually execute
+        if (CheckCondition(CurInstr >> 28))
+        {
+            u32 icode = ((CurInstr >> 4) & 0xF) | ((CurInstr >> 16) & 0xFF0);
+            ARMInterpreter::ARMInstrTable[icode](this);
+        }
+        else
+            AddCycles_C();
+    }
+}
+
 template <CPUExecuteMode mode>
 void ARMv4::Execute()
 {
+    Bus = &ARM7Bus<mode>;
+
     if constexpr (mode == CPUExecuteMode::InterpreterGDB)
         GdbCheckB();
 
@@ -749,32 +887,69 @@ void ARMv4::Execute()
         }
         else
         {
-            NDS.ARM7Timestamp = NDS.ARM7Target;
+            if constexpr (mode == CPUExecuteMode::InterpreterThreadedARM7)
+                NDS.ARM7SkipHalted();
+            else
+                NDS.ARM7Timestamp = NDS.ARM7Target;
             return;
         }
     }
 
     while (NDS.ARM7Timestamp < NDS.ARM7Target)
     {
-#ifdef JIT_ENABLED
-        if constexpr (mode == CPUExecuteMode::JIT)
+        if constexpr (mode == CPUExecuteMode::InterpreterThreadedARM7)
         {
-            u32 instrAddr = R[15] - ((CPSR&0x20)?2:4);
+            // the threaded ARM7 might not know where to stop yet
+            if (!NDS.ARM7CheckTarget())
+                break;
+        }
 
-            if ((instrAddr < FastBlockLookupStart || instrAddr >= (FastBlockLookupStart + FastBlockLookupSize))
-                && !NDS.JIT.SetupExecutableRegion(1, instrAddr, FastBlockLookup, FastBlockLookupStart, FastBlockLookupSize))
+#ifdef JIT_ENABLED
+        if constexpr (mode == CPUExecuteMode::JIT || mode == CPUExecuteMode::InterpreterLockstep)
+        {
+            if constexpr (mode == CPUExecuteMode::JIT)
             {
-                NDS.ARM7Timestamp = NDS.ARM7Target;
-                Log(LogLevel::Error, "ARMv4 PC in non executable region %08X\n", R[15]);
-                return;
-            }
+                u32 instrAddr = R[15] - ((CPSR&0x20)?2:4);
 
-            JitBlockEntry block = NDS.JIT.LookUpBlock(1, FastBlockLookup,
-                instrAddr - FastBlockLookupStart, instrAddr);
-            if (block)
-                ARM_Dispatch(this, block);
+                if ((instrAddr < FastBlockLookupStart || instrAddr >= (FastBlockLookupStart + FastBlockLookupSize))
+                    && !NDS.JIT.SetupExecutableRegion(1, instrAddr, FastBlockLookup, FastBlockLookupStart, FastBlockLookupSize))
+                {
+                    if (NDS.Lockstep)
+                        NDS.Lockstep->RecordBail(*this);
+                    NDS.ARM7Timestamp = NDS.ARM7Target;
+                    Log(LogLevel::Error, "ARMv4 PC in non executable region %08X\n", R[15]);
+                    return;
+                }
+
+                JitBlockEntry block = NDS.JIT.LookUpBlock(1, FastBlockLookup,
+                    instrAddr - FastBlockLookupStart, instrAddr);
+                if (block)
+                    ARM_Dispatch(this, block);
+                else
+                    NDS.JIT.CompileBlock(this);
+
+                if (NDS.Lockstep)
+                    NDS.Lockstep->RecordBlock(*this, instrAddr, !block);
+            }
             else
-                NDS.JIT.CompileBlock(this);
+            {
+                const JITLockstep::Block* replay = NDS.Lockstep->NextBlock(*this);
+                if (!replay)
+                {
+                    NDS.ARM7Timestamp = NDS.ARM7Target;
+                    return;
+                }
+
+                // go through the instructions the JIT went through, it doesn't look at IRQs inside a block
+                FillPipeline();
+                for (u32 addr : *replay->Instrs)
+                {
+                    if (R[15] - ((CPSR&0x20)?2:4) != addr)
+                        break;
+                    InterpretInstr<mode>();
+                }
+                NDS.Lockstep->CheckBlock(*this, *replay);
+            }
 
             if (StopExecution)
             {
@@ -796,46 +971,17 @@ void ARMv4::Execute()
         else
 #endif
         {
-            if (CPSR & 0x20) // THUMB
-            {
-                if constexpr (mode == CPUExecuteMode::InterpreterGDB)
-                    GdbCheckC();
-
-                // prefetch
-                R[15] += 2;
-                CurInstr = NextInstr[0];
-                NextInstr[0] = NextInstr[1];
-                NextInstr[1] = CodeRead16(R[15]);
-
-                // actually execute
-                u32 icode = (CurInstr >> 6);
-                ARMInterpreter::THUMBInstrTable[icode](this);
-            }
-            else
-            {
-                if constexpr (mode == CPUExecuteMode::InterpreterGDB)
-                    GdbCheckC();
-
-                // prefetch
-                R[15] += 4;
-                CurInstr = NextInstr[0];
-                NextInstr[0] = NextInstr[1];
-                NextInstr[1] = CodeRead32(R[15]);
-
-                // actually execute
-                if (CheckCondition(CurInstr >> 28))
-                {
-                    u32 icode = ((CurInstr >> 4) & 0xF) | ((CurInstr >> 16) & 0xFF0);
-                    ARMInterpreter::ARMInstrTable[icode](this);
-                }
-                else
-                    AddCycles_C();
-            }
+            InterpretInstr<mode>();
 
             // TODO optimize this shit!!!
             if (Halted)
             {
-                if (Halted == 1 && NDS.ARM7Timestamp < NDS.ARM7Target)
+                if constexpr (mode == CPUExecuteMode::InterpreterThreadedARM7)
+                {
+                    if (Halted == 1)
+                        NDS.ARM7SkipHalted();
+                }
+                else if (Halted == 1 && NDS.ARM7Timestamp < NDS.ARM7Target)
                 {
                     NDS.ARM7Timestamp = NDS.ARM7Target;
                 }
@@ -867,8 +1013,10 @@ void ARMv4::Execute()
 
 template void ARMv4::Execute<CPUExecuteMode::Interpreter>();
 template void ARMv4::Execute<CPUExecuteMode::InterpreterGDB>();
+template void ARMv4::Execute<CPUExecuteMode::InterpreterThreadedARM7>();
 #ifdef JIT_ENABLED
 template void ARMv4::Execute<CPUExecuteMode::JIT>();
+template void ARMv4::Execute<CPUExecuteMode::InterpreterLockstep>();
 #endif
 
 void ARMv5::FillPipeline()
@@ -1121,7 +1269,7 @@ u32 ARMv5::ReadMem(u32 addr, int size)
 
 void ARMv4::DataRead8(u32 addr, u32* val)
 {
-    *val = BusRead8(addr);
+    *val = Bus->Read8(NDS, addr);
     DataRegion = addr;
     DataCycles = NDS.ARM7MemTimings[addr >> 15][0];
 }
@@ -1130,7 +1278,7 @@ void ARMv4::DataRead16(u32 addr, u32* val)
 {
     addr &= ~1;
 
-    *val = BusRead16(addr);
+    *val = Bus->Read16(NDS, addr);
     DataRegion = addr;
     DataCycles = NDS.ARM7MemTimings[addr >> 15][0];
 }
@@ -1139,7 +1287,7 @@ void ARMv4::DataRead32(u32 addr, u32* val)
 {
     addr &= ~3;
 
-    *val = BusRead32(addr);
+    *val = Bus->Read32(NDS, addr);
     DataRegion = addr;
     DataCycles = NDS.ARM7MemTimings[addr >> 15][2];
 }
@@ -1148,13 +1296,13 @@ void ARMv4::DataRead32S(u32 addr, u32* val)
 {
     addr &= ~3;
 
-    *val = BusRead32(addr);
+    *val = Bus->Read32(NDS, addr);
     DataCycles += NDS.ARM7MemTimings[addr >> 15][3];
 }
 
 void ARMv4::DataWrite8(u32 addr, u8 val)
 {
-    BusWrite8(addr, val);
+    Bus->Write8(NDS, addr, val);
     DataRegion = addr;
     DataCycles = NDS.ARM7MemTimings[addr >> 15][0];
 }
@@ -1163,7 +1311,7 @@ void ARMv4::DataWrite16(u32 addr, u16 val)
 {
     addr &= ~1;
 
-    BusWrite16(addr, val);
+    Bus->Write16(NDS, addr, val);
     DataRegion = addr;
     DataCycles = NDS.ARM7MemTimings[addr >> 15][0];
 }
@@ -1172,7 +1320,7 @@ void ARMv4::DataWrite32(u32 addr, u32 val)
 {
     addr &= ~3;
 
-    BusWrite32(addr, val);
+    Bus->Write32(NDS, addr, val);
     DataRegion = addr;
     DataCycles = NDS.ARM7MemTimings[addr >> 15][2];
 }
@@ -1181,7 +1329,7 @@ void ARMv4::DataWrite32S(u32 addr, u32 val)
 {
     addr &= ~3;
 
-    BusWrite32(addr, val);
+    Bus->Write32(NDS, addr, val);
     DataCycles += NDS.ARM7MemTimings[addr >> 15][3];
 }
 
@@ -1280,32 +1428,32 @@ void ARMv5::BusWrite32(u32 addr, u32 val)
 
 u8 ARMv4::BusRead8(u32 addr)
 {
-    return NDS.ARM7Read8(addr);
+    return Bus->Read8(NDS, addr);
 }
 
 u16 ARMv4::BusRead16(u32 addr)
 {
-    return NDS.ARM7Read16(addr);
+    return Bus->Read16(NDS, addr);
 }
 
 u32 ARMv4::BusRead32(u32 addr)
 {
-    return NDS.ARM7Read32(addr);
+    return Bus->Read32(NDS, addr);
 }
 
 void ARMv4::BusWrite8(u32 addr, u8 val)
 {
-    NDS.ARM7Write8(addr, val);
+    Bus->Write8(NDS, addr, val);
 }
 
 void ARMv4::BusWrite16(u32 addr, u16 val)
 {
-    NDS.ARM7Write16(addr, val);
+    Bus->Write16(NDS, addr, val);
 }
 
 void ARMv4::BusWrite32(u32 addr, u32 val)
 {
-    NDS.ARM7Write32(addr, val);
+    Bus->Write32(NDS, addr, val);
 }
 }
 
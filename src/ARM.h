@@ -47,8 +47,12 @@ enum class CPUExecuteMode : u32
 {
     Interpreter,
     InterpreterGDB,
+    // interpreter with the ARM7 on its own thread, see NDS::SetARM7Threaded
+    InterpreterThreadedARM7,
 #ifdef JIT_ENABLED
-    JIT
+    JIT,
+    // interpreter following the blocks recorded from a JIT console, see JITLockstep.h
+    InterpreterLockstep,
 #endif
 };
 
@@ -251,6 +255,9 @@ public:
     template <CPUExecuteMode mode>
     void Execute();
 
+    template <CPUExecuteMode mode>
+    void InterpretInstr();
+
     // all code accesses are forced nonseq 32bit
     u32 CodeRead32(u32 addr, bool branch);
 
@@ -322,6 +329,11 @@ public:
     void CP15Write(u32 id, u32 val);
     u32 CP15Read(u32 id) const;
 
+    // for the JIT: CP15 reads which can be compiled without calling CP15Read
+    static bool CP15ReadConstant(u32 id, u32& val);
+    static bool CP15ReadMemberOffset(u32 id, u32& offset);
+    static bool CP15WriteIgnored(u32 id);
+
     u32 CP15Control;
 
     u32 RNGSeed;
@@ -392,14 +404,30 @@ public:
     template <CPUExecuteMode mode>
     void Execute();
 
+    template <CPUExecuteMode mode>
+    void InterpretInstr();
+
+    // the ARM7's bus accesses for the mode Execute() was last run with,
+    // only the threaded ARM7 has to sync with the ARM9 for them
+    struct BusFuncs
+    {
+        u8 (*Read8)(melonDS::NDS& nds, u32 addr);
+        u16 (*Read16)(melonDS::NDS& nds, u32 addr);
+        u32 (*Read32)(melonDS::NDS& nds, u32 addr);
+        void (*Write8)(melonDS::NDS& nds, u32 addr, u8 val);
+        void (*Write16)(melonDS::NDS& nds, u32 addr, u16 val);
+        void (*Write32)(melonDS::NDS& nds, u32 addr, u32 val);
+    };
+    const BusFuncs* Bus;
+
     u16 CodeRead16(u32 addr)
     {
-        return BusRead16(addr);
+        return Bus->Read16(NDS, addr);
     }
 
     u32 CodeRead32(u32 addr)
     {
-        return BusRead32(addr);
+        return Bus->Read32(NDS, addr);
     }
 
     void DataRead8(u32 addr, u32* val) override;
@@ -30,6 +30,7 @@ namespace ARMInterpreter
 extern void (*ARMInstrTable[4096])(ARM* cpu);
 extern void (*THUMBInstrTable[1024])(ARM* cpu);
 
+void A_UNK(ARM* cpu);
 void A_MSR_IMM(ARM* cpu);
 void A_MSR_REG(ARM* cpu);
 void A_MRS(ARM* cpu);
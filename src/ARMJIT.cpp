@@ -31,6 +31,7 @@
 #include "ARMJIT_Memory.h"
 #include "ARMJIT_Compiler.h"
 #include "ARMJIT_Global.h"
+#include "JITLockstep.h"
 
 #include "ARMInterpreter_ALU.h"
 #include "ARMInterpreter_LoadStore.h"
@@ -475,7 +476,8 @@ ARMJIT::ARMJIT(melonDS::NDS& nds, std::optional<JITArgs> jit) noexcept :
         MaxBlockSize(jit.has_value() ? std::clamp(jit->MaxBlockSize, 1u, 32u) : 32),
         LiteralOptimizations(jit.has_value() ? jit->LiteralOptimizations : false),
         BranchOptimizations(jit.has_value() ? jit->BranchOptimizations : false),
-        FastMemory((jit.has_value() ? jit->FastMemory : false) && ARMJIT_Memory::IsFastMemSupported())
+        FastMemory((jit.has_value() ? jit->FastMemory : false) && ARMJIT_Memory::IsFastMemSupported()),
+        PerfMap(jit.has_value() ? jit->PerfMap : JITPerfMap::None)
 {}
 
 void ARMJIT::RetireJitBlock(JitBlock* block) noexcept
@@ -507,26 +509,33 @@ void ARMJIT::SetJITArgs(JITArgs args) noexcept
     LiteralOptimizations = args.LiteralOptimizations;
     BranchOptimizations = args.BranchOptimizations;
     FastMemory = args.FastMemory;
+    // only blocks compiled from now on are written to it
+    PerfMap = args.PerfMap;
 }
 
 void ARMJIT::SetMaxBlockSize(int size) noexcept
 {
-    SetJITArgs(JITArgs{static_cast<unsigned>(size), LiteralOptimizations, LiteralOptimizations, FastMemory});
+    SetJITArgs(JITArgs{static_cast<unsigned>(size), LiteralOptimizations, LiteralOptimizations, FastMemory, PerfMap});
 }
 
 void ARMJIT::SetLiteralOptimizations(bool enabled) noexcept
 {
-    SetJITArgs(JITArgs{static_cast<unsigned>(MaxBlockSize), enabled, BranchOptimizations, FastMemory});
+    SetJITArgs(JITArgs{static_cast<unsigned>(MaxBlockSize), enabled, BranchOptimizations, FastMemory, PerfMap});
 }
 
 void ARMJIT::SetBranchOptimizations(bool enabled) noexcept
 {
-    SetJITArgs(JITArgs{static_cast<unsigned>(MaxBlockSize), LiteralOptimizations, enabled, FastMemory});
+    SetJITArgs(JITArgs{static_cast<unsigned>(MaxBlockSize), LiteralOptimizations, enabled, FastMemory, PerfMap});
 }
 
 void ARMJIT::SetFastMemory(bool enabled) noexcept
 {
-    SetJITArgs(JITArgs{static_cast<unsigned>(MaxBlockSize), LiteralOptimizations, BranchOptimizations, enabled});
+    SetJITArgs(JITArgs{static_cast<unsigned>(MaxBlockSize), LiteralOptimizations, BranchOptimizations, enabled, PerfMap});
+}
+
+void ARMJIT::SetPerfMap(JITPerfMap format) noexcept
+{
+    SetJITArgs(JITArgs{static_cast<unsigned>(MaxBlockSize), LiteralOptimizations, BranchOptimizations, FastMemory, format});
 }
 
 void ARMJIT::CompileBlock(ARM* cpu) noexcept
@@ -819,7 +828,13 @@ void ARMJIT::CompileBlock(ARM* cpu) noexcept
         bool secondaryFlagReadCond = !canCompile || (instrs[i - 1].BranchFlags & (branch_FollowCondTaken | branch_FollowCondNotTaken));
         if (instrs[i - 1].Info.ReadFlags != 0 || secondaryFlagReadCond)
             FloodFillSetFlags(instrs, i - 2, !secondaryFlagReadCond ? instrs[i - 1].Info.ReadFlags : 0xF);
-    } while(!instrs[i - 1].Info.EndBlock && i < MaxBlockSize && !cpu->Halted && (!cpu->IRQ || (cpu->CPSR & 0x80)));
+        // an instruction which doesn't branch can still raise an exception
+        // (a coprocessor access from user mode), what follows it didn't run
+    } while(!instrs[i - 1].Info.EndBlock && i < MaxBlockSize && !cpu->Halted && (!cpu->IRQ || (cpu->CPSR & 0x80))
+        && cpu->R[15] == r15);
+
+    if (NDS.Lockstep)
+        NDS.Lockstep->BlockCompiled(cpu->Num, blockAddr, instrs, i);
 
     if (numLiterals)
     {
@@ -894,10 +909,12 @@ void ARMJIT::CompileBlock(ARM* cpu) noexcept
         block->StartAddrLocal = localAddr;
 
         FloodFillSetFlags(instrs, i - 1, 0xF);
+        CountInterpretedInstrs(thumb, instrs, i);
 
         JitEnableWrite();
         block->EntryPoint = JITCompiler.CompileBlock(cpu, thumb, instrs, i, hasMemoryInstr);
         JitEnableExecute();
+        Stats.BlocksCompiled++;
 
         JIT_DEBUGPRINT("block start %p\n", block->EntryPoint);
     }
@@ -905,6 +922,7 @@ void ARMJIT::CompileBlock(ARM* cpu) noexcept
     {
         JIT_DEBUGPRINT("restored! %p\n", prevBlock);
         block = prevBlock;
+        Stats.BlocksRestored++;
     }
 
     assert((localAddr & 1) == 0);
@@ -934,6 +952,23 @@ void ARMJIT::CompileBlock(ARM* cpu) noexcept
     *entry |= JITCompiler.SubEntryOffset(block->EntryPoint);
 }
 
+void ARMJIT::CountInterpretedInstrs(bool thumb, const FetchedInstr instrs[], int instrsCount) noexcept
+{
+    for (int j = 0; j < instrsCount; j++)
+    {
+        u16 kind = instrs[j].Info.Kind;
+        if (!JITCompiler.CanCompile(thumb, kind))
+            (thumb ? Stats.InterpretedThumb : Stats.InterpretedARM)[kind]++;
+    }
+}
+
+JITStats ARMJIT::GetStats() const noexcept
+{
+    JITStats stats = Stats;
+    stats.LiveBlocks = JitBlocks9.size() + JitBlocks7.size();
+    return stats;
+}
+
 void ARMJIT::InvalidateByAddr(u32 localAddr) noexcept
 {
     JIT_DEBUGPRINT("invalidating by addr %x\n", localAddr);
@@ -967,6 +1002,7 @@ void ARMJIT::InvalidateByAddr(u32 localAddr) noexcept
             continue;
         }
         range->Blocks.Remove(i);
+        Stats.Invalidations[localAddr >> 27]++;
 
         if (range->Blocks.Length == 0
             && !PageContainsCode(&region[(localAddr & 0x7FFF000 & ~(Memory.PageSize - 1)) / 512], Memory.PageSize))
@@ -1112,6 +1148,7 @@ template void ARMJIT::CheckAndInvalidate<1, ARMJIT_Memory::memregion_NewSharedWR
 void ARMJIT::ResetBlockCache() noexcept
 {
     Log(LogLevel::Debug, "Resetting JIT block cache...\n");
+    Stats.CacheResets++;
 
     // could be replace through a function which only resets
     // the permissions but we're too lazy
@@ -41,6 +41,39 @@ namespace melonDS
 class ARM;
 
 class JitBlock;
+
+/// What the JIT has been doing since it was created or ResetStats()
+/// was last called, for finding out where its time goes in a game.
+struct JITStats
+{
+    /// Blocks the dispatcher currently knows about, filled in by GetStats().
+    u32 LiveBlocks = 0;
+
+    /// Blocks compiled to native code.
+    u64 BlocksCompiled = 0;
+    /// Blocks which were invalidated before and came back without being compiled again.
+    u64 BlocksRestored = 0;
+
+    /// Blocks invalidated by writes to their code or literals,
+    /// by the ARMJIT_Memory region which was written to.
+    u64 Invalidations[ARMJIT_Memory::memregions_Count] {};
+
+    /// Instructions in compiled blocks which the backend leaves
+    /// to the interpreter, by ARMInstrInfo kind.
+    u64 InterpretedARM[ARMInstrInfo::ak_Count] {};
+    u64 InterpretedThumb[ARMInstrInfo::tk_Count] {};
+
+    /// Faults of fast memory accesses which were handled by mapping
+    /// the page, and those which had the access rewritten to the slow path.
+    u64 FastMemMappings = 0;
+    u64 FastMemRewrites = 0;
+
+    /// Every time all blocks were thrown away, and how
+    /// often that was because the code memory was full.
+    u64 CacheResets = 0;
+    u64 CodeMemoryFull = 0;
+};
+
 class ARMJIT
 {
 public:
@@ -72,11 +105,17 @@ private:
     bool LiteralOptimizations = false;
     bool BranchOptimizations = false;
     bool FastMemory = false;
+    JITPerfMap PerfMap = JITPerfMap::None;
+
+    void CountInterpretedInstrs(bool thumb, const FetchedInstr instrs[], int instrsCount) noexcept;
+
+    JITStats Stats {};
 
 public:
     melonDS::NDS& NDS;
     TinyVector<u32> InvalidLiterals {};
     friend class ARMJIT_Memory;
+    friend class Compiler;
     void blockSanityCheck(u32 num, u32 blockAddr, JitBlockEntry entry) noexcept;
     void RetireJitBlock(JitBlock* block) noexcept;
 
@@ -84,12 +123,17 @@ public:
     bool LiteralOptimizationsEnabled() const noexcept { return LiteralOptimizations; }
     bool BranchOptimizationsEnabled() const noexcept { return BranchOptimizations; }
     bool FastMemoryEnabled() const noexcept { return FastMemory; }
+    JITPerfMap GetPerfMap() const noexcept { return PerfMap; }
 
     void SetJITArgs(JITArgs args) noexcept;
     void SetMaxBlockSize(int size) noexcept;
     void SetLiteralOptimizations(bool enabled) noexcept;
     void SetBranchOptimizations(bool enabled) noexcept;
     void SetFastMemory(bool enabled) noexcept;
+    void SetPerfMap(JITPerfMap format) noexcept;
+
+    [[nodiscard]] JITStats GetStats() const noexcept;
+    void ResetStats() noexcept { Stats = {}; }
 
     Compiler JITCompiler;
     std::unordered_map<u32, JitBlock*> JitBlocks9 {};
@@ -609,6 +609,46 @@ void Compiler::A_Comp_Clz()
     assert(Num == 0);
 }
 
+// saturates reg after an add or sub that overflowed, and sets Q
+void Compiler::Comp_SaturateOverflow(ARM64Reg rd, ARM64Reg reg)
+{
+    // the sign of the result is flipped on overflow
+    ASR(W2, reg, 31);
+    EORI2R(W2, W2, 0x80000000);
+    CSEL(rd, W2, reg, CC_VS);
+
+    ORRI2R(W2, RCPSR, 0x08000000);
+    CSEL(RCPSR, W2, RCPSR, CC_VS);
+
+    CPSRDirty = true;
+}
+
+void Compiler::A_Comp_SatAddSub()
+{
+    Comp_AddCycles_C();
+
+    ARM64Reg rd = MapReg(CurInstr.A_Reg(12));
+    ARM64Reg rm = MapReg(CurInstr.A_Reg(0));
+    ARM64Reg rn = MapReg(CurInstr.A_Reg(16));
+
+    bool sub = CurInstr.Instr & (1 << 21);
+    bool doubling = CurInstr.Instr & (1 << 22);
+
+    if (doubling)
+    {
+        // QDADD/QDSUB
+        ADDS(W1, rn, rn);
+        Comp_SaturateOverflow(W1, W1);
+        rn = W1;
+    }
+
+    if (sub)
+        SUBS(W0, rm, rn);
+    else
+        ADDS(W0, rm, rn);
+    Comp_SaturateOverflow(rd, W0);
+}
+
 void Compiler::Comp_Mul_Mla(bool S, bool mla, ARM64Reg rd, ARM64Reg rm, ARM64Reg rs, ARM64Reg rn)
 {
     if (Num == 0)
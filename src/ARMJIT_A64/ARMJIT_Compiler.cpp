@@ -23,6 +23,7 @@
 #include "../ARMJIT.h"
 #include "../NDS.h"
 #include "../ARMJIT_Global.h"
+#include "../ARMJIT_PerfMap.h"
 
 #include <stdlib.h>
 
@@ -160,6 +161,157 @@ void Compiler::A_Comp_MSR()
     }
 }
 
+void Compiler::Comp_CoprocessorAccessCheck()
+{
+    // coprocessor accesses from user mode raise an undefined instruction exception
+    ANDI2R(W0, RCPSR, 0x1F);
+    CMP(W0, 0x10);
+    FixupBranch privileged = B(CC_NEQ);
+
+    RegCache.PrepareExit();
+
+    SaveCPSR(false);
+    MOVI2R(W0, R15);
+    STR(INDEX_UNSIGNED, W0, RCPU, offsetof(ARM, R[15]));
+    MOVI2R(W0, CurInstr.Instr);
+    STR(INDEX_UNSIGNED, W0, RCPU, offsetof(ARM, CurInstr));
+    SaveCycles();
+    MOV(X0, RCPU);
+    QuickCallFunction(X1, ARMInterpreter::A_UNK);
+    LoadCycles();
+    LDR(INDEX_UNSIGNED, RCPSR, RCPU, offsetof(ARM, CPSR));
+
+    if (ConstantCycles)
+        ADD(RCycles, RCycles, ConstantCycles);
+    QuickTailCall(X0, ARM_Ret);
+
+    SetJumpTarget(privileged);
+}
+
+void CP15WriteTrampoline(ARMv5* cpu, u32 id, u32 val)
+{
+    cpu->CP15Write(id, val);
+}
+
+u32 CP15ReadTrampoline(ARMv5* cpu, u32 id)
+{
+    return cpu->CP15Read(id);
+}
+
+void Compiler::A_Comp_MCR()
+{
+    Comp_CoprocessorAccessCheck();
+    Comp_AddCycles_CI(1 + 1);
+
+    // cp14 on the ARM7 doesn't do anything
+    if (Num == 1)
+        return;
+
+    u32 cn = (CurInstr.Instr >> 16) & 0xF;
+    u32 cm = CurInstr.Instr & 0xF;
+    u32 cpinfo = (CurInstr.Instr >> 5) & 0x7;
+    u32 id = (cn<<8)|(cm<<4)|cpinfo;
+
+    if (id == 0x704 || id == 0x782)
+    {
+        // wait for interrupt, the block ends here
+        MOVI2R(W0, 1);
+        STRB(INDEX_UNSIGNED, W0, RCPU, offsetof(ARM, Halted));
+    }
+    else if (!ARMv5::CP15WriteIgnored(id))
+    {
+        ARM64Reg val = MapReg(CurInstr.A_Reg(12));
+
+        PushRegs(false, false);
+
+        MOV(W2, val);
+        MOVI2R(W1, id);
+        MOV(X0, RCPU);
+        QuickCallFunction(X3, CP15WriteTrampoline);
+
+        PopRegs(false, false);
+    }
+}
+
+void Compiler::A_Comp_MRC()
+{
+    Comp_CoprocessorAccessCheck();
+    Comp_AddCycles_CI(2 + 1);
+
+    if (Num == 1)
+        return;
+
+    u32 cn = (CurInstr.Instr >> 16) & 0xF;
+    u32 cm = CurInstr.Instr & 0xF;
+    u32 cpinfo = (CurInstr.Instr >> 5) & 0x7;
+    u32 id = (cn<<8)|(cm<<4)|cpinfo;
+
+    int rd = CurInstr.A_Reg(12);
+    ARM64Reg dst = rd == 15 ? W0 : MapReg(rd);
+
+    u32 val, offset;
+    if (ARMv5::CP15ReadConstant(id, val))
+    {
+        MOVI2R(dst, val);
+    }
+    else if (ARMv5::CP15ReadMemberOffset(id, offset))
+    {
+        // the protection unit state lies beyond the reach of an immediate offset
+        if (offset < 4096 * 4)
+        {
+            LDR(INDEX_UNSIGNED, dst, RCPU, offset);
+        }
+        else
+        {
+            ADDI2R(X1, RCPU, offset, X1);
+            LDR(INDEX_UNSIGNED, dst, X1, 0);
+        }
+    }
+    else
+    {
+        PushRegs(false, false);
+
+        MOVI2R(W1, id);
+        MOV(X0, RCPU);
+        QuickCallFunction(X2, CP15ReadTrampoline);
+
+        PopRegs(false, false);
+
+        MOV(dst, W0);
+    }
+
+    if (rd == 15)
+        STR(INDEX_UNSIGNED, W0, RCPU, offsetof(ARM, R[15]));
+}
+
+void Compiler::A_Comp_SVC()
+{
+    // the exception entry is done by the interpreter, but without
+    // flushing the register cache or leaving the block through the fallback path
+    IrregularCycles = true;
+
+    bool cpsrDirty = CPSRDirty;
+    SaveCPSR();
+    MOVI2R(W0, R15);
+    STR(INDEX_UNSIGNED, W0, RCPU, offsetof(ARM, R[15]));
+    SaveCycles();
+    PushRegs(true, true);
+
+    MOV(X0, RCPU);
+    QuickCallFunction(X1, Thumb ? ARMInterpreter::T_SVC : ARMInterpreter::A_SVC);
+
+    PopRegs(true, true);
+    LoadCycles();
+    LoadCPSR();
+    // in case this instruction is skipped
+    if (CurInstr.Cond() < 0xE)
+        CPSRDirty = cpsrDirty;
+}
+
+void Compiler::T_Comp_SVC()
+{
+    A_Comp_SVC();
+}
 
 void Compiler::PushRegs(bool saveHiRegs, bool saveRegsToBeChanged, bool allowUnload)
 {
@@ -577,7 +729,7 @@ const Compiler::CompileFunc A_Comp[ARMInstrInfo::ak_Count] =
     // Mul
     F(Mul), F(Mul), F(Mul_Long), F(Mul_Long), F(Mul_Long), F(Mul_Long), F(Mul_Short), F(Mul_Short), F(Mul_Short), F(Mul_Short), F(Mul_Short),
     // ARMv5 exclusives
-    F(Clz), NULL, NULL, NULL, NULL, 
+    F(Clz), F(SatAddSub), F(SatAddSub), F(SatAddSub), F(SatAddSub),
     
     // STR
     F(MemWB), F(MemWB), F(MemWB), F(MemWB), F(MemWB), F(MemWB), F(MemWB), F(MemWB), F(MemWB), F(MemWB),
@@ -606,7 +758,7 @@ const Compiler::CompileFunc A_Comp[ARMInstrInfo::ak_Count] =
     // Branch
     F(BranchImm), F(BranchImm), F(BranchImm), F(BranchXchangeReg), F(BranchXchangeReg),
     // Special
-    NULL, F(MSR), F(MSR), F(MRS), NULL, NULL, NULL,
+    NULL, F(MSR), F(MSR), F(MRS), F(MCR), F(MRC), F(SVC),
     &Compiler::Nop
 };
 #undef F
@@ -645,7 +797,7 @@ const Compiler::CompileFunc T_Comp[ARMInstrInfo::tk_Count] =
     // Branch
     F(BCOND), F(BranchXchangeReg), F(BranchXchangeReg), F(B), F(BL_LONG_1), F(BL_LONG_2),
     // Unk, SVC
-    NULL, NULL,
+    NULL, F(SVC),
     F(BL_Merged)
 };
 
@@ -678,11 +830,13 @@ JitBlockEntry Compiler::CompileBlock(ARM* cpu, bool thumb, FetchedInstr instrs[]
     if (JitMemMainSize - GetCodeOffset() < 1024 * 16)
     {
         Log(LogLevel::Debug, "JIT near memory full, resetting...\n");
+        NDS.JIT.Stats.CodeMemoryFull++;
         NDS.JIT.ResetBlockCache();
     }
     if ((JitMemMainSize +  JitMemSecondarySize) - OtherCodeRegion < 1024 * 8)
     {
         Log(LogLevel::Debug, "JIT far memory full, resetting...\n");
+        NDS.JIT.Stats.CodeMemoryFull++;
         NDS.JIT.ResetBlockCache();
     }
 
@@ -695,6 +849,9 @@ JitBlockEntry Compiler::CompileBlock(ARM* cpu, bool thumb, FetchedInstr instrs[]
     RegCache = RegisterCache<Compiler, ARM64Reg>(this, instrs, instrsCount, true);
     CPSRDirty = false;
 
+    const u8* blockStart = (const u8*)GetRXPtr();
+    ptrdiff_t farBlockStart = OtherCodeRegion;
+
     if (hasMemInstr)
         MOVP2R(RMemBase, Num == 0 ? NDS.JIT.Memory.FastMem9Start : NDS.JIT.Memory.FastMem7Start);
 
@@ -825,6 +982,11 @@ JitBlockEntry Compiler::CompileBlock(ARM* cpu, bool thumb, FetchedInstr instrs[]
 
     FlushIcache();
 
+    ARMJIT_PerfMap::AddBlock(NDS.JIT.GetPerfMap(), blockStart, (const u8*)GetRXPtr() - blockStart, Num, instrs[0].Addr, Thumb);
+    if (OtherCodeRegion != farBlockStart)
+        ARMJIT_PerfMap::AddBlock(NDS.JIT.GetPerfMap(), (const u8*)GetRXBase() + farBlockStart, OtherCodeRegion - farBlockStart,
+            Num, instrs[0].Addr, Thumb, true);
+
     return res;
 }
 
@@ -149,6 +149,7 @@ public:
     void A_Comp_Mul_Short();
 
     void A_Comp_Clz();
+    void A_Comp_SatAddSub();
 
     void A_Comp_MemWB();
     void A_Comp_MemHD();
@@ -160,6 +161,9 @@ public:
 
     void A_Comp_MRS();
     void A_Comp_MSR();
+    void A_Comp_MCR();
+    void A_Comp_MRC();
+    void A_Comp_SVC();
 
     void T_Comp_ShiftImm();
     void T_Comp_AddSub_();
@@ -185,10 +189,12 @@ public:
     void T_Comp_BL_LONG_1();
     void T_Comp_BL_LONG_2();
     void T_Comp_BL_Merged();
+    void T_Comp_SVC();
 
     s32 Comp_MemAccessBlock(int rn, BitSet16 regs, bool store, bool preinc, bool decrement, bool usermode, bool skipLoadingRn);
 
     void Comp_Mul_Mla(bool S, bool mla, Arm64Gen::ARM64Reg rd, Arm64Gen::ARM64Reg rm, Arm64Gen::ARM64Reg rs, Arm64Gen::ARM64Reg rn);
+    void Comp_SaturateOverflow(Arm64Gen::ARM64Reg rd, Arm64Gen::ARM64Reg reg);
 
     void Comp_Compare(int op, Arm64Gen::ARM64Reg rn, Op2 op2);
     void Comp_Logical(int op, bool S, Arm64Gen::ARM64Reg rd, Arm64Gen::ARM64Reg rn, Op2 op2);
@@ -223,6 +229,7 @@ public:
     void* Gen_JumpTo7(int kind);
 
     void Comp_BranchSpecialBehaviour(bool taken);
+    void Comp_CoprocessorAccessCheck();
 
     JitBlockEntry AddEntryOffset(u32 offset)
     {
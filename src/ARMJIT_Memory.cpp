@@ -829,8 +829,14 @@ bool ARMJIT_Memory::FaultHandler(FaultDescription& faultDesc, melonDS::NDS& nds)
         if (memStatus[faultDesc.EmulatedFaultAddr >> PageShift] == memstate_Unmapped)
             rewriteToSlowPath = !nds.JIT.Memory.MapAtAddress(faultDesc.EmulatedFaultAddr);
 
-        if (rewriteToSlowPath)
+        if (!rewriteToSlowPath)
         {
+            nds.JIT.Stats.FastMemMappings++;
+        }
+        else
+        {
+            nds.JIT.Stats.FastMemRewrites++;
+
             nds.JIT.JitEnableWrite();
             faultDesc.FaultPC = nds.JIT.JITCompiler.RewriteMemAccess(faultDesc.FaultPC);
             nds.JIT.JitEnableExecute();
@@ -1237,6 +1243,32 @@ u32 ARMJIT_Memory::LocaliseAddress(int region, u32 num, u32 addr) const noexcept
     }
 }
 
+const char* ARMJIT_Memory::RegionName(int region)
+{
+    static const char* names[memregions_Count] =
+    {
+        "Other",
+        "ITCM",
+        "DTCM",
+        "BIOS9",
+        "MainRAM",
+        "SharedWRAM",
+        "IO9",
+        "VRAM",
+        "BIOS7",
+        "WRAM7",
+        "IO7",
+        "Wifi",
+        "VWRAM",
+        "BIOS9DSi",
+        "BIOS7DSi",
+        "NewSharedWRAM_A",
+        "NewSharedWRAM_B",
+        "NewSharedWRAM_C",
+    };
+    return region >= 0 && region < memregions_Count ? names[region] : "?";
+}
+
 int ARMJIT_Memory::ClassifyAddress9(u32 addr) const noexcept
 {
     if (addr < NDS.ARM9.ITCMSize)
@@ -140,6 +140,7 @@ public:
     bool MapAtAddress(u32 addr) noexcept;
 
     static bool IsFastMemSupported();
+    static const char* RegionName(int region);
 
     static void RegisterFaultHandler();
     static void UnregisterFaultHandler();
@@ -0,0 +1,209 @@
+/*
+    Copyright 2016-2026 melonDS team
+
+    This file is part of melonDS.
+
+    melonDS is free software: you can redistribute it and/or modify it under
+    the terms of the GNU General Public License as published by the Free
+    Software Foundation, either version 3 of the License, or (at your option)
+    any later version.
+
+    melonDS is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+    FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with melonDS. If not, see http://www.gnu.org/licenses/.
+*/
+
+#include "ARMJIT_PerfMap.h"
+#include "Platform.h"
+
+#ifdef __linux__
+#include <elf.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+#endif
+
+#include <stdio.h>
+#include <string.h>
+
+#include <atomic>
+#include <mutex>
+
+namespace melonDS
+{
+
+using Platform::Log;
+using Platform::LogLevel;
+
+namespace ARMJIT_PerfMap
+{
+
+#ifdef __linux__
+
+static std::mutex perfMapMutex;
+
+static FILE* PerfMapFile = nullptr;
+static FILE* JitDumpFile = nullptr;
+static bool OpenFailed[2] = {false, false};
+static u64 JitDumpCodeIndex = 0;
+
+// see tools/perf/Documentation/jitdump-specification.txt in the kernel tree
+struct JitDumpHeader
+{
+    u32 Magic;
+    u32 Version;
+    u32 TotalSize;
+    u32 ElfMach;
+    u32 Pad1;
+    u32 Pid;
+    u64 Timestamp;
+    u64 Flags;
+};
+
+struct JitDumpCodeLoad
+{
+    u32 ID;
+    u32 TotalSize;
+    u64 Timestamp;
+    u32 Pid;
+    u32 Tid;
+    u64 VMA;
+    u64 CodeAddr;
+    u64 CodeSize;
+    u64 CodeIndex;
+};
+
+static_assert(sizeof(JitDumpHeader) == 40);
+static_assert(sizeof(JitDumpCodeLoad) == 56);
+
+// perf record has to be run with -k mono for it to match the samples
+static u64 Timestamp()
+{
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (u64)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static FILE* OpenPerfMap()
+{
+    char path[64];
+    snprintf(path, sizeof(path), "/tmp/perf-%d.map", getpid());
+    FILE* file = fopen(path, "w");
+    if (file)
+        Log(LogLevel::Info, "JIT: writing perf map to %s\n", path);
+    return file;
+}
+
+static FILE* OpenJitDump()
+{
+    char path[64];
+    snprintf(path, sizeof(path), "/tmp/jit-%d.dump", getpid());
+    int fd = open(path, O_CREAT | O_TRUNC | O_RDWR, 0666);
+    if (fd < 0)
+        return nullptr;
+
+    // perf record finds the file through this mapping
+    void* marker = mmap(nullptr, sysconf(_SC_PAGESIZE), PROT_READ | PROT_EXEC, MAP_PRIVATE, fd, 0);
+    if (marker == MAP_FAILED)
+    {
+        close(fd);
+        return nullptr;
+    }
+
+    FILE* file = fdopen(fd, "wb");
+    if (!file)
+    {
+        munmap(marker, sysconf(_SC_PAGESIZE));
+        close(fd);
+        return nullptr;
+    }
+
+    JitDumpHeader header {};
+    header.Magic = 0x4A695444;
+    header.Version = 1;
+    header.TotalSize = sizeof(JitDumpHeader);
+#if defined(__x86_64__)
+    header.ElfMach = EM_X86_64;
+#elif defined(__aarch64__)
+    header.ElfMach = EM_AARCH64;
+#endif
+    header.Pid = getpid();
+    header.Timestamp = Timestamp();
+    fwrite(&header, sizeof(header), 1, file);
+    fflush(file);
+
+    Log(LogLevel::Info, "JIT: writing jitdump to %s\n", path);
+    return file;
+}
+
+void AddBlock(JITPerfMap format, const void* code, size_t size, u32 num, u32 addr, bool thumb, bool farCode)
+{
+    if (format == JITPerfMap::None)
+        return;
+
+    std::lock_guard guard(perfMapMutex);
+
+    FILE*& file = format == JITPerfMap::PerfMap ? PerfMapFile : JitDumpFile;
+    bool& failed = OpenFailed[format == JITPerfMap::PerfMap ? 0 : 1];
+    if (!file && !failed)
+    {
+        file = format == JITPerfMap::PerfMap ? OpenPerfMap() : OpenJitDump();
+        if (!file)
+        {
+            Log(LogLevel::Error, "JIT: couldn't open the %s\n", format == JITPerfMap::PerfMap ? "perf map" : "jitdump");
+            failed = true;
+        }
+    }
+    if (!file)
+        return;
+
+    char name[32];
+    snprintf(name, sizeof(name), "ARM%d_%s_%08X%s", num == 0 ? 9 : 7, thumb ? "Thumb" : "ARM", addr, farCode ? "_far" : "");
+
+    if (format == JITPerfMap::PerfMap)
+    {
+        fprintf(file, "%zx %zx %s\n", (size_t)code, size, name);
+    }
+    else
+    {
+        size_t nameLen = strlen(name) + 1;
+
+        JitDumpCodeLoad record {};
+        record.ID = 0;
+        record.TotalSize = sizeof(record) + nameLen + size;
+        record.Timestamp = Timestamp();
+        record.Pid = getpid();
+        record.Tid = syscall(SYS_gettid);
+        record.VMA = (u64)code;
+        record.CodeAddr = (u64)code;
+        record.CodeSize = size;
+        record.CodeIndex = JitDumpCodeIndex++;
+
+        fwrite(&record, sizeof(record), 1, file);
+        fwrite(name, nameLen, 1, file);
+        fwrite(code, size, 1, file);
+    }
+    // it's read once the process has exited, which might not be a clean exit
+    fflush(file);
+}
+
+#else
+
+void AddBlock(JITPerfMap format, const void* code, size_t size, u32 num, u32 addr, bool thumb, bool farCode)
+{
+    // several instances can be compiling blocks at the same time
+    static std::atomic<bool> warned = false;
+    if (format != JITPerfMap::None && !warned.exchange(true))
+        Log(LogLevel::Warn, "JIT: perf maps are only written on Linux\n");
+}
+
+#endif
+
+}
+
+}
@@ -0,0 +1,51 @@
+/*
+    Copyright 2016-2026 melonDS team
+
+    This file is part of melonDS.
+
+    melonDS is free software: you can redistribute it and/or modify it under
+    the terms of the GNU General Public License as published by the Free
+    Software Foundation, either version 3 of the License, or (at your option)
+    any later version.
+
+    melonDS is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+    FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with melonDS. If not, see http://www.gnu.org/licenses/.
+*/
+
+#ifndef ARMJIT_PERFMAP_H
+#define ARMJIT_PERFMAP_H
+
+#include <stddef.h>
+
+#include "types.h"
+#include "Args.h"
+
+namespace melonDS
+{
+
+/// Tells Linux perf what the generated code is, so that samples landing in
+/// a block are attributed to the guest code it was compiled from.
+///
+/// perf expects a single file per process, so this is shared between all
+/// JIT instances. The perf map (/tmp/perf-<pid>.map) is a plain list of
+/// address ranges, it can't tell code which was compiled to the same place
+/// after the block cache was reset apart. The jitdump (/tmp/jit-<pid>.dump)
+/// records when each block was compiled along with its code, so it also
+/// works for that and for perf annotate, but it has to be merged into the
+/// recording with perf inject --jit first.
+namespace ARMJIT_PerfMap
+{
+
+// the code a block keeps apart for rarely taken paths is added
+// as a separate entry, with _far appended to the name
+void AddBlock(JITPerfMap format, const void* code, size_t size, u32 num, u32 addr, bool thumb, bool farCode = false);
+
+}
+
+}
+
+#endif
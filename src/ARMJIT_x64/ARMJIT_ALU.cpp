@@ -268,6 +268,8 @@ void Compiler::A_Comp_MovOp()
 
 void Compiler::A_Comp_CLZ()
 {
+    Comp_AddCycles_C();
+
     OpArg rd = MapReg(CurInstr.A_Reg(12));
     OpArg rm = MapReg(CurInstr.A_Reg(0));
 
@@ -405,6 +407,126 @@ void Compiler::A_Comp_Mul_Long()
     MOV(32, rd, R(RSCRATCH2));
 }
 
+void Compiler::A_Comp_Mul_Short()
+{
+    OpArg rd = MapReg(CurInstr.A_Reg(16));
+    OpArg rm = MapReg(CurInstr.A_Reg(0));
+    OpArg rs = MapReg(CurInstr.A_Reg(8));
+    u32 op = (CurInstr.Instr >> 21) & 0xF;
+
+    bool x = CurInstr.Instr & (1 << 5);
+    bool y = CurInstr.Instr & (1 << 6);
+
+    if (y)
+    {
+        MOV(32, R(RSCRATCH2), rs);
+        SAR(32, R(RSCRATCH2), Imm8(16));
+    }
+    else
+        MOVSX(32, 16, RSCRATCH2, rs);
+
+    if (op == 0b1001)
+    {
+        // SMLAWy/SMULWy
+        MOVSX(64, 32, RSCRATCH, rm);
+        MOVSX(64, 32, RSCRATCH2, R(RSCRATCH2));
+        IMUL(64, RSCRATCH, R(RSCRATCH2));
+        SAR(64, R(RSCRATCH), Imm8(16));
+    }
+    else
+    {
+        if (x)
+        {
+            MOV(32, R(RSCRATCH), rm);
+            SAR(32, R(RSCRATCH), Imm8(16));
+        }
+        else
+            MOVSX(32, 16, RSCRATCH, rm);
+
+        IMUL(32, RSCRATCH, R(RSCRATCH2));
+    }
+
+    if (op == 0b1000 || (op == 0b1001 && !x))
+    {
+        // SMLAxy/SMLAWy, the accumulation sets Q on overflow
+        OpArg rn = MapReg(CurInstr.A_Reg(12));
+        ADD(32, R(RSCRATCH), rn);
+        FixupBranch noOverflow = J_CC(CC_NO);
+        OR(32, R(RCPSR), Imm32(0x08000000));
+        SetJumpTarget(noOverflow);
+        CPSRDirty = true;
+
+        MOV(32, rd, R(RSCRATCH));
+        Comp_AddCycles_C();
+    }
+    else if (op == 0b1010)
+    {
+        // SMLALxy
+        OpArg rn = MapReg(CurInstr.A_Reg(12));
+
+        MOVSX(64, 32, RSCRATCH, R(RSCRATCH));
+        MOV(32, R(RSCRATCH3), rd);
+        SHL(64, R(RSCRATCH3), Imm8(32));
+        MOV(32, R(RSCRATCH2), rn);
+        OR(64, R(RSCRATCH3), R(RSCRATCH2));
+        ADD(64, R(RSCRATCH), R(RSCRATCH3));
+
+        MOV(32, rn, R(RSCRATCH));
+        SHR(64, R(RSCRATCH), Imm8(32));
+        MOV(32, rd, R(RSCRATCH));
+        Comp_AddCycles_CI(1);
+    }
+    else
+    {
+        // SMULxy/SMULWy
+        MOV(32, rd, R(RSCRATCH));
+        Comp_AddCycles_C();
+    }
+}
+
+// saturates reg after an add or sub that overflowed, and sets Q
+void Compiler::Comp_SaturateOverflow(Gen::X64Reg reg)
+{
+    FixupBranch noOverflow = J_CC(CC_NO);
+    // the sign of the result is flipped on overflow
+    SAR(32, R(reg), Imm8(31));
+    XOR(32, R(reg), Imm32(0x80000000));
+    OR(32, R(RCPSR), Imm32(0x08000000));
+    SetJumpTarget(noOverflow);
+    CPSRDirty = true;
+}
+
+void Compiler::A_Comp_SatAddSub()
+{
+    Comp_AddCycles_C();
+
+    OpArg rd = MapReg(CurInstr.A_Reg(12));
+    OpArg rm = MapReg(CurInstr.A_Reg(0));
+    OpArg rn = MapReg(CurInstr.A_Reg(16));
+
+    bool sub = CurInstr.Instr & (1 << 21);
+    bool doubling = CurInstr.Instr & (1 << 22);
+
+    OpArg op2 = rn;
+    if (doubling)
+    {
+        // QDADD/QDSUB
+        MOV(32, R(RSCRATCH2), rn);
+        ADD(32, R(RSCRATCH2), R(RSCRATCH2));
+        Comp_SaturateOverflow(RSCRATCH2);
+        op2 = R(RSCRATCH2);
+    }
+
+    MOV(32, R(RSCRATCH), rm);
+    if (sub)
+        SUB(32, R(RSCRATCH), op2);
+    else
+        ADD(32, R(RSCRATCH), op2);
+    Comp_SaturateOverflow(RSCRATCH);
+
+    MOV(32, rd, R(RSCRATCH));
+}
+
 void Compiler::Comp_RetriveFlags(bool sign, bool retriveCV, bool carryUsed)
 {
     if (CurInstr.SetFlags == 0)
@@ -22,6 +22,7 @@
 #include "../ARMInterpreter.h"
 #include "../NDS.h"
 #include "../ARMJIT_Global.h"
+#include "../ARMJIT_PerfMap.h"
 
 #include <assert.h>
 #include <stdarg.h>
@@ -223,6 +224,152 @@ void Compiler::A_Comp_MSR()
     }
 }
 
+void Compiler::Comp_CoprocessorAccessCheck()
+{
+    // coprocessor accesses from user mode raise an undefined instruction exception
+    MOV(32, R(RSCRATCH), R(RCPSR));
+    AND(32, R(RSCRATCH), Imm8(0x1F));
+    CMP(32, R(RSCRATCH), Imm8(0x10));
+    FixupBranch userMode = J_CC(CC_E, true);
+
+    SwitchToFarCode();
+    SetJumpTarget(userMode);
+
+    RegCache.PrepareExit();
+
+    SaveCPSR(false);
+    MOV(32, MDisp(RCPU, offsetof(ARM, R[15])), Imm32(R15));
+    MOV(32, MDisp(RCPU, offsetof(ARM, CurInstr)), Imm32(CurInstr.Instr));
+    MOV(64, R(ABI_PARAM1), R(RCPU));
+    ABI_CallFunction(ARMInterpreter::A_UNK);
+    MOV(32, R(RCPSR), MDisp(RCPU, offsetof(ARM, CPSR)));
+
+    if (ConstantCycles)
+        ADD(32, MDisp(RCPU, offsetof(ARM, Cycles)), Imm32(ConstantCycles));
+    ABI_TailCall(ARM_Ret);
+
+    SwitchToNearCode();
+}
+
+void CP15WriteTrampoline(ARMv5* cpu, u32 id, u32 val)
+{
+    cpu->CP15Write(id, val);
+}
+
+u32 CP15ReadTrampoline(ARMv5* cpu, u32 id)
+{
+    return cpu->CP15Read(id);
+}
+
+void Compiler::A_Comp_MCR()
+{
+    Comp_CoprocessorAccessCheck();
+    Comp_AddCycles_CI(1 + 1);
+
+    // cp14 on the ARM7 doesn't do anything
+    if (Num == 1)
+        return;
+
+    u32 cn = (CurInstr.Instr >> 16) & 0xF;
+    u32 cm = CurInstr.Instr & 0xF;
+    u32 cpinfo = (CurInstr.Instr >> 5) & 0x7;
+    u32 id = (cn<<8)|(cm<<4)|cpinfo;
+
+    if (id == 0x704 || id == 0x782)
+    {
+        // wait for interrupt, the block ends here
+        MOV(8, MDisp(RCPU, offsetof(ARM, Halted)), Imm8(1));
+    }
+    else if (!ARMv5::CP15WriteIgnored(id))
+    {
+        OpArg val = MapReg(CurInstr.A_Reg(12));
+
+        PushRegs(false, false);
+
+        MOV(32, R(ABI_PARAM3), val);
+        MOV(32, R(ABI_PARAM2), Imm32(id));
+        MOV(64, R(ABI_PARAM1), R(RCPU));
+        ABI_CallFunction(CP15WriteTrampoline);
+
+        PopRegs(false, false);
+    }
+}
+
+void Compiler::A_Comp_MRC()
+{
+    Comp_CoprocessorAccessCheck();
+    Comp_AddCycles_CI(2 + 1);
+
+    if (Num == 1)
+        return;
+
+    u32 cn = (CurInstr.Instr >> 16) & 0xF;
+    u32 cm = CurInstr.Instr & 0xF;
+    u32 cpinfo = (CurInstr.Instr >> 5) & 0x7;
+    u32 id = (cn<<8)|(cm<<4)|cpinfo;
+
+    int rd = CurInstr.A_Reg(12);
+    OpArg dst = rd == 15 ? MDisp(RCPU, offsetof(ARM, R[15])) : MapReg(rd);
+
+    u32 val, offset;
+    if (ARMv5::CP15ReadConstant(id, val))
+    {
+        MOV(32, dst, Imm32(val));
+    }
+    else if (ARMv5::CP15ReadMemberOffset(id, offset))
+    {
+        if (dst.IsSimpleReg())
+        {
+            MOV(32, dst, MDisp(RCPU, offset));
+        }
+        else
+        {
+            MOV(32, R(RSCRATCH), MDisp(RCPU, offset));
+            MOV(32, dst, R(RSCRATCH));
+        }
+    }
+    else
+    {
+        PushRegs(false, false);
+
+        MOV(32, R(ABI_PARAM2), Imm32(id));
+        MOV(64, R(ABI_PARAM1), R(RCPU));
+        ABI_CallFunction(CP15ReadTrampoline);
+
+        PopRegs(false, false);
+
+        MOV(32, dst, R(RSCRATCH));
+    }
+}
+
+void Compiler::A_Comp_SVC()
+{
+    // the exception entry is done by the interpreter, but without
+    // flushing the register cache or leaving the block through the fallback path
+    IrregularCycles = true;
+
+    bool cpsrDirty = CPSRDirty;
+    SaveCPSR();
+    MOV(32, MDisp(RCPU, offsetof(ARM, R[15])), Imm32(R15));
+
+    PushRegs(true, true);
+
+    MOV(64, R(ABI_PARAM1), R(RCPU));
+    ABI_CallFunction(Thumb ? ARMInterpreter::T_SVC : ARMInterpreter::A_SVC);
+
+    PopRegs(true, true);
+
+    LoadCPSR();
+    // in case this instruction is skipped
+    if (CurInstr.Cond() < 0xE)
+        CPSRDirty = cpsrDirty;
+}
+
+void Compiler::T_Comp_SVC()
+{
+    A_Comp_SVC();
+}
+
 Compiler::Compiler(melonDS::NDS& nds) : XEmitter(), NDS(nds)
 {
     ARMJIT_Global::Init();
@@ -557,9 +704,10 @@ const Compiler::CompileFunc A_Comp[ARMInstrInfo::ak_Count] =
     // CMN
     F(A_Comp_CmpOp), F(A_Comp_CmpOp), F(A_Comp_CmpOp), F(A_Comp_CmpOp), F(A_Comp_CmpOp), F(A_Comp_CmpOp), F(A_Comp_CmpOp), F(A_Comp_CmpOp), F(A_Comp_CmpOp),
     // Mul
-    F(A_Comp_MUL_MLA), F(A_Comp_MUL_MLA), F(A_Comp_Mul_Long), F(A_Comp_Mul_Long), F(A_Comp_Mul_Long), F(A_Comp_Mul_Long), NULL, NULL, NULL, NULL, NULL,
+    F(A_Comp_MUL_MLA), F(A_Comp_MUL_MLA), F(A_Comp_Mul_Long), F(A_Comp_Mul_Long), F(A_Comp_Mul_Long), F(A_Comp_Mul_Long),
+    F(A_Comp_Mul_Short), F(A_Comp_Mul_Short), F(A_Comp_Mul_Short), F(A_Comp_Mul_Short), F(A_Comp_Mul_Short),
     // ARMv5 stuff
-    F(A_Comp_CLZ), NULL, NULL, NULL, NULL,
+    F(A_Comp_CLZ), F(A_Comp_SatAddSub), F(A_Comp_SatAddSub), F(A_Comp_SatAddSub), F(A_Comp_SatAddSub),
     // STR
     F(A_Comp_MemWB), F(A_Comp_MemWB), F(A_Comp_MemWB), F(A_Comp_MemWB), F(A_Comp_MemWB), F(A_Comp_MemWB), F(A_Comp_MemWB), F(A_Comp_MemWB), F(A_Comp_MemWB), F(A_Comp_MemWB),
     // STRB
@@ -585,7 +733,7 @@ const Compiler::CompileFunc A_Comp[ARMInstrInfo::ak_Count] =
     // Branch
     F(A_Comp_BranchImm), F(A_Comp_BranchImm), F(A_Comp_BranchImm), F(A_Comp_BranchXchangeReg), F(A_Comp_BranchXchangeReg),
     // system stuff
-    NULL, F(A_Comp_MSR), F(A_Comp_MSR), F(A_Comp_MRS), NULL, NULL, NULL,
+    NULL, F(A_Comp_MSR), F(A_Comp_MSR), F(A_Comp_MRS), F(A_Comp_MCR), F(A_Comp_MRC), F(A_Comp_SVC),
     F(Nop)
 };
 
@@ -624,7 +772,7 @@ const Compiler::CompileFunc T_Comp[ARMInstrInfo::tk_Count] = {
     // Branch
     F(T_Comp_BCOND), F(T_Comp_BranchXchangeReg), F(T_Comp_BranchXchangeReg), F(T_Comp_B), F(T_Comp_BL_LONG_1), F(T_Comp_BL_LONG_2),
     // Unk, SVC
-    NULL, NULL,
+    NULL, F(T_Comp_SVC),
     F(T_Comp_BL_Merged)
 };
 #undef F
@@ -693,11 +841,13 @@ JitBlockEntry Compiler::CompileBlock(ARM* cpu, bool thumb, FetchedInstr instrs[]
     if (NearSize - (GetCodePtr() - NearStart) < 1024 * 32) // guess...
     {
         Log(LogLevel::Debug, "near reset\n");
+        NDS.JIT.Stats.CodeMemoryFull++;
         NDS.JIT.ResetBlockCache();
     }
     if (FarSize - (FarCode - FarStart) < 1024 * 32) // guess...
     {
         Log(LogLevel::Debug, "far reset\n");
+        NDS.JIT.Stats.CodeMemoryFull++;
         NDS.JIT.ResetBlockCache();
     }
 
@@ -709,6 +859,9 @@ JitBlockEntry Compiler::CompileBlock(ARM* cpu, bool thumb, FetchedInstr instrs[]
     // CPSR might have been modified in a previous block
     CPSRDirty = false;
 
+    const u8* blockStart = GetCodePtr();
+    const u8* farBlockStart = FarCode;
+
     JitBlockEntry res = (JitBlockEntry)GetWritableCodePtr();
 
     RegCache = RegisterCache<Compiler, X64Reg>(this, instrs, instrsCount);
@@ -829,6 +982,9 @@ JitBlockEntry Compiler::CompileBlock(ARM* cpu, bool thumb, FetchedInstr instrs[]
 #ifdef JIT_PROFILING_ENABLED
     CreateMethod("JIT_Block_%d_%d_%08X", (void*)res, Num, Thumb, instrs[0].Addr);
 #endif
+    ARMJIT_PerfMap::AddBlock(NDS.JIT.GetPerfMap(), blockStart, GetCodePtr() - blockStart, Num, instrs[0].Addr, Thumb);
+    if (FarCode != farBlockStart)
+        ARMJIT_PerfMap::AddBlock(NDS.JIT.GetPerfMap(), farBlockStart, FarCode - farBlockStart, Num, instrs[0].Addr, Thumb, true);
 
     /*FILE* codeout = fopen("codeout", "a");
     fprintf(codeout, "beginning block argargarg__ %x!!!", instrs[0].Addr);
@@ -124,8 +124,10 @@ public:
 
     void A_Comp_MUL_MLA();
     void A_Comp_Mul_Long();
+    void A_Comp_Mul_Short();
 
     void A_Comp_CLZ();
+    void A_Comp_SatAddSub();
 
     void A_Comp_MemWB();
     void A_Comp_MemHalf();
@@ -136,6 +138,9 @@ public:
 
     void A_Comp_MRS();
     void A_Comp_MSR();
+    void A_Comp_MCR();
+    void A_Comp_MRC();
+    void A_Comp_SVC();
 
     void T_Comp_ShiftImm();
     void T_Comp_AddSub_();
@@ -162,6 +167,7 @@ public:
     void T_Comp_BL_LONG_1();
     void T_Comp_BL_LONG_2();
     void T_Comp_BL_Merged();
+    void T_Comp_SVC();
 
     enum
     {
@@ -182,10 +188,12 @@ public:
     void Comp_CmpOp(int op, Gen::OpArg rn, Gen::OpArg op2, bool carryUsed);
 
     void Comp_MulOp(bool S, bool add, Gen::OpArg rd, Gen::OpArg rm, Gen::OpArg rs, Gen::OpArg rn);
+    void Comp_SaturateOverflow(Gen::X64Reg reg);
 
     void Comp_RetriveFlags(bool sign, bool retriveCV, bool carryUsed);
 
     void Comp_SpecialBranchBehaviour(bool taken);
+    void Comp_CoprocessorAccessCheck();
 
 
     Gen::OpArg Comp_RegShiftImm(int op, int amount, Gen::OpArg rm, bool S, bool& carryUsed);
@@ -199,7 +199,9 @@ const u32 A_MSR_REG = A_Read0 | ak(ak_MSR_REG);
 const u32 A_MRS = A_Write12 | ak(ak_MRS);
 const u32 A_MCR = A_Read12 | ak(ak_MCR);
 const u32 A_MRC = A_Write12 | ak(ak_MRC);
-const u32 A_SVC = A_BranchAlways | A_Link | ak(ak_SVC);
+// the link register written by SVC is the one banked for supervisor mode,
+// the register of the current mode is left untouched
+const u32 A_SVC = A_BranchAlways | ak(ak_SVC);
 
 // THUMB
 
@@ -309,7 +311,7 @@ const u32 T_BL_LONG_1 = T_WriteR14 | tk(tk_BL_LONG_1);
 const u32 T_BL_LONG_2 = T_BranchAlways | T_ReadR14 | T_WriteR14 | tk(tk_BL_LONG_2);
 
 const u32 T_UNK = T_BranchAlways | T_WriteR14 | tk(tk_UNK);
-const u32 T_SVC = T_BranchAlways | T_WriteR14 | tk(tk_SVC);
+const u32 T_SVC = T_BranchAlways | tk(tk_SVC);
 
 #define INSTRFUNC_PROTO(x) u32 x
 #include "ARM_InstrTable.h"
@@ -458,6 +460,15 @@ Info Decode(bool thumb, u32 num, u32 instr, bool literaloptimizations)
                 res.Kind = ak_UNK;
             }
         }
+        if (res.Kind == ak_MRC)
+        {
+            // there are no readable cp14 registers on the ARM7, the destination is left untouched
+            if (num == 1)
+                data &= ~A_Write12;
+            // from user mode an exception is raised instead, so the old value has to be kept
+            else
+                data |= A_Read12;
+        }
         if (res.Kind == ak_MRS && !(instr & (1 << 22)))
             res.ReadFlags |= flag_N | flag_Z | flag_C | flag_V;
         if ((res.Kind == ak_MSR_IMM || res.Kind == ak_MSR_REG) && instr & (1 << 19))
@@ -54,6 +54,16 @@ constexpr std::array<u8, N> BrokenBIOS = []() constexpr {
     return broken;
 }();
 
+/// Where the JIT describes the code it generates to profilers.
+enum class JITPerfMap
+{
+    None,
+    /// /tmp/perf-<pid>.map, picked up by perf report as is.
+    PerfMap,
+    /// /tmp/jit-<pid>.dump, for perf inject --jit.
+    JitDump,
+};
+
 /// Arguments that configure the JIT.
 /// Ignored in builds that don't have the JIT included.
 struct JITArgs
@@ -67,6 +77,11 @@ struct JITArgs
     /// Enabled by default, but frontends should disable this when debugging
     /// so the constants segfaults don't hinder debugging.
     bool FastMemory = true;
+
+    /// Write every compiled block to a file Linux perf can read,
+    /// named after the CPU, guest address and instruction set.
+    /// Only available on Linux.
+    JITPerfMap PerfMap = JITPerfMap::None;
 };
 
 using ARM9BIOSImage = std::array<u8, ARM9BIOSSize>;
@@ -0,0 +1,209 @@
+/*
+    Copyright 2016-2026 melonDS team
+
+    This file is part of melonDS.
+
+    melonDS is free software: you can redistribute it and/or modify it under
+    the terms of the GNU General Public License as published by the Free
+    Software Foundation, either version 3 of the License, or (at your option)
+    any later version.
+
+    melonDS is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+    FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with melonDS. If not, see http://www.gnu.org/licenses/.
+*/
+
+#include <algorithm>
+#include <thread>
+
+#include "BatchRunner.h"
+#include "NDS.h"
+
+namespace melonDS
+{
+
+BatchRunner::BatchRunner(u32 numthreads)
+{
+    if (numthreads == 0)
+        numthreads = std::max(1u, std::thread::hardware_concurrency());
+
+    NumThreads = numthreads;
+
+    Queues.resize(NumThreads);
+    for (WorkQueue& queue : Queues)
+        queue.Lock = Platform::Mutex_Create();
+
+    Sema_StepDone = Platform::Semaphore_Create();
+
+    // worker 0 is the thread calling Step()
+    for (u32 i = 1; i < NumThreads; i++)
+    {
+        Sema_WorkerStart.push_back(Platform::Semaphore_Create());
+        Workers.push_back(Platform::Thread_Create([this, i]() { WorkerFunc(i); }));
+    }
+}
+
+BatchRunner::~BatchRunner()
+{
+    Quit = true;
+    for (Platform::Semaphore* sema : Sema_WorkerStart)
+        Platform::Semaphore_Post(sema);
+
+    for (Platform::Thread* thread : Workers)
+    {
+        Platform::Thread_Wait(thread);
+        Platform::Thread_Free(thread);
+    }
+
+    for (Platform::Semaphore* sema : Sema_WorkerStart)
+        Platform::Semaphore_Free(sema);
+    Platform::Semaphore_Free(Sema_StepDone);
+
+    for (WorkQueue& queue : Queues)
+        Platform::Mutex_Free(queue.Lock);
+}
+
+u32 BatchRunner::AddConsole(std::unique_ptr<NDS>&& nds)
+{
+    ConsoleEntry entry;
+    entry.Console = std::move(nds);
+    Consoles.push_back(std::move(entry));
+    return Consoles.size() - 1;
+}
+
+std::unique_ptr<NDS> BatchRunner::RemoveConsole(u32 idx)
+{
+    std::unique_ptr<NDS> ret = std::move(Consoles[idx].Console);
+    Consoles.erase(Consoles.begin() + idx);
+    return ret;
+}
+
+void BatchRunner::SetKeyMask(u32 idx, u32 mask)
+{
+    ConsoleEntry& entry = Consoles[idx];
+    entry.KeyMask = mask;
+    entry.InputChanged = true;
+}
+
+void BatchRunner::TouchScreen(u32 idx, u16 x, u16 y)
+{
+    ConsoleEntry& entry = Consoles[idx];
+    entry.Touching = true;
+    entry.TouchX = x;
+    entry.TouchY = y;
+    entry.InputChanged = true;
+}
+
+void BatchRunner::ReleaseScreen(u32 idx)
+{
+    ConsoleEntry& entry = Consoles[idx];
+    entry.Touching = false;
+    entry.InputChanged = true;
+}
+
+void BatchRunner::Step()
+{
+    if (Consoles.empty()) return;
+
+    for (u32 i = 0; i < Consoles.size(); i++)
+    {
+        if (!Consoles[i].Console->IsRunning())
+            continue;
+
+        // nothing runs yet, no need to lock
+        Queues[i % NumThreads].Items.push_back(i);
+    }
+
+    u32 numworkers = std::min<u32>(NumThreads, Consoles.size());
+
+    BusyWorkers = numworkers - 1;
+    for (u32 i = 1; i < numworkers; i++)
+        Platform::Semaphore_Post(Sema_WorkerStart[i-1]);
+
+    RunWork(0);
+
+    if (numworkers > 1)
+        Platform::Semaphore_Wait(Sema_StepDone);
+}
+
+void BatchRunner::WorkerFunc(u32 worker)
+{
+    for (;;)
+    {
+        Platform::Semaphore_Wait(Sema_WorkerStart[worker-1]);
+        if (Quit) break;
+
+        RunWork(worker);
+
+        if (--BusyWorkers == 0)
+            Platform::Semaphore_Post(Sema_StepDone);
+    }
+}
+
+void BatchRunner::RunWork(u32 worker)
+{
+    u32 idx;
+    while (PopWork(worker, idx))
+        RunConsole(idx);
+}
+
+bool BatchRunner::PopWork(u32 worker, u32& idx)
+{
+    // own queue first, from the front
+    {
+        WorkQueue& queue = Queues[worker];
+        Platform::Mutex_Lock(queue.Lock);
+        bool found = !queue.Items.empty();
+        if (found)
+        {
+            idx = queue.Items.front();
+            queue.Items.pop_front();
+        }
+        Platform::Mutex_Unlock(queue.Lock);
+
+        if (found) return true;
+    }
+
+    // then steal from the back of the others
+    for (u32 i = 1; i < NumThreads; i++)
+    {
+        WorkQueue& queue = Queues[(worker + i) % NumThreads];
+        Platform::Mutex_Lock(queue.Lock);
+        bool found = !queue.Items.empty();
+        if (found)
+        {
+            idx = queue.Items.back();
+            queue.Items.pop_back();
+        }
+        Platform::Mutex_Unlock(queue.Lock);
+
+        if (found) return true;
+    }
+
+    return false;
+}
+
+void BatchRunner::RunConsole(u32 idx)
+{
+    ConsoleEntry& entry = Consoles[idx];
+    NDS& nds = *entry.Console;
+
+    if (entry.InputChanged)
+    {
+        nds.SetKeyMask(entry.KeyMask);
+
+        if (entry.Touching)
+            nds.TouchScreen(entry.TouchX, entry.TouchY);
+        else
+            nds.ReleaseScreen();
+
+        entry.InputChanged = false;
+    }
+
+    entry.LastScanlines = nds.RunFrame();
+}
+
+}
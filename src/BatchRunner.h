@@ -0,0 +1,112 @@
+/*
+    Copyright 2016-2026 melonDS team
+
+    This file is part of melonDS.
+
+    melonDS is free software: you can redistribute it and/or modify it under
+    the terms of the GNU General Public License as published by the Free
+    Software Foundation, either version 3 of the License, or (at your option)
+    any later version.
+
+    melonDS is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+    FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with melonDS. If not, see http://www.gnu.org/licenses/.
+*/
+
+#ifndef BATCHRUNNER_H
+#define BATCHRUNNER_H
+
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <vector>
+
+#include "types.h"
+#include "Platform.h"
+
+namespace melonDS
+{
+class NDS;
+
+/// Owns a set of independent consoles and runs one frame on each of them per step,
+/// spread over a pool of worker threads.
+///
+/// Each step hands out the consoles to the workers round-robin. A worker that runs
+/// out of consoles takes pending ones from the back of another worker's queue, so
+/// consoles with heavier frames don't leave the other workers idle.
+///
+/// Consoles are only touched by the workers during Step(). In between steps they can
+/// be accessed freely from the calling thread, ie. to read back framebuffers through
+/// GPU::GetFramebuffers or to save states.
+class BatchRunner
+{
+public:
+    /// @param numthreads Number of worker threads, including the thread calling Step().
+    /// Defaults to one per host core.
+    explicit BatchRunner(u32 numthreads = 0);
+    ~BatchRunner();
+    BatchRunner(const BatchRunner&) = delete;
+    BatchRunner& operator=(const BatchRunner&) = delete;
+
+    /// Takes ownership of a console, which should be set up and started already.
+    /// @return The index of the console.
+    u32 AddConsole(std::unique_ptr<NDS>&& nds);
+    std::unique_ptr<NDS> RemoveConsole(u32 idx);
+
+    [[nodiscard]] u32 GetNumConsoles() const noexcept { return Consoles.size(); }
+    [[nodiscard]] u32 GetNumThreads() const noexcept { return NumThreads; }
+    [[nodiscard]] NDS& GetConsole(u32 idx) noexcept { return *Consoles[idx].Console; }
+
+    /// Input is latched and applied right before the console's next frame.
+    void SetKeyMask(u32 idx, u32 mask);
+    void TouchScreen(u32 idx, u16 x, u16 y);
+    void ReleaseScreen(u32 idx);
+
+    /// Runs one frame on every console that is running, and waits for all of them.
+    void Step();
+
+    /// @return The number of scanlines the console's last frame ran for.
+    [[nodiscard]] u32 GetLastFrameScanlines(u32 idx) const noexcept { return Consoles[idx].LastScanlines; }
+
+private:
+    struct ConsoleEntry
+    {
+        std::unique_ptr<NDS> Console;
+
+        u32 KeyMask = 0xFFF;
+        bool Touching = false;
+        u16 TouchX = 0, TouchY = 0;
+        bool InputChanged = false;
+
+        u32 LastScanlines = 0;
+    };
+
+    struct WorkQueue
+    {
+        Platform::Mutex* Lock;
+        std::deque<u32> Items;
+    };
+
+    void WorkerFunc(u32 worker);
+    void RunWork(u32 worker);
+    bool PopWork(u32 worker, u32& idx);
+    void RunConsole(u32 idx);
+
+    u32 NumThreads;
+    std::vector<ConsoleEntry> Consoles;
+
+    std::vector<WorkQueue> Queues;
+    std::vector<Platform::Thread*> Workers;
+    std::vector<Platform::Semaphore*> Sema_WorkerStart;
+    Platform::Semaphore* Sema_StepDone;
+
+    std::atomic<u32> BusyWorkers = 0;
+    bool Quit = false;
+};
+
+}
+
+#endif // BATCHRUNNER_H
@@ -677,27 +677,25 @@ void ARMv5::CP15Write(u32 id, u32 val)
         Log(LogLevel::Debug, "unknown CP15 write op %03X %08X\n", id, val);
 }
 
+bool ARMv5::CP15WriteIgnored(u32 id)
+{
+    // cache and write buffer maintenance only matters for the instruction cache
+    if ((id & 0xF00) == 0x700)
+        return id != 0x704 && id != 0x782 && (id < 0x750 || id > 0x752);
+
+    return (id & 0xF00) == 0xF00;
+}
+
 u32 ARMv5::CP15Read(u32 id) const
 {
     //printf("CP15 read op %03X %08X\n", id, NDS::ARM9->R[15]);
 
+    u32 val;
+    if (CP15ReadConstant(id, val))
+        return val;
+
     switch (id)
     {
-    case 0x000: // CPU ID
-    case 0x003:
-    case 0x004:
-    case 0x005:
-    case 0x006:
-    case 0x007:
-        return 0x41059461;
-
-    case 0x001: // cache type
-        return 0x0F0D2112;
-
-    case 0x002: // TCM size
-        return (6 << 6) | (5 << 18);
-
-
     case 0x100: // control reg
         return CP15Control;
 
@@ -770,13 +768,65 @@ u32 ARMv5::CP15Read(u32 id) const
         return TraceProcessID;
     }
 
-    if ((id & 0xF00) == 0xF00) // test/debug shit?
-        return 0;
-
     Log(LogLevel::Debug, "unknown CP15 read op %03X\n", id);
     return 0;
 }
 
+bool ARMv5::CP15ReadConstant(u32 id, u32& val)
+{
+    switch (id)
+    {
+    case 0x000: // CPU ID
+    case 0x003:
+    case 0x004:
+    case 0x005:
+    case 0x006:
+    case 0x007:
+        val = 0x41059461;
+        return true;
+
+    case 0x001: // cache type
+        val = 0x0F0D2112;
+        return true;
+
+    case 0x002: // TCM size
+        val = (6 << 6) | (5 << 18);
+        return true;
+    }
+
+    if ((id & 0xF00) == 0xF00) // test/debug shit?
+    {
+        val = 0;
+        return true;
+    }
+
+    return false;
+}
+
+bool ARMv5::CP15ReadMemberOffset(u32 id, u32& offset)
+{
+    switch (id)
+    {
+    case 0x100: offset = offsetof(ARMv5, CP15Control); return true;
+    case 0x200: offset = offsetof(ARMv5, PU_DataCacheable); return true;
+    case 0x201: offset = offsetof(ARMv5, PU_CodeCacheable); return true;
+    case 0x300: offset = offsetof(ARMv5, PU_DataCacheWrite); return true;
+    case 0x502: offset = offsetof(ARMv5, PU_DataRW); return true;
+    case 0x503: offset = offsetof(ARMv5, PU_CodeRW); return true;
+    case 0x910: offset = offsetof(ARMv5, DTCMSetting); return true;
+    case 0x911: offset = offsetof(ARMv5, ITCMSetting); return true;
+    case 0xD01: offset = offsetof(ARMv5, TraceProcessID); return true;
+    }
+
+    if ((id & 0xF0E) == 0x600 && ((id >> 4) & 0xF) < 8)
+    {
+        offset = offsetof(ARMv5, PU_Region) + ((id >> 4) & 0xF) * sizeof(u32);
+        return true;
+    }
+
+    return false;
+}
+
 
 // TCM are handled here.
 // TODO: later on, handle PU, and maybe caches
@@ -0,0 +1,250 @@
+/*
+    Copyright 2016-2026 melonDS team
+
+    This file is part of melonDS.
+
+    melonDS is free software: you can redistribute it and/or modify it under
+    the terms of the GNU General Public License as published by the Free
+    Software Foundation, either version 3 of the License, or (at your option)
+    any later version.
+
+    melonDS is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+    FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with melonDS. If not, see http://www.gnu.org/licenses/.
+*/
+
+#include <algorithm>
+#include <string.h>
+
+#include "CompressedROM.h"
+#include "LZ.h"
+
+namespace melonDS
+{
+using namespace Platform;
+
+constexpr u32 CompressedROMMagic = 0x52434E4D; // MNCR
+constexpr u32 CompressedROMVersion = 1;
+constexpr u32 CodecLZ = 1;
+
+struct CompressedROMHeader
+{
+    u32 Magic;
+    u32 Version;
+    u32 ROMLength;
+    u32 BlockSize;
+    u32 NumBlocks;
+    u32 Codec;
+    u64 Reserved;
+};
+static_assert(sizeof(CompressedROMHeader) == 32, "CompressedROMHeader is not 32 bytes!");
+
+std::unique_ptr<CompressedROM> CompressedROM::Open(const std::string& path)
+{
+    FileHandle* file = OpenFile(path, FileMode::Read);
+    if (!file) return nullptr;
+
+    CompressedROMHeader header;
+    if (FileRead(&header, sizeof(header), 1, file) != 1 ||
+        header.Magic != CompressedROMMagic)
+    {
+        CloseFile(file);
+        return nullptr;
+    }
+
+    if (header.Version != CompressedROMVersion || header.Codec != CodecLZ)
+    {
+        Log(LogLevel::Error, "CompressedROM: unsupported version %d or codec %d\n", header.Version, header.Codec);
+        CloseFile(file);
+        return nullptr;
+    }
+
+    if (header.BlockSize < 0x1000 || header.BlockSize > 0x100000 ||
+        (header.BlockSize & (header.BlockSize - 1)) ||
+        header.ROMLength == 0 || header.ROMLength > 0x40000000 ||
+        header.NumBlocks != ((header.ROMLength + header.BlockSize - 1) / header.BlockSize))
+    {
+        Log(LogLevel::Error, "CompressedROM: bad header\n");
+        CloseFile(file);
+        return nullptr;
+    }
+
+    std::unique_ptr<CompressedROM> rom(new CompressedROM());
+    rom->File = file;
+    rom->CacheLock = Mutex_Create();
+    rom->ROMLength = header.ROMLength;
+    rom->BlockSize = header.BlockSize;
+    rom->NumBlocks = header.NumBlocks;
+    while ((1u << rom->BlockShift) < header.BlockSize)
+        rom->BlockShift++;
+
+    rom->BlockOffsets.resize(header.NumBlocks + 1);
+    if (FileRead(rom->BlockOffsets.data(), sizeof(u64), header.NumBlocks + 1, file) != header.NumBlocks + 1)
+    {
+        Log(LogLevel::Error, "CompressedROM: truncated block index\n");
+        return nullptr;
+    }
+
+    u64 filelen = FileLength(file);
+    u64 datastart = sizeof(header) + (header.NumBlocks + 1) * sizeof(u64);
+    for (u32 i = 0; i < header.NumBlocks; i++)
+    {
+        u64 start = rom->BlockOffsets[i];
+        u64 end = rom->BlockOffsets[i+1];
+        if (start < datastart || end < start || end > filelen ||
+            (end - start) > LZ::CompressBound(header.BlockSize))
+        {
+            Log(LogLevel::Error, "CompressedROM: bad block index\n");
+            return nullptr;
+        }
+    }
+
+    rom->CompBuffer = std::make_unique<u8[]>(LZ::CompressBound(header.BlockSize));
+
+    Log(LogLevel::Info, "CompressedROM: opened %s, %u bytes in %u blocks\n", path.c_str(), header.ROMLength, header.NumBlocks);
+    return rom;
+}
+
+CompressedROM::~CompressedROM()
+{
+    if (File) CloseFile(File);
+    if (CacheLock) Mutex_Free(CacheLock);
+}
+
+bool CompressedROM::LoadBlock(u32 block, u8* out)
+{
+    u32 len = std::min(BlockSize, ROMLength - (block << BlockShift));
+    // the last block may be short, and the buffer may still hold another block
+    if (len < BlockSize)
+        memset(out + len, 0, BlockSize - len);
+
+    u64 start = BlockOffsets[block];
+    u32 complen = (u32)(BlockOffsets[block+1] - start);
+
+    if (!FileSeek(File, (s64)start, FileSeekOrigin::Start))
+        return false;
+
+    if (complen == len)
+        return FileRead(out, len, 1, File) == 1;
+
+    if (FileRead(CompBuffer.get(), complen, 1, File) != 1)
+        return false;
+
+    return LZ::Decompress(CompBuffer.get(), complen, out, len) == (s32)len;
+}
+
+const u8* CompressedROM::GetBlock(u32 block)
+{
+    CacheEntry* entry = &Cache[LastEntry];
+    if (entry->Block == block)
+        return entry->Data.get();
+
+    u32 oldest = 0;
+    for (u32 i = 0; i < NumCacheBlocks; i++)
+    {
+        if (Cache[i].Block == block)
+        {
+            Cache[i].LastUse = ++UseCounter;
+            LastEntry = i;
+            return Cache[i].Data.get();
+        }
+
+        if (Cache[i].LastUse < Cache[oldest].LastUse)
+            oldest = i;
+    }
+
+    entry = &Cache[oldest];
+    if (!entry->Data)
+        entry->Data = std::make_unique<u8[]>(BlockSize);
+
+    if (!LoadBlock(block, entry->Data.get()))
+    {
+        Log(LogLevel::Error, "CompressedROM: failed to read block %u\n", block);
+        memset(entry->Data.get(), 0, BlockSize);
+    }
+
+    entry->Block = block;
+    entry->LastUse = ++UseCounter;
+    LastEntry = oldest;
+    return entry->Data.get();
+}
+
+void CompressedROM::Read(u32 addr, u32 len, u8* data)
+{
+    // a block can be evicted as soon as the lock is released,
+    // so it's held until everything is copied out
+    Mutex_Lock(CacheLock);
+    while (len > 0)
+    {
+        u32 block = addr >> BlockShift;
+        u32 offset = addr & (BlockSize - 1);
+        u32 chunk = std::min(len, BlockSize - offset);
+
+        if (block < NumBlocks)
+            memcpy(data, GetBlock(block) + offset, chunk);
+        else
+            memset(data, 0, chunk);
+
+        addr += chunk;
+        data += chunk;
+        len -= chunk;
+    }
+    Mutex_Unlock(CacheLock);
+}
+
+bool CompressedROM::Write(const u8* rom, u32 len, FileHandle* file, u32 blocksize)
+{
+    if (blocksize < 0x1000 || blocksize > 0x100000 || (blocksize & (blocksize - 1)) || len == 0)
+        return false;
+
+    CompressedROMHeader header {};
+    header.Magic = CompressedROMMagic;
+    header.Version = CompressedROMVersion;
+    header.ROMLength = len;
+    header.BlockSize = blocksize;
+    header.NumBlocks = (len + blocksize - 1) / blocksize;
+    header.Codec = CodecLZ;
+
+    std::vector<u64> offsets(header.NumBlocks + 1);
+    u64 pos = sizeof(header) + offsets.size() * sizeof(u64);
+
+    // the index is written once all the block sizes are known
+    if (!FileSeek(file, (s64)pos, FileSeekOrigin::Start))
+        return false;
+
+    auto buffer = std::make_unique<u8[]>(LZ::CompressBound(blocksize));
+    for (u32 i = 0; i < header.NumBlocks; i++)
+    {
+        const u8* src = &rom[i * blocksize];
+        u32 srclen = std::min(blocksize, len - (i * blocksize));
+
+        u32 complen = LZ::Compress(src, srclen, buffer.get(), LZ::CompressBound(blocksize));
+        if (complen == 0 || complen >= srclen)
+        {
+            // not worth it, store the block as-is
+            complen = srclen;
+            memcpy(buffer.get(), src, srclen);
+        }
+
+        if (FileWrite(buffer.get(), complen, 1, file) != 1)
+            return false;
+
+        offsets[i] = pos;
+        pos += complen;
+    }
+    offsets[header.NumBlocks] = pos;
+
+    if (!FileSeek(file, 0, FileSeekOrigin::Start))
+        return false;
+    if (FileWrite(&header, sizeof(header), 1, file) != 1)
+        return false;
+    if (FileWrite(offsets.data(), sizeof(u64), offsets.size(), file) != offsets.size())
+        return false;
+
+    return true;
+}
+
+}
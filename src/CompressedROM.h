@@ -0,0 +1,102 @@
+/*
+    Copyright 2016-2026 melonDS team
+
+    This file is part of melonDS.
+
+    melonDS is free software: you can redistribute it and/or modify it under
+    the terms of the GNU General Public License as published by the Free
+    Software Foundation, either version 3 of the License, or (at your option)
+    any later version.
+
+    melonDS is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+    FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with melonDS. If not, see http://www.gnu.org/licenses/.
+*/
+
+#ifndef MELONDS_COMPRESSEDROM_H
+#define MELONDS_COMPRESSEDROM_H
+
+#include <array>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "types.h"
+#include "Platform.h"
+
+namespace melonDS
+{
+
+/// Random-access reader for block-compressed ROM files (.ncr).
+///
+/// The ROM is split into fixed-size blocks that are compressed independently
+/// (see LZ.h), followed by an index of where each block starts in the file.
+/// Only the blocks that are actually read get decompressed,
+/// and the most recently used ones are kept in a small cache.
+/// The cache and the file are behind a lock, as the frontend
+/// reads the ROM too while the emulator is running.
+///
+/// File layout, all values little-endian:
+/// - header: "MNCR", version, ROM length, block size, block count, codec, 8 reserved bytes
+/// - (block count + 1) 64-bit file offsets, the last one being the end of the data
+/// - the blocks; a block whose stored size equals its uncompressed size is stored as-is
+class CompressedROM
+{
+public:
+    static constexpr u32 DefaultBlockSize = 0x10000;
+    static constexpr u32 NumCacheBlocks = 16;
+
+    /// Opens a compressed ROM file.
+    /// @return The reader, or \c nullptr if the file isn't a valid compressed ROM.
+    static std::unique_ptr<CompressedROM> Open(const std::string& path);
+
+    /// Writes a ROM image to the given file in the compressed format.
+    /// @param blocksize Size of the blocks, must be a power of 2 between 4 KB and 1 MB.
+    static bool Write(const u8* rom, u32 len, Platform::FileHandle* file, u32 blocksize = DefaultBlockSize);
+
+    ~CompressedROM();
+    CompressedROM(const CompressedROM&) = delete;
+    CompressedROM& operator=(const CompressedROM&) = delete;
+
+    /// @return The uncompressed length of the ROM.
+    [[nodiscard]] u32 GetLength() const noexcept { return ROMLength; }
+
+    /// Copies uncompressed ROM data. Anything past the end of the ROM reads as zero,
+    /// and so do blocks that can't be read back from the file.
+    /// Safe to call from several threads.
+    void Read(u32 addr, u32 len, u8* data);
+
+private:
+    CompressedROM() = default;
+
+    const u8* GetBlock(u32 block);
+    bool LoadBlock(u32 block, u8* out);
+
+    Platform::FileHandle* File = nullptr;
+    // held while the cache is looked up or a block is loaded
+    Platform::Mutex* CacheLock = nullptr;
+
+    u32 ROMLength = 0;
+    u32 BlockSize = 0;
+    u32 BlockShift = 0;
+    u32 NumBlocks = 0;
+    std::vector<u64> BlockOffsets;
+    std::unique_ptr<u8[]> CompBuffer = nullptr;
+
+    struct CacheEntry
+    {
+        u32 Block = UINT32_MAX;
+        u32 LastUse = 0;
+        std::unique_ptr<u8[]> Data = nullptr;
+    };
+    std::array<CacheEntry, NumCacheBlocks> Cache;
+    u32 UseCounter = 0;
+    u32 LastEntry = 0;
+};
+
+}
+
+#endif // MELONDS_COMPRESSEDROM_H
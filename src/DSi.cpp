@@ -350,8 +350,8 @@ void DSi::DecryptModcryptArea(u32 offset, u32 size, const u8* iv)
         (header.AppFlags & (1<<7)))
     {
         // dev key
-        const u8* cartrom = NDSCartSlot.GetCart()->GetROM();
-        memcpy(key, &cartrom[0], 16);
+        const NDSCart::CartCommon& cart = *NDSCartSlot.GetCart();
+        cart.ReadROM(0, 16, key, 0);
     }
     else
     {
@@ -447,7 +447,7 @@ void DSi::SetupDirectBoot()
 {
     bool dsmode = false;
     NDSHeader& header = NDSCartSlot.GetCart()->GetHeader();
-    const u8* cartrom = NDSCartSlot.GetCart()->GetROM();
+    const NDSCart::CartCommon& cart = *NDSCartSlot.GetCart();
     u32 cartid = NDSCartSlot.GetCart()->ID();
     DSi_TSC* tsc = (DSi_TSC*)SPI.GetTSC();
 
@@ -494,7 +494,7 @@ void DSi::SetupDirectBoot()
         MBK[1][8] = 0;
 
         u32 mbk[12];
-        memcpy(mbk, &cartrom[0x180], 12*4);
+        cart.ReadROM(0x180, 12*4, (u8*)mbk, 0);
 
         MapNWRAM_A(0, mbk[0] & 0xFF);
         MapNWRAM_A(1, (mbk[0] >> 8) & 0xFF);
@@ -543,7 +543,7 @@ void DSi::SetupDirectBoot()
     {
         for (u32 i = 0; i < 0x170; i+=4)
         {
-            u32 tmp = *(u32*)&cartrom[i];
+            u32 tmp = cart.ReadROM32(i);
             ARM9Write32(0x027FFE00+i, tmp);
         }
 
@@ -570,14 +570,14 @@ void DSi::SetupDirectBoot()
 
         for (u32 i = 0; i < 0x160; i+=4)
         {
-            u32 tmp = *(u32*)&cartrom[i];
+            u32 tmp = cart.ReadROM32(i);
             ARM9Write32(0x02FFFA80+i, tmp);
             ARM9Write32(0x02FFFE00+i, tmp);
         }
 
         for (u32 i = 0; i < 0x1000; i+=4)
         {
-            u32 tmp = *(u32*)&cartrom[i];
+            u32 tmp = cart.ReadROM32(i);
             ARM9Write32(0x02FFC000+i, tmp);
             ARM9Write32(0x02FFE000+i, tmp);
         }
@@ -651,13 +651,13 @@ void DSi::SetupDirectBoot()
 
     for (u32 i = arm9start; i < header.ARM9Size; i+=4)
     {
-        u32 tmp = *(u32*)&cartrom[header.ARM9ROMOffset+i];
+        u32 tmp = cart.ReadROM32(header.ARM9ROMOffset+i);
         ARM9Write32(header.ARM9RAMAddress+i, tmp);
     }
 
     for (u32 i = 0; i < header.ARM7Size; i+=4)
     {
-        u32 tmp = *(u32*)&cartrom[header.ARM7ROMOffset+i];
+        u32 tmp = cart.ReadROM32(header.ARM7ROMOffset+i);
         ARM7Write32(header.ARM7RAMAddress+i, tmp);
     }
 
@@ -667,13 +667,13 @@ void DSi::SetupDirectBoot()
 
         for (u32 i = 0; i < header.DSiARM9iSize; i+=4)
         {
-            u32 tmp = *(u32*)&cartrom[header.DSiARM9iROMOffset+i];
+            u32 tmp = cart.ReadROM32(header.DSiARM9iROMOffset+i);
             ARM9Write32(header.DSiARM9iRAMAddress+i, tmp);
         }
 
         for (u32 i = 0; i < header.DSiARM7iSize; i+=4)
         {
-            u32 tmp = *(u32*)&cartrom[header.DSiARM7iROMOffset+i];
+            u32 tmp = cart.ReadROM32(header.DSiARM7iROMOffset+i);
             ARM7Write32(header.DSiARM7iRAMAddress+i, tmp);
         }
 
@@ -1635,6 +1635,7 @@ void DSi::ARM9Write8(u32 addr, u8 val)
     case 0x0C000000:
         JIT.CheckAndInvalidate<0, ARMJIT_Memory::memregion_MainRAM>(addr);
         *(u8*)&MainRAM[addr & MainRAMMask] = val;
+        DirtyPages.Mark(DirtyRegion_MainRAM, addr & MainRAMMask);
         return;
     }
 
@@ -1720,6 +1721,7 @@ void DSi::ARM9Write16(u32 addr, u16 val)
     case 0x0C000000:
         JIT.CheckAndInvalidate<0, ARMJIT_Memory::memregion_MainRAM>(addr);
         *(u16*)&MainRAM[addr & MainRAMMask] = val;
+        DirtyPages.Mark(DirtyRegion_MainRAM, addr & MainRAMMask);
         return;
     }
 
@@ -1805,6 +1807,7 @@ void DSi::ARM9Write32(u32 addr, u32 val)
     case 0x0C000000:
         JIT.CheckAndInvalidate<0, ARMJIT_Memory::memregion_MainRAM>(addr);
         *(u32*)&MainRAM[addr & MainRAMMask] = val;
+        DirtyPages.Mark(DirtyRegion_MainRAM, addr & MainRAMMask);
         return;
     }
 
@@ -2108,6 +2111,7 @@ void DSi::ARM7Write8(u32 addr, u8 val)
     case 0x0C800000:
         JIT.CheckAndInvalidate<1, ARMJIT_Memory::memregion_MainRAM>(addr);
         *(u8*)&NDS::MainRAM[addr & NDS::MainRAMMask] = val;
+        DirtyPages.Mark(DirtyRegion_MainRAM, addr & MainRAMMask);
         return;
     }
 
@@ -2198,6 +2202,7 @@ void DSi::ARM7Write16(u32 addr, u16 val)
     case 0x0C800000:
         JIT.CheckAndInvalidate<1, ARMJIT_Memory::memregion_MainRAM>(addr);
         *(u16*)&NDS::MainRAM[addr & NDS::MainRAMMask] = val;
+        DirtyPages.Mark(DirtyRegion_MainRAM, addr & MainRAMMask);
         return;
     }
 
@@ -2288,6 +2293,7 @@ void DSi::ARM7Write32(u32 addr, u32 val)
     case 0x0C800000:
         JIT.CheckAndInvalidate<1, ARMJIT_Memory::memregion_MainRAM>(addr);
         *(u32*)&NDS::MainRAM[addr & NDS::MainRAMMask] = val;
+        DirtyPages.Mark(DirtyRegion_MainRAM, addr & MainRAMMask);
         return;
     }
 
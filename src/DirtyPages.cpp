@@ -0,0 +1,64 @@
+/*
+    Copyright 2016-2026 melonDS team
+
+    This file is part of melonDS.
+
+    melonDS is free software: you can redistribute it and/or modify it under
+    the terms of the GNU General Public License as published by the Free
+    Software Foundation, either version 3 of the License, or (at your option)
+    any later version.
+
+    melonDS is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+    FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with melonDS. If not, see http://www.gnu.org/licenses/.
+*/
+
+#include <atomic>
+#include "DirtyPages.h"
+
+namespace melonDS
+{
+
+static std::atomic<u32> NextTrackerID = 1;
+
+DirtyPageTracker::DirtyPageTracker() noexcept :
+    Generation(1),
+    ID(NextTrackerID++)
+{
+    MarkAll();
+}
+
+void DirtyPageTracker::MarkRange(u32 region, u32 offset, u32 len) noexcept
+{
+    if (!len) return;
+
+    u32 first = RegionStart[region] + (offset >> PageShift);
+    u32 last = RegionStart[region] + ((offset + len - 1) >> PageShift);
+    for (u32 i = first; i <= last; i++)
+        PageGen[i] = Generation;
+}
+
+void DirtyPageTracker::MarkAll() noexcept
+{
+    for (u32 i = 0; i < NumPages; i++)
+        PageGen[i] = Generation;
+}
+
+bool DirtyPageTracker::Changed(u32 region, u32 offset, u32 len, u32 since) const noexcept
+{
+    if (!len) return false;
+
+    u32 first = RegionStart[region] + (offset >> PageShift);
+    u32 last = RegionStart[region] + ((offset + len - 1) >> PageShift);
+    for (u32 i = first; i <= last; i++)
+    {
+        if (PageGen[i] > since)
+            return true;
+    }
+    return false;
+}
+
+}
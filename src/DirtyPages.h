@@ -0,0 +1,129 @@
+/*
+    Copyright 2016-2026 melonDS team
+
+    This file is part of melonDS.
+
+    melonDS is free software: you can redistribute it and/or modify it under
+    the terms of the GNU General Public License as published by the Free
+    Software Foundation, either version 3 of the License, or (at your option)
+    any later version.
+
+    melonDS is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+    FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with melonDS. If not, see http://www.gnu.org/licenses/.
+*/
+
+#ifndef DIRTYPAGES_H
+#define DIRTYPAGES_H
+
+#include "types.h"
+#include "MemConstants.h"
+
+namespace melonDS
+{
+
+enum
+{
+    DirtyRegion_MainRAM = 0,
+    DirtyRegion_SharedWRAM,
+    DirtyRegion_ARM7WRAM,
+    DirtyRegion_VRAM, // all nine banks, each one at bank * 128K
+
+    DirtyRegion_MAX
+};
+
+/// Keeps track of which pages of guest memory were written since a given snapshot.
+///
+/// Every page remembers the generation it was last written in. Taking a snapshot
+/// ends the current generation, so a page changed since snapshot K if its
+/// generation is past K. Any number of snapshots can be compared against this way,
+/// unlike with a dirty bit that would have to be cleared by one of them.
+///
+/// Writes are marked by the memory handlers, which the JIT bypasses for the
+/// memory it accesses directly; the generations aren't reliable while it runs.
+class DirtyPageTracker
+{
+public:
+    static constexpr u32 PageShift = 12;
+    static constexpr u32 PageSize = 1 << PageShift;
+
+    DirtyPageTracker() noexcept;
+    DirtyPageTracker(const DirtyPageTracker&) = delete;
+    DirtyPageTracker& operator=(const DirtyPageTracker&) = delete;
+
+    void Mark(u32 region, u32 offset) noexcept
+    {
+        PageGen[RegionStart[region] + (offset >> PageShift)] = Generation;
+    }
+
+    void MarkRange(u32 region, u32 offset, u32 len) noexcept;
+
+    /// Marks everything as written, ie. after a reset or when loading a state.
+    void MarkAll() noexcept;
+
+    /// @return The generation writes are currently marked with.
+    /// A snapshot taken now has this number.
+    [[nodiscard]] u32 GetGeneration() const noexcept { return Generation; }
+
+    /// Ends the current generation, once a snapshot was taken.
+    void NextGeneration() noexcept { Generation++; }
+
+    /// @return A number telling trackers apart, so that snapshots of one console
+    /// aren't mistaken for snapshots of another.
+    [[nodiscard]] u32 GetID() const noexcept { return ID; }
+
+    /// @return Whether any page overlapping the given range was written after snapshot \c since.
+    [[nodiscard]] bool Changed(u32 region, u32 offset, u32 len, u32 since) const noexcept;
+
+    /// Calls \c func(offset, len) for each run of pages written after snapshot \c since,
+    /// within the \c len bytes at \c offset of the given region.
+    /// The offsets passed to \c func are relative to \c offset, which has to be page-aligned.
+    template <typename F>
+    void ForEachChanged(u32 region, u32 offset, u32 len, u32 since, F&& func) const
+    {
+        const u32* gen = &PageGen[RegionStart[region] + (offset >> PageShift)];
+        u32 numpages = (len + PageSize - 1) >> PageShift;
+
+        for (u32 i = 0; i < numpages;)
+        {
+            if (gen[i] <= since)
+            {
+                i++;
+                continue;
+            }
+
+            u32 start = i;
+            while (i < numpages && gen[i] > since)
+                i++;
+
+            u32 runstart = start << PageShift;
+            u32 runend = i << PageShift;
+            if (runend > len) runend = len;
+            func(runstart, runend - runstart);
+        }
+    }
+
+private:
+    static constexpr u32 VRAMBankSize = 128*1024;
+
+    static constexpr u32 RegionStart[DirtyRegion_MAX + 1] =
+    {
+        0,
+        (MainRAMMaxSize >> PageShift),
+        (MainRAMMaxSize >> PageShift) + (SharedWRAMSize >> PageShift),
+        (MainRAMMaxSize >> PageShift) + (SharedWRAMSize >> PageShift) + (ARM7WRAMSize >> PageShift),
+        (MainRAMMaxSize >> PageShift) + (SharedWRAMSize >> PageShift) + (ARM7WRAMSize >> PageShift) + ((9 * VRAMBankSize) >> PageShift),
+    };
+    static constexpr u32 NumPages = RegionStart[DirtyRegion_MAX];
+
+    u32 PageGen[NumPages];
+    u32 Generation;
+    u32 ID;
+};
+
+}
+
+#endif // DIRTYPAGES_H
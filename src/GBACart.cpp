@@ -100,7 +100,7 @@ CartGame::CartGame(const u8* rom, u32 len, const u8* sram, u32 sramlen, void* us
 {
 }
 
-CartGame::CartGame(std::unique_ptr<u8[]>&& rom, u32 len, std::unique_ptr<u8[]>&& sram, u32 sramlen, void* userdata, GBACart::CartType type) :
+CartGame::CartGame(SharedROMData&& rom, u32 len, std::unique_ptr<u8[]>&& sram, u32 sramlen, void* userdata, GBACart::CartType type) :
     CartCommon(type),
     ROM(std::move(rom)),
     ROMLength(len),
@@ -532,7 +532,7 @@ CartGameSolarSensor::CartGameSolarSensor(const u8* rom, u32 len, const u8* sram,
 {
 }
 
-CartGameSolarSensor::CartGameSolarSensor(std::unique_ptr<u8[]>&& rom, u32 len, std::unique_ptr<u8[]>&& sram, u32 sramlen, void* userdata) :
+CartGameSolarSensor::CartGameSolarSensor(SharedROMData&& rom, u32 len, std::unique_ptr<u8[]>&& sram, u32 sramlen, void* userdata) :
     CartGame(std::move(rom), len, std::move(sram), sramlen, userdata, CartType::GameSolarSensor)
 {
 }
@@ -868,7 +868,8 @@ std::unique_ptr<CartCommon> ParseROM(std::unique_ptr<u8[]>&& romdata, u32 romlen
         return nullptr;
     }
 
-    auto [cartrom, cartromsize] = PadToPowerOf2(std::move(romdata), romlen);
+    auto [paddedrom, cartromsize] = PadToPowerOf2(std::move(romdata), romlen);
+    SharedROMData cartrom = ShareROMData(std::move(paddedrom), cartromsize);
 
     char gamecode[5] = { '\0' };
     memcpy(&gamecode, cartrom.get() + 0xAC, 4);
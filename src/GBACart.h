@@ -22,6 +22,7 @@
 #include <memory>
 #include "types.h"
 #include "Savestate.h"
+#include "SharedROM.h"
 
 namespace melonDS::GBACart
 {
@@ -96,7 +97,7 @@ class CartGame : public CartCommon
 {
 public:
     CartGame(const u8* rom, u32 len, const u8* sram, u32 sramlen, void* userdata, GBACart::CartType type = GBACart::CartType::Game);
-    CartGame(std::unique_ptr<u8[]>&& rom, u32 len, std::unique_ptr<u8[]>&& sram, u32 sramlen, void* userdata, GBACart::CartType type = GBACart::CartType::Game);
+    CartGame(SharedROMData&& rom, u32 len, std::unique_ptr<u8[]>&& sram, u32 sramlen, void* userdata, GBACart::CartType type = GBACart::CartType::Game);
     ~CartGame() override;
 
     u32 Checksum() const override;
@@ -114,7 +115,8 @@ public:
     [[nodiscard]] const u8* GetROM() const override { return ROM.get(); }
     [[nodiscard]] u32 GetROMLength() const override { return ROMLength; }
     [[nodiscard]] const GBAHeader& GetHeader() const noexcept { return *reinterpret_cast<const GBAHeader*>(ROM.get()); }
-    [[nodiscard]] GBAHeader& GetHeader() noexcept { return *reinterpret_cast<GBAHeader*>(ROM.get()); }
+    /// Makes the ROM private to this cart if it was shared.
+    [[nodiscard]] GBAHeader& GetHeader() noexcept { return *reinterpret_cast<GBAHeader*>(MakeROMDataWritable(ROM, ROMLength)); }
 
     u8* GetSaveMemory() const override;
     u32 GetSaveMemoryLength() const override;
@@ -131,7 +133,7 @@ protected:
 
     void* UserData;
 
-    std::unique_ptr<u8[]> ROM;
+    SharedROMData ROM;
     u32 ROMLength;
 
     struct
@@ -175,7 +177,7 @@ class CartGameSolarSensor : public CartGame
 {
 public:
     CartGameSolarSensor(const u8* rom, u32 len, const u8* sram, u32 sramlen, void* userdata);
-    CartGameSolarSensor(std::unique_ptr<u8[]>&& rom, u32 len, std::unique_ptr<u8[]>&& sram, u32 sramlen, void* userdata);
+    CartGameSolarSensor(SharedROMData&& rom, u32 len, std::unique_ptr<u8[]>&& sram, u32 sramlen, void* userdata);
 
     void Reset() override;
 
@@ -73,6 +73,7 @@ enum
 
 GPU::GPU(melonDS::NDS& nds, std::unique_ptr<Renderer>&& renderer) noexcept :
     NDS(nds),
+    DirtyPages(nds.DirtyPages),
     GPU2D_A(0, *this),
     GPU2D_B(1, *this),
     GPU3D(*this)
@@ -242,15 +243,17 @@ void GPU::DoSavestate(Savestate* file) noexcept
     file->VarArray(Palette, 2*1024);
     file->VarArray(OAM, 2*1024);
 
-    file->VarArray(VRAM_A, 128*1024);
-    file->VarArray(VRAM_B, 128*1024);
-    file->VarArray(VRAM_C, 128*1024);
-    file->VarArray(VRAM_D, 128*1024);
-    file->VarArray(VRAM_E,  64*1024);
-    file->VarArray(VRAM_F,  16*1024);
-    file->VarArray(VRAM_G,  16*1024);
-    file->VarArray(VRAM_H,  32*1024);
-    file->VarArray(VRAM_I,  16*1024);
+    // code generated by the JIT writes memory without marking pages
+    DirtyPageTracker* tracker = NDS.IsJITEnabled() ? nullptr : &DirtyPages;
+    file->VarTracked(VRAM_A, 128*1024, tracker, DirtyRegion_VRAM, 0 << 17);
+    file->VarTracked(VRAM_B, 128*1024, tracker, DirtyRegion_VRAM, 1 << 17);
+    file->VarTracked(VRAM_C, 128*1024, tracker, DirtyRegion_VRAM, 2 << 17);
+    file->VarTracked(VRAM_D, 128*1024, tracker, DirtyRegion_VRAM, 3 << 17);
+    file->VarTracked(VRAM_E,  64*1024, tracker, DirtyRegion_VRAM, 4 << 17);
+    file->VarTracked(VRAM_F,  16*1024, tracker, DirtyRegion_VRAM, 5 << 17);
+    file->VarTracked(VRAM_G,  16*1024, tracker, DirtyRegion_VRAM, 6 << 17);
+    file->VarTracked(VRAM_H,  32*1024, tracker, DirtyRegion_VRAM, 7 << 17);
+    file->VarTracked(VRAM_I,  16*1024, tracker, DirtyRegion_VRAM, 8 << 17);
 
     file->VarArray(VRAMCNT, 9);
     file->Var8(&VRAMSTAT);
@@ -1153,20 +1156,36 @@ void GPU::StartHBlank(u32 line) noexcept
     {
         // draw
         // note: this should start 48 cycles after the scanline start
-        if (line < 192)
-            Rend->DrawScanline(line);
-        if (line < 191)
-            Rend->DrawSprites(line+1);
+        PROFILER_SCOPE(NDS.Profiler, Prof_Render2D);
+
+        // display capture writes to VRAM from the renderer
+        if (CaptureEnable)
+            DirtyPages.MarkRange(DirtyRegion_VRAM, ((CaptureCnt >> 16) & 0x3) << 17, 128*1024);
+
+        if (SkipDrawing && !CaptureEnable)
+        {
+            if (line < 192)
+                Rend->SkipScanline(line);
+        }
+        else
+        {
+            if (line < 192)
+                Rend->DrawScanline(line);
+            if (line < 191)
+                Rend->DrawSprites(line+1);
+        }
 
         NDS.CheckDMAs(0, 0x02);
     }
     else if (VCount == 215)
     {
+        PROFILER_SCOPE(NDS.Profiler, Prof_Render3D);
         Rend->Start3DRendering();
     }
     else if (VCount == 262)
     {
         // sprites are pre-rendered one scanline in advance
+        PROFILER_SCOPE(NDS.Profiler, Prof_Render2D);
         Rend->DrawSprites(0);
     }
 
@@ -1184,12 +1203,14 @@ void GPU::StartHBlank(u32 line) noexcept
 
 void GPU::FinishFrame(u32 lines) noexcept
 {
-    Rend->SwapBuffers();
+    if (!SkipDrawing)
+        Rend->SwapBuffers();
 
     TotalScanlines = lines;
 
     if (GPU3D.AbortFrame)
     {
+        PROFILER_SCOPE(NDS.Profiler, Prof_Render3D);
         Rend->Restart3DRendering();
         GPU3D.AbortFrame = false;
     }
@@ -1286,7 +1307,10 @@ void GPU::StartScanline(u32 line) noexcept
         // texture memory anyway and only update it before the start
         // of the next frame.
         // So we can give the rasteriser a bit more headroom
-        Rend->Finish3DRendering();
+        {
+            PROFILER_SCOPE(NDS.Profiler, Prof_Render3D);
+            Rend->Finish3DRendering();
+        }
 
         DispStat[0] |= (1<<0);
         DispStat[1] |= (1<<0);
@@ -1631,6 +1655,7 @@ void GPU::SyncVRAMCaptureBlock(u32 block, bool write)
     }
 
     Rend->SyncVRAMCapture(bank, start, len, (flags & CBFlag_Complete));
+    DirtyPages.MarkRange(DirtyRegion_VRAM, bank << 17, 128*1024);
 
     if (write)
     {
@@ -1660,6 +1685,7 @@ void GPU::SyncAllVRAMCaptures()
         u32 len = (flags >> 6) & 0x3;
 
         Rend->SyncVRAMCapture(bank, start, len, (flags & CBFlag_Complete));
+        DirtyPages.MarkRange(DirtyRegion_VRAM, bank << 17, 128*1024);
         VRAMCBFlagsClear(bank, start);
     }
 }
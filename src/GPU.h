@@ -24,6 +24,7 @@
 #include "GPU2D.h"
 #include "GPU3D.h"
 #include "NonStupidBitfield.h"
+#include "DirtyPages.h"
 
 namespace melonDS
 {
@@ -74,6 +75,11 @@ public:
     //          - values are renderer-specific (ie. OpenGL texture handle)
     bool GetFramebuffers(void** top, void** bottom);
 
+    // skips drawing frames that won't be shown (ie. for run-ahead)
+    // the framebuffers keep the last frame that was drawn
+    // lines are still drawn while display capture is active, as its output is part of the emulated state
+    void SetSkipDrawing(bool skip) noexcept { SkipDrawing = skip; }
+
     u8* GetUniqueBankPtr(u32 mask, u32 offset) noexcept;
     const u8* GetUniqueBankPtr(u32 mask, u32 offset) const noexcept;
 
@@ -282,6 +288,7 @@ public:
         {
             *(T*)&VRAM[bank][addr] = val;
             VRAMDirty[bank][addr / VRAMDirtyGranularity] = true;
+            DirtyPages.Mark(DirtyRegion_VRAM, (bank << 17) | addr);
         }
     }
 
@@ -314,36 +321,43 @@ public:
         if (mask & (1<<0))
         {
             VRAMDirty[0][(addr & 0x1FFFF) / VRAMDirtyGranularity] = true;
+            DirtyPages.Mark(DirtyRegion_VRAM, (0 << 17) | (addr & 0x1FFFF));
             *(T*)&VRAM_A[addr & 0x1FFFF] = val;
         }
         if (mask & (1<<1))
         {
             VRAMDirty[1][(addr & 0x1FFFF) / VRAMDirtyGranularity] = true;
+            DirtyPages.Mark(DirtyRegion_VRAM, (1 << 17) | (addr & 0x1FFFF));
             *(T*)&VRAM_B[addr & 0x1FFFF] = val;
         }
         if (mask & (1<<2))
         {
             VRAMDirty[2][(addr & 0x1FFFF) / VRAMDirtyGranularity] = true;
+            DirtyPages.Mark(DirtyRegion_VRAM, (2 << 17) | (addr & 0x1FFFF));
             *(T*)&VRAM_C[addr & 0x1FFFF] = val;
         }
         if (mask & (1<<3))
         {
             VRAMDirty[3][(addr & 0x1FFFF) / VRAMDirtyGranularity] = true;
+            DirtyPages.Mark(DirtyRegion_VRAM, (3 << 17) | (addr & 0x1FFFF));
             *(T*)&VRAM_D[addr & 0x1FFFF] = val;
         }
         if (mask & (1<<4))
         {
             VRAMDirty[4][(addr & 0xFFFF) / VRAMDirtyGranularity] = true;
+            DirtyPages.Mark(DirtyRegion_VRAM, (4 << 17) | (addr & 0xFFFF));
             *(T*)&VRAM_E[addr & 0xFFFF] = val;
         }
         if (mask & (1<<5))
         {
             VRAMDirty[5][(addr & 0x3FFF) / VRAMDirtyGranularity] = true;
+            DirtyPages.Mark(DirtyRegion_VRAM, (5 << 17) | (addr & 0x3FFF));
             *(T*)&VRAM_F[addr & 0x3FFF] = val;
         }
         if (mask & (1<<6))
         {
             VRAMDirty[6][(addr & 0x3FFF) / VRAMDirtyGranularity] = true;
+            DirtyPages.Mark(DirtyRegion_VRAM, (6 << 17) | (addr & 0x3FFF));
             *(T*)&VRAM_G[addr & 0x3FFF] = val;
         }
     }
@@ -375,26 +389,31 @@ public:
         if (mask & (1<<0))
         {
             VRAMDirty[0][(addr & 0x1FFFF) / VRAMDirtyGranularity] = true;
+            DirtyPages.Mark(DirtyRegion_VRAM, (0 << 17) | (addr & 0x1FFFF));
             *(T*)&VRAM_A[addr & 0x1FFFF] = val;
         }
         if (mask & (1<<1))
         {
             VRAMDirty[1][(addr & 0x1FFFF) / VRAMDirtyGranularity] = true;
+            DirtyPages.Mark(DirtyRegion_VRAM, (1 << 17) | (addr & 0x1FFFF));
             *(T*)&VRAM_B[addr & 0x1FFFF] = val;
         }
         if (mask & (1<<4))
         {
             VRAMDirty[4][(addr & 0xFFFF) / VRAMDirtyGranularity] = true;
+            DirtyPages.Mark(DirtyRegion_VRAM, (4 << 17) | (addr & 0xFFFF));
             *(T*)&VRAM_E[addr & 0xFFFF] = val;
         }
         if (mask & (1<<5))
         {
             VRAMDirty[5][(addr & 0x3FFF) / VRAMDirtyGranularity] = true;
+            DirtyPages.Mark(DirtyRegion_VRAM, (5 << 17) | (addr & 0x3FFF));
             *(T*)&VRAM_F[addr & 0x3FFF] = val;
         }
         if (mask & (1<<6))
         {
             VRAMDirty[6][(addr & 0x3FFF) / VRAMDirtyGranularity] = true;
+            DirtyPages.Mark(DirtyRegion_VRAM, (6 << 17) | (addr & 0x3FFF));
             *(T*)&VRAM_G[addr & 0x3FFF] = val;
         }
     }
@@ -424,16 +443,19 @@ public:
         if (mask & (1<<2))
         {
             VRAMDirty[2][(addr & 0x1FFFF) / VRAMDirtyGranularity] = true;
+            DirtyPages.Mark(DirtyRegion_VRAM, (2 << 17) | (addr & 0x1FFFF));
             *(T*)&VRAM_C[addr & 0x1FFFF] = val;
         }
         if (mask & (1<<7))
         {
             VRAMDirty[7][(addr & 0x7FFF) / VRAMDirtyGranularity] = true;
+            DirtyPages.Mark(DirtyRegion_VRAM, (7 << 17) | (addr & 0x7FFF));
             *(T*)&VRAM_H[addr & 0x7FFF] = val;
         }
         if (mask & (1<<8))
         {
             VRAMDirty[8][(addr & 0x3FFF) / VRAMDirtyGranularity] = true;
+            DirtyPages.Mark(DirtyRegion_VRAM, (8 << 17) | (addr & 0x3FFF));
             *(T*)&VRAM_I[addr & 0x3FFF] = val;
         }
     }
@@ -462,11 +484,13 @@ public:
         if (mask & (1<<3))
         {
             VRAMDirty[3][(addr & 0x1FFFF) / VRAMDirtyGranularity] = true;
+            DirtyPages.Mark(DirtyRegion_VRAM, (3 << 17) | (addr & 0x1FFFF));
             *(T*)&VRAM_D[addr & 0x1FFFF] = val;
         }
         if (mask & (1<<8))
         {
             VRAMDirty[8][(addr & 0x3FFF) / VRAMDirtyGranularity] = true;
+            DirtyPages.Mark(DirtyRegion_VRAM, (8 << 17) | (addr & 0x3FFF));
             *(T*)&VRAM_I[addr & 0x3FFF] = val;
         }
     }
@@ -488,8 +512,16 @@ public:
     {
         u32 mask = VRAMMap_ARM7[(addr >> 17) & 0x1];
 
-        if (mask & (1<<2)) *(T*)&VRAM_C[addr & 0x1FFFF] = val;
-        if (mask & (1<<3)) *(T*)&VRAM_D[addr & 0x1FFFF] = val;
+        if (mask & (1<<2))
+        {
+            *(T*)&VRAM_C[addr & 0x1FFFF] = val;
+            DirtyPages.Mark(DirtyRegion_VRAM, (2 << 17) | (addr & 0x1FFFF));
+        }
+        if (mask & (1<<3))
+        {
+            *(T*)&VRAM_D[addr & 0x1FFFF] = val;
+            DirtyPages.Mark(DirtyRegion_VRAM, (3 << 17) | (addr & 0x1FFFF));
+        }
     }
 
 
@@ -614,6 +646,7 @@ public:
     bool MakeVRAMFlat_TexPalCoherent(NonStupidBitField<128*1024/VRAMDirtyGranularity>& dirty) noexcept;
 
     melonDS::NDS& NDS;
+    DirtyPageTracker& DirtyPages;
 
     bool ScreensEnabled = false;
     bool ScreenSwap = false;
@@ -805,6 +838,7 @@ private:
     u16 VMatch[2] {};
 
     std::unique_ptr<Renderer> Rend = nullptr;
+    bool SkipDrawing = false;
 
     u16 VRAMCaptureBlockFlags[16];
 
@@ -846,6 +880,8 @@ public:
 
     virtual void DrawScanline(u32 line) = 0;
     virtual void DrawSprites(u32 line) = 0;
+    // called instead of DrawScanline/DrawSprites when a line isn't drawn
+    virtual void SkipScanline(u32 line) {}
 
     virtual void Start3DRendering() { Rend3D->RenderFrame(); }
     virtual void Finish3DRendering() { Rend3D->FinishRendering(); }
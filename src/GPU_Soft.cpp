@@ -163,6 +163,13 @@ void SoftRenderer::DrawSprites(u32 line)
     Rend2D_B->DrawSprites(line);
 }
 
+void SoftRenderer::SkipScanline(u32 line)
+{
+    // the threaded 3D renderer hands out its lines one by one, they still need to be taken
+    if (GPU.VCount < 192)
+        Rend3D->GetLine(GPU.VCount);
+}
+
 void SoftRenderer::DrawScanlineA(u32 line, u32* dst)
 {
     u32 dispcnt = GPU.GPU2D_A.DispCnt;
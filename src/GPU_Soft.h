@@ -42,6 +42,7 @@ public:
 
     void DrawScanline(u32 line) override;
     void DrawSprites(u32 line) override;
+    void SkipScanline(u32 line) override;
 
     void VBlank() override {};
     void VBlankEnd() override {};
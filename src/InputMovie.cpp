@@ -0,0 +1,707 @@
+/*
+    Copyright 2016-2026 melonDS team
+
+    This file is part of melonDS.
+
+    melonDS is free software: you can redistribute it and/or modify it under
+    the terms of the GNU General Public License as published by the Free
+    Software Foundation, either version 3 of the License, or (at your option)
+    any later version.
+
+    melonDS is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+    FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with melonDS. If not, see http://www.gnu.org/licenses/.
+*/
+
+#include <string.h>
+#include <algorithm>
+
+#include "InputMovie.h"
+#include "NDS.h"
+#include "LZ.h"
+#include "Savestate.h"
+#include "Platform.h"
+
+#define XXH_STATIC_LINKING_ONLY
+#include "xxhash/xxhash.h"
+
+namespace melonDS
+{
+using Platform::Log;
+using Platform::LogLevel;
+
+// A movie file is made of:
+//   MovieHeader
+//   u8 rtcstate[RTCStateLength]    - RTC::StateData, only for movies starting from boot
+//   u8 savestate[StateLength]      - compressed savestate to start from
+//   u8 events[EventsLength]        - LZ-compressed event stream
+//
+// Each event is:
+//   varint framedelta  - frame number minus that of the previous event
+//   u8 type
+//   payload:
+//     Ev_Keys      u16 keymask
+//     Ev_Touch     u16 x, u16 y
+//     Ev_Release   -
+//     Ev_Lid       u8 closed
+//     Ev_Mic       varint count, s16 samples[count] - one per Mic_ReadInput call
+//     Ev_Hash      u64 hash of the state after the frame
+//
+// Events of a frame come in that order: input, then mic input, then the hash.
+// Numbers are little-endian, varints are LEB128.
+
+constexpr char MovieMagic[8] = {'M', 'E', 'L', 'N', 'M', 'O', 'V', 'I'};
+constexpr u16 MovieVersionMajor = 1;
+constexpr u16 MovieVersionMinor = 0;
+
+struct MovieHeader
+{
+    char Magic[8];
+    u16 VersionMajor;
+    u16 VersionMinor;
+    u32 ConsoleType;
+    u32 GameCode;
+    u16 HeaderCRC;
+    u16 Reserved;
+    u32 HashInterval;
+    u32 StartFrame;         // NDS::NumFrames when the movie starts
+    u32 Length;             // number of frames
+    u32 LagFrames;          // number of lag frames over the movie
+    u32 RTCStateLength;
+    u32 StateLength;
+    u32 EventsLength;
+    u32 EventsRawLength;
+};
+
+
+InputMovie::InputMovie(melonDS::NDS& nds) : NDS(nds)
+{
+}
+
+InputMovie::~InputMovie()
+{
+    Stop();
+}
+
+bool InputMovie::StartRecording(u32 hashinterval, bool embedstate)
+{
+    Stop();
+
+    ConsoleType = NDS.ConsoleType;
+    GameCode = 0;
+    HeaderCRC = 0;
+    if (const NDSCart::CartCommon* cart = NDS.NDSCartSlot.GetCart())
+    {
+        GameCode = cart->GetHeader().GameCodeAsU32();
+        HeaderCRC = cart->GetHeader().HeaderCRC16;
+    }
+    HashInterval = hashinterval;
+    Length = 0;
+    LagFrames = 0;
+
+    State.clear();
+    RTCState.clear();
+    if (embedstate)
+    {
+        Savestate state;
+        if (!NDS.DoSavestate(&state) || state.Error)
+        {
+            Log(LogLevel::Error, "InputMovie: failed to save the state to start from\n");
+            return false;
+        }
+
+        State.resize(Savestate::CompressedBound(state.Length()));
+        u32 len = state.Compress(State.data(), State.size());
+        if (!len)
+        {
+            Log(LogLevel::Error, "InputMovie: failed to compress the state to start from\n");
+            State.clear();
+            return false;
+        }
+        State.resize(len);
+
+        // parts of the console that aren't savestated (such as buffered mic input)
+        // would make the recording start from somewhere playback can't, so the
+        // recording starts from the state that was just saved, the same way playback will
+        Savestate reload(State.data(), State.size(), false);
+        if (reload.Error || !NDS.DoSavestate(&reload) || reload.Error)
+        {
+            Log(LogLevel::Error, "InputMovie: failed to reload the state to start from\n");
+            State.clear();
+            return false;
+        }
+    }
+    else
+    {
+        RTC::StateData rtc;
+        NDS.RTC.GetState(rtc);
+        RTCState.resize(sizeof(rtc));
+        memcpy(RTCState.data(), &rtc, sizeof(rtc));
+    }
+
+    StartFrame = NDS.NumFrames;
+    StartLagFrames = NDS.NumLagFrames;
+
+    Events.clear();
+    EventPos = 0;
+    LastEventFrame = 0;
+    CurFrame = 0;
+    HaveLastInput = false;
+    LastHashed = false;
+    Desynced = false;
+    DesyncFrame = 0;
+
+    NDS.Mic.SetMovie(this);
+    CurMode = Mode::Recording;
+    return true;
+}
+
+bool InputMovie::StartPlayback(const u8* data, u32 len)
+{
+    Stop();
+
+    MovieHeader header;
+    if (len < sizeof(header))
+    {
+        Log(LogLevel::Error, "InputMovie: movie is too short\n");
+        return false;
+    }
+    memcpy(&header, data, sizeof(header));
+
+    if (memcmp(header.Magic, MovieMagic, sizeof(MovieMagic)) != 0)
+    {
+        Log(LogLevel::Error, "InputMovie: not a movie file\n");
+        return false;
+    }
+    if (header.VersionMajor != MovieVersionMajor)
+    {
+        Log(LogLevel::Error, "InputMovie: unsupported movie version %d.%d\n", header.VersionMajor, header.VersionMinor);
+        return false;
+    }
+
+    u64 datalen = (u64)sizeof(header) + header.RTCStateLength + header.StateLength + header.EventsLength;
+    if (datalen > len)
+    {
+        Log(LogLevel::Error, "InputMovie: movie is truncated\n");
+        return false;
+    }
+    if (!header.StateLength && header.RTCStateLength != sizeof(RTC::StateData))
+    {
+        Log(LogLevel::Error, "InputMovie: movie has neither a savestate nor an RTC state to start from\n");
+        return false;
+    }
+
+    if (header.ConsoleType != (u32)NDS.ConsoleType)
+    {
+        Log(LogLevel::Error, "InputMovie: movie was recorded in %s mode\n", header.ConsoleType ? "DSi" : "DS");
+        return false;
+    }
+
+    const NDSCart::CartCommon* cart = NDS.NDSCartSlot.GetCart();
+    u32 gamecode = cart ? cart->GetHeader().GameCodeAsU32() : 0;
+    u16 crc = cart ? cart->GetHeader().HeaderCRC16 : 0;
+    if (gamecode != header.GameCode || crc != header.HeaderCRC)
+    {
+        Log(LogLevel::Error, "InputMovie: movie was recorded with a different game\n");
+        return false;
+    }
+
+    const u8* ptr = &data[sizeof(header)];
+    RTCState.assign(ptr, ptr + header.RTCStateLength);
+    ptr += header.RTCStateLength;
+    State.assign(ptr, ptr + header.StateLength);
+    ptr += header.StateLength;
+
+    Events.resize(header.EventsRawLength);
+    if (header.EventsRawLength)
+    {
+        s32 evlen = LZ::Decompress(ptr, header.EventsLength, Events.data(), Events.size());
+        if (evlen != (s32)header.EventsRawLength)
+        {
+            Log(LogLevel::Error, "InputMovie: movie events are corrupt\n");
+            Events.clear();
+            return false;
+        }
+    }
+
+    if (!State.empty())
+    {
+        Savestate state(State.data(), State.size(), false);
+        if (state.Error || !NDS.DoSavestate(&state) || state.Error)
+        {
+            Log(LogLevel::Error, "InputMovie: failed to load the movie's savestate\n");
+            return false;
+        }
+    }
+    else
+    {
+        if (NDS.NumFrames != header.StartFrame)
+        {
+            Log(LogLevel::Error, "InputMovie: movie starts at frame %u of a freshly booted console, this one is at frame %u\n",
+                header.StartFrame, NDS.NumFrames);
+            return false;
+        }
+
+        RTC::StateData rtc;
+        memcpy(&rtc, RTCState.data(), sizeof(rtc));
+        NDS.RTC.SetState(rtc);
+    }
+
+    ConsoleType = header.ConsoleType;
+    GameCode = header.GameCode;
+    HeaderCRC = header.HeaderCRC;
+    HashInterval = header.HashInterval;
+    StartFrame = header.StartFrame;
+    Length = header.Length;
+    LagFrames = header.LagFrames;
+    StartLagFrames = NDS.NumLagFrames;
+
+    EventPos = 0;
+    LastEventFrame = 0;
+    CurFrame = 0;
+    LastInput = {0xFFF, false, 0, 0, NDS.IsLidClosed()};
+    HaveLastInput = true;
+    Desynced = false;
+    DesyncFrame = 0;
+    PeekEvent();
+
+    NDS.Mic.SetMovie(this);
+    CurMode = Mode::Playback;
+
+    Log(LogLevel::Info, "InputMovie: playing back %u frames\n", Length);
+    return true;
+}
+
+bool InputMovie::StartPlayback(const std::string& path)
+{
+    Platform::FileHandle* f = Platform::OpenFile(path, Platform::FileMode::Read);
+    if (!f)
+    {
+        Log(LogLevel::Error, "InputMovie: failed to open %s\n", path.c_str());
+        return false;
+    }
+
+    u64 len = Platform::FileLength(f);
+    if (len > 0x40000000)
+    {
+        Platform::CloseFile(f);
+        Log(LogLevel::Error, "InputMovie: %s is too large to be a movie\n", path.c_str());
+        return false;
+    }
+
+    std::vector<u8> data(len);
+    bool ok = len && Platform::FileRead(data.data(), len, 1, f) == 1;
+    Platform::CloseFile(f);
+    if (!ok)
+    {
+        Log(LogLevel::Error, "InputMovie: failed to read %s\n", path.c_str());
+        return false;
+    }
+
+    return StartPlayback(data.data(), len);
+}
+
+void InputMovie::Stop()
+{
+    if (CurMode == Mode::Idle)
+        return;
+
+    if (CurMode == Mode::Recording)
+    {
+        // make sure the state the movie ends on is checked
+        if (HashInterval && CurFrame > 0 && !LastHashed)
+        {
+            CurFrame--;
+            PutEvent(Ev_Hash);
+            u64 hash = Hash(NDS);
+            for (int i = 0; i < 8; i++)
+                Events.push_back((u8)(hash >> (i*8)));
+            CurFrame++;
+        }
+
+        Length = CurFrame;
+        LagFrames = NDS.NumLagFrames - StartLagFrames;
+        Log(LogLevel::Info, "InputMovie: recorded %u frames, %u bytes of events\n", Length, (u32)Events.size());
+    }
+    else
+    {
+        Log(LogLevel::Info, "InputMovie: playback ended after %u frames\n", CurFrame);
+    }
+
+    NDS.Mic.SetMovie(nullptr);
+    CurMode = Mode::Idle;
+}
+
+void InputMovie::ApplyInput(const Input& input)
+{
+    NDS.SetKeyMask(input.KeyMask);
+
+    if (input.Touching)
+        NDS.TouchScreen(input.TouchX, input.TouchY);
+    else
+        NDS.ReleaseScreen();
+
+    // opening the lid raises an IRQ, so it's only done when the state changes
+    if (input.LidClosed != NDS.IsLidClosed())
+        NDS.SetLidClosed(input.LidClosed);
+}
+
+void InputMovie::RecordInput(const Input& input)
+{
+    if (CurMode != Mode::Recording)
+        return;
+
+    if (!HaveLastInput || input.KeyMask != LastInput.KeyMask)
+    {
+        PutEvent(Ev_Keys);
+        PutU16(input.KeyMask);
+    }
+
+    if (input.Touching)
+    {
+        if (!HaveLastInput || !LastInput.Touching ||
+            input.TouchX != LastInput.TouchX || input.TouchY != LastInput.TouchY)
+        {
+            PutEvent(Ev_Touch);
+            PutU16(input.TouchX);
+            PutU16(input.TouchY);
+        }
+    }
+    else if (!HaveLastInput || LastInput.Touching)
+        PutEvent(Ev_Release);
+
+    if (!HaveLastInput || input.LidClosed != LastInput.LidClosed)
+    {
+        PutEvent(Ev_Lid);
+        Events.push_back(input.LidClosed ? 1 : 0);
+    }
+
+    LastInput = input;
+    HaveLastInput = true;
+    ApplyInput(input);
+}
+
+bool InputMovie::PlayInput()
+{
+    if (CurMode != Mode::Playback)
+        return false;
+
+    if (CurFrame >= Length)
+    {
+        Stop();
+        return false;
+    }
+
+    Input input = LastInput;
+    while (NextFrame == CurFrame && NextType <= Ev_Lid)
+    {
+        bool ok = true;
+        switch (NextType)
+        {
+        case Ev_Keys:
+            ok = GetU16(input.KeyMask);
+            break;
+
+        case Ev_Touch:
+            input.Touching = true;
+            ok = GetU16(input.TouchX) && GetU16(input.TouchY);
+            break;
+
+        case Ev_Release:
+            input.Touching = false;
+            break;
+
+        case Ev_Lid:
+            ok = EventPos < Events.size();
+            if (ok) input.LidClosed = Events[EventPos++] != 0;
+            break;
+
+        default:
+            break;
+        }
+
+        if (!ok)
+        {
+            Desync(CurFrame, "movie events are truncated");
+            NextFrame = NoFrame;
+            break;
+        }
+        PeekEvent();
+    }
+
+    LastInput = input;
+    ApplyInput(input);
+    return true;
+}
+
+void InputMovie::EndFrame()
+{
+    if (CurMode == Mode::Recording)
+    {
+        LastHashed = HashInterval && ((CurFrame + 1) % HashInterval) == 0;
+        if (LastHashed)
+        {
+            PutEvent(Ev_Hash);
+            u64 hash = Hash(NDS);
+            for (int i = 0; i < 8; i++)
+                Events.push_back((u8)(hash >> (i*8)));
+        }
+
+        CurFrame++;
+    }
+    else if (CurMode == Mode::Playback)
+    {
+        // mic input the recording got but this run didn't ask for
+        bool skipped = false;
+        while (NextFrame == CurFrame && NextType == Ev_Mic)
+        {
+            u32 count;
+            if (!GetVarint(count) || count > ((Events.size() - EventPos) >> 1))
+            {
+                NextFrame = NoFrame;
+                break;
+            }
+            EventPos += count * 2;
+            skipped = true;
+            PeekEvent();
+        }
+        if (skipped)
+            Desync(CurFrame, "mic input was recorded but not requested");
+
+        if (NextFrame == CurFrame && NextType == Ev_Hash)
+        {
+            if (EventPos + 8 <= Events.size())
+            {
+                u64 recorded = 0;
+                for (int i = 0; i < 8; i++)
+                    recorded |= (u64)Events[EventPos + i] << (i*8);
+                EventPos += 8;
+
+                if (recorded != Hash(NDS))
+                    Desync(CurFrame, "state hash mismatch");
+            }
+            else
+                Desync(CurFrame, "movie events are truncated");
+
+            PeekEvent();
+        }
+
+        if (NextFrame <= CurFrame)
+        {
+            Desync(CurFrame, "movie events are corrupt");
+            NextFrame = NoFrame;
+        }
+
+        CurFrame++;
+        if (CurFrame == Length && (NDS.NumLagFrames - StartLagFrames) != LagFrames)
+            Desync(CurFrame - 1, "lag frame count mismatch");
+    }
+}
+
+int InputMovie::FeedMic(s16* data, int maxlength)
+{
+    if (CurMode == Mode::Recording)
+    {
+        int len = Platform::Mic_ReadInput(data, maxlength, NDS.UserData);
+        if (len < 0) len = 0;
+        if (len > maxlength) len = maxlength;
+
+        PutEvent(Ev_Mic);
+        PutVarint(len);
+        for (int i = 0; i < len; i++)
+            PutU16((u16)data[i]);
+
+        return len;
+    }
+
+    if (CurMode == Mode::Playback)
+    {
+        if (NextFrame != CurFrame || NextType != Ev_Mic)
+        {
+            Desync(CurFrame, "mic input was requested but not recorded");
+            return 0;
+        }
+
+        u32 count;
+        if (!GetVarint(count) || count > ((Events.size() - EventPos) >> 1))
+        {
+            Desync(CurFrame, "movie events are truncated");
+            NextFrame = NoFrame;
+            return 0;
+        }
+        if (count > (u32)maxlength)
+            Desync(CurFrame, "more mic input was recorded than requested");
+
+        int len = std::min(count, (u32)maxlength);
+        for (int i = 0; i < len; i++)
+            data[i] = (s16)(Events[EventPos + i*2] | (Events[EventPos + i*2 + 1] << 8));
+        EventPos += count * 2;
+
+        PeekEvent();
+        return len;
+    }
+
+    return Platform::Mic_ReadInput(data, maxlength, NDS.UserData);
+}
+
+std::vector<u8> InputMovie::Serialize() const
+{
+    std::vector<u8> ret;
+    if (CurMode == Mode::Recording)
+        return ret;
+
+    MovieHeader header = {};
+    memcpy(header.Magic, MovieMagic, sizeof(MovieMagic));
+    header.VersionMajor = MovieVersionMajor;
+    header.VersionMinor = MovieVersionMinor;
+    header.ConsoleType = ConsoleType;
+    header.GameCode = GameCode;
+    header.HeaderCRC = HeaderCRC;
+    header.HashInterval = HashInterval;
+    header.StartFrame = StartFrame;
+    header.Length = Length;
+    header.LagFrames = LagFrames;
+    header.RTCStateLength = RTCState.size();
+    header.StateLength = State.size();
+    header.EventsRawLength = Events.size();
+
+    u32 offset = sizeof(header) + RTCState.size() + State.size();
+    ret.resize(offset + LZ::CompressBound(Events.size()));
+    if (!Events.empty())
+    {
+        header.EventsLength = LZ::Compress(Events.data(), Events.size(), &ret[offset], ret.size() - offset);
+        if (!header.EventsLength)
+            return {};
+    }
+    ret.resize(offset + header.EventsLength);
+
+    memcpy(&ret[0], &header, sizeof(header));
+    if (!RTCState.empty())
+        memcpy(&ret[sizeof(header)], RTCState.data(), RTCState.size());
+    if (!State.empty())
+        memcpy(&ret[sizeof(header) + RTCState.size()], State.data(), State.size());
+
+    return ret;
+}
+
+bool InputMovie::Save(const std::string& path) const
+{
+    std::vector<u8> data = Serialize();
+    if (data.empty())
+    {
+        Log(LogLevel::Error, "InputMovie: no finished recording to save\n");
+        return false;
+    }
+
+    Platform::FileHandle* f = Platform::OpenFile(path, Platform::FileMode::Write);
+    if (!f)
+    {
+        Log(LogLevel::Error, "InputMovie: failed to open %s for writing\n", path.c_str());
+        return false;
+    }
+
+    bool ok = Platform::FileWrite(data.data(), data.size(), 1, f) == 1;
+    Platform::CloseFile(f);
+    if (!ok)
+        Log(LogLevel::Error, "InputMovie: failed to write %s\n", path.c_str());
+    return ok;
+}
+
+u64 InputMovie::Hash(melonDS::NDS& nds)
+{
+    XXH3_state_t* state = XXH3_createState();
+    XXH3_64bits_reset(state);
+
+    XXH3_64bits_update(state, nds.MainRAM, nds.MainRAMMask + 1);
+    XXH3_64bits_update(state, nds.SharedWRAM, nds.SharedWRAMSize);
+    XXH3_64bits_update(state, nds.ARM7WRAM, nds.ARM7WRAMSize);
+
+    void* top; void* bottom;
+    if (nds.GPU.GetFramebuffers(&top, &bottom))
+    {
+        XXH3_64bits_update(state, top, 256*192*4);
+        XXH3_64bits_update(state, bottom, 256*192*4);
+    }
+
+    u64 ret = XXH3_64bits_digest(state);
+    XXH3_freeState(state);
+    return ret;
+}
+
+void InputMovie::PutEvent(EventType type)
+{
+    PutVarint(CurFrame - LastEventFrame);
+    Events.push_back(type);
+    LastEventFrame = CurFrame;
+}
+
+void InputMovie::PutVarint(u32 val)
+{
+    while (val >= 0x80)
+    {
+        Events.push_back((u8)(val | 0x80));
+        val >>= 7;
+    }
+    Events.push_back((u8)val);
+}
+
+void InputMovie::PutU16(u16 val)
+{
+    Events.push_back(val & 0xFF);
+    Events.push_back(val >> 8);
+}
+
+bool InputMovie::GetVarint(u32& val)
+{
+    val = 0;
+    for (int shift = 0; shift < 35; shift += 7)
+    {
+        if (EventPos >= Events.size())
+            return false;
+
+        u8 b = Events[EventPos++];
+        val |= (u32)(b & 0x7F) << shift;
+        if (!(b & 0x80))
+            return true;
+    }
+    return false;
+}
+
+bool InputMovie::GetU16(u16& val)
+{
+    if (EventPos + 2 > Events.size())
+        return false;
+
+    val = Events[EventPos] | (Events[EventPos + 1] << 8);
+    EventPos += 2;
+    return true;
+}
+
+void InputMovie::PeekEvent()
+{
+    u32 delta;
+    if (EventPos >= Events.size() || !GetVarint(delta) || EventPos >= Events.size())
+    {
+        NextFrame = NoFrame;
+        return;
+    }
+
+    NextType = (EventType)Events[EventPos++];
+    NextFrame = LastEventFrame + delta;
+    LastEventFrame = NextFrame;
+}
+
+void InputMovie::Desync(u32 frame, const char* reason)
+{
+    if (Desynced)
+        return;
+
+    Desynced = true;
+    DesyncFrame = frame;
+    Log(LogLevel::Warn, "InputMovie: playback diverged at frame %u: %s\n", frame, reason);
+}
+
+}
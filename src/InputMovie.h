@@ -0,0 +1,177 @@
+/*
+    Copyright 2016-2026 melonDS team
+
+    This file is part of melonDS.
+
+    melonDS is free software: you can redistribute it and/or modify it under
+    the terms of the GNU General Public License as published by the Free
+    Software Foundation, either version 3 of the License, or (at your option)
+    any later version.
+
+    melonDS is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+    FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with melonDS. If not, see http://www.gnu.org/licenses/.
+*/
+
+#ifndef INPUTMOVIE_H
+#define INPUTMOVIE_H
+
+#include <string>
+#include <vector>
+
+#include "types.h"
+
+namespace melonDS
+{
+class NDS;
+
+/// Input movie: the input a console was given, frame by frame, so that a run can be replayed exactly.
+///
+/// A movie starts either from a savestate embedded in it, or from a console that was
+/// just booted, in which case only the RTC state is kept and playback has to start on a
+/// console booted the same way. From there, the key mask, touchscreen and lid state of
+/// every frame are recorded, along with the samples fed to the mic.
+///
+/// Only changes in input are stored, keyed by frame. Every few frames, a hash of the
+/// guest RAM and the framebuffers is stored as well; playback checks these hashes and
+/// reports the first frame whose hash doesn't match.
+///
+/// The frame count and lag frame count are taken from the console's own accounting,
+/// and the lag frame count is checked at the end of playback.
+///
+/// Each frame goes: RecordInput() or PlayInput(), then NDS::RunFrame(), then EndFrame().
+class InputMovie
+{
+public:
+    static constexpr u32 DefaultHashInterval = 60;
+
+    enum class Mode
+    {
+        Idle,
+        Recording,
+        Playback,
+    };
+
+    struct Input
+    {
+        u16 KeyMask;    // as passed to NDS::SetKeyMask, 0 = pressed
+        bool Touching;
+        u16 TouchX, TouchY;
+        bool LidClosed;
+    };
+
+    explicit InputMovie(melonDS::NDS& nds);
+    ~InputMovie();
+    InputMovie(const InputMovie&) = delete;
+    InputMovie& operator=(const InputMovie&) = delete;
+
+    /// Starts recording from the current state of the console.
+    /// @param hashinterval Number of frames between state hashes, 0 to disable them.
+    /// @param embedstate Whether to embed a savestate to start from. Without one, the movie
+    /// can only be played back on a console that was just booted.
+    bool StartRecording(u32 hashinterval = DefaultHashInterval, bool embedstate = true);
+
+    /// Starts playing back a movie held in memory, loading its embedded savestate if it has one.
+    bool StartPlayback(const u8* data, u32 len);
+
+    /// Loads a movie file and starts playing it back.
+    bool StartPlayback(const std::string& path);
+
+    /// Ends recording or playback. A recorded movie can still be saved afterwards.
+    void Stop();
+
+    /// Applies the given input to the console and records it.
+    void RecordInput(const Input& input);
+
+    /// Applies the recorded input of the next frame to the console.
+    /// @return false if the movie is over, in which case playback has ended.
+    bool PlayInput();
+
+    /// Records or checks the state hash and mic input once the frame is emulated.
+    void EndFrame();
+
+    /// Gives samples to the console's mic, from the platform when recording, from the movie when playing back.
+    int FeedMic(s16* data, int maxlength);
+
+    /// @return The movie file contents, once recording has ended.
+    [[nodiscard]] std::vector<u8> Serialize() const;
+    bool Save(const std::string& path) const;
+
+    [[nodiscard]] Mode GetMode() const noexcept { return CurMode; }
+    [[nodiscard]] bool IsRecording() const noexcept { return CurMode == Mode::Recording; }
+    [[nodiscard]] bool IsPlaying() const noexcept { return CurMode == Mode::Playback; }
+
+    /// @return The number of frames recorded or played back so far.
+    [[nodiscard]] u32 GetFrame() const noexcept { return CurFrame; }
+    /// @return The number of frames in the movie being played back, or recorded so far.
+    [[nodiscard]] u32 GetLength() const noexcept { return CurMode == Mode::Playback ? Length : CurFrame; }
+
+    /// @return Whether the playback diverged from the recording.
+    [[nodiscard]] bool IsDesynced() const noexcept { return Desynced; }
+    /// @return The first frame found to diverge.
+    [[nodiscard]] u32 GetDesyncFrame() const noexcept { return DesyncFrame; }
+
+    /// @return A hash of the guest RAM and framebuffers.
+    static u64 Hash(melonDS::NDS& nds);
+
+private:
+    enum EventType : u8
+    {
+        Ev_Keys = 1,
+        Ev_Touch,
+        Ev_Release,
+        Ev_Lid,
+        Ev_Mic,
+        Ev_Hash,
+    };
+
+    static constexpr u32 NoFrame = 0xFFFFFFFF;
+
+    void ApplyInput(const Input& input);
+    void PutEvent(EventType type);
+    void PutVarint(u32 val);
+    void PutU16(u16 val);
+    bool GetVarint(u32& val);
+    bool GetU16(u16& val);
+    void PeekEvent();
+    void Desync(u32 frame, const char* reason);
+
+    melonDS::NDS& NDS;
+    Mode CurMode = Mode::Idle;
+
+    // movie properties, see the file header
+    u32 ConsoleType = 0;
+    u32 GameCode = 0;
+    u16 HeaderCRC = 0;
+    u32 HashInterval = 0;
+    u32 StartFrame = 0;
+    u32 StartLagFrames = 0;
+    u32 Length = 0;
+    u32 LagFrames = 0;
+    std::vector<u8> RTCState;
+    std::vector<u8> State;      // compressed savestate, empty if starting from boot
+
+    // uncompressed event stream
+    std::vector<u8> Events;
+    u32 EventPos = 0;
+    u32 LastEventFrame = 0;
+
+    // next event to be played back, decoded ahead
+    u32 NextFrame = NoFrame;
+    EventType NextType = Ev_Keys;
+
+    u32 CurFrame = 0;
+    Input LastInput {};
+    bool HaveLastInput = false;
+    bool LastHashed = false;
+
+    bool Desynced = false;
+    u32 DesyncFrame = 0;
+};
+
+}
+
+#endif // INPUTMOVIE_H
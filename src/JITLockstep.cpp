@@ -0,0 +1,325 @@
+/*
+    Copyright 2016-2026 melonDS team
+
+    This file is part of melonDS.
+
+    melonDS is free software: you can redistribute it and/or modify it under
+    the terms of the GNU General Public License as published by the Free
+    Software Foundation, either version 3 of the License, or (at your option)
+    any later version.
+
+    melonDS is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+    FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with melonDS. If not, see http://www.gnu.org/licenses/.
+*/
+
+#include <string.h>
+
+#include "JITLockstep.h"
+#include "NDS.h"
+#include "ARM.h"
+#include "ARMJIT_Internal.h"
+#include "Savestate.h"
+#include "Platform.h"
+
+namespace melonDS
+{
+using Platform::Log;
+using Platform::LogLevel;
+
+JITLockstep::JITLockstep(melonDS::NDS& jit, melonDS::NDS& interp) noexcept :
+    JIT(jit),
+    Interp(interp)
+{
+}
+
+JITLockstep::~JITLockstep() noexcept
+{
+    Stop();
+}
+
+bool JITLockstep::Start() noexcept
+{
+    Stop();
+
+    if (!JIT.IsJITEnabled() || Interp.IsJITEnabled())
+    {
+        Log(LogLevel::Error, "JITLockstep: needs one console with the JIT and one without\n");
+        return false;
+    }
+    if (JIT.ConsoleType != Interp.ConsoleType)
+    {
+        Log(LogLevel::Error, "JITLockstep: the consoles aren't of the same type\n");
+        return false;
+    }
+    if (JIT.IsARM7Threaded() || Interp.IsARM7Threaded())
+    {
+        Log(LogLevel::Error, "JITLockstep: the ARM7 can't run on its own thread\n");
+        return false;
+    }
+
+    Savestate state;
+    if (!JIT.DoSavestate(&state) || state.Error)
+    {
+        Log(LogLevel::Error, "JITLockstep: failed to save the JIT console's state\n");
+        return false;
+    }
+
+    // both consoles load the state, so that whatever isn't savestated doesn't differ
+    for (melonDS::NDS* nds : {&JIT, &Interp})
+    {
+        Savestate load(state.Buffer(), state.Length(), false);
+        if (load.Error || !nds->DoSavestate(&load) || load.Error)
+        {
+            Log(LogLevel::Error, "JITLockstep: failed to load the state into a console\n");
+            return false;
+        }
+    }
+
+    // every block has to go through the compiler to have its instructions known
+    JIT.JIT.ResetBlockCache();
+    BlockInstrs.clear();
+
+    Diverged = false;
+    Report = {};
+    Frames = 0;
+    BlocksChecked[0] = BlocksChecked[1] = 0;
+
+    JIT.Lockstep = this;
+    Interp.Lockstep = this;
+    Running = true;
+    return true;
+}
+
+void JITLockstep::Stop() noexcept
+{
+    if (!Running)
+        return;
+
+    JIT.Lockstep = nullptr;
+    Interp.Lockstep = nullptr;
+    Running = false;
+
+    BlockInstrs.clear();
+    for (int i = 0; i < 2; i++)
+    {
+        Trace[i].clear();
+        TracePos[i] = 0;
+    }
+}
+
+bool JITLockstep::RunFrame() noexcept
+{
+    if (!Running || Diverged)
+        return false;
+
+    for (int i = 0; i < 2; i++)
+    {
+        Trace[i].clear();
+        TracePos[i] = 0;
+    }
+
+    JIT.RunFrame();
+    Interp.RunFrame();
+
+    for (u32 num = 0; num < 2 && !Diverged; num++)
+    {
+        if (TracePos[num] < Trace[num].size())
+            Diverge(num, &Trace[num][TracePos[num]], nullptr, "the interpreter didn't reach this block before the end of the frame");
+    }
+
+    if (!Diverged)
+        CompareMemory();
+
+    Frames++;
+    return !Diverged;
+}
+
+void JITLockstep::BlockCompiled(u32 num, u32 addr, const FetchedInstr* instrs, int count) noexcept
+{
+    auto list = std::make_shared<std::vector<u32>>();
+    list->reserve(count);
+    for (int i = 0; i < count; i++)
+    {
+        list->push_back(instrs[i].Addr);
+
+        // both halves of a long branch with link are merged into one instruction
+        if (instrs[i].Info.Kind == ARMInstrInfo::tk_BL_LONG)
+            list->push_back(instrs[i].Addr + 2);
+    }
+
+    BlockInstrs[((u64)num << 32) | addr] = std::move(list);
+}
+
+void JITLockstep::RecordBlock(const ARM& cpu, u32 addr, bool compiled) noexcept
+{
+    // the JIT only switched to a block it had compiled for another mirror, nothing ran
+    if (compiled && cpu.Cycles == 0 && cpu.R[15] == addr + ((cpu.CPSR & 0x20) ? 2 : 4))
+        return;
+
+    Block& block = Trace[cpu.Num].emplace_back();
+
+    auto it = BlockInstrs.find(((u64)cpu.Num << 32) | addr);
+    if (it != BlockInstrs.end())
+        block.Instrs = it->second;
+    block.Addr = addr;
+    memcpy(block.R, cpu.R, sizeof(block.R));
+    block.CPSR = cpu.CPSR;
+    block.Cycles = cpu.Cycles;
+    block.Halted = cpu.Halted;
+    block.IRQ = cpu.IRQ;
+    block.IdleLoop = cpu.IdleLoop;
+    block.Compiled = compiled;
+    block.Bailed = false;
+}
+
+void JITLockstep::RecordBail(const ARM& cpu) noexcept
+{
+    Block& block = Trace[cpu.Num].emplace_back();
+    block.Addr = cpu.R[15] - ((cpu.CPSR & 0x20) ? 2 : 4);
+    memcpy(block.R, cpu.R, sizeof(block.R));
+    block.CPSR = cpu.CPSR;
+    block.Cycles = 0;
+    block.Halted = cpu.Halted;
+    block.IRQ = cpu.IRQ;
+    block.IdleLoop = 0;
+    block.Compiled = false;
+    block.Bailed = true;
+}
+
+const JITLockstep::Block* JITLockstep::NextBlock(const ARM& cpu) noexcept
+{
+    if (Diverged)
+        return nullptr;
+
+    u32 num = cpu.Num;
+    if (TracePos[num] >= Trace[num].size())
+    {
+        Diverge(num, nullptr, &cpu, "the interpreter ran past the last block of the frame");
+        return nullptr;
+    }
+
+    const Block& block = Trace[num][TracePos[num]];
+    u32 addr = cpu.R[15] - ((cpu.CPSR & 0x20) ? 2 : 4);
+    if (addr != block.Addr)
+    {
+        Diverge(num, &block, &cpu, "the interpreter is at a different address");
+        return nullptr;
+    }
+
+    TracePos[num]++;
+    if (block.Bailed)
+        return nullptr;
+    if (!block.Instrs)
+    {
+        Diverge(num, &block, &cpu, "the instructions of the block weren't recorded");
+        return nullptr;
+    }
+
+    return &block;
+}
+
+void JITLockstep::CheckBlock(ARM& cpu, const Block& block) noexcept
+{
+    // take on the JIT's timing, so that both consoles keep running the same way
+    cpu.Cycles = block.Cycles;
+    cpu.IdleLoop = block.IdleLoop;
+
+    if (memcmp(cpu.R, block.R, sizeof(block.R)) != 0 || cpu.CPSR != block.CPSR)
+        Diverge(cpu.Num, &block, &cpu, "the registers differ after the block");
+    else if (cpu.Halted != block.Halted)
+        Diverge(cpu.Num, &block, &cpu, "the CPU is halted on only one console");
+    else if (cpu.IRQ != block.IRQ)
+        Diverge(cpu.Num, &block, &cpu, "an IRQ is pending on only one console");
+    else
+        BlocksChecked[cpu.Num]++;
+}
+
+void JITLockstep::Diverge(u32 num, const Block* block, const ARM* cpu, const std::string& reason) noexcept
+{
+    Diverged = true;
+
+    Report = {};
+    Report.Frame = Frames;
+    Report.Reason = reason;
+    Report.HasBlock = true;
+    Report.CPU = num;
+    Report.BlockIndex = block ? (block - Trace[num].data()) : Trace[num].size();
+    if (block)
+    {
+        Report.BlockAddr = block->Addr;
+        Report.Compiled = block->Compiled;
+        memcpy(Report.JITRegs, block->R, sizeof(block->R));
+        Report.JITRegs[16] = block->CPSR;
+    }
+    if (cpu)
+    {
+        memcpy(Report.InterpRegs, cpu->R, sizeof(cpu->R));
+        Report.InterpRegs[16] = cpu->CPSR;
+    }
+
+    Log(LogLevel::Error, "JITLockstep: frame %llu, ARM%d block %llu at %08X%s: %s\n",
+        (unsigned long long)Report.Frame, num ? 7 : 9, (unsigned long long)Report.BlockIndex,
+        Report.BlockAddr, Report.Compiled ? " (first run)" : "", reason.c_str());
+    if (block && cpu)
+    {
+        for (int i = 0; i < 17; i++)
+        {
+            if (Report.JITRegs[i] != Report.InterpRegs[i])
+            {
+                if (i < 16)
+                    Log(LogLevel::Error, "  r%d: JIT %08X, interpreter %08X\n", i, Report.JITRegs[i], Report.InterpRegs[i]);
+                else
+                    Log(LogLevel::Error, "  cpsr: JIT %08X, interpreter %08X\n", Report.JITRegs[i], Report.InterpRegs[i]);
+            }
+        }
+    }
+}
+
+bool JITLockstep::CompareMemory() noexcept
+{
+    struct Region
+    {
+        const char* Name;
+        const u8* JIT;
+        const u8* Interp;
+        u32 Size;
+    };
+    const Region regions[] =
+    {
+        {"main RAM", JIT.MainRAM, Interp.MainRAM, JIT.MainRAMMask + 1},
+        {"shared WRAM", JIT.SharedWRAM, Interp.SharedWRAM, JIT.SharedWRAMSize},
+        {"ARM7 WRAM", JIT.ARM7WRAM, Interp.ARM7WRAM, JIT.ARM7WRAMSize},
+        {"ITCM", JIT.ARM9.ITCM, Interp.ARM9.ITCM, ITCMPhysicalSize},
+        {"DTCM", JIT.ARM9.DTCM, Interp.ARM9.DTCM, DTCMPhysicalSize},
+    };
+
+    for (const Region& region : regions)
+    {
+        if (memcmp(region.JIT, region.Interp, region.Size) == 0)
+            continue;
+
+        u32 offset = 0;
+        while (region.JIT[offset] == region.Interp[offset])
+            offset++;
+
+        Diverged = true;
+        Report = {};
+        Report.Frame = Frames;
+        Report.Reason = std::string(region.Name) + " differs at the end of the frame";
+        Report.HasBlock = false;
+        Report.Region = region.Name;
+        Report.Offset = offset;
+
+        Log(LogLevel::Error, "JITLockstep: frame %llu: %s differs at offset %08X (JIT %02X, interpreter %02X)\n",
+            (unsigned long long)Frames, region.Name, offset, region.JIT[offset], region.Interp[offset]);
+        return false;
+    }
+
+    return true;
+}
+
+}
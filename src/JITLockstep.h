@@ -0,0 +1,136 @@
+/*
+    Copyright 2016-2026 melonDS team
+
+    This file is part of melonDS.
+
+    melonDS is free software: you can redistribute it and/or modify it under
+    the terms of the GNU General Public License as published by the Free
+    Software Foundation, either version 3 of the License, or (at your option)
+    any later version.
+
+    melonDS is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+    FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with melonDS. If not, see http://www.gnu.org/licenses/.
+*/
+
+#ifndef JITLOCKSTEP_H
+#define JITLOCKSTEP_H
+
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "types.h"
+
+namespace melonDS
+{
+class NDS;
+class ARM;
+struct FetchedInstr;
+
+/// Runs a JIT console and an interpreter console side by side and reports the
+/// first point where they stop agreeing.
+///
+/// The two CPU modes don't count cycles the same way, so consoles left to run on
+/// their own drift apart within a few frames even when the JIT is right. Instead,
+/// the JIT console runs each frame first and records every block it executes: the
+/// instructions it went through, its cycle count, and the registers it left behind.
+/// The interpreter console then runs the same frame, going through the same
+/// instructions for each block and taking the JIT's cycle count, so that both
+/// consoles see the same timings and their registers can be compared after every
+/// block. Guest memory is compared at the end of every frame.
+///
+/// Both consoles need the same ROM, BIOS and firmware, and neither can run the ARM7
+/// on its own thread. Start() copies the JIT console's state to the interpreter
+/// console, then each frame is run with RunFrame() instead of NDS::RunFrame().
+class JITLockstep
+{
+public:
+    // a block as run by the JIT console
+    struct Block
+    {
+        std::shared_ptr<const std::vector<u32>> Instrs; // address of each instruction
+        u32 Addr;
+        u32 R[16];
+        u32 CPSR;
+        s32 Cycles;
+        u8 Halted;
+        u8 IRQ;
+        u8 IdleLoop;
+        bool Compiled;  // run by the interpreter while the JIT compiled it
+        bool Bailed;    // the JIT gave up on the rest of the slice, see ARM::Execute
+    };
+
+    struct Divergence
+    {
+        u64 Frame;      // frames since Start()
+        std::string Reason;
+
+        // the block after which the CPUs stopped agreeing,
+        // unset for memory that differs at the end of a frame
+        bool HasBlock;
+        u32 CPU;        // 0 = ARM9, 1 = ARM7
+        u64 BlockIndex; // blocks that CPU ran earlier in the frame
+        u32 BlockAddr;
+        bool Compiled;
+        u32 JITRegs[17];    // R0-R15, then CPSR
+        u32 InterpRegs[17];
+
+        // first byte that differs, for memory
+        const char* Region;
+        u32 Offset;
+    };
+
+    JITLockstep(melonDS::NDS& jit, melonDS::NDS& interp) noexcept;
+    ~JITLockstep() noexcept;
+    JITLockstep(const JITLockstep&) = delete;
+    JITLockstep& operator=(const JITLockstep&) = delete;
+
+    bool Start() noexcept;
+    void Stop() noexcept;
+    [[nodiscard]] bool IsRunning() const noexcept { return Running; }
+
+    /// Runs one frame on both consoles.
+    /// @return false once they diverged, after which neither is run anymore.
+    bool RunFrame() noexcept;
+
+    [[nodiscard]] bool HasDiverged() const noexcept { return Diverged; }
+    [[nodiscard]] const Divergence& GetDivergence() const noexcept { return Report; }
+    [[nodiscard]] u64 GetFrameCount() const noexcept { return Frames; }
+    [[nodiscard]] u64 GetBlockCount(u32 cpu) const noexcept { return BlocksChecked[cpu]; }
+
+    // called by the JIT console
+    void BlockCompiled(u32 num, u32 addr, const FetchedInstr* instrs, int count) noexcept;
+    void RecordBlock(const ARM& cpu, u32 addr, bool compiled) noexcept;
+    void RecordBail(const ARM& cpu) noexcept;
+
+    // called by the interpreter console
+    const Block* NextBlock(const ARM& cpu) noexcept;
+    void CheckBlock(ARM& cpu, const Block& block) noexcept;
+
+private:
+    melonDS::NDS& JIT;
+    melonDS::NDS& Interp;
+
+    bool Running = false;
+    bool Diverged = false;
+    Divergence Report {};
+    u64 Frames = 0;
+    u64 BlocksChecked[2] {};
+
+    // instructions of every block compiled so far, by CPU and address
+    std::unordered_map<u64, std::shared_ptr<const std::vector<u32>>> BlockInstrs;
+
+    std::vector<Block> Trace[2];
+    size_t TracePos[2] {};
+
+    void Diverge(u32 num, const Block* block, const ARM* cpu, const std::string& reason) noexcept;
+    bool CompareMemory() noexcept;
+};
+
+}
+#endif // JITLOCKSTEP_H
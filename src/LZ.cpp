@@ -0,0 +1,219 @@
+/*
+    Copyright 2016-2026 melonDS team
+
+    This file is part of melonDS.
+
+    melonDS is free software: you can redistribute it and/or modify it under
+    the terms of the GNU General Public License as published by the Free
+    Software Foundation, either version 3 of the License, or (at your option)
+    any later version.
+
+    melonDS is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+    FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with melonDS. If not, see http://www.gnu.org/licenses/.
+*/
+
+#include <string.h>
+#include "LZ.h"
+
+namespace melonDS::LZ
+{
+
+// format constraints, see the LZ4 block format description
+constexpr u32 MinMatch = 4;
+constexpr u32 LastLiterals = 5;
+constexpr u32 MatchFindLimit = 12;
+constexpr u32 MaxOffset = 0xFFFF;
+
+constexpr u32 HashLog = 13;
+
+static inline u32 Read32(const u8* ptr)
+{
+    u32 ret;
+    memcpy(&ret, ptr, 4);
+    return ret;
+}
+
+static inline u32 Hash(u32 seq)
+{
+    return (seq * 2654435761u) >> (32 - HashLog);
+}
+
+// writes a length that doesn't fit in the token as a run of 255s
+static inline u8* WriteLength(u8* op, u32 len)
+{
+    while (len >= 255)
+    {
+        *op++ = 255;
+        len -= 255;
+    }
+    *op++ = (u8)len;
+    return op;
+}
+
+static u8* WriteSequence(u8* op, u8* opend, const u8* lit, u32 litlen, u32 offset, u32 matchlen)
+{
+    // worst case size of this sequence
+    u32 needed = 1 + (litlen / 255) + 1 + litlen + (matchlen ? (2 + (matchlen / 255) + 1) : 0);
+    if ((u32)(opend - op) < needed)
+        return nullptr;
+
+    u8* token = op++;
+    u8 tokval;
+
+    if (litlen >= 15)
+    {
+        tokval = 15 << 4;
+        op = WriteLength(op, litlen - 15);
+    }
+    else
+        tokval = litlen << 4;
+
+    // lit can be null for empty input
+    if (litlen)
+        memcpy(op, lit, litlen);
+    op += litlen;
+
+    if (matchlen)
+    {
+        *op++ = offset & 0xFF;
+        *op++ = offset >> 8;
+
+        u32 ml = matchlen - MinMatch;
+        if (ml >= 15)
+        {
+            tokval |= 15;
+            op = WriteLength(op, ml - 15);
+        }
+        else
+            tokval |= ml;
+    }
+
+    *token = tokval;
+    return op;
+}
+
+u32 Compress(const u8* src, u32 srclen, u8* dst, u32 dstcap) noexcept
+{
+    u8* op = dst;
+    u8* opend = dst + dstcap;
+    u32 anchor = 0;
+
+    if (srclen > MatchFindLimit)
+    {
+        // positions are stored plus one, so that zero means empty
+        u32 table[1 << HashLog] = {};
+
+        u32 ip = 0;
+        u32 limit = srclen - MatchFindLimit;
+        u32 matchend = srclen - LastLiterals;
+
+        while (ip < limit)
+        {
+            u32 seq = Read32(&src[ip]);
+            u32 h = Hash(seq);
+            u32 ref = table[h];
+            table[h] = ip + 1;
+
+            if (ref && (ip - (ref - 1)) <= MaxOffset && Read32(&src[ref - 1]) == seq)
+            {
+                ref--;
+
+                u32 len = MinMatch;
+                while ((ip + len) < matchend && src[ref + len] == src[ip + len])
+                    len++;
+
+                op = WriteSequence(op, opend, &src[anchor], ip - anchor, ip - ref, len);
+                if (!op) return 0;
+
+                ip += len;
+                anchor = ip;
+            }
+            else
+            {
+                // skip faster through data that doesn't compress
+                ip += 1 + ((ip - anchor) >> 6);
+            }
+        }
+    }
+
+    op = WriteSequence(op, opend, &src[anchor], srclen - anchor, 0, 0);
+    if (!op) return 0;
+
+    return op - dst;
+}
+
+s32 Decompress(const u8* src, u32 srclen, u8* dst, u32 dstcap) noexcept
+{
+    u32 ip = 0;
+    u32 op = 0;
+
+    while (ip < srclen)
+    {
+        u8 token = src[ip++];
+
+        u32 litlen = token >> 4;
+        if (litlen == 15)
+        {
+            u8 b;
+            do
+            {
+                if (ip >= srclen) return -1;
+                b = src[ip++];
+                litlen += b;
+            }
+            while (b == 255);
+        }
+
+        if (litlen > (srclen - ip) || litlen > (dstcap - op))
+            return -1;
+
+        memcpy(&dst[op], &src[ip], litlen);
+        ip += litlen;
+        op += litlen;
+
+        // the last sequence only has literals
+        if (ip >= srclen)
+            break;
+
+        if ((srclen - ip) < 2) return -1;
+        u32 offset = src[ip] | (src[ip+1] << 8);
+        ip += 2;
+        if (offset == 0 || offset > op)
+            return -1;
+
+        u32 matchlen = token & 0xF;
+        if (matchlen == 15)
+        {
+            u8 b;
+            do
+            {
+                if (ip >= srclen) return -1;
+                b = src[ip++];
+                matchlen += b;
+            }
+            while (b == 255);
+        }
+        matchlen += MinMatch;
+
+        if (matchlen > (dstcap - op))
+            return -1;
+
+        if (offset >= matchlen)
+            memcpy(&dst[op], &dst[op - offset], matchlen);
+        else
+        {
+            // overlapping copy, repeats the last offset bytes
+            for (u32 i = 0; i < matchlen; i++)
+                dst[op + i] = dst[op - offset + i];
+        }
+        op += matchlen;
+    }
+
+    return op;
+}
+
+}
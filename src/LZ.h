@@ -0,0 +1,49 @@
+/*
+    Copyright 2016-2026 melonDS team
+
+    This file is part of melonDS.
+
+    melonDS is free software: you can redistribute it and/or modify it under
+    the terms of the GNU General Public License as published by the Free
+    Software Foundation, either version 3 of the License, or (at your option)
+    any later version.
+
+    melonDS is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+    FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with melonDS. If not, see http://www.gnu.org/licenses/.
+*/
+
+#ifndef MELONDS_LZ_H
+#define MELONDS_LZ_H
+
+#include "types.h"
+
+/// Small LZ77 codec used for data that has to be decompressed quickly,
+/// such as blocks of compressed ROMs.
+///
+/// The compressed data follows the LZ4 block format, so it can be produced
+/// or inspected with other tools that support it.
+namespace melonDS::LZ
+{
+
+/// @return The largest size compressing \c srclen bytes can result in.
+constexpr u32 CompressBound(u32 srclen) noexcept
+{
+    return srclen + (srclen / 255) + 16;
+}
+
+/// Compresses \c srclen bytes from \c src into \c dst.
+/// @return The compressed size, or 0 if it wouldn't fit in \c dstcap bytes.
+u32 Compress(const u8* src, u32 srclen, u8* dst, u32 dstcap) noexcept;
+
+/// Decompresses \c srclen bytes of compressed data from \c src into \c dst.
+/// Malformed input is detected and never causes reads or writes out of bounds.
+/// @return The decompressed size, or -1 if the data is malformed or doesn't fit in \c dstcap bytes.
+s32 Decompress(const u8* src, u32 srclen, u8* dst, u32 dstcap) noexcept;
+
+}
+
+#endif // MELONDS_LZ_H
@@ -17,6 +17,7 @@
 */
 
 #include "NDS.h"
+#include "InputMovie.h"
 #include "DSi.h"
 #include "Mic.h"
 
@@ -88,6 +89,9 @@ void Mic::DoSavestate(melonDS::Savestate *file)
 
 void Mic::Start(MicSource source)
 {
+    // the mic input is advanced along with the SPU
+    NDS.CatchUpEvent(Event_SPU);
+
     if (source == Mic_NDS)
         StopMask |= (1<<source);
     else
@@ -155,7 +159,16 @@ void Mic::FeedBuffer()
         if ((InputBufferWritePos + thislen) > InputBufferSize)
             thislen = InputBufferSize - InputBufferWritePos;
 
-        int actuallen = Platform::Mic_ReadInput(&InputBuffer[InputBufferWritePos], thislen, NDS.UserData);
+        int actuallen;
+        if (Muted)
+        {
+            memset(&InputBuffer[InputBufferWritePos], 0, thislen * sizeof(s16));
+            actuallen = thislen;
+        }
+        else if (Movie)
+            actuallen = Movie->FeedMic(&InputBuffer[InputBufferWritePos], thislen);
+        else
+            actuallen = Platform::Mic_ReadInput(&InputBuffer[InputBufferWritePos], thislen, NDS.UserData);
         if (!actuallen)
             break;
 
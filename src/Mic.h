@@ -25,6 +25,7 @@
 namespace melonDS
 {
 class NDS;
+class InputMovie;
 
 enum MicSource
 {
@@ -48,6 +49,16 @@ public:
     void Advance(u32 cycles);
     s16 ReadSample();
 
+    bool IsOpen() const { return OpenMask != 0; }
+
+    /// Makes the mic input go through an input movie, to be recorded or played back.
+    void SetMovie(InputMovie* movie) { Movie = movie; }
+
+    /// Feeds silence instead of the platform's mic input, for when the console
+    /// must not depend on the host, ie. during netplay.
+    void SetMuted(bool muted) { Muted = muted; }
+    bool IsMuted() const { return Muted; }
+
 private:
     melonDS::NDS& NDS;
 
@@ -63,6 +74,9 @@ private:
     u8 StopMask;
     u32 StopCount[3];
 
+    InputMovie* Movie = nullptr;
+    bool Muted = false;
+
     void DoStop(MicSource source);
     void FeedBuffer();
 };
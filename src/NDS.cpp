@@ -20,6 +20,8 @@
 #include <stdio.h>
 #include <string.h>
 #include <inttypes.h>
+#include <algorithm>
+#include <thread>
 #include "NDS.h"
 #include "ARM.h"
 #include "NDSCart.h"
@@ -49,6 +51,8 @@ namespace melonDS
 {
 using namespace Platform;
 
+static_assert(Prof_MAX == Prof_EventBase + Event_MAX, "profiler buckets out of sync with scheduler events");
+
 const s32 kMaxIterationCycles = 64;
 const s32 kIterationCycleMargin = 8;
 
@@ -75,6 +79,7 @@ const s32 kIterationCycleMargin = 8;
 // timings for GBA slot and wifi are set up at runtime
 
 thread_local NDS* NDS::Current = nullptr;
+thread_local bool NDS::OnARM7Thread = false;
 
 NDS::NDS() noexcept :
     NDS(
@@ -133,6 +138,8 @@ NDS::NDS(NDSArgs&& args, int type, void* userdata) noexcept :
 
 NDS::~NDS() noexcept
 {
+    StopARM7Thread();
+
     UnregisterEventFuncs(Event_Div);
     UnregisterEventFuncs(Event_Sqrt);
     // The destructor for each component is automatically called by the compiler
@@ -217,11 +224,20 @@ void NDS::SetJITArgs(std::optional<JITArgs> args) noexcept
 {
     if (args)
     { // If we want to turn the JIT on...
+        if (ARM7Threaded)
+        {
+            // the JIT doesn't go through the threaded ARM7's sync points
+            Log(LogLevel::Warn, "Threaded ARM7 is not supported with the JIT, turning it off\n");
+            SetARM7Threaded(false);
+        }
+
         JIT.SetJITArgs(*args);
     }
     else if (args.has_value() != EnableJIT)
     { // Else if we want to turn the JIT off, and it wasn't already off...
         JIT.Reset();
+        // nothing that was written while it ran has been marked
+        DirtyPages.MarkAll();
     }
 
     EnableJIT = args.has_value();
@@ -291,7 +307,7 @@ void NDS::SetupDirectBoot()
 {
     const NDSHeader& header = NDSCartSlot.GetCart()->GetHeader();
     u32 cartid = NDSCartSlot.GetCart()->ID();
-    const u8* cartrom = NDSCartSlot.GetCart()->GetROM();
+    const NDSCart::CartCommon& cart = *NDSCartSlot.GetCart();
     MapSharedWRAM(3);
 
     // Copy the Nintendo logo from the NDS ROM header to the ARM9 BIOS if using FreeBIOS
@@ -305,7 +321,7 @@ void NDS::SetupDirectBoot()
 
     for (u32 i = 0; i < 0x170; i+=4)
     {
-        u32 tmp = *(u32*)&cartrom[i];
+        u32 tmp = cart.ReadROM32(i);
         NDS::ARM9Write32(0x027FFE00+i, tmp);
     }
 
@@ -344,13 +360,13 @@ void NDS::SetupDirectBoot()
 
     for (u32 i = arm9start; i < header.ARM9Size; i+=4)
     {
-        u32 tmp = *(u32*)&cartrom[header.ARM9ROMOffset+i];
+        u32 tmp = cart.ReadROM32(header.ARM9ROMOffset+i);
         NDS::ARM9Write32(header.ARM9RAMAddress+i, tmp);
     }
 
     for (u32 i = 0; i < header.ARM7Size; i+=4)
     {
-        u32 tmp = *(u32*)&cartrom[header.ARM7ROMOffset+i];
+        u32 tmp = cart.ReadROM32(header.ARM7ROMOffset+i);
         NDS::ARM7Write32(header.ARM7RAMAddress+i, tmp);
     }
 
@@ -434,6 +450,10 @@ void NDS::Reset()
     RunningGame = false;
     LastSysClockCycles = 0;
 
+    NumFrames = 0;
+    NumLagFrames = 0;
+    LagFrameFlag = false;
+
     // BIOS files are now loaded by the frontend
 
     JIT.Reset();
@@ -464,6 +484,7 @@ void NDS::Reset()
     memset(MainRAM, 0, MainRAMMask + 1);
     memset(SharedWRAM, 0, 0x8000);
     memset(ARM7WRAM, 0, 0x10000);
+    DirtyPages.MarkAll();
 
     MapSharedWRAM(0);
 
@@ -525,6 +546,8 @@ void NDS::Reset()
         evt.Param = 0;
     }
     SchedListMask = 0;
+    SchedListParkedMask = 0;
+    SchedListCaughtUpMask = 0;
 
     KeyInput = 0x007F03FF;
     KeyCnt[0] = 0;
@@ -639,9 +662,11 @@ bool NDS::DoSavestate(Savestate* file)
         }
     }
 
-    file->VarArray(MainRAM, MainRAMMaxSize);
-    file->VarArray(SharedWRAM, SharedWRAMSize);
-    file->VarArray(ARM7WRAM, ARM7WRAMSize);
+    // code generated by the JIT writes memory without marking pages
+    DirtyPageTracker* tracker = IsJITEnabled() ? nullptr : &DirtyPages;
+    file->VarTracked(MainRAM, MainRAMMaxSize, tracker, DirtyRegion_MainRAM);
+    file->VarTracked(SharedWRAM, SharedWRAMSize, tracker, DirtyRegion_SharedWRAM);
+    file->VarTracked(ARM7WRAM, ARM7WRAMSize, tracker, DirtyRegion_ARM7WRAM);
 
     //file->VarArray(ARM9BIOS, 0x1000);
     //file->VarArray(ARM7BIOS, 0x4000);
@@ -675,7 +700,9 @@ bool NDS::DoSavestate(Savestate* file)
     file->Var16(&DivCnt);
     file->Var16(&SqrtCnt);
 
-    file->Var32(&CPUStop);
+    u32 cpustop = CPUStop;
+    file->Var32(&cpustop);
+    CPUStop = cpustop;
 
     for (int i = 0; i < 8; i++)
     {
@@ -700,6 +727,13 @@ bool NDS::DoSavestate(Savestate* file)
         file->Var32(&evt.Param);
     }
     file->Var32(&SchedListMask);
+    // parked events are saved as they are, running them here would make
+    // saving a state change the console's timing
+    if (file->IsAtLeastVersion(14, 1))
+        file->Var32(&SchedListParkedMask);
+    else
+        SchedListParkedMask = 0;
+    SchedListCaughtUpMask = 0;
     file->Var64(&ARM9Timestamp);
     file->Var64(&ARM9Target);
     file->Var64(&ARM7Timestamp);
@@ -756,10 +790,22 @@ bool NDS::DoSavestate(Savestate* file)
         SPU.SetPowerCnt(PowerControl7 & 0x0001);
         Wifi.SetPowerCnt(PowerControl7 & 0x0002);
 
+        // the state may come from a console running with event catch-up
+        if (!EventCatchUp && SchedListParkedMask)
+            CatchUpParkedEvents(true);
+
 #ifdef JIT_ENABLED
-        JIT.Reset();
+        // without the JIT there are no blocks to drop, and resetting
+        // its tables would make up most of the time spent loading
+        if (IsJITEnabled())
+            JIT.Reset();
 #endif
     }
+    else
+    {
+        // writes from now on come after this snapshot
+        DirtyPages.NextGeneration();
+    }
 
     file->Finish();
 
@@ -823,7 +869,8 @@ u64 NDS::NextTarget()
         mask >>= 1;
     }
 
-    u64 max = SysTimestamp + kMaxIterationCycles;
+    // the threaded ARM7 runs alongside the ARM9 for up to a whole slice
+    u64 max = SysTimestamp + (ARM7Threaded ? ARM7MaxSkew : kMaxIterationCycles);
 
     if (minEvent < max + kIterationCycleMargin)
         return minEvent;
@@ -834,6 +881,7 @@ u64 NDS::NextTarget()
 void NDS::RunSystem(u64 timestamp)
 {
     SysTimestamp = timestamp;
+    SchedListCaughtUpMask = 0;
 
     u32 mask = SchedListMask;
     for (int i = 0; i < Event_MAX; i++)
@@ -847,6 +895,7 @@ void NDS::RunSystem(u64 timestamp)
             {
                 SchedListMask &= ~(1<<i);
 
+                PROFILER_SCOPE(Profiler, Prof_EventBase + i);
                 EventFunc func = evt.Funcs[evt.FuncID];
                 func(evt.That, evt.Param);
             }
@@ -856,6 +905,54 @@ void NDS::RunSystem(u64 timestamp)
     }
 }
 
+void NDS::RunParkedEvent(u32 id, u64 timestamp)
+{
+    SchedEvent& evt = SchedList[id];
+
+    // replayed ticks reschedule themselves in the past, which would cut the
+    // current CPU slice short for no reason
+    u64 arm9target = ARM9Target;
+    u64 arm7target = ARM7Target;
+
+    // an event caught up earlier in this slice isn't parked anymore, but its
+    // ticks still don't split the slice, so they're run from here too
+    u32 pending = SchedListParkedMask | (SchedListMask & SchedListCaughtUpMask);
+    while ((pending & (1<<id)) && (evt.Timestamp <= timestamp))
+    {
+        SchedListParkedMask &= ~(1<<id);
+        SchedListMask &= ~(1<<id);
+
+        PROFILER_SCOPE(Profiler, Prof_EventBase + id);
+        EventFunc func = evt.Funcs[evt.FuncID];
+        func(evt.That, evt.Param);
+
+        pending = SchedListParkedMask | (SchedListMask & SchedListCaughtUpMask);
+    }
+
+    ARM9Target = arm9target;
+    ARM7Target = arm7target;
+
+    if (SchedListMask & (1<<id))
+        Reschedule(evt.Timestamp);
+}
+
+void NDS::CatchUpParkedEvents(bool unpark)
+{
+    for (int i = 0; i < Event_MAX; i++)
+    {
+        if (!(SchedListParkedMask & (1<<i)))
+            continue;
+
+        RunParkedEvent(i, SysTimestamp);
+
+        if (unpark && (SchedListParkedMask & (1<<i)))
+        {
+            SchedListParkedMask &= ~(1<<i);
+            SchedListMask |= (1<<i);
+        }
+    }
+}
+
 u64 NDS::NextTargetSleep()
 {
     u64 minEvent = UINT64_MAX;
@@ -920,6 +1017,10 @@ u32 NDS::RunFrame()
 {
     Current = this;
 
+#ifdef PROFILER_ENABLED
+    Profiler.BeginFrame(NumFrames);
+#endif
+
     FrameStartTimestamp = SysTimestamp;
 
     GPU.TotalScanlines = 0;
@@ -932,6 +1033,11 @@ u32 NDS::RunFrame()
 
         if (CPUStop & CPUStop_Sleep)
         {
+            // sleep mode only runs the RTC and keeps the other events frozen,
+            // so go back to regular scheduling for it
+            if (SchedListParkedMask)
+                CatchUpParkedEvents(true);
+
             // we are running in sleep mode
             // we still need to run the RTC during this mode
             // we also keep outputting audio, so that frontends using audio sync don't skyrocket to 1000+FPS
@@ -970,11 +1076,27 @@ u32 NDS::RunFrame()
             }
             CPUStop &= ~CPUStop_Wakeup;
 
+            if constexpr (cpuMode == CPUExecuteMode::InterpreterThreadedARM7)
+            {
+                ARM7FrameDone.store(false, std::memory_order_release);
+                Platform::Semaphore_Post(Sema_ARM7FrameStart);
+            }
+
             while (Running && GPU.TotalScanlines==0)
             {
                 u64 target = NextTarget();
-                ARM9Target = target << ARM9ClockShift;
-                CurCPU = 0;
+                if constexpr (cpuMode == CPUExecuteMode::InterpreterThreadedARM7)
+                {
+                    StartARM9Slice(target);
+                }
+                else
+                {
+                    ARM9Target = target << ARM9ClockShift;
+                    CurCPU = 0;
+                }
+#ifdef PROFILER_ENABLED
+                u64 profstart = ARM9Timestamp;
+#endif
 
                 if (CPUStop & CPUStop_GXStall)
                 {
@@ -985,6 +1107,7 @@ u32 NDS::RunFrame()
                 }
                 else if (CPUStop & CPUStop_DMA9)
                 {
+                    PROFILER_SCOPE(Profiler, Prof_DMA);
                     DMAs[0].Run();
                     if (!(CPUStop & CPUStop_GXStall)) DMAs[1].Run();
                     if (!(CPUStop & CPUStop_GXStall)) DMAs[2].Run();
@@ -994,40 +1117,70 @@ u32 NDS::RunFrame()
                         auto& dsi = dynamic_cast<melonDS::DSi&>(*this);
                         dsi.RunNDMAs(0);
                     }
+                    PROFILER_CYCLES(Profiler, Prof_DMA, (ARM9Timestamp - profstart) >> ARM9ClockShift);
                 }
                 else
                 {
+                    PROFILER_SCOPE(Profiler, Prof_ARM9);
                     ARM9.Execute<cpuMode>();
+                    PROFILER_CYCLES(Profiler, Prof_ARM9, (ARM9Timestamp - profstart) >> ARM9ClockShift);
                 }
 
-                RunTimers(0);
-                GPU.GPU3D.Run();
-
-                target = ARM9Timestamp >> ARM9ClockShift;
-                CurCPU = 1;
-
-                while (ARM7Timestamp < target)
                 {
-                    ARM7Target = target; // might be changed by a reschedule
+                    PROFILER_SCOPE(Profiler, Prof_Timers);
+                    RunTimers(0);
+                }
+                {
+                    PROFILER_SCOPE(Profiler, Prof_GPU3D);
+#ifdef PROFILER_ENABLED
+                    profstart = GPU.GPU3D.Timestamp;
+#endif
+                    GPU.GPU3D.Run();
+                    PROFILER_CYCLES(Profiler, Prof_GPU3D, GPU.GPU3D.Timestamp - profstart);
+                }
 
-                    if (CPUStop & CPUStop_DMA7)
+                {
+                    PROFILER_SCOPE(Profiler, Prof_ARM7);
+#ifdef PROFILER_ENABLED
+                    profstart = ARM7Timestamp;
+#endif
+                    if constexpr (cpuMode == CPUExecuteMode::InterpreterThreadedARM7)
                     {
-                        DMAs[4].Run();
-                        DMAs[5].Run();
-                        DMAs[6].Run();
-                        DMAs[7].Run();
-                        if (ConsoleType == 1)
-                        {
-                            auto& dsi = dynamic_cast<melonDS::DSi&>(*this);
-                            dsi.RunNDMAs(1);
-                        }
+                        // the ARM7 is caught up by its thread
+                        FinishARM9Slice();
+                        target = ARM9SliceEnd;
+                        ApplyARM7PendingChanges();
                     }
                     else
                     {
-                        ARM7.Execute<cpuMode>();
-                    }
+                        target = ARM9Timestamp >> ARM9ClockShift;
+                        CurCPU = 1;
 
-                    RunTimers(1);
+                        while (ARM7Timestamp < target)
+                        {
+                            ARM7Target = target; // might be changed by a reschedule
+
+                            if (CPUStop & CPUStop_DMA7)
+                            {
+                                DMAs[4].Run();
+                                DMAs[5].Run();
+                                DMAs[6].Run();
+                                DMAs[7].Run();
+                                if (ConsoleType == 1)
+                                {
+                                    auto& dsi = dynamic_cast<melonDS::DSi&>(*this);
+                                    dsi.RunNDMAs(1);
+                                }
+                            }
+                            else
+                            {
+                                ARM7.Execute<cpuMode>();
+                            }
+
+                            RunTimers(1);
+                        }
+                    }
+                    PROFILER_CYCLES(Profiler, Prof_ARM7, ARM7Timestamp - profstart);
                 }
 
                 RunSystem(target);
@@ -1037,6 +1190,12 @@ u32 NDS::RunFrame()
                     break;
                 }
             }
+
+            if constexpr (cpuMode == CPUExecuteMode::InterpreterThreadedARM7)
+            {
+                ARM7FrameDone.store(true, std::memory_order_release);
+                WakeARM7();
+            }
         }
 
         if (GPU.TotalScanlines == 0)
@@ -1052,6 +1211,10 @@ u32 NDS::RunFrame()
         break;
     }
 
+    // Bring parked devices up to date, the frontend may look at them between frames
+    if (SchedListParkedMask)
+        CatchUpParkedEvents(false);
+
     // Ensure the last audio samples produced for this frame are available to the frontend immediately
     SPU.BufferAudio();
 
@@ -1061,6 +1224,10 @@ u32 NDS::RunFrame()
     if (LagFrameFlag)
         NumLagFrames++;
 
+#ifdef PROFILER_ENABLED
+    Profiler.EndFrame();
+#endif
+
     if (Running)
         return GPU.TotalScanlines;
     else
@@ -1072,6 +1239,8 @@ u32 NDS::RunFrame()
 #ifdef JIT_ENABLED
     if (EnableJIT)
         return RunFrame<CPUExecuteMode::JIT>();
+    else if (Lockstep)
+        return RunFrame<CPUExecuteMode::InterpreterLockstep>();
     else
 #endif
 #ifdef GDBSTUB_ENABLED
@@ -1080,6 +1249,11 @@ u32 NDS::RunFrame()
         return RunFrame<CPUExecuteMode::InterpreterGDB>();
     } else
 #endif
+    if (ARM7Threaded)
+    {
+        return RunFrame<CPUExecuteMode::InterpreterThreadedARM7>();
+    }
+    else
     {
         return RunFrame<CPUExecuteMode::Interpreter>();
     }
@@ -1152,6 +1326,392 @@ void NDS::ScheduleEvent(u32 id, bool periodic, s32 delay, u32 funcid, u32 param)
 void NDS::CancelEvent(u32 id)
 {
     SchedListMask &= ~(1<<id);
+    SchedListParkedMask &= ~(1<<id);
+}
+
+void NDS::ParkEvent(u32 id)
+{
+    if (!EventCatchUp) return;
+    if (CPUStop & CPUStop_Sleep) return;
+    if (!(SchedListMask & (1<<id))) return;
+
+    SchedListMask &= ~(1<<id);
+    SchedListParkedMask |= (1<<id);
+}
+
+void NDS::CatchUpEvent(u32 id)
+{
+    if (!((SchedListParkedMask | SchedListCaughtUpMask) & (1<<id)))
+        return;
+
+    u64 now;
+    if (CurCPU == 0)
+        now = ARM9Timestamp >> ARM9ClockShift;
+    else
+        now = ARM7Timestamp;
+
+    RunParkedEvent(id, now);
+
+    // the device is about to be accessed, so it goes back to regular scheduling
+    // its next tick will park it again if it's still idle
+    if (SchedListParkedMask & (1<<id))
+    {
+        SchedListParkedMask &= ~(1<<id);
+        SchedListMask |= (1<<id);
+        Reschedule(SchedList[id].Timestamp);
+    }
+    if (SchedListMask & (1<<id))
+        SchedListCaughtUpMask |= (1<<id);
+}
+
+void NDS::SetEventCatchUp(bool enable)
+{
+    if (!enable && SchedListParkedMask)
+        CatchUpParkedEvents(true);
+
+    EventCatchUp = enable;
+}
+
+
+// spin for a bit first: slices are short, and the other side is usually done
+// within a few microseconds. past that, sleep until the other side wakes this
+// one up, so that a CPU thread which has to wait long doesn't keep a core busy.
+// the sleep is bounded in case the other side changed something it doesn't wake for
+template <typename F>
+static void SpinWait(F&& cond, std::atomic<bool>& sleeping, Platform::Semaphore* wake)
+{
+    for (int i = 0; i < 4096; i++)
+    {
+        if (cond()) return;
+    }
+    for (int i = 0; i < 64; i++)
+    {
+        if (cond()) return;
+        std::this_thread::yield();
+    }
+
+    for (;;)
+    {
+        // pairs with the fence in WakeARM7()/WakeARM9(): either the condition
+        // is seen as met here, or the other side sees this one sleeping
+        sleeping.store(true, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (cond()) break;
+
+        Platform::Semaphore_TryWait(wake, 1);
+    }
+    sleeping.store(false, std::memory_order_relaxed);
+}
+
+void NDS::WakeARM7()
+{
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (ARM7Sleeping.load(std::memory_order_relaxed))
+        Platform::Semaphore_Post(Sema_ARM7Wake);
+}
+
+void NDS::WakeARM9()
+{
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (ARM9Sleeping.load(std::memory_order_relaxed))
+        Platform::Semaphore_Post(Sema_ARM9Wake);
+}
+
+void NDS::SetARM7MaxSkew(u32 cycles)
+{
+    ARM7MaxSkew = std::clamp(cycles, (u32)kMaxIterationCycles, 16384u);
+}
+
+bool NDS::SetARM7Threaded(bool enable)
+{
+    if (enable)
+    {
+        if (ConsoleType != 0)
+        {
+            Log(LogLevel::Warn, "Threaded ARM7 is not supported in DSi mode\n");
+            return false;
+        }
+#ifdef JIT_ENABLED
+        if (EnableJIT)
+        {
+            Log(LogLevel::Warn, "Threaded ARM7 is not supported with the JIT\n");
+            return false;
+        }
+#endif
+#ifdef GDBSTUB_ENABLED
+        if (EnableGDBStub)
+        {
+            Log(LogLevel::Warn, "Threaded ARM7 is not supported with the GDB stub\n");
+            return false;
+        }
+#endif
+
+        if (std::thread::hardware_concurrency() == 1)
+            Log(LogLevel::Warn, "Threaded ARM7 enabled on a single-core host, expect it to be slower\n");
+
+        if (!ARM7Thread)
+        {
+            ARM7ThreadQuit = false;
+            ARM7FrameDone = true;
+            Sema_ARM7FrameStart = Platform::Semaphore_Create();
+            Sema_ARM7Wake = Platform::Semaphore_Create();
+            Sema_ARM9Wake = Platform::Semaphore_Create();
+            ARM7Thread = Platform::Thread_Create([this]() { ARM7ThreadFunc(); });
+        }
+    }
+    else
+    {
+        StopARM7Thread();
+    }
+
+    ARM7Threaded = enable;
+    return true;
+}
+
+void NDS::StopARM7Thread()
+{
+    if (!ARM7Thread) return;
+
+    ARM7ThreadQuit = true;
+    ARM7FrameDone = true;
+    Platform::Semaphore_Post(Sema_ARM7FrameStart);
+
+    Platform::Thread_Wait(ARM7Thread);
+    Platform::Thread_Free(ARM7Thread);
+    ARM7Thread = nullptr;
+
+    Platform::Semaphore_Free(Sema_ARM7FrameStart);
+    Platform::Semaphore_Free(Sema_ARM7Wake);
+    Platform::Semaphore_Free(Sema_ARM9Wake);
+    Sema_ARM7FrameStart = nullptr;
+    Sema_ARM7Wake = nullptr;
+    Sema_ARM9Wake = nullptr;
+
+    ARM7Threaded = false;
+}
+
+void NDS::ARM7ThreadFunc()
+{
+    OnARM7Thread = true;
+    u32 gen = ARM7SliceGen.load(std::memory_order_acquire);
+
+    for (;;)
+    {
+        Platform::Semaphore_Wait(Sema_ARM7FrameStart);
+        if (ARM7ThreadQuit) break;
+
+        Current = this;
+
+        for (;;)
+        {
+            SpinWait([&]() {
+                return ARM7SliceGen.load(std::memory_order_acquire) != gen
+                    || ARM7FrameDone.load(std::memory_order_acquire);
+            }, ARM7Sleeping, Sema_ARM7Wake);
+
+            u32 newgen = ARM7SliceGen.load(std::memory_order_acquire);
+            if (newgen == gen)
+                break; // end of frame
+
+            gen = newgen;
+            ARM7SliceStart = ARM7Timestamp;
+            ARM7SliceHalted = 0;
+            ARM7SliceCounted = false;
+            RunARM7Slice();
+            ARM7ThreadCycles += ARM7Timestamp - ARM7SliceStart;
+            ARM7ThreadHaltedCycles += ARM7SliceHalted;
+            ARM7SliceDoneGen.store(gen, std::memory_order_release);
+            WakeARM9();
+        }
+    }
+}
+
+void NDS::StartARM9Slice(u64 target)
+{
+    ARM9Target = target << ARM9ClockShift;
+    CurCPU = 0;
+
+    ARM9SliceRunning = true;
+    ARM9SliceDone.store(false, std::memory_order_relaxed);
+    NumARM7IRQEvents.store(0, std::memory_order_relaxed);
+    ARM7IRQEventsDone = 0;
+
+    ARM9Progress.store(ARM9Timestamp >> ARM9ClockShift, std::memory_order_relaxed);
+    ARM7KnownProgress = 0;
+    ARM7SliceDMA = (CPUStop & CPUStop_DMA7) != 0;
+    ARM7SyncPending = true;
+
+    ARM7SliceGen.fetch_add(1, std::memory_order_release);
+    WakeARM7();
+}
+
+void NDS::FinishARM9Slice()
+{
+    ARM9SliceRunning = false;
+    ARM9SliceEnd = ARM9Timestamp >> ARM9ClockShift;
+    CurCPU = 1;
+    ARM9SliceDone.store(true, std::memory_order_release);
+    WakeARM7();
+
+    u32 gen = ARM7SliceGen.load(std::memory_order_relaxed);
+    SpinWait([&]() { return ARM7SliceDoneGen.load(std::memory_order_acquire) == gen; }, ARM9Sleeping, Sema_ARM9Wake);
+}
+
+// runs the ARM7 on its thread up to where the ARM9 ends its slice, stopping wherever
+// the ARM9 raised or cleared one of its IRQs. this starts while the ARM9 is still
+// running, and doesn't depend on how far the ARM9 got by the time it looks
+void NDS::RunARM7Slice()
+{
+    // DMA transfers go through shared memory
+    if (ARM7SyncPending && ARM7SliceDMA)
+        SyncARM7ToARM9();
+
+    for (;;)
+    {
+        // everything the ARM9 did up to now has to be known
+        if (ARM7SyncPending && (ARM7Timestamp >= ARM7KnownProgress))
+        {
+            SpinWait([&]() {
+                ARM7KnownProgress = ARM9Progress.load(std::memory_order_acquire);
+                return ARM7KnownProgress > ARM7Timestamp || ARM9SliceDone.load(std::memory_order_acquire);
+            }, ARM7Sleeping, Sema_ARM7Wake);
+        }
+
+        RunARM7IRQEvents(ARM7Timestamp);
+
+        bool done = ARM9SliceDone.load(std::memory_order_acquire);
+        if (done && (ARM7Timestamp >= ARM9SliceEnd))
+            break;
+
+        // run up to the next IRQ or the end of the slice, if either is known yet
+        u32 numevents = NumARM7IRQEvents.load(std::memory_order_acquire);
+        ARM7TargetOpen = false;
+        if (ARM7IRQEventsDone < numevents)
+            ARM7Target = ARM7IRQEvents[ARM7IRQEventsDone].Timestamp;
+        else if (done)
+            ARM7Target = ARM9SliceEnd;
+        else
+        {
+            ARM7Target = UINT64_MAX;
+            ARM7TargetOpen = true;
+        }
+
+        if (!ARM7SyncPending && (CPUStop & CPUStop_DMA7))
+        {
+            DMAs[4].Run();
+            DMAs[5].Run();
+            DMAs[6].Run();
+            DMAs[7].Run();
+            if (ConsoleType == 1)
+            {
+                auto& dsi = dynamic_cast<melonDS::DSi&>(*this);
+                dsi.RunNDMAs(1);
+            }
+        }
+        else
+        {
+            ARM7.Execute<CPUExecuteMode::InterpreterThreadedARM7>();
+        }
+
+        RunTimers(1);
+    }
+
+    CountARM7Concurrent();
+    ARM7SyncPending = false;
+}
+
+void NDS::QueueARM7IRQ(u32 irq, bool set)
+{
+    u32 num = NumARM7IRQEvents.load(std::memory_order_relaxed);
+    ARM7IRQEvents[num] = {ARM9Timestamp >> ARM9ClockShift, (u8)irq, set};
+    NumARM7IRQEvents.store(num + 1, std::memory_order_release);
+
+    // a single instruction raises a few at most, end the slice well before running out
+    if (num + 1 >= kMaxARM7IRQEvents - 64)
+        ARM9Target = ARM9Timestamp;
+}
+
+void NDS::RunARM7IRQEvents(u64 timestamp)
+{
+    u32 num = NumARM7IRQEvents.load(std::memory_order_acquire);
+    while (ARM7IRQEventsDone < num)
+    {
+        ARM7IRQEvent& evt = ARM7IRQEvents[ARM7IRQEventsDone];
+        if (evt.Timestamp > timestamp)
+            break;
+
+        if (evt.Set)
+            SetIRQ(1, evt.IRQ);
+        else
+            ClearIRQ(1, evt.IRQ);
+        ARM7IRQEventsDone++;
+    }
+}
+
+void NDS::ApplyARM7PendingChanges()
+{
+    if (!ARM7PendingChanges)
+        return;
+
+    if (ARM7PendingChanges & ARM7Pending_SharedWRAM)
+    {
+        JIT.Memory.RemapSWRAM();
+        MapARM7SharedWRAM();
+    }
+    if (ARM7PendingChanges & ARM7Pending_GBASlotTimings)
+        SetARM7GBASlotTimings();
+
+    ARM7PendingChanges = 0;
+}
+
+// counts where the ARM7 first needed the ARM9 to be done with the slice. unlike the
+// point where it finds out it is, this doesn't depend on the host
+void NDS::CountARM7Concurrent()
+{
+    if (ARM7SliceCounted)
+        return;
+
+    ARM7SliceCounted = true;
+    ARM7ConcurrentCycles += ARM7Timestamp - ARM7SliceStart - ARM7SliceHalted;
+}
+
+void NDS::WaitForARM9(bool needtarget)
+{
+    SpinWait([&]() {
+        u64 progress = ARM9Progress.load(std::memory_order_acquire);
+        bool done = ARM9SliceDone.load(std::memory_order_acquire);
+        u32 numevents = NumARM7IRQEvents.load(std::memory_order_acquire);
+
+        if (ARM7IRQEventsDone < numevents)
+        {
+            ARM7Target = ARM7IRQEvents[ARM7IRQEventsDone].Timestamp;
+            ARM7TargetOpen = false;
+            return true;
+        }
+        if (done)
+        {
+            if (needtarget)
+                CountARM7Concurrent();
+            ARM7Target = ARM9SliceEnd;
+            ARM7TargetOpen = false;
+            return true;
+        }
+
+        ARM7KnownProgress = progress;
+        return !needtarget && (progress > ARM7Timestamp);
+    }, ARM7Sleeping, Sema_ARM7Wake);
+}
+
+void NDS::SyncARM7ToARM9()
+{
+    // from here on, the ARM9 is done with the slice and the ARM7 runs alone
+    CountARM7Concurrent();
+    ARM7SyncPending = false;
+
+    SpinWait([&]() { return ARM9SliceDone.load(std::memory_order_acquire); }, ARM7Sleeping, Sema_ARM7Wake);
+
+    if (ARM7TargetOpen)
+        WaitForARM9(true);
 }
 
 
@@ -1255,27 +1815,57 @@ void NDS::MapSharedWRAM(u8 val)
     case 0:
         SWRAM_ARM9.Mem = &SharedWRAM[0];
         SWRAM_ARM9.Mask = 0x7FFF;
-        SWRAM_ARM7.Mem = NULL;
-        SWRAM_ARM7.Mask = 0;
         break;
 
     case 1:
         SWRAM_ARM9.Mem = &SharedWRAM[0x4000];
         SWRAM_ARM9.Mask = 0x3FFF;
-        SWRAM_ARM7.Mem = &SharedWRAM[0];
-        SWRAM_ARM7.Mask = 0x3FFF;
         break;
 
     case 2:
         SWRAM_ARM9.Mem = &SharedWRAM[0];
         SWRAM_ARM9.Mask = 0x3FFF;
-        SWRAM_ARM7.Mem = &SharedWRAM[0x4000];
-        SWRAM_ARM7.Mask = 0x3FFF;
         break;
 
     case 3:
         SWRAM_ARM9.Mem = NULL;
         SWRAM_ARM9.Mask = 0;
+        break;
+    }
+
+    if (ARM7Threaded && ARM9SliceRunning)
+    {
+        // the ARM7 keeps the old mapping until it's through with the slice,
+        // and the ARM9 stops right away so they never get the same bank at once
+        ARM7PendingChanges |= ARM7Pending_SharedWRAM;
+        ARM9Target = ARM9Timestamp;
+    }
+    else
+    {
+        MapARM7SharedWRAM();
+    }
+}
+
+void NDS::MapARM7SharedWRAM()
+{
+    switch (WRAMCnt & 0x3)
+    {
+    case 0:
+        SWRAM_ARM7.Mem = NULL;
+        SWRAM_ARM7.Mask = 0;
+        break;
+
+    case 1:
+        SWRAM_ARM7.Mem = &SharedWRAM[0];
+        SWRAM_ARM7.Mask = 0x3FFF;
+        break;
+
+    case 2:
+        SWRAM_ARM7.Mem = &SharedWRAM[0x4000];
+        SWRAM_ARM7.Mask = 0x3FFF;
+        break;
+
+    case 3:
         SWRAM_ARM7.Mem = &SharedWRAM[0];
         SWRAM_ARM7.Mask = 0x7FFF;
         break;
@@ -1325,19 +1915,19 @@ void NDS::SetGBASlotTimings()
     {
         SetARM9RegionTimings(0x08000, 0x0A000, Mem9_GBAROM, 16, romN, romS);
         SetARM9RegionTimings(0x0A000, 0x0B000, Mem9_GBARAM, 8, ramN, ramN);
-
-        SetARM7RegionTimings(0x08000, 0x0A000, 0, 32, 1, 1);
-        SetARM7RegionTimings(0x0A000, 0x0B000, 0, 32, 1, 1);
     }
     else
     {
         SetARM9RegionTimings(0x08000, 0x0A000, 0, 32, 1, 1);
         SetARM9RegionTimings(0x0A000, 0x0B000, 0, 32, 1, 1);
-
-        SetARM7RegionTimings(0x08000, 0x0A000, Mem7_GBAROM, 16, romN, romS);
-        SetARM7RegionTimings(0x0A000, 0x0B000, Mem7_GBARAM, 8, ramN, ramN);
     }
 
+    // the threaded ARM7 gets its side once it's through with the slice
+    if (ARM7Threaded && ARM9SliceRunning)
+        ARM7PendingChanges |= ARM7Pending_GBASlotTimings;
+    else
+        SetARM7GBASlotTimings();
+
     // this open-bus implementation is a rough way of simulating the way values
     // lingering on the bus decay after a while, which is visible at higher waitstates
     // for example, the Cartridge Construction Kit relies on this to determine that
@@ -1346,6 +1936,28 @@ void NDS::SetGBASlotTimings()
     GBACartSlot.SetOpenBusDecay(openbus[(curcnt>>2) & 0x3]);
 }
 
+void NDS::SetARM7GBASlotTimings()
+{
+    const int ntimings[4] = {10, 8, 6, 18};
+
+    u16 curcpu = (ExMemCnt[0] >> 7) & 0x1;
+    u16 curcnt = ExMemCnt[curcpu];
+    int ramN = ntimings[curcnt & 0x3];
+    int romN = ntimings[(curcnt>>2) & 0x3];
+    int romS = (curcnt & 0x10) ? 4 : 6;
+
+    if (curcpu == 0)
+    {
+        SetARM7RegionTimings(0x08000, 0x0A000, 0, 32, 1, 1);
+        SetARM7RegionTimings(0x0A000, 0x0B000, 0, 32, 1, 1);
+    }
+    else
+    {
+        SetARM7RegionTimings(0x08000, 0x0A000, Mem7_GBAROM, 16, romN, romS);
+        SetARM7RegionTimings(0x0A000, 0x0B000, Mem7_GBARAM, 8, ramN, ramN);
+    }
+}
+
 
 void NDS::UpdateIRQ(u32 cpu)
 {
@@ -1365,6 +1977,12 @@ void NDS::UpdateIRQ(u32 cpu)
 
 void NDS::SetIRQ(u32 cpu, u32 irq)
 {
+    if (ARM7Threaded && (cpu == 1) && !OnARM7Thread && ARM9SliceRunning)
+    {
+        QueueARM7IRQ(irq, true);
+        return;
+    }
+
     IF[cpu] |= (1 << irq);
     UpdateIRQ(cpu);
 
@@ -1381,6 +1999,12 @@ void NDS::SetIRQ(u32 cpu, u32 irq)
 
 void NDS::ClearIRQ(u32 cpu, u32 irq)
 {
+    if (ARM7Threaded && (cpu == 1) && !OnARM7Thread && ARM9SliceRunning)
+    {
+        QueueARM7IRQ(irq, false);
+        return;
+    }
+
     IF[cpu] &= ~(1 << irq);
     UpdateIRQ(cpu);
 }
@@ -2112,6 +2736,7 @@ void NDS::ARM9Write8(u32 addr, u8 val)
     case 0x02000000:
         JIT.CheckAndInvalidate<0, ARMJIT_Memory::memregion_MainRAM>(addr);
         *(u8*)&MainRAM[addr & MainRAMMask] = val;
+        DirtyPages.Mark(DirtyRegion_MainRAM, addr & MainRAMMask);
         return;
 
     case 0x03000000:
@@ -2119,6 +2744,7 @@ void NDS::ARM9Write8(u32 addr, u8 val)
         {
             JIT.CheckAndInvalidate<0, ARMJIT_Memory::memregion_SharedWRAM>(addr);
             *(u8*)&SWRAM_ARM9.Mem[addr & SWRAM_ARM9.Mask] = val;
+            DirtyPages.Mark(DirtyRegion_SharedWRAM, (SWRAM_ARM9.Mem - SharedWRAM) + (addr & SWRAM_ARM9.Mask));
         }
         return;
 
@@ -2153,6 +2779,7 @@ void NDS::ARM9Write16(u32 addr, u16 val)
     case 0x02000000:
         JIT.CheckAndInvalidate<0, ARMJIT_Memory::memregion_MainRAM>(addr);
         *(u16*)&MainRAM[addr & MainRAMMask] = val;
+        DirtyPages.Mark(DirtyRegion_MainRAM, addr & MainRAMMask);
         return;
 
     case 0x03000000:
@@ -2160,6 +2787,7 @@ void NDS::ARM9Write16(u32 addr, u16 val)
         {
             JIT.CheckAndInvalidate<0, ARMJIT_Memory::memregion_SharedWRAM>(addr);
             *(u16*)&SWRAM_ARM9.Mem[addr & SWRAM_ARM9.Mask] = val;
+            DirtyPages.Mark(DirtyRegion_SharedWRAM, (SWRAM_ARM9.Mem - SharedWRAM) + (addr & SWRAM_ARM9.Mask));
         }
         return;
 
@@ -2213,6 +2841,7 @@ void NDS::ARM9Write32(u32 addr, u32 val)
     case 0x02000000:
         JIT.CheckAndInvalidate<0, ARMJIT_Memory::memregion_MainRAM>(addr);
         *(u32*)&MainRAM[addr & MainRAMMask] = val;
+        DirtyPages.Mark(DirtyRegion_MainRAM, addr & MainRAMMask);
         return ;
 
     case 0x03000000:
@@ -2220,6 +2849,7 @@ void NDS::ARM9Write32(u32 addr, u32 val)
         {
             JIT.CheckAndInvalidate<0, ARMJIT_Memory::memregion_SharedWRAM>(addr);
             *(u32*)&SWRAM_ARM9.Mem[addr & SWRAM_ARM9.Mask] = val;
+            DirtyPages.Mark(DirtyRegion_SharedWRAM, (SWRAM_ARM9.Mem - SharedWRAM) + (addr & SWRAM_ARM9.Mask));
         }
         return;
 
@@ -2508,6 +3138,7 @@ void NDS::ARM7Write8(u32 addr, u8 val)
     case 0x02800000:
         JIT.CheckAndInvalidate<1, ARMJIT_Memory::memregion_MainRAM>(addr);
         *(u8*)&MainRAM[addr & MainRAMMask] = val;
+        DirtyPages.Mark(DirtyRegion_MainRAM, addr & MainRAMMask);
         return;
 
     case 0x03000000:
@@ -2515,18 +3146,21 @@ void NDS::ARM7Write8(u32 addr, u8 val)
         {
             JIT.CheckAndInvalidate<1, ARMJIT_Memory::memregion_SharedWRAM>(addr);
             *(u8*)&SWRAM_ARM7.Mem[addr & SWRAM_ARM7.Mask] = val;
+            DirtyPages.Mark(DirtyRegion_SharedWRAM, (SWRAM_ARM7.Mem - SharedWRAM) + (addr & SWRAM_ARM7.Mask));
             return;
         }
         else
         {
             JIT.CheckAndInvalidate<1, ARMJIT_Memory::memregion_WRAM7>(addr);
             *(u8*)&ARM7WRAM[addr & (ARM7WRAMSize - 1)] = val;
+            DirtyPages.Mark(DirtyRegion_ARM7WRAM, addr & (ARM7WRAMSize - 1));
             return;
         }
 
     case 0x03800000:
         JIT.CheckAndInvalidate<1, ARMJIT_Memory::memregion_WRAM7>(addr);
         *(u8*)&ARM7WRAM[addr & (ARM7WRAMSize - 1)] = val;
+        DirtyPages.Mark(DirtyRegion_ARM7WRAM, addr & (ARM7WRAMSize - 1));
         return;
 
     case 0x04000000:
@@ -2567,6 +3201,7 @@ void NDS::ARM7Write16(u32 addr, u16 val)
     case 0x02800000:
         JIT.CheckAndInvalidate<1, ARMJIT_Memory::memregion_MainRAM>(addr);
         *(u16*)&MainRAM[addr & MainRAMMask] = val;
+        DirtyPages.Mark(DirtyRegion_MainRAM, addr & MainRAMMask);
         return;
 
     case 0x03000000:
@@ -2574,18 +3209,21 @@ void NDS::ARM7Write16(u32 addr, u16 val)
         {
             JIT.CheckAndInvalidate<1, ARMJIT_Memory::memregion_SharedWRAM>(addr);
             *(u16*)&SWRAM_ARM7.Mem[addr & SWRAM_ARM7.Mask] = val;
+            DirtyPages.Mark(DirtyRegion_SharedWRAM, (SWRAM_ARM7.Mem - SharedWRAM) + (addr & SWRAM_ARM7.Mask));
             return;
         }
         else
         {
             JIT.CheckAndInvalidate<1, ARMJIT_Memory::memregion_WRAM7>(addr);
             *(u16*)&ARM7WRAM[addr & (ARM7WRAMSize - 1)] = val;
+            DirtyPages.Mark(DirtyRegion_ARM7WRAM, addr & (ARM7WRAMSize - 1));
             return;
         }
 
     case 0x03800000:
         JIT.CheckAndInvalidate<1, ARMJIT_Memory::memregion_WRAM7>(addr);
         *(u16*)&ARM7WRAM[addr & (ARM7WRAMSize - 1)] = val;
+        DirtyPages.Mark(DirtyRegion_ARM7WRAM, addr & (ARM7WRAMSize - 1));
         return;
 
     case 0x04000000:
@@ -2637,6 +3275,7 @@ void NDS::ARM7Write32(u32 addr, u32 val)
     case 0x02800000:
         JIT.CheckAndInvalidate<1, ARMJIT_Memory::memregion_MainRAM>(addr);
         *(u32*)&MainRAM[addr & MainRAMMask] = val;
+        DirtyPages.Mark(DirtyRegion_MainRAM, addr & MainRAMMask);
         return;
 
     case 0x03000000:
@@ -2644,18 +3283,21 @@ void NDS::ARM7Write32(u32 addr, u32 val)
         {
             JIT.CheckAndInvalidate<1, ARMJIT_Memory::memregion_SharedWRAM>(addr);
             *(u32*)&SWRAM_ARM7.Mem[addr & SWRAM_ARM7.Mask] = val;
+            DirtyPages.Mark(DirtyRegion_SharedWRAM, (SWRAM_ARM7.Mem - SharedWRAM) + (addr & SWRAM_ARM7.Mask));
             return;
         }
         else
         {
             JIT.CheckAndInvalidate<1, ARMJIT_Memory::memregion_WRAM7>(addr);
             *(u32*)&ARM7WRAM[addr & (ARM7WRAMSize - 1)] = val;
+            DirtyPages.Mark(DirtyRegion_ARM7WRAM, addr & (ARM7WRAMSize - 1));
             return;
         }
 
     case 0x03800000:
         JIT.CheckAndInvalidate<1, ARMJIT_Memory::memregion_WRAM7>(addr);
         *(u32*)&ARM7WRAM[addr & (ARM7WRAMSize - 1)] = val;
+        DirtyPages.Mark(DirtyRegion_ARM7WRAM, addr & (ARM7WRAMSize - 1));
         return;
 
     case 0x04000000:
@@ -4060,6 +4702,7 @@ void NDS::ARM7IOWrite8(u32 addr, u8 val)
         RCnt = (RCnt & 0xFF00) | val;
         return;
     case 0x04000135:
+        RTC.CatchUp(); // RCNT routes the RTC IRQ
         RCnt = (RCnt & 0x00FF) | (val << 8);
         return;
 
@@ -4177,7 +4820,7 @@ void NDS::ARM7IOWrite16(u32 addr, u16 val)
     case 0x0400010E: TimerStart(7, val); return;
 
     case 0x04000132: KeyCnt[1] = val; return;
-    case 0x04000134: RCnt = val; return;
+    case 0x04000134: RTC.CatchUp(); RCnt = val; return;
 
     case 0x04000138: RTC.Write(val, false); return;
 
@@ -4355,7 +4998,7 @@ void NDS::ARM7IOWrite32(u32 addr, u32 val)
         return;
 
     case 0x04000130: KeyCnt[1] = val >> 16; return;
-    case 0x04000134: RCnt = val & 0xFFFF; return;
+    case 0x04000134: RTC.CatchUp(); RCnt = val & 0xFFFF; return;
     case 0x04000138: RTC.Write(val & 0xFFFF, false); return;
 
     case 0x04000180:
@@ -19,6 +19,8 @@
 #ifndef NDS_H
 #define NDS_H
 
+#include <array>
+#include <atomic>
 #include <memory>
 #include <string>
 #include <optional>
@@ -38,11 +40,13 @@
 #include "GPU.h"
 #include "ARMJIT.h"
 #include "MemRegion.h"
+#include "DirtyPages.h"
 #include "ARMJIT_Memory.h"
 #include "ARM.h"
 #include "CRC32.h"
 #include "DMA.h"
 #include "FreeBIOS.h"
+#include "Profiler.h"
 
 // when touching the main loop/timing code, pls test a lot of shit
 // with this enabled, to make sure it doesn't desync
@@ -234,6 +238,9 @@ class RTC;
 class Wifi;
 
 class AREngine;
+#ifdef JIT_ENABLED
+class JITLockstep;
+#endif
 class GPU;
 class ARMJIT;
 
@@ -275,7 +282,8 @@ public: // TODO: Encapsulate the rest of these members
     u32 IF2;
     Timer Timers[8];
 
-    u32 CPUStop;
+    // the ARM9 thread changes it while the threaded ARM7 checks its DMA bits
+    std::atomic<u32> CPUStop = 0;
 
     u16 PowerControl9;
 
@@ -307,6 +315,15 @@ public: // TODO: Encapsulate the rest of these members
     u32 KeyInput;
     u16 RCnt;
 
+    // pages of main RAM, WRAM and VRAM written since earlier snapshots,
+    // anything writing guest memory without going through the handlers has to mark it
+    DirtyPageTracker DirtyPages;
+
+#ifdef JIT_ENABLED
+    // set while this console takes part in a JIT lockstep check, see JITLockstep.h
+    JITLockstep* Lockstep = nullptr;
+#endif
+
     // JIT MUST be declared before all other component objects,
     // as they'll need the memory that it allocates in its constructor!
     // (Reminder: C++ fields are initialized in the order they're declared,
@@ -327,6 +344,11 @@ public: // TODO: Encapsulate the rest of these members
     const u32 ARM7WRAMSize = 0x10000;
     u8* ARM7WRAM;
 
+#ifdef PROFILER_ENABLED
+    // per-subsystem time accounting, see Profiler.h
+    melonDS::Profiler Profiler;
+#endif
+
     virtual void Reset();
     void Start();
 
@@ -404,6 +426,14 @@ public: // TODO: Encapsulate the rest of these members
 
     u32 RunFrame();
 
+    /// @return Time and cycle accounting for the last frame run by RunFrame,
+    /// or \c nullptr if this build doesn't include the profiler.
+#ifdef PROFILER_ENABLED
+    [[nodiscard]] const FrameProfile* GetFrameProfile() const noexcept { return &Profiler.GetLastFrame(); }
+#else
+    [[nodiscard]] const FrameProfile* GetFrameProfile() const noexcept { return nullptr; }
+#endif
+
     bool IsRunning() const noexcept { return Running; }
 
     void TouchScreen(u16 x, u16 y);
@@ -419,6 +449,94 @@ public: // TODO: Encapsulate the rest of these members
     void ScheduleEvent(u32 id, bool periodic, s32 delay, u32 funcid, u32 param);
     void CancelEvent(u32 id);
 
+    // lazy catch-up for periodic device events
+    // a device whose upcoming ticks don't depend on anything outside of it (ie. an idle SPU)
+    // can park its event right after rescheduling it. parked events no longer split the
+    // scheduler loop; instead the device calls CatchUpEvent() before its state is observed
+    // or modified, which replays all the ticks due up to the current time and resumes
+    // regular scheduling. parked events are also caught up at the end of every frame.
+    // this is off unless enabled with SetEventCatchUp(), as it isn't cycle-exact:
+    // - a tick is caught up as soon as the CPU accessing the device has reached it, whereas
+    //   regular scheduling only runs it once the ARM9 is done with the instruction it was
+    //   in at that time. an ARM7 access falling in between sees the tick already done.
+    // - the CPU slices are longer, so what is only checked at the end of one (timer
+    //   overflows, the 3D engine) can be seen slightly later.
+    // apart from that, the audio output and the console state are the same either way,
+    // which is what melonDS-eventcatchuptest checks.
+    void ParkEvent(u32 id);
+    void CatchUpEvent(u32 id);
+
+    bool GetEventCatchUp() const noexcept { return EventCatchUp; }
+    void SetEventCatchUp(bool enable);
+
+    // threaded ARM7 (off by default)
+    // the ARM7 runs on its own host thread, alongside the ARM9. within a slice, it
+    // runs concurrently as long as it stays in memory the ARM9 can't see (its BIOS,
+    // ARM7 WRAM and whatever shared WRAM is mapped to it) and doesn't get ahead of
+    // the ARM9. anything else waits for the ARM9 to finish its slice.
+    // this is interpreter-only and DS-only: enabling it returns false in DSi mode,
+    // with the JIT or with the GDB stub, and SetJITArgs() turns it back off (with
+    // just a warning in the log) when it enables the JIT.
+    // runs are reproducible, but their timing differs from the single-threaded mode,
+    // which is left unchanged: IRQs the ARM9 raises for the ARM7 reach it at exactly
+    // the time they were raised at, and changes to WRAMCNT or the GBA slot timings
+    // reach the ARM7 at the end of the slice.
+    bool SetARM7Threaded(bool enable);
+    bool IsARM7Threaded() const noexcept { return ARM7Threaded; }
+
+    // how many system cycles the threaded ARM7 may run apart from the ARM9 at most,
+    // ie. how long its slices are. longer slices leave it more to run alongside the
+    // ARM9, at the cost of a coarser timing between the CPUs: above the 64 cycles of
+    // the single-threaded mode, either CPU may see the other's writes at a different
+    // time than there. not used otherwise.
+    void SetARM7MaxSkew(u32 cycles);
+    u32 GetARM7MaxSkew() const noexcept { return ARM7MaxSkew; }
+
+    // emulated ARM7 cycles run on its thread, how many of those it spent halted,
+    // and how many of the others it got through before it had to wait for the ARM9
+    // to finish its slice
+    u64 ARM7ThreadCycles = 0;
+    u64 ARM7ThreadHaltedCycles = 0;
+    u64 ARM7ConcurrentCycles = 0;
+
+    void ARM7BusAccess(u32 addr)
+    {
+        // the ARM7's view of 0x03xxxxxx never overlaps the ARM9's, and it only
+        // changes at the end of a slice (see MapSharedWRAM())
+        if (ARM7SyncPending && (addr >= 0x00004000) && ((addr & 0xFF000000) != 0x03000000))
+            SyncARM7ToARM9();
+    }
+
+    // lets the threaded ARM7 run up to where the ARM9 got
+    void PublishARM9Progress()
+    {
+        ARM9Progress.store(ARM9Timestamp >> ARM9ClockShift, std::memory_order_release);
+    }
+
+    // the threaded ARM7 may only run an instruction once it's known that the ARM9
+    // won't raise an IRQ for it any earlier, and only stop where it would stop
+    // in the single-threaded mode
+    bool ARM7CheckTarget()
+    {
+        if (!ARM7TargetOpen || (ARM7Timestamp < ARM7KnownProgress))
+            return true;
+
+        WaitForARM9(false);
+        return ARM7Timestamp < ARM7Target;
+    }
+    // a halted ARM7 skips to the end of its current run
+    void ARM7SkipHalted()
+    {
+        if (ARM7TargetOpen)
+            WaitForARM9(true);
+
+        if (ARM7Timestamp < ARM7Target)
+        {
+            ARM7SliceHalted += ARM7Target - ARM7Timestamp;
+            ARM7Timestamp = ARM7Target;
+        }
+    }
+
     void debug(u32 p);
 
     void Halt();
@@ -498,6 +616,9 @@ public: // TODO: Encapsulate the rest of these members
 protected:
     void InitTimings();
     u32 SchedListMask;
+    u32 SchedListParkedMask = 0;
+    u32 SchedListCaughtUpMask = 0; // events unparked by CatchUpEvent() since the last RunSystem()
+    bool EventCatchUp = false;
     u64 SysTimestamp;
     u8 WRAMCnt;
     u8 PostFlag9;
@@ -531,6 +652,74 @@ protected:
     void Reschedule(u64 target);
     void RunSystemSleep(u64 timestamp);
     void RunSystem(u64 timestamp);
+    void RunParkedEvent(u32 id, u64 timestamp);
+    void CatchUpParkedEvents(bool unpark);
+
+    // ARM7 IRQs raised or cleared by the ARM9 side of a slice, they reach
+    // the ARM7 when it gets to the time they were raised at
+    struct ARM7IRQEvent
+    {
+        u64 Timestamp;
+        u8 IRQ;
+        bool Set;
+    };
+    static constexpr u32 kMaxARM7IRQEvents = 256;
+
+    enum
+    {
+        ARM7Pending_SharedWRAM = 1 << 0,
+        ARM7Pending_GBASlotTimings = 1 << 1,
+    };
+
+    u32 ARM7MaxSkew = 256;
+
+    bool ARM9SliceRunning = false;
+    u64 ARM9SliceEnd = 0;
+    std::atomic<bool> ARM9SliceDone = true;
+    alignas(64) std::atomic<u64> ARM9Progress = 0;
+    alignas(64) std::array<ARM7IRQEvent, kMaxARM7IRQEvents> ARM7IRQEvents {};
+    std::atomic<u32> NumARM7IRQEvents = 0;
+    u32 ARM7IRQEventsDone = 0;
+    // changes made by the ARM9 which the ARM7 only sees at the end of the slice
+    u32 ARM7PendingChanges = 0;
+
+    bool ARM7Threaded = false;
+    Platform::Thread* ARM7Thread = nullptr;
+    Platform::Semaphore* Sema_ARM7FrameStart = nullptr;
+    // for when either side has to wait longer than it's worth spinning
+    Platform::Semaphore* Sema_ARM7Wake = nullptr;
+    Platform::Semaphore* Sema_ARM9Wake = nullptr;
+    std::atomic<bool> ARM7Sleeping = false;
+    std::atomic<bool> ARM9Sleeping = false;
+    std::atomic<u32> ARM7SliceGen = 0;
+    std::atomic<u32> ARM7SliceDoneGen = 0;
+    std::atomic<bool> ARM7FrameDone = true;
+    std::atomic<bool> ARM7ThreadQuit = false;
+    // the ARM7 thread's side, set up by StartARM9Slice()
+    bool ARM7SliceDMA = false;
+    bool ARM7SyncPending = false;
+    bool ARM7TargetOpen = false;
+    u64 ARM7KnownProgress = 0;
+    u64 ARM7SliceStart = 0;
+    u64 ARM7SliceHalted = 0;
+    bool ARM7SliceCounted = false;
+    static thread_local bool OnARM7Thread;
+
+    void ARM7ThreadFunc();
+    void StopARM7Thread();
+    void StartARM9Slice(u64 target);
+    void FinishARM9Slice();
+    void RunARM7Slice();
+    void WakeARM7();
+    void WakeARM9();
+    void QueueARM7IRQ(u32 irq, bool set);
+    void RunARM7IRQEvents(u64 timestamp);
+    void ApplyARM7PendingChanges();
+    void CountARM7Concurrent();
+    void WaitForARM9(bool needtarget);
+    void SyncARM7ToARM9();
+    void MapARM7SharedWRAM();
+    void SetARM7GBASlotTimings();
     void HandleTimerOverflow(u32 tid);
     u16 TimerGetCounter(u32 timer);
     void TimerStart(u32 id, u16 cnt);
@@ -16,6 +16,7 @@
     with melonDS. If not, see http://www.gnu.org/licenses/.
 */
 
+#include <algorithm>
 #include <string.h>
 #include "NDS.h"
 #include "DSi.h"
@@ -194,17 +195,29 @@ CartCommon::CartCommon(const u8* rom, u32 len, u32 chipid, bool badDSiDump, ROML
 {
 }
 
-CartCommon::CartCommon(std::unique_ptr<u8[]>&& rom, u32 len, u32 chipid, bool badDSiDump, ROMListEntry romparams, melonDS::NDSCart::CartType type, void* userdata) :
-    ROM(std::move(rom)),
+CartCommon::CartCommon(CartROMSource&& rom, u32 len, u32 chipid, bool badDSiDump, ROMListEntry romparams, melonDS::NDSCart::CartType type, void* userdata) :
+    ROM(std::move(rom.Data)),
+    ROMBlocks(std::move(rom.Blocks)),
     ROMLength(len),
     ChipID(chipid),
     ROMParams(romparams),
     CartType(type),
     UserData(userdata)
 {
-    memcpy(&Header, ROM.get(), sizeof(Header));
+    ReadROM(0, sizeof(Header), (u8*)&Header, 0);
     IsDSi = Header.IsDSi() && !badDSiDump;
     DSiBase = Header.DSiRegionStart << 19;
+
+    if (ROMBlocks)
+    {
+        // Banner() hands out a pointer, so keep the banner around
+        size_t bannersize = Header.IsDSi() ? 0x23C0 : 0xA40;
+        if (Header.BannerOffset >= 0x200 && Header.BannerOffset < (ROMLength - bannersize))
+        {
+            BannerCopy = std::make_unique<u8[]>(std::max(bannersize, sizeof(NDSBanner)));
+            ReadROM(Header.BannerOffset, bannersize, BannerCopy.get(), 0);
+        }
+    }
 }
 
 CartCommon::~CartCommon() = default;
@@ -212,15 +225,33 @@ CartCommon::~CartCommon() = default;
 u32 CartCommon::Checksum() const
 {
     const NDSHeader& header = GetHeader();
-    u32 crc = CRC32(ROM.get(), 0x40);
+    u32 crc = ChecksumROM(0, 0x40, 0);
 
-    crc = CRC32(&ROM[header.ARM9ROMOffset], header.ARM9Size, crc);
-    crc = CRC32(&ROM[header.ARM7ROMOffset], header.ARM7Size, crc);
+    crc = ChecksumROM(header.ARM9ROMOffset, header.ARM9Size, crc);
+    crc = ChecksumROM(header.ARM7ROMOffset, header.ARM7Size, crc);
 
     if (IsDSi)
     {
-        crc = CRC32(&ROM[header.DSiARM9iROMOffset], header.DSiARM9iSize, crc);
-        crc = CRC32(&ROM[header.DSiARM7iROMOffset], header.DSiARM7iSize, crc);
+        crc = ChecksumROM(header.DSiARM9iROMOffset, header.DSiARM9iSize, crc);
+        crc = ChecksumROM(header.DSiARM7iROMOffset, header.DSiARM7iSize, crc);
+    }
+
+    return crc;
+}
+
+u32 CartCommon::ChecksumROM(u32 addr, u32 len, u32 crc) const
+{
+    // go through ReadROM so the secure area and compressed ROMs are handled
+    u8 buf[0x1000];
+    while (len > 0)
+    {
+        u32 chunk = std::min(len, (u32)sizeof(buf));
+        memset(buf, 0, chunk);
+        ReadROM(addr, chunk, buf, 0);
+        crc = CRC32(buf, chunk, crc);
+
+        addr += chunk;
+        len -= chunk;
     }
 
     return crc;
@@ -278,7 +309,7 @@ int CartCommon::ROMCommandStart(NDS& nds, NDSCartSlot& cartslot, const u8* cmd,
 
         case 0x3C:
             CmdEncMode = 1;
-            cartslot.Key1_InitKeycode(false, *(u32*)&ROM[0xC], 2, 2);
+            cartslot.Key1_InitKeycode(false, ReadROM32(0xC), 2, 2);
             DSiMode = false;
             return 0;
 
@@ -286,7 +317,7 @@ int CartCommon::ROMCommandStart(NDS& nds, NDSCartSlot& cartslot, const u8* cmd,
             if (IsDSi)
             {
                 CmdEncMode = 1;
-                cartslot.Key1_InitKeycode(true, *(u32*)&ROM[0xC], 1, 2);
+                cartslot.Key1_InitKeycode(true, ReadROM32(0xC), 1, 2);
                 DSiMode = true;
             }
             return 0;
@@ -376,7 +407,31 @@ void CartCommon::ReadROM(u32 addr, u32 len, u8* data, u32 offset) const
     if ((addr+len) > ROMLength)
         len = ROMLength - addr;
 
-    memcpy(data+offset, ROM.get()+addr, len);
+    if (ROMBlocks)
+        ROMBlocks->Read(addr, len, data+offset);
+    else
+        memcpy(data+offset, ROM.get()+addr, len);
+
+    if (SecureArea && (addr < SecureAreaOffset+0x800) && ((addr+len) > SecureAreaOffset))
+    {
+        u32 start = std::max(addr, SecureAreaOffset);
+        u32 end = std::min(addr+len, SecureAreaOffset+0x800);
+        memcpy(data+offset+(start-addr), &SecureArea[start-SecureAreaOffset], end-start);
+    }
+}
+
+void CartCommon::SetSecureArea(const u8* data)
+{
+    if (!SecureArea)
+        SecureArea = std::make_unique<u8[]>(0x800);
+
+    SecureAreaOffset = Header.ARM9ROMOffset;
+    memcpy(SecureArea.get(), data, 0x800);
+}
+
+u8* CartCommon::GetWritableROM()
+{
+    return MakeROMDataWritable(ROM, ROMLength);
 }
 
 const NDSBanner* CartCommon::Banner() const
@@ -385,6 +440,9 @@ const NDSBanner* CartCommon::Banner() const
     size_t bannersize = header.IsDSi() ? 0x23C0 : 0xA40;
     if (header.BannerOffset >= 0x200 && header.BannerOffset < (ROMLength - bannersize))
     {
+        if (ROMBlocks)
+            return reinterpret_cast<const NDSBanner*>(BannerCopy.get());
+
         return reinterpret_cast<const NDSBanner*>(ROM.get() + header.BannerOffset);
     }
 
@@ -396,7 +454,7 @@ CartRetail::CartRetail(const u8* rom, u32 len, u32 chipid, bool badDSiDump, ROML
 {
 }
 
-CartRetail::CartRetail(std::unique_ptr<u8[]>&& rom, u32 len, u32 chipid, bool badDSiDump, ROMListEntry romparams, std::unique_ptr<u8[]>&& sram, u32 sramlen, void* userdata, melonDS::NDSCart::CartType type) :
+CartRetail::CartRetail(CartROMSource&& rom, u32 len, u32 chipid, bool badDSiDump, ROMListEntry romparams, std::unique_ptr<u8[]>&& sram, u32 sramlen, void* userdata, melonDS::NDSCart::CartType type) :
     CartCommon(std::move(rom), len, chipid, badDSiDump, romparams, type, userdata)
 {
     u32 savememtype = ROMParams.SaveMemType <= 10 ? ROMParams.SaveMemType : 0;
@@ -574,7 +632,7 @@ void CartRetail::ReadROM_B7(u32 addr, u32 len, u8* data, u32 offset) const
             addr = 0x8000 + (addr & 0x1FF);
     }
 
-    memcpy(data+offset, ROM.get()+addr, len);
+    ReadROM(addr, len, data, offset);
 }
 
 u8 CartRetail::SRAMWrite_EEPROMTiny(u8 val, u32 pos, bool last)
@@ -859,7 +917,7 @@ CartRetailNAND::CartRetailNAND(const u8* rom, u32 len, u32 chipid, ROMListEntry
 {
 }
 
-CartRetailNAND::CartRetailNAND(std::unique_ptr<u8[]>&& rom, u32 len, u32 chipid, ROMListEntry romparams, std::unique_ptr<u8[]>&& sram, u32 sramlen, void* userdata) :
+CartRetailNAND::CartRetailNAND(CartROMSource&& rom, u32 len, u32 chipid, ROMListEntry romparams, std::unique_ptr<u8[]>&& sram, u32 sramlen, void* userdata) :
     CartRetail(std::move(rom), len, chipid, false, romparams, std::move(sram), sramlen, userdata, CartType::RetailNAND)
 {
     BuildSRAMID();
@@ -876,7 +934,9 @@ void CartRetailNAND::Reset()
     SRAMWindow = 0;
 
     // ROM header 94/96 = SRAM addr start / 0x20000
-    SRAMBase = *(u16*)&ROM[0x96] << 17;
+    u16 sramstart;
+    ReadROM(0x96, 2, (u8*)&sramstart, 0);
+    SRAMBase = sramstart << 17;
 
     memset(SRAMWriteBuffer, 0, 0x800);
 }
@@ -1092,7 +1152,7 @@ CartRetailIR::CartRetailIR(const u8* rom, u32 len, u32 chipid, u32 irversion, bo
 }
 
 CartRetailIR::CartRetailIR(
-    std::unique_ptr<u8[]>&& rom,
+    CartROMSource&& rom,
     u32 len,
     u32 chipid,
     u32 irversion,
@@ -1150,7 +1210,7 @@ CartRetailBT::CartRetailBT(const u8* rom, u32 len, u32 chipid, ROMListEntry romp
 {
 }
 
-CartRetailBT::CartRetailBT(std::unique_ptr<u8[]>&& rom, u32 len, u32 chipid, ROMListEntry romparams, std::unique_ptr<u8[]>&& sram, u32 sramlen, void* userdata) :
+CartRetailBT::CartRetailBT(CartROMSource&& rom, u32 len, u32 chipid, ROMListEntry romparams, std::unique_ptr<u8[]>&& sram, u32 sramlen, void* userdata) :
     CartRetail(std::move(rom), len, chipid, false, romparams, std::move(sram), sramlen, userdata, CartType::RetailBT)
 {
     Log(LogLevel::Info,"POKETYPE CART\n");
@@ -1177,7 +1237,7 @@ CartSD::CartSD(const u8* rom, u32 len, u32 chipid, ROMListEntry romparams, void*
     CartSD(CopyToUnique(rom, len), len, chipid, romparams, userdata, std::move(sdcard))
 {}
 
-CartSD::CartSD(std::unique_ptr<u8[]>&& rom, u32 len, u32 chipid, ROMListEntry romparams, void* userdata, std::optional<FATStorage>&& sdcard) :
+CartSD::CartSD(CartROMSource&& rom, u32 len, u32 chipid, ROMListEntry romparams, void* userdata, std::optional<FATStorage>&& sdcard) :
     CartCommon(std::move(rom), len, chipid, false, romparams, CartType::Homebrew, userdata),
     SD(std::move(sdcard))
 {
@@ -1303,7 +1363,7 @@ void CartSD::ApplyDLDIPatch(const u8* patch, u32 patchlen, bool readonly)
     u32 offset = *(u32*)&ROM[0x20];
     u32 size = *(u32*)&ROM[0x2C];
 
-    u8* binary = &ROM[offset];
+    u8* binary = GetWritableROM() + offset;
 
     for (u32 i = 0; i < size; )
     {
@@ -1326,14 +1386,14 @@ void CartSD::ReadROM_B7(u32 addr, u32 len, u8* data, u32 offset) const
 
     addr &= (ROMLength-1);
 
-    memcpy(data+offset, ROM.get()+addr, len);
+    ReadROM(addr, len, data, offset);
 }
 
 CartHomebrew::CartHomebrew(const u8* rom, u32 len, u32 chipid, ROMListEntry romparams, void* userdata, std::optional<FATStorage>&& sdcard) :
     CartSD(rom, len, chipid, romparams, userdata, std::move(sdcard))
 {}
 
-CartHomebrew::CartHomebrew(std::unique_ptr<u8[]>&& rom, u32 len, u32 chipid, ROMListEntry romparams, void* userdata, std::optional<FATStorage>&& sdcard) :
+CartHomebrew::CartHomebrew(CartROMSource&& rom, u32 len, u32 chipid, ROMListEntry romparams, void* userdata, std::optional<FATStorage>&& sdcard) :
     CartSD(std::move(rom), len, chipid, romparams, userdata, std::move(sdcard))
 {}
 
@@ -1562,12 +1622,10 @@ bool ReadROMParams(u32 gamecode, ROMListEntry* params)
 void NDSCartSlot::DecryptSecureArea(u8* out) noexcept
 {
     const NDSHeader& header = Cart->GetHeader();
-    const u8* cartrom = Cart->GetROM();
-
     u32 gamecode = header.GameCodeAsU32();
     u32 arm9base = header.ARM9ROMOffset;
 
-    memcpy(out, &cartrom[arm9base], 0x800);
+    Cart->ReadROM(arm9base, 0x800, out, 0);
 
     Key1_InitKeycode(false, gamecode, 2, 2);
     Key1_Decrypt((u32*)&out[0]);
@@ -1606,6 +1664,8 @@ bool ValidateROM(u32 romlen, NDSHeader& header)
     return true;
 }
 
+static std::unique_ptr<CartCommon> ParseROMSource(CartROMSource&& cartrom, u32 romlen, void* userdata, std::optional<NDSCartArgs>&& args);
+
 std::unique_ptr<CartCommon> ParseROM(const u8* romdata, u32 romlen, void* userdata, std::optional<NDSCartArgs>&& args)
 {
     return ParseROM(CopyToUnique(romdata, romlen), romlen, userdata, std::move(args));
@@ -1613,7 +1673,31 @@ std::unique_ptr<CartCommon> ParseROM(const u8* romdata, u32 romlen, void* userda
 
 std::unique_ptr<CartCommon> ParseROM(std::unique_ptr<u8[]>&& romdata, u32 romlen, void* userdata, std::optional<NDSCartArgs>&& args)
 {
-    if (romdata == nullptr)
+    if (romlen > 512*1024*1024)
+    {
+        Log(LogLevel::Error, "NDSCart: ROM is too large\n");
+        return nullptr;
+    }
+
+    // null or empty data is reported by the overload below
+    auto [paddedrom, cartromsize] = PadToPowerOf2(std::move(romdata), romlen);
+    return ParseROM(ShareROMData(std::move(paddedrom), cartromsize), romlen, userdata, std::move(args));
+}
+
+std::unique_ptr<CartCommon> ParseROM(SharedROMData&& romdata, u32 romlen, void* userdata, std::optional<NDSCartArgs>&& args)
+{
+    return ParseROMSource(std::move(romdata), romlen, userdata, std::move(args));
+}
+
+std::unique_ptr<CartCommon> ParseROM(std::unique_ptr<CompressedROM>&& romdata, void* userdata, std::optional<NDSCartArgs>&& args)
+{
+    u32 romlen = romdata ? romdata->GetLength() : 0;
+    return ParseROMSource(std::move(romdata), romlen, userdata, std::move(args));
+}
+
+static std::unique_ptr<CartCommon> ParseROMSource(CartROMSource&& cartrom, u32 romlen, void* userdata, std::optional<NDSCartArgs>&& args)
+{
+    if (!cartrom.Data && !cartrom.Blocks)
     {
         Log(LogLevel::Error, "NDSCart: romdata is null\n");
         return nullptr;
@@ -1631,10 +1715,15 @@ std::unique_ptr<CartCommon> ParseROM(std::unique_ptr<u8[]>&& romdata, u32 romlen
         return nullptr;
     }
 
-    auto [cartrom, cartromsize] = PadToPowerOf2(std::move(romdata), romlen);
+    u32 cartromsize = 1;
+    while (cartromsize < romlen)
+        cartromsize <<= 1;
 
     NDSHeader header {};
-    memcpy(&header, cartrom.get(), sizeof(header));
+    if (cartrom.Blocks)
+        cartrom.Blocks->Read(0, sizeof(header), (u8*)&header);
+    else
+        memcpy(&header, cartrom.Data.get(), sizeof(header));
 
     if (!ValidateROM(cartromsize, header))
     {
@@ -1705,6 +1794,16 @@ std::unique_ptr<CartCommon> ParseROM(std::unique_ptr<u8[]>&& romdata, u32 romlen
             irversion = 2; // Pokémon HG/SS, B/W, B2/W2
     }
 
+    bool r4 = gametitle[0] == 0 && !strncmp("SD/TF-NDS", gametitle + 1, 9) && gamecode == 0x414D5341;
+
+    if (cartrom.Blocks && (homebrew || r4))
+    {
+        // these carts patch their ROM and hand it to the SD card as a whole
+        auto data = std::make_unique<u8[]>(cartromsize);
+        cartrom.Blocks->Read(0, cartromsize, data.get());
+        cartrom = CartROMSource(std::move(data));
+    }
+
     std::unique_ptr<CartCommon> cart;
     std::unique_ptr<u8[]> sram = args ? std::move(args->SRAM) : nullptr;
     u32 sramlen = args ? args->SRAMLength : 0;
@@ -1713,7 +1812,7 @@ std::unique_ptr<CartCommon> ParseROM(std::unique_ptr<u8[]>&& romdata, u32 romlen
         std::optional<FATStorage> sdcard = args && args->SDCard ? std::make_optional<FATStorage>(std::move(*args->SDCard)) : std::nullopt;
         cart = std::make_unique<CartHomebrew>(std::move(cartrom), cartromsize, cartid, romparams, userdata, std::move(sdcard));
     }
-    else if (gametitle[0] == 0 && !strncmp("SD/TF-NDS", gametitle + 1, 9) && gamecode == 0x414D5341)
+    else if (r4)
     {
         std::optional<FATStorage> sdcard = args && args->SDCard ? std::make_optional<FATStorage>(std::move(*args->SDCard)) : std::nullopt;
         cart = std::make_unique<CartR4>(std::move(cartrom), cartromsize, cartid, romparams, CartR4TypeR4, CartR4LanguageEnglish, userdata, std::move(sdcard));
@@ -1748,22 +1847,27 @@ void NDSCartSlot::SetCart(std::unique_ptr<CartCommon>&& cart) noexcept
 
     const NDSHeader& header = Cart->GetHeader();
     const ROMListEntry romparams = Cart->GetROMParams();
-    const u8* cartrom = Cart->GetROM();
     if (header.ARM9ROMOffset >= 0x4000 && header.ARM9ROMOffset < 0x8000)
     {
         // reencrypt secure area if needed
-        if (*(u32*)&cartrom[header.ARM9ROMOffset] == 0xE7FFDEFF && *(u32*)&cartrom[header.ARM9ROMOffset + 0x10] != 0xE7FFDEFF)
+        // the ROM data may be shared, so the cart keeps the result to itself
+        alignas(4) u8 securearea[0x800];
+        Cart->ReadROM(header.ARM9ROMOffset, 0x800, securearea, 0);
+
+        if (*(u32*)&securearea[0] == 0xE7FFDEFF && *(u32*)&securearea[0x10] != 0xE7FFDEFF)
         {
             Log(LogLevel::Debug, "Re-encrypting cart secure area\n");
 
-            strncpy((char*)&cartrom[header.ARM9ROMOffset], "encryObj", 8);
+            strncpy((char*)&securearea[0], "encryObj", 8);
 
             Key1_InitKeycode(false, romparams.GameCode, 3, 2);
             for (u32 i = 0; i < 0x800; i += 8)
-                Key1_Encrypt((u32*)&cartrom[header.ARM9ROMOffset + i]);
+                Key1_Encrypt((u32*)&securearea[i]);
 
             Key1_InitKeycode(false, romparams.GameCode, 2, 2);
-            Key1_Encrypt((u32*)&cartrom[header.ARM9ROMOffset]);
+            Key1_Encrypt((u32*)&securearea[0]);
+
+            Cart->SetSecureArea(securearea);
 
             Log(LogLevel::Debug, "Re-encrypted cart secure area\n");
         }
@@ -29,6 +29,8 @@
 #include "NDS_Header.h"
 #include "FATStorage.h"
 #include "ROMList.h"
+#include "SharedROM.h"
+#include "CompressedROM.h"
 
 namespace melonDS
 {
@@ -72,12 +74,24 @@ struct NDSCartArgs
     u32 SRAMLength = 0;
 };
 
+/// Where a cart's ROM contents come from: either an image held in memory,
+/// or a block-compressed file that is decompressed as the cart reads it.
+struct CartROMSource
+{
+    CartROMSource(SharedROMData&& data) noexcept : Data(std::move(data)) {}
+    CartROMSource(std::unique_ptr<u8[]>&& data) noexcept : Data(std::move(data)) {}
+    CartROMSource(std::unique_ptr<CompressedROM>&& blocks) noexcept : Blocks(std::move(blocks)) {}
+
+    SharedROMData Data = nullptr;
+    std::unique_ptr<CompressedROM> Blocks = nullptr;
+};
+
 // CartCommon -- base code shared by all cart types
 class CartCommon
 {
 public:
     CartCommon(const u8* rom, u32 len, u32 chipid, bool badDSiDump, ROMListEntry romparams, CartType type, void* userdata);
-    CartCommon(std::unique_ptr<u8[]>&& rom, u32 len, u32 chipid, bool badDSiDump, ROMListEntry romparams, CartType type, void* userdata);
+    CartCommon(CartROMSource&& rom, u32 len, u32 chipid, bool badDSiDump, ROMListEntry romparams, CartType type, void* userdata);
     virtual ~CartCommon();
 
     [[nodiscard]] u32 Type() const { return CartType; };
@@ -106,15 +120,32 @@ public:
     [[nodiscard]] const NDSBanner* Banner() const;
     [[nodiscard]] const ROMListEntry& GetROMParams() const { return ROMParams; };
     [[nodiscard]] u32 ID() const { return ChipID; }
+    /// @return The cart's ROM data, or \c nullptr if the ROM isn't held in memory
+    /// (ie. it is read from a compressed ROM file). The ROM may be shared with other carts,
+    /// so this does not include the re-encrypted secure area; use \c ReadROM for that.
     [[nodiscard]] const u8* GetROM() const { return ROM.get(); }
     [[nodiscard]] u32 GetROMLength() const { return ROMLength; }
-protected:
+
+    /// Copies ROM contents as seen by the console, with the cart's own patches applied.
     void ReadROM(u32 addr, u32 len, u8* data, u32 offset) const;
+    [[nodiscard]] u32 ReadROM32(u32 addr) const { u32 val = 0; ReadROM(addr, 4, (u8*)&val, 0); return val; }
+
+    /// Replaces the secure area (the first 0x800 bytes of the ARM9 binary)
+    /// for this cart only, without touching the possibly shared ROM data.
+    void SetSecureArea(const u8* data);
+protected:
+    /// @return A writable pointer to the ROM, which becomes private to this cart.
+    u8* GetWritableROM();
 
     void* UserData;
 
-    std::unique_ptr<u8[]> ROM = nullptr;
+    SharedROMData ROM = nullptr;
+    // set instead of ROM when reading from a compressed ROM file
+    std::unique_ptr<CompressedROM> ROMBlocks = nullptr;
     u32 ROMLength = 0;
+    // re-encrypted secure area, overlaid on top of the ROM data
+    std::unique_ptr<u8[]> SecureArea = nullptr;
+    u32 SecureAreaOffset = 0;
     u32 ChipID = 0;
     bool IsDSi = false;
     bool DSiMode = false;
@@ -127,6 +158,11 @@ protected:
     NDSHeader Header {};
     ROMListEntry ROMParams {};
     const melonDS::NDSCart::CartType CartType = Default;
+
+private:
+    u32 ChecksumROM(u32 addr, u32 len, u32 crc) const;
+
+    std::unique_ptr<u8[]> BannerCopy = nullptr;
 };
 
 // CartRetail -- regular retail cart (ROM, SPI SRAM)
@@ -145,7 +181,7 @@ public:
         melonDS::NDSCart::CartType type = CartType::Retail
     );
     CartRetail(
-        std::unique_ptr<u8[]>&& rom,
+        CartROMSource&& rom,
         u32 len, u32 chipid,
         bool badDSiDump,
         ROMListEntry romparams,
@@ -192,7 +228,7 @@ class CartRetailNAND : public CartRetail
 {
 public:
     CartRetailNAND(const u8* rom, u32 len, u32 chipid, ROMListEntry romparams, std::unique_ptr<u8[]>&& sram, u32 sramlen, void* userdata);
-    CartRetailNAND(std::unique_ptr<u8[]>&& rom, u32 len, u32 chipid, ROMListEntry romparams, std::unique_ptr<u8[]>&& sram, u32 sramlen, void* userdata);
+    CartRetailNAND(CartROMSource&& rom, u32 len, u32 chipid, ROMListEntry romparams, std::unique_ptr<u8[]>&& sram, u32 sramlen, void* userdata);
     ~CartRetailNAND() override;
 
     void Reset() override;
@@ -221,7 +257,7 @@ class CartRetailIR : public CartRetail
 {
 public:
     CartRetailIR(const u8* rom, u32 len, u32 chipid, u32 irversion, bool badDSiDump, ROMListEntry romparams, std::unique_ptr<u8[]>&& sram, u32 sramlen, void* userdata);
-    CartRetailIR(std::unique_ptr<u8[]>&& rom, u32 len, u32 chipid, u32 irversion, bool badDSiDump, ROMListEntry romparams, std::unique_ptr<u8[]>&& sram, u32 sramlen, void* userdata);
+    CartRetailIR(CartROMSource&& rom, u32 len, u32 chipid, u32 irversion, bool badDSiDump, ROMListEntry romparams, std::unique_ptr<u8[]>&& sram, u32 sramlen, void* userdata);
     ~CartRetailIR() override;
 
     void Reset() override;
@@ -240,7 +276,7 @@ class CartRetailBT : public CartRetail
 {
 public:
     CartRetailBT(const u8* rom, u32 len, u32 chipid, ROMListEntry romparams, std::unique_ptr<u8[]>&& sram, u32 sramlen, void* userdata);
-    CartRetailBT(std::unique_ptr<u8[]>&& rom, u32 len, u32 chipid, ROMListEntry romparams, std::unique_ptr<u8[]>&& sram, u32 sramlen, void* userdata);
+    CartRetailBT(CartROMSource&& rom, u32 len, u32 chipid, ROMListEntry romparams, std::unique_ptr<u8[]>&& sram, u32 sramlen, void* userdata);
     ~CartRetailBT() override;
 
     u8 SPIWrite(u8 val, u32 pos, bool last) override;
@@ -251,7 +287,7 @@ class CartSD : public CartCommon
 {
 public:
     CartSD(const u8* rom, u32 len, u32 chipid, ROMListEntry romparams, void* userdata, std::optional<FATStorage>&& sdcard = std::nullopt);
-    CartSD(std::unique_ptr<u8[]>&& rom, u32 len, u32 chipid, ROMListEntry romparams, void* userdata, std::optional<FATStorage>&& sdcard = std::nullopt);
+    CartSD(CartROMSource&& rom, u32 len, u32 chipid, ROMListEntry romparams, void* userdata, std::optional<FATStorage>&& sdcard = std::nullopt);
     ~CartSD() override;
 
     [[nodiscard]] const std::optional<FATStorage>& GetSDCard() const noexcept { return SD; }
@@ -293,7 +329,7 @@ class CartHomebrew : public CartSD
 {
 public:
     CartHomebrew(const u8* rom, u32 len, u32 chipid, ROMListEntry romparams, void* userdata, std::optional<FATStorage>&& sdcard = std::nullopt);
-    CartHomebrew(std::unique_ptr<u8[]>&& rom, u32 len, u32 chipid, ROMListEntry romparams, void* userdata, std::optional<FATStorage>&& sdcard = std::nullopt);
+    CartHomebrew(CartROMSource&& rom, u32 len, u32 chipid, ROMListEntry romparams, void* userdata, std::optional<FATStorage>&& sdcard = std::nullopt);
     ~CartHomebrew() override;
 
     void Reset() override;
@@ -326,7 +362,7 @@ enum CartR4Language
 class CartR4 : public CartSD
 {
 public:
-    CartR4(std::unique_ptr<u8[]>&& rom, u32 len, u32 chipid, ROMListEntry romparams, CartR4Type ctype, CartR4Language clanguage, void* userdata,
+    CartR4(CartROMSource&& rom, u32 len, u32 chipid, ROMListEntry romparams, CartR4Type ctype, CartR4Language clanguage, void* userdata,
         std::optional<FATStorage>&& sdcard = std::nullopt);
     ~CartR4() override;
 
@@ -468,6 +504,18 @@ private:
 /// or \c nullptr if the ROM data couldn't be parsed.
 std::unique_ptr<CartCommon> ParseROM(const u8* romdata, u32 romlen, void* userdata = nullptr, std::optional<NDSCartArgs>&& args = std::nullopt);
 std::unique_ptr<CartCommon> ParseROM(std::unique_ptr<u8[]>&& romdata, u32 romlen, void* userdata = nullptr, std::optional<NDSCartArgs>&& args = std::nullopt);
+
+/// Same as above, but takes ROM data that is already set up for sharing,
+/// such as a file mapped with \c MapROMFile.
+/// Only the header is read upfront; the rest of the ROM is left untouched until the game reads it.
+/// @param romdata The ROM data, which must be readable (and zero-padded)
+/// up to the next power of 2 of \c romlen.
+std::unique_ptr<CartCommon> ParseROM(SharedROMData&& romdata, u32 romlen, void* userdata = nullptr, std::optional<NDSCartArgs>&& args = std::nullopt);
+
+/// Same as above, but reads the ROM from a block-compressed ROM file,
+/// decompressing only the parts the game reads.
+/// Homebrew ROMs are decompressed entirely, as they are patched and copied to the SD card.
+std::unique_ptr<CartCommon> ParseROM(std::unique_ptr<CompressedROM>&& romdata, void* userdata = nullptr, std::optional<NDSCartArgs>&& args = std::nullopt);
 }
 
 #endif
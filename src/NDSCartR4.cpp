@@ -67,7 +67,7 @@ static void DecryptR4Sector(u8* dest, u8* src, u16 key1)
     }
 }
 
-CartR4::CartR4(std::unique_ptr<u8[]>&& rom, u32 len, u32 chipid, ROMListEntry romparams, CartR4Type ctype, CartR4Language clanguage, void* userdata,
+CartR4::CartR4(CartROMSource&& rom, u32 len, u32 chipid, ROMListEntry romparams, CartR4Type ctype, CartR4Language clanguage, void* userdata,
             std::optional<FATStorage>&& sdcard)
     : CartSD(std::move(rom), len, chipid, romparams, userdata, std::move(sdcard))
 {
@@ -190,7 +190,7 @@ int CartR4::ROMCommandStart(NDS& nds, NDSCart::NDSCartSlot& cartslot, const u8*
             if (!BufferInitialized)
             {
                 u32 addr = (cmd[1]<<24) | (cmd[2]<<16) | (cmd[3]<<8) | cmd[4];
-                memcpy(data, &ROM[addr & (ROMLength-1)], len);
+                ReadROM(addr & (ROMLength-1), len, data, 0);
                 return 0;
             }
             /* Otherwise, fall through. */
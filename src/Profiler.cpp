@@ -0,0 +1,162 @@
+/*
+    Copyright 2016-2026 melonDS team
+
+    This file is part of melonDS.
+
+    melonDS is free software: you can redistribute it and/or modify it under
+    the terms of the GNU General Public License as published by the Free
+    Software Foundation, either version 3 of the License, or (at your option)
+    any later version.
+
+    melonDS is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+    FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with melonDS. If not, see http://www.gnu.org/licenses/.
+*/
+
+#include <algorithm>
+
+#include "Profiler.h"
+#include "Platform.h"
+
+namespace melonDS
+{
+using Platform::Log;
+using Platform::LogLevel;
+
+static const char* BucketNames[Prof_MAX] =
+{
+    "ARM9",
+    "ARM7",
+    "DMA",
+    "Timers",
+    "GPU3D",
+    "Render2D",
+    "Render3D",
+    "SPU Mix",
+
+    // scheduler events, same order as Event_* in NDS.h
+    "Event LCD",
+    "Event SPU",
+    "Event Wifi",
+    "Event RTC",
+    "Event DisplayFIFO",
+    "Event ROMTransfer",
+    "Event ROMSPITransfer",
+    "Event SPITransfer",
+    "Event Div",
+    "Event Sqrt",
+    "Event DSi SDMMCTransfer",
+    "Event DSi SDIOTransfer",
+    "Event DSi NWifi",
+    "Event DSi CamIRQ",
+    "Event DSi CamTransfer",
+    "Event DSi DSP",
+    "Event DSi DSPHLE",
+};
+
+Profiler::Profiler()
+{
+}
+
+const char* Profiler::BucketName(u32 bucket)
+{
+    if (bucket >= Prof_MAX) return "?";
+    return BucketNames[bucket];
+}
+
+void Profiler::BeginFrame(u32 framenum)
+{
+    Current = FrameProfile();
+    Current.FrameNum = framenum;
+    Depth = 0;
+    FrameStart = Now();
+}
+
+void Profiler::EndFrame()
+{
+    Current.FrameTimeNS = Now() - FrameStart;
+    LastFrame = Current;
+
+    if (Tracing)
+    {
+        TraceFrames.push_back(Current);
+        TraceFrameStarts.push_back(FrameStart);
+    }
+}
+
+void Profiler::StartTrace(u32 maxevents)
+{
+    TraceEvents.clear();
+    TraceFrames.clear();
+    TraceFrameStarts.clear();
+
+    MaxTraceEvents = maxevents;
+    TraceEvents.reserve(std::min(maxevents, 1024u*1024u));
+
+    TraceStart = Now();
+    Tracing = true;
+}
+
+void Profiler::StopTrace()
+{
+    Tracing = false;
+}
+
+bool Profiler::WriteTrace(const std::string& path) const
+{
+    Platform::FileHandle* file = Platform::OpenFile(path, Platform::FileMode::WriteText);
+    if (!file)
+    {
+        Log(LogLevel::Error, "profiler: failed to open %s for writing\n", path.c_str());
+        return false;
+    }
+
+    // timestamps are in microseconds in the trace-event format
+    auto us = [this](u64 ns) { return (ns - TraceStart) / 1000.0; };
+
+    Platform::FileWriteFormatted(file, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+    Platform::FileWriteFormatted(file,
+        "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":0,\"args\":{\"name\":\"emulation\"}}");
+
+    for (size_t i = 0; i < TraceFrames.size(); i++)
+    {
+        const FrameProfile& frame = TraceFrames[i];
+        u64 start = TraceFrameStarts[i];
+
+        Platform::FileWriteFormatted(file,
+            ",\n{\"name\":\"Frame %u\",\"cat\":\"frame\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":0,\"tid\":0}",
+            frame.FrameNum, us(start), frame.FrameTimeNS / 1000.0);
+
+        // per-frame totals as a counter track, in microseconds
+        Platform::FileWriteFormatted(file,
+            ",\n{\"name\":\"frame time (us)\",\"ph\":\"C\",\"ts\":%.3f,\"pid\":0,\"args\":{", us(start));
+        bool first = true;
+        for (u32 b = 0; b < Prof_MAX; b++)
+        {
+            if (!frame.Calls[b]) continue;
+            Platform::FileWriteFormatted(file, "%s\"%s\":%.3f", first ? "" : ",", BucketNames[b], frame.TimeNS[b] / 1000.0);
+            first = false;
+        }
+        Platform::FileWriteFormatted(file, "}}");
+    }
+
+    for (const TraceEvent& evt : TraceEvents)
+    {
+        Platform::FileWriteFormatted(file,
+            ",\n{\"name\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":0,\"tid\":0}",
+            BucketNames[evt.Bucket], us(evt.Start), evt.Duration / 1000.0);
+    }
+
+    Platform::FileWriteFormatted(file, "\n]}\n");
+    Platform::CloseFile(file);
+
+    if (TraceEvents.size() >= MaxTraceEvents)
+        Log(LogLevel::Warn, "profiler: trace buffer filled up, only the first %u scopes were recorded\n", MaxTraceEvents);
+
+    return true;
+}
+
+}
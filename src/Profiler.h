@@ -0,0 +1,176 @@
+/*
+    Copyright 2016-2026 melonDS team
+
+    This file is part of melonDS.
+
+    melonDS is free software: you can redistribute it and/or modify it under
+    the terms of the GNU General Public License as published by the Free
+    Software Foundation, either version 3 of the License, or (at your option)
+    any later version.
+
+    melonDS is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+    FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with melonDS. If not, see http://www.gnu.org/licenses/.
+*/
+
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <string>
+#include <vector>
+
+#include "types.h"
+
+#ifdef PROFILER_ENABLED
+#include <chrono>
+#endif
+
+namespace melonDS
+{
+
+// time accounting buckets
+// scheduler events get one bucket each, starting at Prof_EventBase
+// (indexed like NDS::SchedList)
+enum
+{
+    Prof_ARM9 = 0,
+    Prof_ARM7,
+    Prof_DMA,
+    Prof_Timers,
+    Prof_GPU3D,
+    Prof_Render2D,
+    Prof_Render3D,
+    Prof_SPUMix,
+
+    Prof_EventBase,
+    Prof_MAX = Prof_EventBase + 17, // checked against Event_MAX in NDS.cpp
+};
+
+/// Accumulated measurements for one emulated frame.
+/// Times are exclusive: time spent in a nested bucket (ie. SPU mixing
+/// inside the SPU scheduler event) is not counted again for the outer one.
+/// Cycles are counted in units of the 33 MHz system clock, and are only
+/// tracked for the buckets that advance emulated time (CPUs, DMA, GPU3D).
+struct FrameProfile
+{
+    u32 FrameNum = 0;
+    u64 FrameTimeNS = 0;
+
+    u64 TimeNS[Prof_MAX] {};
+    u64 Cycles[Prof_MAX] {};
+    u32 Calls[Prof_MAX] {};
+};
+
+#ifdef PROFILER_ENABLED
+
+class Profiler
+{
+public:
+    Profiler();
+
+    static const char* BucketName(u32 bucket);
+
+    void BeginFrame(u32 framenum);
+    void EndFrame();
+
+    void Enter(u32 bucket)
+    {
+        StackEntry& entry = Stack[Depth++];
+        entry.Bucket = bucket;
+        entry.ChildTime = 0;
+        entry.Start = Now();
+    }
+
+    void Leave()
+    {
+        u64 end = Now();
+        StackEntry& entry = Stack[--Depth];
+
+        u64 time = end - entry.Start;
+        Current.TimeNS[entry.Bucket] += time - entry.ChildTime;
+        Current.Calls[entry.Bucket]++;
+
+        if (Depth > 0)
+            Stack[Depth-1].ChildTime += time;
+
+        if (Tracing && TraceEvents.size() < MaxTraceEvents)
+            TraceEvents.push_back({entry.Start, time, entry.Bucket});
+    }
+
+    void AddCycles(u32 bucket, u64 cycles) { Current.Cycles[bucket] += cycles; }
+
+    /// @return The measurements for the last completed frame.
+    [[nodiscard]] const FrameProfile& GetLastFrame() const noexcept { return LastFrame; }
+
+    /// Starts recording a trace of every instrumented scope.
+    /// @param maxevents Recording stops silently once this many scopes have been recorded.
+    void StartTrace(u32 maxevents = 4*1024*1024);
+    void StopTrace();
+    [[nodiscard]] bool IsTracing() const noexcept { return Tracing; }
+
+    /// Writes the recorded trace in Chrome trace-event format
+    /// (loadable in chrome://tracing or Perfetto).
+    bool WriteTrace(const std::string& path) const;
+
+private:
+    struct StackEntry
+    {
+        u32 Bucket;
+        u64 Start;
+        u64 ChildTime;
+    };
+
+    struct TraceEvent
+    {
+        u64 Start;
+        u64 Duration;
+        u32 Bucket;
+    };
+
+    static u64 Now()
+    {
+        auto t = std::chrono::steady_clock::now().time_since_epoch();
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(t).count();
+    }
+
+    // instrumented scopes nest a few levels at most (frame > event > renderer)
+    StackEntry Stack[16];
+    u32 Depth = 0;
+
+    u64 FrameStart = 0;
+    FrameProfile Current;
+    FrameProfile LastFrame;
+
+    bool Tracing = false;
+    u32 MaxTraceEvents = 0;
+    u64 TraceStart = 0;
+    std::vector<TraceEvent> TraceEvents;
+    std::vector<FrameProfile> TraceFrames;
+    std::vector<u64> TraceFrameStarts;
+};
+
+class ProfilerScope
+{
+public:
+    ProfilerScope(Profiler& prof, u32 bucket) : Prof(prof) { Prof.Enter(bucket); }
+    ~ProfilerScope() { Prof.Leave(); }
+private:
+    Profiler& Prof;
+};
+
+#define PROFILER_SCOPE(prof, bucket) melonDS::ProfilerScope profilerScope((prof), (bucket))
+#define PROFILER_CYCLES(prof, bucket, cycles) (prof).AddCycles((bucket), (cycles))
+
+#else
+
+#define PROFILER_SCOPE(prof, bucket)
+#define PROFILER_CYCLES(prof, bucket, cycles)
+
+#endif
+
+}
+
+#endif // PROFILER_H
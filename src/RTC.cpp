@@ -541,6 +541,16 @@ void RTC::ClockTimer(u32 param)
     ProcessIRQ(1);
 
     ScheduleTimer(false);
+
+    // as long as the RTC IRQ isn't routed to the ARM7, the clock can't be
+    // observed without going through RTC::Write, so it can be run lazily
+    if ((NDS.RCnt & 0xC100) != 0x8100)
+        NDS.ParkEvent(Event_RTC);
+}
+
+void RTC::CatchUp()
+{
+    NDS.CatchUpEvent(Event_RTC);
 }
 
 
@@ -882,6 +892,8 @@ u16 RTC::Read()
 
 void RTC::Write(u16 val, bool byte)
 {
+    CatchUp();
+
     if (byte) val |= (IO & 0xFF00);
 
     //printf("RTC WRITE %04X\n", val);
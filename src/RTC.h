@@ -61,6 +61,7 @@ public:
     void SetDateTime(int year, int month, int day, int hour, int minute, int second);
 
     void ClockTimer(u32 param);
+    void CatchUp();
 
     u16 Read();
     void Write(u16 val, bool byte);
@@ -0,0 +1,359 @@
+/*
+    Copyright 2016-2026 melonDS team
+
+    This file is part of melonDS.
+
+    melonDS is free software: you can redistribute it and/or modify it under
+    the terms of the GNU General Public License as published by the Free
+    Software Foundation, either version 3 of the License, or (at your option)
+    any later version.
+
+    melonDS is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+    FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with melonDS. If not, see http://www.gnu.org/licenses/.
+*/
+
+#include <string.h>
+#include <algorithm>
+
+#include "RewindBuffer.h"
+#include "DirtyPages.h"
+#include "Platform.h"
+
+namespace melonDS
+{
+using Platform::Log;
+using Platform::LogLevel;
+
+// A delta is a sequence of runs, each made of:
+//   u32 skip  - number of bytes identical to the reference
+//   u32 count - number of differing bytes
+//   u8 xor[count] - the differing bytes XORed with the reference
+// Bytes past the last run are identical to the reference.
+
+// a run header costs 8 bytes, so differing bytes are only split
+// into separate runs when at least that many identical bytes lie between them
+constexpr u32 MinSkipWords = 2;
+
+RewindBuffer::RewindBuffer(u64 budget, u32 keyframeinterval) :
+    Budget(budget),
+    KeyframeInterval(keyframeinterval ? keyframeinterval : 1)
+{
+}
+
+void RewindBuffer::SetBudget(u64 budget)
+{
+    Budget = budget;
+    Trim();
+}
+
+void RewindBuffer::Clear()
+{
+    Entries.clear();
+    HeadTracked.clear();
+    MemoryUsage = 0;
+    SinceKeyframe = 0;
+}
+
+void RewindBuffer::Push(const Savestate& state, const DirtyPageTracker* tracker)
+{
+    u32 len = state.Length();
+    FindChangedRanges(state, tracker, len);
+    Add(static_cast<const u8*>(state.Buffer()), len);
+
+    u32 numtracked;
+    const Savestate::TrackedBlock* tracked = state.GetTrackedBlocks(numtracked);
+    if (tracker)
+        HeadTracked.assign(tracked, tracked + numtracked);
+    else
+        HeadTracked.clear();
+}
+
+void RewindBuffer::Push(const u8* data, u32 len)
+{
+    Changed.assign(1, {0, len});
+    HeadTracked.clear();
+    Add(data, len);
+}
+
+void RewindBuffer::FindChangedRanges(const Savestate& state, const DirtyPageTracker* tracker, u32 len)
+{
+    Changed.clear();
+
+    // ranges are compared in whole words
+    auto addrange = [&](u32 start, u32 end)
+    {
+        start &= ~7;
+        end = std::min((end + 7) & ~7, len);
+        if (start >= end)
+            return;
+
+        if (!Changed.empty() && start <= Changed.back().End)
+            Changed.back().End = std::max(Changed.back().End, end);
+        else
+            Changed.push_back({start, end});
+    };
+
+    u32 pos = 0;
+    u32 numtracked;
+    const Savestate::TrackedBlock* tracked = state.GetTrackedBlocks(numtracked);
+    for (u32 i = 0; tracker && Head.size() == len && i < numtracked; i++)
+    {
+        const Savestate::TrackedBlock& block = tracked[i];
+        if (block.TrackerID != tracker->GetID() || block.Offset < pos || block.Length > len - block.Offset)
+            continue;
+
+        auto prev = std::find_if(HeadTracked.begin(), HeadTracked.end(), [&](const Savestate::TrackedBlock& cur)
+        {
+            return cur.TrackerID == block.TrackerID && cur.Region == block.Region && cur.RegionOffset == block.RegionOffset
+                && cur.Offset == block.Offset && cur.Length == block.Length;
+        });
+        if (prev == HeadTracked.end())
+            continue;
+
+        // the pages that weren't written since the head was saved are the same in it
+        addrange(pos, block.Offset);
+        tracker->ForEachChanged(block.Region, block.RegionOffset, block.Length, prev->Generation, [&](u32 start, u32 count)
+        {
+            addrange(block.Offset + start, block.Offset + start + count);
+        });
+        pos = block.Offset + block.Length;
+    }
+
+    addrange(pos, len);
+}
+
+void RewindBuffer::Add(const u8* data, u32 len)
+{
+    // states can change size, ie. when the cart is changed, in which case they can't be XORed
+    bool keyframe = Entries.empty() || SinceKeyframe >= KeyframeInterval || Head.size() != len;
+    if (keyframe)
+        Changed.assign(1, {0, len});
+
+    Entry entry;
+    entry.Keyframe = keyframe;
+    entry.Length = len;
+    Encode(entry.Delta, data, keyframe ? nullptr : Head.data(), len, Changed);
+
+    // the head only needs the changed bytes updated
+    if (keyframe)
+        Head.assign(data, data + len);
+    else
+        Decode(Head.data(), Head.data(), entry.Delta, len);
+
+    SinceKeyframe = keyframe ? 1 : SinceKeyframe+1;
+    MemoryUsage += entry.Delta.size();
+    Entries.push_back(std::move(entry));
+
+    Trim();
+}
+
+const u8* RewindBuffer::Pop(u32& len)
+{
+    if (Entries.empty())
+    {
+        len = 0;
+        return nullptr;
+    }
+
+    std::swap(Out, Head);
+    len = Out.size();
+
+    // the tracker's generations are relative to the popped snapshot, not the one before
+    HeadTracked.clear();
+
+    if (!RebuildHead())
+    {
+        Log(LogLevel::Error, "RewindBuffer: corrupted snapshot, dropping the rest of the buffer\n");
+        Clear();
+    }
+
+    return Out.data();
+}
+
+bool RewindBuffer::RebuildHead()
+{
+    Entry entry = std::move(Entries.back());
+    Entries.pop_back();
+    MemoryUsage -= entry.Delta.size();
+
+    if (Entries.empty())
+    {
+        Head.clear();
+        SinceKeyframe = 0;
+        return true;
+    }
+
+    if (!entry.Keyframe)
+    {
+        // the snapshot before is this one with its delta undone
+        SinceKeyframe--;
+        Head.resize(entry.Length);
+        return Decode(Head.data(), Out.data(), entry.Delta, entry.Length);
+    }
+
+    // replay the previous group from its keyframe
+    size_t first = Entries.size() - 1;
+    while (!Entries[first].Keyframe)
+        first--;
+
+    SinceKeyframe = Entries.size() - first;
+
+    const Entry& key = Entries[first];
+    Head.resize(key.Length);
+    if (!Decode(Head.data(), nullptr, key.Delta, key.Length))
+        return false;
+
+    for (size_t i = first+1; i < Entries.size(); i++)
+    {
+        if (!Decode(Head.data(), Head.data(), Entries[i].Delta, Entries[i].Length))
+            return false;
+    }
+
+    return true;
+}
+
+void RewindBuffer::Trim()
+{
+    // drop whole groups, but always keep the newest one
+    while (MemoryUsage > Budget)
+    {
+        size_t next = 1;
+        while (next < Entries.size() && !Entries[next].Keyframe)
+            next++;
+
+        if (next >= Entries.size())
+            break;
+
+        for (size_t i = 0; i < next; i++)
+            MemoryUsage -= Entries[i].Delta.size();
+        Entries.erase(Entries.begin(), Entries.begin() + next);
+    }
+}
+
+void RewindBuffer::Encode(std::vector<u8>& out, const u8* data, const u8* ref, u32 len, const std::vector<Range>& ranges)
+{
+    out.clear();
+
+    auto word = [&](u32 pos) -> u64
+    {
+        u64 a, b = 0;
+        memcpy(&a, &data[pos], 8);
+        if (ref) memcpy(&b, &ref[pos], 8);
+        return a ^ b;
+    };
+
+    auto addrun = [&](u32 skip, u32 start, u32 count)
+    {
+        size_t pos = out.size();
+        out.resize(pos + 8 + count);
+        memcpy(&out[pos], &skip, 4);
+        memcpy(&out[pos+4], &count, 4);
+        u8* dst = &out[pos+8];
+        for (u32 i = 0; i < count; i++)
+            dst[i] = data[start+i] ^ (ref ? ref[start+i] : 0);
+    };
+
+    // compare in whole words, the tail (if any) is always stored.
+    // Outside of the given ranges, data is the same as ref
+    u32 wordlen = len & ~7;
+    u32 runend = 0; // end of the last stored run
+    for (const Range& range : ranges)
+    {
+        u32 pos = range.Start;
+        u32 rangeend = std::min(range.End, wordlen);
+        while (pos < rangeend)
+        {
+            // most of the state is unchanged, skip over it in larger chunks first
+            if (ref && (rangeend - pos) >= 64 && !memcmp(&data[pos], &ref[pos], 64))
+            {
+                pos += 64;
+                continue;
+            }
+
+            if (word(pos) == 0)
+            {
+                pos += 8;
+                continue;
+            }
+
+            // extend the run until enough identical words are found
+            u32 start = pos;
+            u32 end = pos + 8;
+            pos += 8;
+            while (pos < rangeend)
+            {
+                if (word(pos) != 0)
+                {
+                    pos += 8;
+                    end = pos;
+                }
+                else if (pos - end >= (MinSkipWords-1)*8)
+                {
+                    pos += 8;
+                    break;
+                }
+                else
+                    pos += 8;
+            }
+
+            addrun(start - runend, start, end - start);
+            runend = end;
+        }
+    }
+
+    if (wordlen < len)
+    {
+        addrun(wordlen - runend, wordlen, len - wordlen);
+    }
+}
+
+bool RewindBuffer::Decode(u8* out, const u8* ref, const std::vector<u8>& delta, u32 len)
+{
+    // out can be ref, to apply a delta in place
+    u32 pos = 0;
+    size_t in = 0;
+    while (in < delta.size())
+    {
+        if (delta.size() - in < 8) return false;
+
+        u32 skip, count;
+        memcpy(&skip, &delta[in], 4);
+        memcpy(&count, &delta[in+4], 4);
+        in += 8;
+
+        if (skip > len - pos || count > len - pos - skip || count > delta.size() - in)
+            return false;
+
+        if (ref)
+        {
+            if (out != ref) memcpy(&out[pos], &ref[pos], skip);
+            pos += skip;
+            for (u32 i = 0; i < count; i++)
+                out[pos+i] = ref[pos+i] ^ delta[in+i];
+        }
+        else
+        {
+            memset(&out[pos], 0, skip);
+            pos += skip;
+            memcpy(&out[pos], &delta[in], count);
+        }
+
+        pos += count;
+        in += count;
+    }
+
+    if (ref)
+    {
+        if (out != ref) memcpy(&out[pos], &ref[pos], len - pos);
+    }
+    else
+        memset(&out[pos], 0, len - pos);
+
+    return true;
+}
+
+}
@@ -0,0 +1,111 @@
+/*
+    Copyright 2016-2026 melonDS team
+
+    This file is part of melonDS.
+
+    melonDS is free software: you can redistribute it and/or modify it under
+    the terms of the GNU General Public License as published by the Free
+    Software Foundation, either version 3 of the License, or (at your option)
+    any later version.
+
+    melonDS is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+    FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with melonDS. If not, see http://www.gnu.org/licenses/.
+*/
+
+#ifndef REWINDBUFFER_H
+#define REWINDBUFFER_H
+
+#include <deque>
+#include <vector>
+
+#include "types.h"
+#include "Savestate.h"
+
+namespace melonDS
+{
+class DirtyPageTracker;
+
+/// Ring of savestate snapshots for stepping back in time, capped by a memory budget.
+///
+/// Consecutive snapshots differ in little of their data, so each one is stored as
+/// the XOR against the previous snapshot with its zero runs skipped. A keyframe,
+/// stored the same way against zeroes, starts a new group every few snapshots.
+/// When over budget, the oldest group is dropped as a whole.
+///
+/// Snapshots are taken back newest first: since XOR deltas work both ways, stepping
+/// back only undoes the delta of the snapshot that was taken back. Only going past a
+/// keyframe needs the previous group to be replayed from its own keyframe.
+///
+/// Memory saved with Savestate::VarTracked is only compared where its tracker saw
+/// writes since the previous snapshot, the rest is known to be the same.
+class RewindBuffer
+{
+public:
+    /// @param budget Maximum memory used by the stored snapshots, in bytes.
+    /// This doesn't include the two full-size buffers used for encoding and decoding.
+    /// @param keyframeinterval Number of snapshots per group.
+    explicit RewindBuffer(u64 budget, u32 keyframeinterval = 64);
+    RewindBuffer(const RewindBuffer&) = delete;
+    RewindBuffer& operator=(const RewindBuffer&) = delete;
+
+    void SetBudget(u64 budget);
+    void Clear();
+
+    /// Adds a finished savestate as the newest snapshot.
+    /// @param tracker The tracker the state's memory was saved with, if any.
+    void Push(const Savestate& state, const DirtyPageTracker* tracker = nullptr);
+    void Push(const u8* data, u32 len);
+
+    /// Takes back the newest snapshot.
+    /// @return A pointer to the snapshot's data, valid until the next call to Push or Pop,
+    /// or nullptr if the buffer is empty.
+    const u8* Pop(u32& len);
+
+    [[nodiscard]] bool IsEmpty() const noexcept { return Entries.empty(); }
+    [[nodiscard]] u32 GetNumEntries() const noexcept { return Entries.size(); }
+    [[nodiscard]] u64 GetMemoryUsage() const noexcept { return MemoryUsage; }
+
+private:
+    struct Entry
+    {
+        bool Keyframe;
+        u32 Length;
+        std::vector<u8> Delta;
+    };
+
+    // a range of the state that may differ from the head
+    struct Range
+    {
+        u32 Start;
+        u32 End;
+    };
+
+    void FindChangedRanges(const Savestate& state, const DirtyPageTracker* tracker, u32 len);
+    void Add(const u8* data, u32 len);
+    static void Encode(std::vector<u8>& out, const u8* data, const u8* ref, u32 len, const std::vector<Range>& ranges);
+    static bool Decode(u8* out, const u8* ref, const std::vector<u8>& delta, u32 len);
+    void Trim();
+    bool RebuildHead();
+
+    u64 Budget;
+    u32 KeyframeInterval;
+    u64 MemoryUsage = 0;
+    u32 SinceKeyframe = 0;
+    std::deque<Entry> Entries;
+
+    // Head holds the newest snapshot in full, Out the one handed out by Pop
+    std::vector<u8> Head;
+    std::vector<u8> Out;
+
+    // the tracked blocks of the head, empty if it wasn't pushed from a tracked state
+    std::vector<Savestate::TrackedBlock> HeadTracked;
+    std::vector<Range> Changed;
+};
+
+}
+
+#endif // REWINDBUFFER_H
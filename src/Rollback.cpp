@@ -0,0 +1,387 @@
+/*
+    Copyright 2016-2026 melonDS team
+
+    This file is part of melonDS.
+
+    melonDS is free software: you can redistribute it and/or modify it under
+    the terms of the GNU General Public License as published by the Free
+    Software Foundation, either version 3 of the License, or (at your option)
+    any later version.
+
+    melonDS is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+    FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with melonDS. If not, see http://www.gnu.org/licenses/.
+*/
+
+#include <algorithm>
+
+#include "Rollback.h"
+#include "NDS.h"
+#include "NDSCart.h"
+#include "Savestate.h"
+#include "Platform.h"
+
+#define XXH_STATIC_LINKING_ONLY
+#include "xxhash/xxhash.h"
+
+namespace melonDS
+{
+using Platform::Log;
+using Platform::LogLevel;
+
+// what a start state begins with, followed by the compressed console state
+struct StartStateHeader
+{
+    u32 GameCode;
+    u16 HeaderCRC;
+    u8 InputDelay;
+    u8 MaxFrames;
+    u32 StateLength;
+};
+
+Rollback::Rollback(melonDS::NDS& nds, int localplayer, int numplayers, int inputdelay, int maxframes, int checksuminterval) noexcept :
+    NDS(nds),
+    LocalPlayer(localplayer),
+    NumPlayers(std::clamp(numplayers, 1, MaxPlayers)),
+    InputDelay(std::clamp(inputdelay, 0, MaxInputDelay)),
+    MaxAhead(std::clamp(maxframes, 1, MaxFrames)),
+    ChecksumInterval(std::max(checksuminterval, 0))
+{
+    Frame = 0;
+
+    // the first frames are emulated before any delayed input can apply,
+    // every peer agrees they have none
+    for (int p = 0; p < MaxPlayers; p++)
+    {
+        for (u32 i = 0; i < InputRing; i++)
+        {
+            Inputs[p][i] = NoInput;
+            UsedInputs[p][i] = NoInput;
+        }
+        NumInputs[p] = InputDelay;
+    }
+    NumInputsSent = InputDelay;
+
+    RollbackFrame = NoFrame;
+
+    memset(FrameChecksums, 0, sizeof(FrameChecksums));
+    NextChecksumFrame = ChecksumInterval;
+    NumLocalChecksums = 0;
+    NumChecksumsSent = 0;
+    NumRemoteChecksums = 0;
+
+    Desynced = false;
+    DesyncFrame = NoFrame;
+
+    memset(&Stat, 0, sizeof(Stat));
+
+    // the other peers can't hear this machine's mic
+    NDS.Mic.SetMuted(true);
+}
+
+Rollback::~Rollback()
+{
+    NDS.Mic.SetMuted(false);
+    NDS.GPU.SetSkipDrawing(false);
+    NDS.SPU.SetOutputEnabled(true);
+}
+
+u32 Rollback::GetConfirmedFrame() const noexcept
+{
+    u32 ret = NumInputs[0];
+    for (int p = 1; p < NumPlayers; p++)
+        ret = std::min(ret, NumInputs[p]);
+    return ret;
+}
+
+const Rollback::Input& Rollback::GetInput(int player, u32 frame) const noexcept
+{
+    u32 num = NumInputs[player];
+    if (frame < num)
+        return Inputs[player][frame % InputRing];
+
+    // not received yet, the player is assumed to keep doing what they last did
+    if (num == 0)
+        return NoInput;
+    return Inputs[player][(num - 1) % InputRing];
+}
+
+void Rollback::ApplyInput(u32 frame)
+{
+    // shared-controller mode: all players drive the one console, a key is down
+    // if any of them holds it, and the touchscreen goes to the first player touching it
+    u32 keymask = 0xFFF;
+    const Input* touch = nullptr;
+
+    for (int p = 0; p < NumPlayers; p++)
+    {
+        const Input& input = GetInput(p, frame);
+        UsedInputs[p][frame % InputRing] = input;
+
+        keymask &= input.KeyMask;
+        if (input.Touching && !touch)
+            touch = &input;
+    }
+
+    NDS.SetKeyMask(keymask);
+    if (touch)
+        NDS.TouchScreen(touch->TouchX, touch->TouchY);
+    else
+        NDS.ReleaseScreen();
+}
+
+u32 Rollback::Simulate(u32 frame)
+{
+    // a frame can only be rolled back to if some of its input is predicted
+    if (frame >= GetConfirmedFrame())
+    {
+        std::unique_ptr<Savestate>& state = States[frame % (MaxAhead + 1)];
+        if (!state)
+            state = std::make_unique<Savestate>();
+        else
+            state->Rewind(true);
+
+        NDS.DoSavestate(state.get());
+        if (state->Error)
+            Log(LogLevel::Error, "Rollback: failed to snapshot frame %u\n", frame);
+    }
+
+    if (ChecksumInterval && frame && (frame % ChecksumInterval) == 0)
+        FrameChecksums[frame % InputRing] = Checksum(NDS);
+
+    ApplyInput(frame);
+    return NDS.RunFrame();
+}
+
+u32 Rollback::RunFrame(const Input& local)
+{
+    if (Frame >= GetConfirmedFrame() + MaxAhead)
+    {
+        Stat.Stalls++;
+        return 0;
+    }
+
+    // the input goes to the frame the delay points at, which skips frames
+    // if the delay just grew and is one already given input if it shrank
+    while (NumInputs[LocalPlayer] <= Frame + InputDelay)
+    {
+        Inputs[LocalPlayer][NumInputs[LocalPlayer] % InputRing] = local;
+        NumInputs[LocalPlayer]++;
+    }
+
+    if (RollbackFrame < Frame)
+    {
+        Savestate* state = States[RollbackFrame % (MaxAhead + 1)].get();
+        state->Rewind(false);
+        NDS.DoSavestate(state);
+        if (state->Error)
+            Log(LogLevel::Error, "Rollback: failed to restore frame %u\n", RollbackFrame);
+
+        u32 depth = Frame - RollbackFrame;
+        Stat.Rollbacks++;
+        Stat.FramesResimulated += depth;
+        Stat.MaxDepth = std::max(Stat.MaxDepth, depth);
+
+        // these frames were already seen and heard
+        NDS.GPU.SetSkipDrawing(true);
+        NDS.SPU.SetOutputEnabled(false);
+        for (u32 f = RollbackFrame; f < Frame; f++)
+            Simulate(f);
+        NDS.GPU.SetSkipDrawing(false);
+        NDS.SPU.SetOutputEnabled(true);
+    }
+    RollbackFrame = NoFrame;
+
+    u32 nlines = Simulate(Frame);
+    Frame++;
+
+    // checksums are final once no rollback can go back before them
+    u32 confirmed = std::min(GetConfirmedFrame(), Frame - 1);
+    while (ChecksumInterval && NextChecksumFrame <= confirmed)
+    {
+        ChecksumEntry& entry = LocalChecksums[NumLocalChecksums % ChecksumRing];
+        entry.Frame = NextChecksumFrame;
+        entry.Checksum = FrameChecksums[NextChecksumFrame % InputRing];
+        NumLocalChecksums++;
+
+        NextChecksumFrame += ChecksumInterval;
+    }
+    CompareChecksums();
+
+    return nlines;
+}
+
+void Rollback::SetInputDelay(int inputdelay) noexcept
+{
+    InputDelay = std::clamp(inputdelay, 0, MaxInputDelay);
+}
+
+bool Rollback::AddRemoteInput(int player, u32 frame, const Input& input)
+{
+    if (player < 0 || player >= NumPlayers || player == LocalPlayer)
+        return false;
+
+    u32 num = NumInputs[player];
+    if (frame < num)
+        return true; // already received
+    if (frame > num || (frame - std::min(GetConfirmedFrame(), Frame)) >= InputRing)
+        return false;
+
+    Inputs[player][frame % InputRing] = input;
+    NumInputs[player]++;
+
+    if (frame < Frame && UsedInputs[player][frame % InputRing] != input)
+        RollbackFrame = std::min(RollbackFrame, frame);
+
+    return true;
+}
+
+void Rollback::AddRemoteChecksum(u32 frame, u64 checksum)
+{
+    ChecksumEntry& entry = RemoteChecksums[NumRemoteChecksums % ChecksumRing];
+    entry.Frame = frame;
+    entry.Checksum = checksum;
+    NumRemoteChecksums++;
+
+    CompareChecksums();
+}
+
+void Rollback::CompareChecksums()
+{
+    u32 numlocal = std::min(NumLocalChecksums, ChecksumRing);
+    u32 numremote = std::min(NumRemoteChecksums, ChecksumRing);
+
+    for (u32 i = 0; i < numlocal; i++)
+    {
+        const ChecksumEntry& local = LocalChecksums[(NumLocalChecksums - 1 - i) % ChecksumRing];
+        for (u32 j = 0; j < numremote; j++)
+        {
+            const ChecksumEntry& remote = RemoteChecksums[(NumRemoteChecksums - 1 - j) % ChecksumRing];
+            if (remote.Frame != local.Frame || remote.Checksum == local.Checksum)
+                continue;
+
+            if (!Desynced || local.Frame < DesyncFrame)
+            {
+                if (!Desynced)
+                    Log(LogLevel::Warn, "Rollback: desync detected at frame %u\n", local.Frame);
+                Desynced = true;
+                DesyncFrame = local.Frame;
+            }
+        }
+    }
+}
+
+bool Rollback::PopLocalInput(u32& frame, Input& input)
+{
+    if (NumInputsSent >= NumInputs[LocalPlayer])
+        return false;
+
+    frame = NumInputsSent++;
+    input = Inputs[LocalPlayer][frame % InputRing];
+    return true;
+}
+
+bool Rollback::PopLocalChecksum(u32& frame, u64& checksum)
+{
+    if (NumChecksumsSent >= NumLocalChecksums)
+        return false;
+
+    const ChecksumEntry& entry = LocalChecksums[NumChecksumsSent++ % ChecksumRing];
+    frame = entry.Frame;
+    checksum = entry.Checksum;
+    return true;
+}
+
+u64 Rollback::Checksum(melonDS::NDS& nds)
+{
+    XXH3_state_t* state = XXH3_createState();
+    XXH3_64bits_reset(state);
+
+    XXH3_64bits_update(state, nds.MainRAM, nds.MainRAMMask + 1);
+    XXH3_64bits_update(state, nds.SharedWRAM, nds.SharedWRAMSize);
+    XXH3_64bits_update(state, nds.ARM7WRAM, ARM7WRAMSize);
+    XXH3_64bits_update(state, nds.ARM9.R, sizeof(nds.ARM9.R));
+    XXH3_64bits_update(state, &nds.ARM9.CPSR, sizeof(nds.ARM9.CPSR));
+    XXH3_64bits_update(state, nds.ARM7.R, sizeof(nds.ARM7.R));
+    XXH3_64bits_update(state, &nds.ARM7.CPSR, sizeof(nds.ARM7.CPSR));
+
+    u64 ret = XXH3_64bits_digest(state);
+    XXH3_freeState(state);
+    return ret;
+}
+
+static void GetGameID(melonDS::NDS& nds, u32& gamecode, u16& crc)
+{
+    gamecode = 0;
+    crc = 0;
+    if (const NDSCart::CartCommon* cart = nds.NDSCartSlot.GetCart())
+    {
+        gamecode = cart->GetHeader().GameCodeAsU32();
+        crc = cart->GetHeader().HeaderCRC16;
+    }
+}
+
+bool Rollback::SaveStartState(melonDS::NDS& nds, int inputdelay, int maxframes, std::vector<u8>& data)
+{
+    Savestate state;
+    nds.DoSavestate(&state);
+    if (state.Error)
+        return false;
+
+    // the state is compressed straight into place
+    u32 bound = Savestate::CompressedBound(state.Length());
+    data.resize(sizeof(StartStateHeader) + bound);
+    u32 statelen = state.Compress(&data[sizeof(StartStateHeader)], bound);
+    if (!statelen)
+        return false;
+    data.resize(sizeof(StartStateHeader) + statelen);
+
+    StartStateHeader header = {};
+    GetGameID(nds, header.GameCode, header.HeaderCRC);
+    header.InputDelay = std::clamp(inputdelay, 0, MaxInputDelay);
+    header.MaxFrames = std::clamp(maxframes, 1, MaxFrames);
+    header.StateLength = statelen;
+    memcpy(&data[0], &header, sizeof(header));
+    return true;
+}
+
+Rollback::StartResult Rollback::CheckStartState(melonDS::NDS& nds, const u8* data, u32 len) noexcept
+{
+    StartStateHeader header;
+    if (len < sizeof(header)) return Start_Malformed;
+    memcpy(&header, data, sizeof(header));
+    if (header.StateLength != (len - sizeof(header))) return Start_Malformed;
+    if (header.InputDelay > MaxInputDelay) return Start_Malformed;
+    if (header.MaxFrames < 1 || header.MaxFrames > MaxFrames) return Start_Malformed;
+
+    u32 gamecode;
+    u16 crc;
+    GetGameID(nds, gamecode, crc);
+    if (gamecode != header.GameCode || crc != header.HeaderCRC)
+        return Start_WrongGame;
+
+    return Start_OK;
+}
+
+Rollback::StartResult Rollback::LoadStartState(melonDS::NDS& nds, const u8* data, u32 len, int& inputdelay, int& maxframes)
+{
+    StartResult res = CheckStartState(nds, data, len);
+    if (res != Start_OK)
+        return res;
+
+    StartStateHeader header;
+    memcpy(&header, data, sizeof(header));
+
+    Savestate state((void*)&data[sizeof(header)], header.StateLength, false);
+    if (state.Error || !nds.DoSavestate(&state) || state.Error)
+        return Start_BadState;
+
+    inputdelay = header.InputDelay;
+    maxframes = header.MaxFrames;
+    return Start_OK;
+}
+
+}
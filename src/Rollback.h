@@ -0,0 +1,221 @@
+/*
+    Copyright 2016-2026 melonDS team
+
+    This file is part of melonDS.
+
+    melonDS is free software: you can redistribute it and/or modify it under
+    the terms of the GNU General Public License as published by the Free
+    Software Foundation, either version 3 of the License, or (at your option)
+    any later version.
+
+    melonDS is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+    FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with melonDS. If not, see http://www.gnu.org/licenses/.
+*/
+
+#ifndef ROLLBACK_H
+#define ROLLBACK_H
+
+#include <memory>
+#include <vector>
+
+#include "types.h"
+
+namespace melonDS
+{
+class NDS;
+class Savestate;
+
+/// Rollback session for netplay: a console shared by several players, each on their own machine.
+///
+/// Every peer runs the console on its own, without waiting for the others' input.
+/// What isn't known yet of a remote player's input is predicted to stay the same as
+/// the last input received from them. When the actual input turns out different,
+/// the console is brought back to the snapshot taken at the start of the first
+/// mispredicted frame and emulated forward again to the current frame, with video
+/// and audio output suppressed.
+///
+/// Local input is applied a few frames after it was entered, which gives it time to
+/// reach the other peers and makes rollbacks rarer and shallower.
+///
+/// Checksums of the console state are exchanged every few frames, once all the
+/// input leading to them is known, so that peers diverging is detected.
+///
+/// This is a shared-controller mode, not a link between several consoles: the players
+/// share the one console, as if they were holding it together. A key is down when any
+/// of them holds it, and the touchscreen follows the first player touching it.
+///
+/// The session doesn't deal with the network: input and checksums to send are
+/// queued for the caller, and what was received is handed to it. The same goes for
+/// the state the session starts from, see \c SaveStartState and \c LoadStartState.
+class Rollback
+{
+public:
+    static constexpr int MaxPlayers = 2;
+    static constexpr int MaxFrames = 16;
+    static constexpr int MaxInputDelay = 16;
+
+    struct Input
+    {
+        u16 KeyMask;    // as passed to NDS::SetKeyMask, 0 = pressed
+        u16 Touching;
+        u16 TouchX, TouchY;
+
+        bool operator==(const Input& other) const noexcept
+        {
+            return KeyMask == other.KeyMask && Touching == other.Touching
+                && TouchX == other.TouchX && TouchY == other.TouchY;
+        }
+        bool operator!=(const Input& other) const noexcept { return !(*this == other); }
+    };
+
+    /// Input before any key is pressed.
+    static constexpr Input NoInput = {0xFFF, 0, 0, 0};
+
+    struct Stats
+    {
+        u32 Rollbacks;          // number of times the console was brought back
+        u32 FramesResimulated;  // number of frames emulated again
+        u32 MaxDepth;           // most frames brought back at once
+        u32 Stalls;             // number of times the console waited for remote input
+    };
+
+    enum StartResult
+    {
+        Start_OK = 0,
+        Start_Malformed,        // the data isn't a start state
+        Start_WrongGame,        // the state is from another game than the one in the console
+        Start_BadState,         // the state couldn't be loaded, the console is left half loaded
+    };
+
+    /// @param nds The console, which has to be in the same state on every peer.
+    /// @param localplayer Number of the player entering input on this machine.
+    /// @param numplayers Number of players in the session, up to \c MaxPlayers.
+    /// @param inputdelay Number of frames local input is delayed by, up to \c MaxInputDelay.
+    /// @param maxframes Most frames the console can be ahead of the last frame
+    /// all input is known for, up to \c MaxFrames.
+    /// @param checksuminterval Number of frames between checksums, 0 to disable them.
+    Rollback(melonDS::NDS& nds, int localplayer, int numplayers, int inputdelay, int maxframes, int checksuminterval = 60) noexcept;
+    ~Rollback();
+    Rollback(const Rollback&) = delete;
+    Rollback& operator=(const Rollback&) = delete;
+
+    /// Enters the local input and emulates the next frame, rolling back first
+    /// if remote input came in that doesn't match what was predicted.
+    /// @return The number of scanlines emulated, or 0 if the console is too far ahead
+    /// of the remote input and waits for it. The local input isn't taken in that case.
+    u32 RunFrame(const Input& local);
+
+    /// Hands over the input of a remote player, for the frame following the last one received from them.
+    /// @return false if the frame isn't the one expected, ie. input was lost.
+    bool AddRemoteInput(int player, u32 frame, const Input& input);
+
+    /// Hands over the checksum a remote peer computed for the given frame.
+    void AddRemoteChecksum(u32 frame, u64 checksum);
+
+    /// Takes the next local input to be sent to the other peers.
+    bool PopLocalInput(u32& frame, Input& input);
+
+    /// Takes the next checksum to be sent to the other peers.
+    bool PopLocalChecksum(u32& frame, u64& checksum);
+
+    /// Changes the number of frames local input is delayed by, from the next call to \c RunFrame.
+    /// The other peers don't need to be told: the input of the frames the delay grows by
+    /// repeats the next input entered, and the input entered while it shrinks is dropped.
+    void SetInputDelay(int inputdelay) noexcept;
+    [[nodiscard]] int GetInputDelay() const noexcept { return InputDelay; }
+
+    /// @return The number of the frame to emulate next.
+    [[nodiscard]] u32 GetFrame() const noexcept { return Frame; }
+
+    /// @return The number of frames all players' input is known for.
+    [[nodiscard]] u32 GetConfirmedFrame() const noexcept;
+
+    /// @return Whether a checksum received didn't match the local one.
+    [[nodiscard]] bool IsDesynced() const noexcept { return Desynced; }
+    [[nodiscard]] u32 GetDesyncFrame() const noexcept { return DesyncFrame; }
+
+    [[nodiscard]] const Stats& GetStats() const noexcept { return Stat; }
+
+    [[nodiscard]] melonDS::NDS& GetNDS() noexcept { return NDS; }
+
+    /// @return A hash of the console's memory and CPU registers,
+    /// which is the same on every peer emulating the same frame.
+    static u64 Checksum(melonDS::NDS& nds);
+
+    /// Saves the state of the console for the other peers to start a session from,
+    /// compressed, along with the session settings and what identifies the game.
+    /// @return false if the state couldn't be saved.
+    static bool SaveStartState(melonDS::NDS& nds, int inputdelay, int maxframes, std::vector<u8>& data);
+
+    /// Checks that a start state is well-formed and was saved from the game in the console.
+    static StartResult CheckStartState(melonDS::NDS& nds, const u8* data, u32 len) noexcept;
+
+    /// Loads a start state saved by \c SaveStartState into the console,
+    /// which isn't touched if \c CheckStartState fails.
+    /// @param inputdelay Set to the input delay the session was started with.
+    /// @param maxframes Set to the most frames the session can be ahead by.
+    static StartResult LoadStartState(melonDS::NDS& nds, const u8* data, u32 len, int& inputdelay, int& maxframes);
+
+private:
+    // enough to hold the input of the frames that can be ahead on either side,
+    // plus the delayed input entered meanwhile
+    static constexpr u32 InputRing = 128;
+    static constexpr u32 ChecksumRing = 8;
+    static constexpr u32 NoFrame = 0xFFFFFFFF;
+
+    struct ChecksumEntry
+    {
+        u32 Frame;
+        u64 Checksum;
+    };
+
+    const Input& GetInput(int player, u32 frame) const noexcept;
+    void ApplyInput(u32 frame);
+    u32 Simulate(u32 frame);
+    void CompareChecksums();
+
+    melonDS::NDS& NDS;
+    int LocalPlayer;
+    int NumPlayers;
+    int InputDelay;
+    int MaxAhead;
+    u32 ChecksumInterval;
+
+    u32 Frame;
+
+    // input per player and frame, and how many frames of it were received
+    Input Inputs[MaxPlayers][InputRing];
+    u32 NumInputs[MaxPlayers];
+    u32 NumInputsSent;
+
+    // input each frame was emulated with, predicted or not
+    Input UsedInputs[MaxPlayers][InputRing];
+
+    // first frame emulated with a wrong prediction
+    u32 RollbackFrame;
+
+    // snapshots from the start of the frames that can be rolled back to
+    std::unique_ptr<Savestate> States[MaxFrames + 1];
+
+    // checksums of the start of frames, computed when they're emulated
+    // and final once all the input before them is known
+    u64 FrameChecksums[InputRing];
+    u32 NextChecksumFrame;
+    ChecksumEntry LocalChecksums[ChecksumRing];
+    u32 NumLocalChecksums, NumChecksumsSent;
+    ChecksumEntry RemoteChecksums[ChecksumRing];
+    u32 NumRemoteChecksums;
+
+    bool Desynced;
+    u32 DesyncFrame;
+
+    Stats Stat;
+};
+
+}
+
+#endif // ROLLBACK_H
@@ -108,6 +108,7 @@ void FirmwareMem::Reset()
     CurCmd = 0;
     Data = 0;
     StatusReg = 0x00;
+    Addr = 0;
 }
 
 void FirmwareMem::DoSavestate(Savestate* file)
@@ -290,6 +290,7 @@ void SPU::DoSavestate(Savestate* file)
 
 void SPU::SetPowerCnt(u32 val)
 {
+    NDS.CatchUpEvent(Event_SPU);
     Mute = !(val & (1<<0));
 }
 
@@ -852,6 +853,8 @@ void SPUCaptureUnit::Run(u32 cycles, s32 sample)
 
 void SPU::Mix(u32 spucycles)
 {
+    PROFILER_SCOPE(NDS.Profiler, Prof_SPUMix);
+
     s32 left = 0, right = 0;
     s32 leftoutput = 0, rightoutput = 0;
 
@@ -1000,20 +1003,52 @@ void SPU::Mix(u32 spucycles)
         output[1] &= 0xFFC0;
     }
 
-    BlipTimer += spucycles;
+    if (OutputEnabled)
+    {
+        BlipTimer += spucycles;
 
-    if (output[0] != OutputLastSamples[0])
-        blip_add_delta(BlipLeft, BlipTimer, (int) output[0] - OutputLastSamples[0]);
-    if (output[1] != OutputLastSamples[1])
-        blip_add_delta(BlipRight, BlipTimer, (int) output[1] - OutputLastSamples[1]);
+        if (output[0] != OutputLastSamples[0])
+            blip_add_delta(BlipLeft, BlipTimer, (int) output[0] - OutputLastSamples[0]);
+        if (output[1] != OutputLastSamples[1])
+            blip_add_delta(BlipRight, BlipTimer, (int) output[1] - OutputLastSamples[1]);
 
-    OutputLastSamples[0] = output[0];
-    OutputLastSamples[1] = output[1];
+        OutputLastSamples[0] = output[0];
+        OutputLastSamples[1] = output[1];
 
-    if (BlipTimer >= 512 * 128)
-        BufferAudio();
+        if (BlipTimer >= 512 * 128)
+            BufferAudio();
+    }
 
     NDS.ScheduleEvent(Event_SPU, true, MixInterval, 0, MixInterval >> 1);
+
+    // while idle, the SPU outputs a constant level and doesn't access memory,
+    // so the next mixes can be done whenever it is accessed again
+    if (IsIdle())
+        NDS.ParkEvent(Event_SPU);
+}
+
+bool SPU::IsIdle() const
+{
+    // on the DSi, the I2S interface mixes in DSP audio at every sample
+    if (NDS.ConsoleType == 1)
+        return false;
+
+    if (NDS.Mic.IsOpen())
+        return false;
+
+    for (const SPUChannel& chan : Channels)
+    {
+        if (chan.Cnt & (1<<31))
+            return false;
+    }
+
+    for (const SPUCaptureUnit& capture : Capture)
+    {
+        if (capture.Cnt & (1<<7))
+            return false;
+    }
+
+    return true;
 }
 
 void SPU::BufferAudio()
@@ -1266,6 +1301,9 @@ u32 SPU::Read32(u32 addr)
 
 void SPU::Write8(u32 addr, u8 val)
 {
+    // register reads don't need this, as they aren't affected by idle mixes
+    NDS.CatchUpEvent(Event_SPU);
+
     if (addr < 0x04000500)
     {
         SPUChannel* chan = &Channels[(addr >> 4) & 0xF];
@@ -1307,6 +1345,8 @@ void SPU::Write8(u32 addr, u8 val)
 
 void SPU::Write16(u32 addr, u16 val)
 {
+    NDS.CatchUpEvent(Event_SPU);
+
     if (addr < 0x04000500)
     {
         SPUChannel* chan = &Channels[(addr >> 4) & 0xF];
@@ -1356,6 +1396,8 @@ void SPU::Write16(u32 addr, u16 val)
 
 void SPU::Write32(u32 addr, u32 val)
 {
+    NDS.CatchUpEvent(Event_SPU);
+
     if (addr < 0x04000500)
     {
         SPUChannel* chan = &Channels[(addr >> 4) & 0xF];
@@ -255,6 +255,8 @@ public:
     int ReadOutput(s16* data, int samples);
     void SetOutputSampleRate(double rate);
     void SetOutputSkew(double skew);
+    // while disabled, the SPU runs as usual but doesn't produce any output (ie. for run-ahead)
+    void SetOutputEnabled(bool enable) { OutputEnabled = enable; }
 
     u8 Read8(u32 addr);
     u16 Read16(u32 addr);
@@ -267,6 +269,7 @@ private:
     u32 OutputBufferSize = 0;
     double OutputSampleRate;
     double OutputSkew = 1.0;
+    bool OutputEnabled = true;
     melonDS::NDS& NDS;
 
     blip_t* BlipLeft;
@@ -282,6 +285,8 @@ private:
 
     Platform::Mutex* AudioLock;
 
+    bool IsIdle() const;
+
     u16 Cnt = 0;
     u8 MasterVolume = 0;
     u16 Bias = 0;
@@ -21,6 +21,8 @@
 #include <cstring>
 #include "Savestate.h"
 #include "Platform.h"
+#include "LZ.h"
+#include "DirtyPages.h"
 
 namespace melonDS
 {
@@ -37,7 +39,9 @@ static const char* SAVESTATE_MAGIC = "MELN";
     04 - version major
     06 - version minor
     08 - length
-    0C - reserved (should be game serial later!)
+    0C - flags
+         bit0: rest of the state after the header is compressed (see LZ.h),
+               length is the uncompressed length
 
     section header:
     00 - section magic
@@ -60,7 +64,13 @@ Savestate::Savestate(void *buffer, u32 size, bool save) :
     buffer_offset(0),
     buffer_length(size),
     buffer_owned(false),
-    finished(false)
+    finished(false),
+    layout_trusted(false),
+    num_sections(0),
+    next_section(0),
+    sections_complete(true),
+    num_tracked(0),
+    num_prev_tracked(0)
 {
     if (Saving)
     {
@@ -68,6 +78,12 @@ Savestate::Savestate(void *buffer, u32 size, bool save) :
     }
     else
     {
+        if (!Decompress())
+        {
+            Error = true;
+            return;
+        }
+
         // Ensure that the file starts with "MELN"
         u32 read_magic = 0;
         Var32(&read_magic);
@@ -110,8 +126,10 @@ Savestate::Savestate(void *buffer, u32 size, bool save) :
             return;
         }
 
-        // The next 4 bytes are reserved
+        // The next 4 bytes are flags, only relevant to the compressed form
         buffer_offset += 4;
+
+        ScanSections();
     }
 }
 
@@ -124,7 +142,13 @@ Savestate::Savestate(u32 initial_size) :
     buffer_offset(0),
     buffer_length(initial_size),
     buffer_owned(true),
-    finished(false)
+    finished(false),
+    layout_trusted(false),
+    num_sections(0),
+    next_section(0),
+    sections_complete(true),
+    num_tracked(0),
+    num_prev_tracked(0)
 {
     buffer = static_cast<u8 *>(malloc(buffer_length));
 
@@ -164,6 +188,10 @@ void Savestate::Section(const char* magic)
 
         CurSection = buffer_offset;
 
+        u32 section_magic;
+        memcpy(&section_magic, magic, sizeof(section_magic));
+        AddSection(section_magic, CurSection + 16);
+
         // Write the new section's magic number
         VarArray((void*)magic, 4);
 
@@ -187,6 +215,7 @@ void Savestate::Section(const char* magic)
         {
             Log(LogLevel::Error, "savestate: section %s not found. blarg\n", magic);
             Error = true;
+            layout_trusted = false;
         }
     }
 }
@@ -222,7 +251,7 @@ void Savestate::Bool32(bool* var)
     }
 }
 
-void Savestate::VarArray(void* data, u32 len)
+void Savestate::CheckedVarArray(void* data, u32 len)
 {
     if (Error || finished) return;
 
@@ -265,6 +294,144 @@ void Savestate::VarArray(void* data, u32 len)
     buffer_offset += len;
 }
 
+void Savestate::VarTracked(void* data, u32 len, DirtyPageTracker* tracker, u32 region, u32 offset)
+{
+    if (!tracker || Error || finished)
+    {
+        VarArray(data, len);
+        return;
+    }
+
+    TrackedBlock block = {tracker->GetID(), region, offset, buffer_offset, len, tracker->GetGeneration()};
+    const TrackedBlock* base = nullptr;
+    if (Saving)
+        base = FindTrackedBlock(prev_tracked, num_prev_tracked, block);
+    else if (layout_trusted)
+        base = FindTrackedBlock(tracked, num_tracked, block);
+
+    if (!base)
+    {
+        VarArray(data, len);
+
+        // what was loaded has nothing to do with what was there before
+        if (!Saving)
+            tracker->MarkRange(region, offset, len);
+    }
+    else if (Saving)
+    {
+        // the buffer holds this block as of the earlier snapshot,
+        // only the pages written since then need to be brought up to date
+        assert(buffer_offset + len <= buffer_length);
+        u8* src = static_cast<u8*>(data);
+        u8* dst = buffer + buffer_offset;
+        tracker->ForEachChanged(region, offset, len, base->Generation, [=](u32 start, u32 count)
+        {
+            memcpy(dst + start, src + start, count);
+        });
+        buffer_offset += len;
+    }
+    else
+    {
+        // reloading the snapshot: only the pages written after it was taken differ from it.
+        // They're marked again since, to any other snapshot, they changed once more
+        u8* src = buffer + buffer_offset;
+        u8* dst = static_cast<u8*>(data);
+        tracker->ForEachChanged(region, offset, len, base->Generation, [=](u32 start, u32 count)
+        {
+            memcpy(dst + start, src + start, count);
+            tracker->MarkRange(region, offset + start, count);
+        });
+        buffer_offset += len;
+    }
+
+    if (Saving && !Error && num_tracked < MAX_TRACKED_BLOCKS)
+        tracked[num_tracked++] = block;
+}
+
+const Savestate::TrackedBlock* Savestate::FindTrackedBlock(const TrackedBlock* blocks, u32 count, const TrackedBlock& block)
+{
+    for (u32 i = 0; i < count; i++)
+    {
+        const TrackedBlock& cur = blocks[i];
+        if (cur.TrackerID == block.TrackerID && cur.Region == block.Region && cur.RegionOffset == block.RegionOffset
+            && cur.Offset == block.Offset && cur.Length == block.Length)
+            return &cur;
+    }
+
+    return nullptr;
+}
+
+u32 Savestate::CompressedBound(u32 len)
+{
+    return 0x10 + LZ::CompressBound(len);
+}
+
+u32 Savestate::Compress(void* dst, u32 dstlen)
+{
+    if (Error || !Saving) return 0;
+    Finish();
+
+    u32 length = buffer_offset;
+    if (length < 0x10 || dstlen < 0x10) return 0;
+
+    u8* out = static_cast<u8*>(dst);
+    memcpy(out, buffer, 0x10);
+
+    u32 flags = FLAG_COMPRESSED;
+    memcpy(out + 0x0C, &flags, sizeof(flags));
+
+    u32 complen = LZ::Compress(buffer + 0x10, length - 0x10, out + 0x10, dstlen - 0x10);
+    if (complen == 0 && length > 0x10)
+    {
+        Log(LogLevel::Error, "savestate: %u-byte buffer too small to compress the state\n", dstlen);
+        return 0;
+    }
+
+    return 0x10 + complen;
+}
+
+bool Savestate::Decompress()
+{
+    if (buffer_length < 0x10) return true;
+
+    u32 flags = 0;
+    memcpy(&flags, buffer + 0x0C, sizeof(flags));
+    if (memcmp(buffer, SAVESTATE_MAGIC, 4) != 0 || !(flags & FLAG_COMPRESSED))
+        return true;
+
+    u32 length = 0;
+    memcpy(&length, buffer + 0x08, sizeof(length));
+    if (length < 0x10 || length > 0x40000000)
+    {
+        Log(LogLevel::Error, "savestate: bad length %u in compressed state\n", length);
+        return false;
+    }
+
+    u8* decomp = static_cast<u8*>(malloc(length));
+    if (!decomp)
+    {
+        Log(LogLevel::Error, "savestate: failed to allocate %d bytes\n", length);
+        return false;
+    }
+
+    if (LZ::Decompress(buffer + 0x10, buffer_length - 0x10, decomp + 0x10, length - 0x10) != (s32)(length - 0x10))
+    {
+        Log(LogLevel::Error, "savestate: compressed state is corrupted\n");
+        free(decomp);
+        return false;
+    }
+
+    // from here on it looks like a regular state
+    memcpy(decomp, buffer, 0x10);
+    flags &= ~FLAG_COMPRESSED;
+    memcpy(decomp + 0x0C, &flags, sizeof(flags));
+
+    buffer = decomp;
+    buffer_length = length;
+    buffer_owned = true;
+    return true;
+}
+
 void Savestate::Finish()
 {
     if (Error || finished) return;
@@ -275,12 +442,39 @@ void Savestate::Finish()
 
 void Savestate::Rewind(bool save)
 {
+    // a failed save can't be built upon
+    if (Saving && Error)
+        num_tracked = 0;
+
+    if (save)
+    {
+        layout_trusted = false;
+        num_sections = 0;
+        sections_complete = true;
+
+        // the buffer keeps what was last saved in it, the next save can skip over what didn't change
+        memcpy(prev_tracked, tracked, num_tracked * sizeof(TrackedBlock));
+        num_prev_tracked = num_tracked;
+        num_tracked = 0;
+    }
+    else if (Saving)
+    {
+        // the sections were recorded while saving
+        Finish();
+        layout_trusted = !Error;
+    }
+
+    next_section = 0;
     Error = false;
     Saving = save;
     CurSection = NO_SECTION;
 
     buffer_offset = 0;
     finished = false;
+
+    // a state rewound for saving is reused as a fresh one
+    if (Saving)
+        WriteSavestateHeader();
 }
 
 void Savestate::CloseCurrentSection()
@@ -342,7 +536,7 @@ void Savestate::WriteSavestateHeader()
     u32 zero = 0;
     Var32(&zero);
 
-    // The following 4 bytes are reserved
+    // The following 4 bytes are flags, none for an uncompressed state
     Var32(&zero);
 }
 
@@ -357,10 +551,62 @@ void Savestate::WriteStateLength()
     memcpy(buffer + 0x08, &state_length, sizeof(state_length));
 }
 
-u32 Savestate::FindSection(const char* magic) const
+void Savestate::AddSection(u32 magic, u32 offset)
+{
+    if (num_sections < MAX_SECTIONS)
+        sections[num_sections++] = {magic, offset};
+    else
+        sections_complete = false;
+}
+
+void Savestate::ScanSections()
+{
+    num_sections = 0;
+    next_section = 0;
+    sections_complete = true;
+
+    for (u32 offset = 0x10; offset + 16 <= buffer_length;)
+    {
+        u32 magic = 0, section_length = 0;
+        memcpy(&magic, buffer + offset, sizeof(magic));
+        memcpy(&section_length, buffer + offset + 4, sizeof(section_length));
+
+        // (The section length includes the 16-byte header.)
+        if (section_length < 16 || section_length > buffer_length - offset)
+        {
+            Log(LogLevel::Warn, "savestate: bad length %u for section at %#x\n", section_length, offset);
+            break;
+        }
+
+        AddSection(magic, offset + 16);
+        offset += section_length;
+    }
+}
+
+u32 Savestate::FindSection(const char* magic)
 {
     if (!magic) return NO_SECTION;
 
+    u32 wanted_magic;
+    memcpy(&wanted_magic, magic, sizeof(wanted_magic));
+
+    // Sections are normally loaded in the order they were saved in
+    if (next_section < num_sections && sections[next_section].Magic == wanted_magic)
+        return sections[next_section++].Offset;
+
+    for (u32 i = 0; i < num_sections; i++)
+    {
+        if (sections[i].Magic == wanted_magic)
+        {
+            next_section = i + 1;
+            return sections[i].Offset;
+        }
+    }
+
+    if (sections_complete)
+        return NO_SECTION;
+
+    // More sections than the table can hold, look for it the slow way.
     // Start looking at the savestate's beginning, right after its global header
     // (we can't start from the current offset because then we'd lose the ability to rearrange sections)
 
@@ -387,13 +633,14 @@ u32 Savestate::FindSection(const char* magic) const
         // First we need to find out how big this section is...
         u32 section_length = 0;
         memcpy(&section_length, buffer + section_length_offset, sizeof(section_length));
+        if (section_length < 16)
+            break;
 
         // ...then skip it. (The section length includes the 16-byte header.)
         offset += section_length;
     }
 
     // We've reached the end of the file without finding the requested section...
-    Log(LogLevel::Error, "savestate: section %s not found. blarg\n", magic);
     return NO_SECTION;
 }
 
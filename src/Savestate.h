@@ -19,13 +19,14 @@
 #ifndef SAVESTATE_H
 #define SAVESTATE_H
 
+#include <cassert>
 #include <cstring>
 #include <string>
 #include <stdio.h>
 #include "types.h"
 
 #define SAVESTATE_MAJOR 14
-#define SAVESTATE_MINOR 0
+#define SAVESTATE_MINOR 1
 
 // bitmask for the savestate config word
 enum
@@ -36,6 +37,8 @@ enum
 
 namespace melonDS
 {
+class DirtyPageTracker;
+
 class Savestate
 {
 public:
@@ -76,11 +79,60 @@ public:
     void VarBool(bool* var);
     void Bool32(bool* var); // backwards compatibility (TODO remove)
 
-    void VarArray(void* data, u32 len);
+    void VarArray(void* data, u32 len)
+    {
+        if (layout_trusted)
+        {
+            // reloading what was just saved, the reads follow the writes
+            // unless something is loaded differently from how it was saved
+            if (buffer_offset + len > buffer_length)
+            {
+                layout_trusted = false;
+                Error = true;
+                return;
+            }
+            memcpy(data, buffer + buffer_offset, len);
+            buffer_offset += len;
+            return;
+        }
+
+        CheckedVarArray(data, len);
+    }
+
+    /// Saves or loads a block of guest memory whose writes are tracked by \c tracker,
+    /// at \c offset within the tracked region.
+    /// When saving over an earlier snapshot of the same console that holds this block
+    /// at the same place, only the pages written since that snapshot are copied.
+    /// Likewise when reloading a snapshot right after saving it, only the pages written
+    /// since are copied back. Without a tracker, this is the same as VarArray.
+    void VarTracked(void* data, u32 len, DirtyPageTracker* tracker, u32 region, u32 offset = 0);
+
+    /// A block saved with VarTracked, and the snapshot of its tracker it's from.
+    struct TrackedBlock
+    {
+        u32 TrackerID;
+        u32 Region;
+        u32 RegionOffset;
+        u32 Offset; // within the state
+        u32 Length;
+        u32 Generation;
+    };
+
+    /// @return The blocks written with VarTracked by the last save, in the order they were written.
+    [[nodiscard]] const TrackedBlock* GetTrackedBlocks(u32& count) const
+    {
+        count = num_tracked;
+        return tracked;
+    }
 
     void Finish();
 
-    // TODO rewinds the stream
+    /// Rewinds the stream, to load the state again or to save a new one over it.
+    /// The buffer is kept, so a state can be used as an arena for repeated snapshots
+    /// without allocating.
+    /// A state rewound for loading right after being saved is finished first and
+    /// then read with only a bounds check per variable, so it must be loaded into
+    /// the console that saved it.
     void Rewind(bool save);
 
     bool IsAtLeastVersion(u32 major, u32 minor)
@@ -91,6 +143,15 @@ public:
         return false;
     }
 
+    /// @return The largest size the compressed form of a \c len -byte state can take.
+    static u32 CompressedBound(u32 len);
+
+    /// Encodes the state in its compressed form, for storage.
+    /// Finishes the state first if it is still being saved.
+    /// Compressed states are loaded like regular ones, they are recognized from their header.
+    /// @return The size of the compressed state, or 0 if it doesn't fit in \c dstlen bytes.
+    u32 Compress(void* dst, u32 dstlen);
+
     void* Buffer() { return buffer; }
     [[nodiscard]] const void* Buffer() const { return buffer; }
 
@@ -116,16 +177,45 @@ public:
 
 private:
     static constexpr u32 NO_SECTION = 0xffffffff;
+    // bits for the header flags word
+    static constexpr u32 FLAG_COMPRESSED = (1<<0);
+    // a DSi state has about twice as many sections as a DS one
+    static constexpr u32 MAX_SECTIONS = 128;
+
+    static constexpr u32 MAX_TRACKED_BLOCKS = 16;
+
+    // where each section starts, recorded while saving or gathered once when
+    // loading, so sections don't need to be searched for
+    struct SectionEntry
+    {
+        u32 Magic;
+        u32 Offset;
+    };
+
+    bool Decompress();
+    void CheckedVarArray(void* data, u32 len);
     void CloseCurrentSection();
     bool Resize(u32 new_length);
     void WriteSavestateHeader();
     void WriteStateLength();
-    u32 FindSection(const char* magic) const;
+    void AddSection(u32 magic, u32 offset);
+    void ScanSections();
+    u32 FindSection(const char* magic);
+    static const TrackedBlock* FindTrackedBlock(const TrackedBlock* blocks, u32 count, const TrackedBlock& block);
     u8* buffer;
     u32 buffer_offset;
     u32 buffer_length;
     bool buffer_owned;
     bool finished;
+    bool layout_trusted;
+    SectionEntry sections[MAX_SECTIONS];
+    u32 num_sections;
+    u32 next_section;
+    bool sections_complete;
+    TrackedBlock tracked[MAX_TRACKED_BLOCKS]; // written by the current save
+    u32 num_tracked;
+    TrackedBlock prev_tracked[MAX_TRACKED_BLOCKS]; // written by the previous one
+    u32 num_prev_tracked;
 };
 }
 
@@ -0,0 +1,218 @@
+/*
+    Copyright 2016-2026 melonDS team
+
+    This file is part of melonDS.
+
+    melonDS is free software: you can redistribute it and/or modify it under
+    the terms of the GNU General Public License as published by the Free
+    Software Foundation, either version 3 of the License, or (at your option)
+    any later version.
+
+    melonDS is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+    FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with melonDS. If not, see http://www.gnu.org/licenses/.
+*/
+
+#if defined(_WIN32)
+#include <windows.h>
+#elif !defined(__SWITCH__)
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include <algorithm>
+#include <mutex>
+#include <string.h>
+#include <vector>
+
+#include "SharedROM.h"
+#include "Platform.h"
+
+#define XXH_STATIC_LINKING_ONLY
+#include "xxhash/xxhash.h"
+
+namespace melonDS
+{
+using Platform::Log;
+using Platform::LogLevel;
+
+namespace
+{
+struct SharedROMEntry
+{
+    std::weak_ptr<const u8[]> Data;
+    u32 Length;
+    u64 Hash;
+};
+
+// only carts hold strong references, so an image goes away
+// as soon as the last cart using it is destroyed
+std::mutex SharedROMLock;
+std::vector<SharedROMEntry> SharedROMs;
+
+void PruneSharedROMs()
+{
+    SharedROMs.erase(std::remove_if(SharedROMs.begin(), SharedROMs.end(),
+                                    [](const SharedROMEntry& entry) { return entry.Data.expired(); }),
+                     SharedROMs.end());
+}
+}
+
+SharedROMData ShareROMData(std::unique_ptr<u8[]>&& data, u32 len) noexcept
+{
+    if (!data) return nullptr;
+
+    u64 hash = XXH3_64bits(data.get(), len);
+
+    std::lock_guard<std::mutex> lock(SharedROMLock);
+    PruneSharedROMs();
+
+    for (const SharedROMEntry& entry : SharedROMs)
+    {
+        if (entry.Length != len || entry.Hash != hash)
+            continue;
+
+        SharedROMData existing = entry.Data.lock();
+        if (!existing || memcmp(existing.get(), data.get(), len) != 0)
+            continue;
+
+        Log(LogLevel::Info, "Sharing already loaded ROM image (%u bytes)\n", len);
+        data = nullptr;
+        return existing;
+    }
+
+    SharedROMData ret(std::move(data));
+    SharedROMs.push_back({ret, len, hash});
+    return ret;
+}
+
+SharedROMData MapROMFile(const std::string& path, u32& len) noexcept
+{
+#if defined(_WIN32)
+    int wlen = MultiByteToWideChar(CP_UTF8, 0, path.c_str(), -1, nullptr, 0);
+    std::wstring wpath(wlen, 0);
+    MultiByteToWideChar(CP_UTF8, 0, path.c_str(), -1, wpath.data(), wlen);
+
+    HANDLE file = CreateFileW(wpath.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE)
+        return nullptr;
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size) || size.QuadPart == 0 || size.QuadPart > 0x40000000)
+    {
+        CloseHandle(file);
+        return nullptr;
+    }
+
+    // a file view can't extend past the end of the file,
+    // so only ROMs that don't need padding can be mapped
+    u32 filelen = (u32)size.QuadPart;
+    if (filelen & (filelen - 1))
+    {
+        CloseHandle(file);
+        return nullptr;
+    }
+
+    HANDLE mapping = CreateFileMappingW(file, nullptr, PAGE_WRITECOPY, 0, 0, nullptr);
+    CloseHandle(file);
+    if (!mapping)
+        return nullptr;
+
+    void* base = MapViewOfFile(mapping, FILE_MAP_COPY, 0, 0, filelen);
+    CloseHandle(mapping);
+    if (!base)
+        return nullptr;
+
+    len = filelen;
+    return SharedROMData((const u8*)base, [](const u8* ptr) { UnmapViewOfFile(ptr); });
+#elif defined(__SWITCH__)
+    return nullptr;
+#else
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        return nullptr;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size == 0 || st.st_size > 0x40000000)
+    {
+        close(fd);
+        return nullptr;
+    }
+
+    // a mapped file which is truncated or rewritten in place while the game runs
+    // makes the next read of it raise SIGBUS, there's no way to lock a file against
+    // that here. Only files nobody can write to through us are mapped, the rest are
+    // better read into memory, where changes to the file can't reach them.
+    if (access(path.c_str(), W_OK) == 0)
+    {
+        Log(LogLevel::Debug, "Not mapping ROM file %s, it's writable\n", path.c_str());
+        close(fd);
+        return nullptr;
+    }
+
+    u32 filelen = (u32)st.st_size;
+    u32 mappedlen = 1;
+    while (mappedlen < filelen)
+        mappedlen <<= 1;
+
+    // reserve the padded size with zero pages, then put the file over the start of it
+    // private writable mappings give us copy-on-write for patches without touching the file
+    void* base = mmap(nullptr, mappedlen, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (base == MAP_FAILED)
+    {
+        close(fd);
+        return nullptr;
+    }
+
+    void* filebase = mmap(base, filelen, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, fd, 0);
+    close(fd);
+    if (filebase == MAP_FAILED)
+    {
+        munmap(base, mappedlen);
+        return nullptr;
+    }
+
+    Log(LogLevel::Debug, "Mapped ROM file %s (%u bytes)\n", path.c_str(), filelen);
+
+    len = filelen;
+    return SharedROMData((const u8*)base, [mappedlen](const u8* ptr) { munmap((void*)ptr, mappedlen); });
+#endif
+}
+
+u8* MakeROMDataWritable(SharedROMData& data, u32 len) noexcept
+{
+    if (!data) return nullptr;
+
+    bool shared = data.use_count() > 1;
+    if (!shared)
+    {
+        // we hold the only reference, but the image might still be handed out
+        // to the next cart loading the same ROM
+        std::lock_guard<std::mutex> lock(SharedROMLock);
+        for (const SharedROMEntry& entry : SharedROMs)
+        {
+            if (!entry.Data.owner_before(data) && !data.owner_before(entry.Data))
+            {
+                shared = true;
+                break;
+            }
+        }
+    }
+
+    if (shared)
+    {
+        auto copy = std::make_unique<u8[]>(len);
+        memcpy(copy.get(), data.get(), len);
+        data = std::move(copy);
+    }
+
+    // the data isn't reachable from anywhere else at this point
+    return const_cast<u8*>(data.get());
+}
+
+}
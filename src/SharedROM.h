@@ -0,0 +1,62 @@
+/*
+    Copyright 2016-2026 melonDS team
+
+    This file is part of melonDS.
+
+    melonDS is free software: you can redistribute it and/or modify it under
+    the terms of the GNU General Public License as published by the Free
+    Software Foundation, either version 3 of the License, or (at your option)
+    any later version.
+
+    melonDS is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+    FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with melonDS. If not, see http://www.gnu.org/licenses/.
+*/
+
+#ifndef MELONDS_SHAREDROM_H
+#define MELONDS_SHAREDROM_H
+
+#include <memory>
+#include <string>
+#include "types.h"
+
+namespace melonDS
+{
+/// ROM contents that may be referenced by several carts at once,
+/// including carts inserted in different consoles.
+/// Carts never write to it; those that need to patch their ROM
+/// make a private copy of it first (see \c MakeROMDataWritable).
+using SharedROMData = std::shared_ptr<const u8[]>;
+
+/// Turns a ROM buffer into shared ROM data.
+///
+/// If another image with the same length and contents is still alive,
+/// that image is returned instead and \c data is freed,
+/// so that loading the same ROM into several consoles only keeps one copy of it in memory.
+/// @post \c data is \c nullptr.
+SharedROMData ShareROMData(std::unique_ptr<u8[]>&& data, u32 len) noexcept;
+
+/// Maps a ROM file into memory instead of reading it,
+/// so that only the parts the game actually reads get loaded.
+///
+/// The mapping is zero-padded up to the next power of 2.
+/// Writes through \c MakeROMDataWritable stay private to the process and never reach the file.
+///
+/// Changes made to the file while it's mapped would show up in the ROM, and on POSIX
+/// systems a read past the end of a file truncated meanwhile kills the process.
+/// Files that can be written to are therefore never mapped there.
+/// On Windows, the file can't be truncated or written to as long as it's mapped.
+/// @param len Receives the length of the file (not the padded length).
+/// @return The mapped data, or \c nullptr if the file can't be mapped on this platform
+/// or isn't safe to map, in which case it should be read into memory instead.
+SharedROMData MapROMFile(const std::string& path, u32& len) noexcept;
+
+/// Returns a writable pointer to the given ROM data.
+/// If the data may be seen by anyone else, it is first replaced with a private copy.
+u8* MakeROMDataWritable(SharedROMData& data, u32 len) noexcept;
+}
+
+#endif // MELONDS_SHAREDROM_H
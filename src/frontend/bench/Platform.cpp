@@ -0,0 +1,448 @@
+/*
+    Copyright 2016-2026 melonDS team
+
+    This file is part of melonDS.
+
+    melonDS is free software: you can redistribute it and/or modify it under
+    the terms of the GNU General Public License as published by the Free
+    Software Foundation, either version 3 of the License, or (at your option)
+    any later version.
+
+    melonDS is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+    FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with melonDS. If not, see http://www.gnu.org/licenses/.
+*/
+
+// Platform implementation for the headless frontend.
+// No Qt or SDL here: files go through stdio, threading through the C++ standard library.
+// Everything that would need a host device (mic, camera, wifi, addon input) is stubbed out.
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <dlfcn.h>
+#endif
+
+#include "Platform.h"
+#include "main.h"
+
+namespace melonDS::Platform
+{
+
+static const auto startTime = std::chrono::steady_clock::now();
+
+void SignalStop(StopReason reason, void* userdata)
+{
+    // the bench loop polls NDS::IsRunning(), nothing else to do
+}
+
+
+constexpr char AccessMode(FileMode mode, bool file_exists)
+{
+    if (mode & FileMode::Append)
+        return  'a';
+
+    if (!(mode & FileMode::Write))
+        return 'r';
+
+    if (mode & (FileMode::NoCreate))
+        return 'r';
+
+    if ((mode & FileMode::Preserve) && file_exists)
+        return 'r';
+
+    return 'w';
+}
+
+constexpr bool IsExtended(FileMode mode)
+{
+    return (mode & FileMode::ReadWrite) == FileMode::ReadWrite;
+}
+
+static std::string GetModeString(FileMode mode, bool file_exists)
+{
+    std::string modeString;
+
+    modeString += AccessMode(mode, file_exists);
+
+    if (IsExtended(mode))
+        modeString += '+';
+
+    if (!(mode & FileMode::Text))
+        modeString += 'b';
+
+    return modeString;
+}
+
+FileHandle* OpenFile(const std::string& path, FileMode mode)
+{
+    if ((mode & (FileMode::ReadWrite | FileMode::Append)) == FileMode::None)
+    {
+        Log(LogLevel::Error, "Attempted to open \"%s\" in neither read nor write mode (FileMode 0x%x)\n", path.c_str(), mode);
+        return nullptr;
+    }
+
+    bool exists = false;
+    if (FILE* f = fopen(path.c_str(), "rb"))
+    {
+        exists = true;
+        fclose(f);
+    }
+
+    if ((mode & FileMode::NoCreate) && !exists)
+        return nullptr;
+
+    std::string modeString = GetModeString(mode, exists);
+    FILE* file = fopen(path.c_str(), modeString.c_str());
+    if (!file)
+    {
+        Log(LogLevel::Warn, "Failed to open \"%s\" with FileMode 0x%x (effective mode \"%s\")\n", path.c_str(), mode, modeString.c_str());
+        return nullptr;
+    }
+
+    Log(LogLevel::Debug, "Opened \"%s\" with FileMode 0x%x (effective mode \"%s\")\n", path.c_str(), mode, modeString.c_str());
+    return reinterpret_cast<FileHandle *>(file);
+}
+
+std::string GetLocalFilePath(const std::string& filename)
+{
+    // the headless frontend has no emulator directory; everything is relative to the working directory
+    return filename;
+}
+
+FileHandle* OpenLocalFile(const std::string& path, FileMode mode)
+{
+    return OpenFile(GetLocalFilePath(path), mode);
+}
+
+bool CloseFile(FileHandle* file)
+{
+    return fclose(reinterpret_cast<FILE *>(file)) == 0;
+}
+
+bool IsEndOfFile(FileHandle* file)
+{
+    return feof(reinterpret_cast<FILE *>(file)) != 0;
+}
+
+bool FileReadLine(char* str, int count, FileHandle* file)
+{
+    return fgets(str, count, reinterpret_cast<FILE *>(file)) != nullptr;
+}
+
+bool FileExists(const std::string& name)
+{
+    FileHandle* f = OpenFile(name, FileMode::Read);
+    if (!f) return false;
+    CloseFile(f);
+    return true;
+}
+
+bool LocalFileExists(const std::string& name)
+{
+    FileHandle* f = OpenLocalFile(name, FileMode::Read);
+    if (!f) return false;
+    CloseFile(f);
+    return true;
+}
+
+bool CheckFileWritable(const std::string& filepath)
+{
+    FileHandle* file = OpenFile(filepath, FileMode::Append);
+    if (file)
+    {
+        CloseFile(file);
+        return true;
+    }
+    else return false;
+}
+
+bool CheckLocalFileWritable(const std::string& name)
+{
+    return CheckFileWritable(GetLocalFilePath(name));
+}
+
+bool FileSeek(FileHandle* file, s64 offset, FileSeekOrigin origin)
+{
+    int stdorigin;
+    switch (origin)
+    {
+        case FileSeekOrigin::Start: stdorigin = SEEK_SET; break;
+        case FileSeekOrigin::Current: stdorigin = SEEK_CUR; break;
+        case FileSeekOrigin::End: stdorigin = SEEK_END; break;
+    }
+
+    return fseek(reinterpret_cast<FILE *>(file), offset, stdorigin) == 0;
+}
+
+void FileRewind(FileHandle* file)
+{
+    rewind(reinterpret_cast<FILE *>(file));
+}
+
+u64 FilePosition(FileHandle* file)
+{
+    return ftell(reinterpret_cast<FILE *>(file));
+}
+
+u64 FileRead(void* data, u64 size, u64 count, FileHandle* file)
+{
+    return fread(data, size, count, reinterpret_cast<FILE *>(file));
+}
+
+bool FileFlush(FileHandle* file)
+{
+    return fflush(reinterpret_cast<FILE *>(file)) == 0;
+}
+
+u64 FileWrite(const void* data, u64 size, u64 count, FileHandle* file)
+{
+    return fwrite(data, size, count, reinterpret_cast<FILE *>(file));
+}
+
+u64 FileWriteFormatted(FileHandle* file, const char* fmt, ...)
+{
+    if (fmt == nullptr)
+        return 0;
+
+    va_list args;
+    va_start(args, fmt);
+    u64 ret = vfprintf(reinterpret_cast<FILE *>(file), fmt, args);
+    va_end(args);
+    return ret;
+}
+
+u64 FileLength(FileHandle* file)
+{
+    FILE* stdfile = reinterpret_cast<FILE *>(file);
+    long pos = ftell(stdfile);
+    fseek(stdfile, 0, SEEK_END);
+    long len = ftell(stdfile);
+    fseek(stdfile, pos, SEEK_SET);
+    return len;
+}
+
+void Log(LogLevel level, const char* fmt, ...)
+{
+    if (fmt == nullptr || level < minLogLevel)
+        return;
+
+    // stdout is reserved for the JSON report
+    va_list args;
+    va_start(args, fmt);
+    vfprintf(stderr, fmt, args);
+    va_end(args);
+}
+
+struct Thread
+{
+    std::thread Impl;
+};
+
+Thread* Thread_Create(std::function<void()> func)
+{
+    return new Thread {std::thread(std::move(func))};
+}
+
+void Thread_Free(Thread* thread)
+{
+    // unlike QThread we can't terminate a thread, callers always wait on it first
+    if (thread->Impl.joinable())
+        thread->Impl.detach();
+    delete thread;
+}
+
+void Thread_Wait(Thread* thread)
+{
+    if (thread->Impl.joinable())
+        thread->Impl.join();
+}
+
+struct Semaphore
+{
+    std::mutex Lock;
+    std::condition_variable Cond;
+    int Count = 0;
+};
+
+Semaphore* Semaphore_Create()
+{
+    return new Semaphore();
+}
+
+void Semaphore_Free(Semaphore* sema)
+{
+    delete sema;
+}
+
+void Semaphore_Reset(Semaphore* sema)
+{
+    std::lock_guard<std::mutex> lock(sema->Lock);
+    sema->Count = 0;
+}
+
+void Semaphore_Wait(Semaphore* sema)
+{
+    std::unique_lock<std::mutex> lock(sema->Lock);
+    sema->Cond.wait(lock, [sema]() { return sema->Count > 0; });
+    sema->Count--;
+}
+
+bool Semaphore_TryWait(Semaphore* sema, int timeout_ms)
+{
+    std::unique_lock<std::mutex> lock(sema->Lock);
+    if (timeout_ms && !sema->Cond.wait_for(lock, std::chrono::milliseconds(timeout_ms), [sema]() { return sema->Count > 0; }))
+        return false;
+
+    if (sema->Count == 0)
+        return false;
+
+    sema->Count--;
+    return true;
+}
+
+void Semaphore_Post(Semaphore* sema, int count)
+{
+    {
+        std::lock_guard<std::mutex> lock(sema->Lock);
+        sema->Count += count;
+    }
+    sema->Cond.notify_all();
+}
+
+struct Mutex
+{
+    std::mutex Impl;
+};
+
+Mutex* Mutex_Create()
+{
+    return new Mutex();
+}
+
+void Mutex_Free(Mutex* mutex)
+{
+    delete mutex;
+}
+
+void Mutex_Lock(Mutex* mutex)
+{
+    mutex->Impl.lock();
+}
+
+void Mutex_Unlock(Mutex* mutex)
+{
+    mutex->Impl.unlock();
+}
+
+bool Mutex_TryLock(Mutex* mutex)
+{
+    return mutex->Impl.try_lock();
+}
+
+void Sleep(u64 usecs)
+{
+    std::this_thread::sleep_for(std::chrono::microseconds(usecs));
+}
+
+u64 GetMSCount()
+{
+    auto elapsed = std::chrono::steady_clock::now() - startTime;
+    return std::chrono::duration_cast<std::chrono::milliseconds>(elapsed).count();
+}
+
+u64 GetUSCount()
+{
+    auto elapsed = std::chrono::steady_clock::now() - startTime;
+    return std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count();
+}
+
+
+// save data is never written back, so that every run starts from the same state
+void WriteNDSSave(const u8* savedata, u32 savelen, u32 writeoffset, u32 writelen, void* userdata) {}
+void WriteGBASave(const u8* savedata, u32 savelen, u32 writeoffset, u32 writelen, void* userdata) {}
+void WriteFirmware(const Firmware& firmware, u32 writeoffset, u32 writelen, void* userdata) {}
+void WriteDateTime(int year, int month, int day, int hour, int minute, int second, void* userdata) {}
+
+
+void MP_Begin(void* userdata) {}
+void MP_End(void* userdata) {}
+int MP_SendPacket(u8* data, int len, u64 timestamp, void* userdata) { return 0; }
+int MP_RecvPacket(u8* data, u64* timestamp, void* userdata) { return 0; }
+int MP_SendCmd(u8* data, int len, u64 timestamp, void* userdata) { return 0; }
+int MP_SendReply(u8* data, int len, u64 timestamp, u16 aid, void* userdata) { return 0; }
+int MP_SendAck(u8* data, int len, u64 timestamp, void* userdata) { return 0; }
+int MP_RecvHostPacket(u8* data, u64* timestamp, void* userdata) { return 0; }
+u16 MP_RecvReplies(u8* data, u64 timestamp, u16 aidmask, void* userdata) { return 0; }
+
+
+int Net_SendPacket(u8* data, int len, void* userdata) { return 0; }
+int Net_RecvPacket(u8* data, void* userdata) { return 0; }
+
+
+void Mic_Start(void* userdata) {}
+void Mic_Stop(void* userdata) {}
+int Mic_ReadInput(s16* data, int maxlength, void* userdata) { return 0; }
+
+
+void Camera_Start(int num, void* userdata) {}
+void Camera_Stop(int num, void* userdata) {}
+
+void Camera_CaptureFrame(int num, u32* frame, int width, int height, bool yuv, void* userdata)
+{
+    memset(frame, 0, width * height * sizeof(u32));
+}
+
+
+AACDecoder* AAC_Init() { return nullptr; }
+void AAC_DeInit(AACDecoder* dec) {}
+bool AAC_Configure(AACDecoder* dec, int frequency, int channels) { return false; }
+bool AAC_DecodeFrame(AACDecoder* dec, const void* input, int inputlen, void* output, int outputlen) { return false; }
+
+
+bool Addon_KeyDown(KeyType type, void* userdata) { return false; }
+void Addon_RumbleStart(u32 len, void* userdata) {}
+void Addon_RumbleStop(void* userdata) {}
+float Addon_MotionQuery(MotionQueryType type, void* userdata) { return 0.0f; }
+
+
+DynamicLibrary* DynamicLibrary_Load(const char* lib)
+{
+#ifdef _WIN32
+    return (DynamicLibrary*) LoadLibraryA(lib);
+#else
+    return (DynamicLibrary*) dlopen(lib, RTLD_NOW | RTLD_LOCAL);
+#endif
+}
+
+void DynamicLibrary_Unload(DynamicLibrary* lib)
+{
+#ifdef _WIN32
+    FreeLibrary((HMODULE) lib);
+#else
+    dlclose(lib);
+#endif
+}
+
+void* DynamicLibrary_LoadFunction(DynamicLibrary* lib, const char* name)
+{
+#ifdef _WIN32
+    return (void*) GetProcAddress((HMODULE) lib, name);
+#else
+    return dlsym(lib, name);
+#endif
+}
+
+}
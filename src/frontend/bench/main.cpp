@@ -0,0 +1,985 @@
+/*
+    Copyright 2016-2026 melonDS team
+
+    This file is part of melonDS.
+
+    melonDS is free software: you can redistribute it and/or modify it under
+    the terms of the GNU General Public License as published by the Free
+    Software Foundation, either version 3 of the License, or (at your option)
+    any later version.
+
+    melonDS is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+    FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with melonDS. If not, see http://www.gnu.org/licenses/.
+*/
+
+// melonDS-bench: headless throughput benchmark
+//
+// Boots a ROM without any display or audio device, runs a fixed number of
+// frames through NDS::RunFrame and prints a JSON report to stdout.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+#include "main.h"
+
+#include "types.h"
+#include "version.h"
+#include "Args.h"
+#include "NDS.h"
+#include "NDSCart.h"
+#include "GPU_Soft.h"
+#include "BatchRunner.h"
+#include "Savestate.h"
+#include "RewindBuffer.h"
+#include "InputMovie.h"
+#ifdef JIT_ENABLED
+#include "JITLockstep.h"
+#endif
+#include "Platform.h"
+
+#define XXH_STATIC_LINKING_ONLY
+#include "xxhash/xxhash.h"
+
+using namespace melonDS;
+using namespace melonDS::Platform;
+
+Platform::LogLevel minLogLevel = LogLevel::Warn;
+
+struct BenchConfig
+{
+    std::string ROMPath;
+    std::string BIOS9Path;
+    std::string BIOS7Path;
+    std::string FirmwarePath;
+    std::string OutputPath;
+    std::string TracePath;
+
+    u32 Frames = 3600;
+    u32 WarmupFrames = 0;
+
+    bool JIT = false;
+    JITPerfMap PerfMap = JITPerfMap::None;
+    bool Threaded = false;
+    bool Profile = false;
+    bool EventCatchUp = false;
+
+    bool ThreadedARM7 = false;
+    u32 ARM7MaxSkew = 256;
+    bool CheckDeterminism = false;
+    bool CheckJIT = false;
+
+    u32 NumConsoles = 1;
+    u32 NumThreads = 0;
+
+    u32 SavestateRoundTrips = 0;
+
+    std::string MoviePath;
+    std::string RecordMoviePath;
+    u32 MovieHashInterval = InputMovie::DefaultHashInterval;
+};
+
+static void printUsage(const char* argv0)
+{
+    fprintf(stderr,
+        "usage: %s [options] <rom.nds>\n"
+        "\n"
+        "  --frames N          number of measured frames (default 3600)\n"
+        "  --warmup N          frames to run before measuring (default 0)\n"
+        "  --cpu MODE          interpreter or jit (default interpreter)\n"
+        "  --renderer MODE     soft or soft-threaded (default soft)\n"
+        "  --arm7-thread       run the ARM7 on its own thread (interpreter only)\n"
+        "  --arm7-skew N       max system cycles the threaded ARM7 may run apart\n"
+        "                      from the ARM9 (default 256)\n"
+        "  --check-determinism run the threaded ARM7 twice and compare the runs with\n"
+        "                      each other and with a single-threaded run, frame by\n"
+        "                      frame, instead of benchmarking. fails on any difference\n"
+        "  --event-catch-up    run the ticks of idle devices lazily\n"
+#ifdef JIT_ENABLED
+        "  --check-jit         run the JIT against the interpreter block by block\n"
+        "                      after the warmup frames instead of benchmarking\n"
+        "  --jit-perf-map      write compiled blocks to /tmp/perf-<pid>.map for perf\n"
+        "  --jit-dump          write compiled blocks to /tmp/jit-<pid>.dump for perf\n"
+        "                      inject --jit (record with perf record -k mono)\n"
+#endif
+        "  --consoles N        run N copies of the ROM in parallel (default 1)\n"
+        "  --threads N         worker threads for --consoles (default one per core)\n"
+        "  --savestates N      time N savestate save+load round-trips and N rewind\n"
+        "                      snapshots after the warmup frames instead of\n"
+        "                      benchmarking frames\n"
+        "  --movie PATH        play back an input movie over the warmup and measured\n"
+        "                      frames, stopping where it ends\n"
+        "  --record-movie PATH record the run as an input movie, with state hashes\n"
+        "                      to check later runs against\n"
+        "  --movie-hash-interval N\n"
+        "                      frames between state hashes in recorded movies\n"
+        "                      (default 60)\n"
+        "  --bios9 PATH        ARM9 BIOS image (default FreeBIOS)\n"
+        "  --bios7 PATH        ARM7 BIOS image (default FreeBIOS)\n"
+        "  --firmware PATH     firmware image (default generated firmware)\n"
+        "  --output PATH       write the JSON report to PATH instead of stdout\n"
+#ifdef PROFILER_ENABLED
+        "  --profile           include per-subsystem time accounting in the report\n"
+        "  --trace PATH        write a Chrome trace of the measured frames to PATH\n"
+#endif
+        "  --verbose           print core log output to stderr\n",
+        argv0);
+}
+
+static bool parseArgs(int argc, char** argv, BenchConfig& cfg)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        bool hasval = (i+1) < argc;
+
+        if (arg == "--frames" && hasval)
+            cfg.Frames = strtoul(argv[++i], nullptr, 0);
+        else if (arg == "--warmup" && hasval)
+            cfg.WarmupFrames = strtoul(argv[++i], nullptr, 0);
+        else if (arg == "--cpu" && hasval)
+        {
+            std::string mode = argv[++i];
+            if (mode == "jit")
+                cfg.JIT = true;
+            else if (mode == "interpreter")
+                cfg.JIT = false;
+            else
+                return false;
+        }
+        else if (arg == "--renderer" && hasval)
+        {
+            std::string mode = argv[++i];
+            if (mode == "soft-threaded")
+                cfg.Threaded = true;
+            else if (mode == "soft")
+                cfg.Threaded = false;
+            else
+                return false;
+        }
+        else if (arg == "--arm7-thread")
+            cfg.ThreadedARM7 = true;
+        else if (arg == "--arm7-skew" && hasval)
+            cfg.ARM7MaxSkew = strtoul(argv[++i], nullptr, 0);
+        else if (arg == "--check-determinism")
+            cfg.CheckDeterminism = true;
+        else if (arg == "--event-catch-up")
+            cfg.EventCatchUp = true;
+#ifdef JIT_ENABLED
+        else if (arg == "--check-jit")
+            cfg.CheckJIT = true;
+        else if (arg == "--jit-perf-map")
+            cfg.PerfMap = JITPerfMap::PerfMap;
+        else if (arg == "--jit-dump")
+            cfg.PerfMap = JITPerfMap::JitDump;
+#endif
+        else if (arg == "--consoles" && hasval)
+            cfg.NumConsoles = std::max(1ul, strtoul(argv[++i], nullptr, 0));
+        else if (arg == "--threads" && hasval)
+            cfg.NumThreads = strtoul(argv[++i], nullptr, 0);
+        else if (arg == "--savestates" && hasval)
+            cfg.SavestateRoundTrips = strtoul(argv[++i], nullptr, 0);
+        else if (arg == "--movie" && hasval)
+            cfg.MoviePath = argv[++i];
+        else if (arg == "--record-movie" && hasval)
+            cfg.RecordMoviePath = argv[++i];
+        else if (arg == "--movie-hash-interval" && hasval)
+            cfg.MovieHashInterval = strtoul(argv[++i], nullptr, 0);
+        else if (arg == "--bios9" && hasval)
+            cfg.BIOS9Path = argv[++i];
+        else if (arg == "--bios7" && hasval)
+            cfg.BIOS7Path = argv[++i];
+        else if (arg == "--firmware" && hasval)
+            cfg.FirmwarePath = argv[++i];
+        else if (arg == "--output" && hasval)
+            cfg.OutputPath = argv[++i];
+#ifdef PROFILER_ENABLED
+        else if (arg == "--profile")
+            cfg.Profile = true;
+        else if (arg == "--trace" && hasval)
+            cfg.TracePath = argv[++i];
+#endif
+        else if (arg == "--verbose")
+            minLogLevel = LogLevel::Debug;
+        else if (arg[0] != '-' && cfg.ROMPath.empty())
+            cfg.ROMPath = arg;
+        else
+            return false;
+    }
+
+    // movies are only supported on the regular single-console path
+    bool usemovie = !cfg.MoviePath.empty() || !cfg.RecordMoviePath.empty();
+    if (usemovie && (cfg.CheckDeterminism || cfg.CheckJIT || cfg.SavestateRoundTrips > 0 || cfg.NumConsoles > 1))
+        return false;
+    if (!cfg.MoviePath.empty() && !cfg.RecordMoviePath.empty())
+        return false;
+
+    if (cfg.PerfMap != JITPerfMap::None && !cfg.JIT && !cfg.CheckJIT)
+        return false;
+
+    return !cfg.ROMPath.empty() && cfg.Frames > 0;
+}
+
+static std::unique_ptr<u8[]> loadFile(const std::string& path, u32& len)
+{
+    FileHandle* f = OpenFile(path, FileMode::Read);
+    if (!f) return nullptr;
+
+    u64 filelen = FileLength(f);
+    if (filelen == 0 || filelen > 0x40000000)
+    {
+        CloseFile(f);
+        return nullptr;
+    }
+
+    auto data = std::make_unique<u8[]>(filelen);
+    u64 nread = FileRead(data.get(), filelen, 1, f);
+    CloseFile(f);
+    if (nread != 1) return nullptr;
+
+    len = (u32)filelen;
+    return data;
+}
+
+template <typename T>
+static std::unique_ptr<T> loadBIOS(const std::string& path)
+{
+    u32 len = 0;
+    auto data = loadFile(path, len);
+    if (!data || len != std::tuple_size<T>::value)
+    {
+        Log(LogLevel::Error, "Failed to load BIOS image %s\n", path.c_str());
+        return nullptr;
+    }
+
+    auto bios = std::make_unique<T>();
+    memcpy(bios->data(), data.get(), len);
+    return bios;
+}
+
+static u64 peakRSSKB()
+{
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS pmc;
+    if (GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof(pmc)))
+        return pmc.PeakWorkingSetSize / 1024;
+    return 0;
+#else
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0)
+        return 0;
+#ifdef __APPLE__
+    return usage.ru_maxrss / 1024; // bytes on macOS
+#else
+    return usage.ru_maxrss;
+#endif
+#endif
+}
+
+static double percentile(const std::vector<double>& sorted, double p)
+{
+    if (sorted.empty()) return 0;
+
+    double pos = p * (sorted.size() - 1);
+    size_t lo = (size_t)pos;
+    size_t hi = std::min(lo + 1, sorted.size() - 1);
+    double frac = pos - lo;
+    return sorted[lo] + (sorted[hi] - sorted[lo]) * frac;
+}
+
+static std::string jsonEscape(const std::string& str)
+{
+    std::string ret;
+    for (char c : str)
+    {
+        if (c == '"' || c == '\\')
+        {
+            ret += '\\';
+            ret += c;
+        }
+        else if ((u8)c < 0x20)
+        {
+            char buf[8];
+            snprintf(buf, sizeof(buf), "\\u%04x", c);
+            ret += buf;
+        }
+        else
+            ret += c;
+    }
+    return ret;
+}
+
+static std::unique_ptr<NDS> createConsole(const BenchConfig& cfg, const std::string& romname, bool threadedarm7)
+{
+    NDSArgs args {};
+
+    if (!cfg.BIOS9Path.empty())
+    {
+        args.ARM9BIOS = loadBIOS<ARM9BIOSImage>(cfg.BIOS9Path);
+        if (!args.ARM9BIOS) return nullptr;
+    }
+    if (!cfg.BIOS7Path.empty())
+    {
+        args.ARM7BIOS = loadBIOS<ARM7BIOSImage>(cfg.BIOS7Path);
+        if (!args.ARM7BIOS) return nullptr;
+    }
+    if (!cfg.FirmwarePath.empty())
+    {
+        u32 len = 0;
+        auto data = loadFile(cfg.FirmwarePath, len);
+        if (!data)
+        {
+            Log(LogLevel::Error, "Failed to load firmware image %s\n", cfg.FirmwarePath.c_str());
+            return nullptr;
+        }
+        args.Firmware = Firmware(data.get(), len);
+    }
+
+    if (!cfg.JIT)
+        args.JIT = std::nullopt;
+    else
+        args.JIT->PerfMap = cfg.PerfMap;
+
+    std::unique_ptr<NDSCart::CartCommon> cart;
+    u32 romlen = 0;
+    if (auto compressed = CompressedROM::Open(cfg.ROMPath))
+    {
+        cart = NDSCart::ParseROM(std::move(compressed), nullptr);
+    }
+    else if (SharedROMData mapped = MapROMFile(cfg.ROMPath, romlen))
+    {
+        cart = NDSCart::ParseROM(std::move(mapped), romlen, nullptr);
+    }
+    else
+    {
+        auto romdata = loadFile(cfg.ROMPath, romlen);
+        if (!romdata)
+        {
+            Log(LogLevel::Error, "Failed to load ROM %s\n", cfg.ROMPath.c_str());
+            return nullptr;
+        }
+
+        cart = NDSCart::ParseROM(std::move(romdata), romlen, nullptr);
+    }
+    if (!cart)
+    {
+        Log(LogLevel::Error, "Failed to parse ROM %s\n", cfg.ROMPath.c_str());
+        return nullptr;
+    }
+
+    auto nds = std::make_unique<NDS>(std::move(args));
+    nds->SetRenderer(std::make_unique<SoftRenderer>(*nds));
+
+    RendererSettings rendersettings {
+        .ScaleFactor = 1,
+        .Threaded = cfg.Threaded,
+        .HiresCoordinates = false,
+        .BetterPolygons = false,
+    };
+    nds->GetRenderer().SetRenderSettings(rendersettings);
+
+    nds->Reset();
+    nds->SetNDSCart(std::move(cart));
+    nds->SetEventCatchUp(cfg.EventCatchUp);
+    nds->SetARM7MaxSkew(cfg.ARM7MaxSkew);
+
+    if (threadedarm7 && !nds->SetARM7Threaded(true))
+        return nullptr;
+
+    if (nds->NeedsDirectBoot())
+        nds->SetupDirectBoot(romname);
+
+    nds->Start();
+    return nds;
+}
+
+// hash of everything the determinism check compares after each frame
+static u64 hashConsoleState(NDS& nds)
+{
+    XXH3_state_t* state = XXH3_createState();
+    XXH3_64bits_reset(state);
+
+    void* top; void* bottom;
+    if (nds.GPU.GetFramebuffers(&top, &bottom))
+    {
+        XXH3_64bits_update(state, top, 256*192*4);
+        XXH3_64bits_update(state, bottom, 256*192*4);
+    }
+
+    XXH3_64bits_update(state, nds.MainRAM, nds.MainRAMMask + 1);
+    XXH3_64bits_update(state, nds.ARM7WRAM, nds.ARM7WRAMSize);
+    XXH3_64bits_update(state, nds.ARM7.R, sizeof(nds.ARM7.R));
+    XXH3_64bits_update(state, nds.ARM9.R, sizeof(nds.ARM9.R));
+
+    u64 hash = XXH3_64bits_digest(state);
+    XXH3_freeState(state);
+    return hash;
+}
+
+static bool runForHashes(const BenchConfig& cfg, const std::string& romname, bool threadedarm7, std::vector<u64>& hashes)
+{
+    auto nds = createConsole(cfg, romname, threadedarm7);
+    if (!nds) return false;
+
+    std::vector<s16> audiobuf(2 * 1024);
+    for (u32 i = 0; i < cfg.WarmupFrames + cfg.Frames && nds->IsRunning(); i++)
+    {
+        nds->RunFrame();
+        while (nds->SPU.ReadOutput(audiobuf.data(), 1024) > 0);
+
+        if (i >= cfg.WarmupFrames)
+            hashes.push_back(hashConsoleState(*nds));
+    }
+
+    return true;
+}
+
+static int firstMismatch(const std::vector<u64>& a, const std::vector<u64>& b)
+{
+    size_t len = std::min(a.size(), b.size());
+    for (size_t i = 0; i < len; i++)
+    {
+        if (a[i] != b[i]) return (int)i;
+    }
+    if (a.size() != b.size()) return (int)len;
+    return -1;
+}
+
+// the threaded ARM7 must give the same result every time it's run, and the same
+// result as the single-threaded path. the timing differences NDS::SetARM7Threaded()
+// lists, and an ARM7 skew above 64, count as differences too, so a game
+// whose outcome depends on them fails this check
+static int checkDeterminism(const BenchConfig& cfg)
+{
+    if (cfg.JIT)
+    {
+        Log(LogLevel::Error, "The determinism check only works with the interpreter\n");
+        return 1;
+    }
+
+    std::string romname = cfg.ROMPath.substr(cfg.ROMPath.find_last_of("/\\") + 1);
+
+    std::vector<u64> reference, threaded1, threaded2;
+    if (!runForHashes(cfg, romname, false, reference)) return 1;
+    if (!runForHashes(cfg, romname, true, threaded1)) return 1;
+    if (!runForHashes(cfg, romname, true, threaded2)) return 1;
+
+    int repro = firstMismatch(threaded1, threaded2);
+    int vsref = firstMismatch(reference, threaded1);
+
+    printf("{\n");
+    printf("  \"rom\": \"%s\",\n", jsonEscape(romname).c_str());
+    printf("  \"frames\": %u,\n", (u32)reference.size());
+    printf("  \"arm7_max_skew\": %u,\n", cfg.ARM7MaxSkew);
+    printf("  \"threaded_reproducible\": %s,\n", repro < 0 ? "true" : "false");
+    if (repro >= 0) printf("  \"threaded_first_divergent_frame\": %d,\n", repro);
+    printf("  \"matches_single_threaded\": %s", vsref < 0 ? "true" : "false");
+    if (vsref >= 0) printf(",\n  \"first_divergent_frame\": %d", vsref);
+    printf("\n}\n");
+
+    return (repro < 0 && vsref < 0) ? 0 : 2;
+}
+
+#ifdef JIT_ENABLED
+// the JIT has to leave the guest in the same state the interpreter would,
+// see JITLockstep for how the two are kept in step
+static int checkJIT(const BenchConfig& cfg, const std::string& romname)
+{
+    if (cfg.ThreadedARM7)
+    {
+        Log(LogLevel::Error, "The JIT check can't run the ARM7 on its own thread\n");
+        return 1;
+    }
+
+    BenchConfig jitcfg = cfg;
+    jitcfg.JIT = true;
+    BenchConfig interpcfg = cfg;
+    interpcfg.JIT = false;
+
+    auto jit = createConsole(jitcfg, romname, false);
+    if (!jit) return 1;
+    auto interp = createConsole(interpcfg, romname, false);
+    if (!interp) return 1;
+
+    std::vector<s16> audiobuf(2 * 1024);
+    for (u32 i = 0; i < cfg.WarmupFrames && jit->IsRunning(); i++)
+    {
+        jit->RunFrame();
+        while (jit->SPU.ReadOutput(audiobuf.data(), 1024) > 0);
+    }
+
+    JITLockstep lockstep(*jit, *interp);
+    if (!lockstep.Start()) return 1;
+
+    for (u32 i = 0; i < cfg.Frames && jit->IsRunning(); i++)
+    {
+        if (!lockstep.RunFrame())
+            break;
+        while (jit->SPU.ReadOutput(audiobuf.data(), 1024) > 0);
+        while (interp->SPU.ReadOutput(audiobuf.data(), 1024) > 0);
+    }
+
+    printf("{\n");
+    printf("  \"rom\": \"%s\",\n", jsonEscape(romname).c_str());
+    printf("  \"frames\": %llu,\n", (unsigned long long)lockstep.GetFrameCount());
+    printf("  \"arm9_blocks\": %llu,\n", (unsigned long long)lockstep.GetBlockCount(0));
+    printf("  \"arm7_blocks\": %llu,\n", (unsigned long long)lockstep.GetBlockCount(1));
+    printf("  \"matches_interpreter\": %s", lockstep.HasDiverged() ? "false" : "true");
+    if (lockstep.HasDiverged())
+    {
+        const JITLockstep::Divergence& div = lockstep.GetDivergence();
+        printf(",\n  \"divergence\": {\n");
+        printf("    \"frame\": %llu,\n", (unsigned long long)(cfg.WarmupFrames + div.Frame));
+        printf("    \"reason\": \"%s\"", jsonEscape(div.Reason).c_str());
+        if (div.HasBlock)
+        {
+            printf(",\n    \"cpu\": \"arm%d\",\n", div.CPU ? 7 : 9);
+            printf("    \"block_index\": %llu,\n", (unsigned long long)div.BlockIndex);
+            printf("    \"block_addr\": \"%08X\",\n", div.BlockAddr);
+            printf("    \"first_run\": %s,\n", div.Compiled ? "true" : "false");
+            for (int i = 0; i < 2; i++)
+            {
+                const u32* regs = i ? div.InterpRegs : div.JITRegs;
+                printf("    \"%s_regs\": [", i ? "interpreter" : "jit");
+                for (int j = 0; j < 17; j++)
+                    printf("%s\"%08X\"", j ? ", " : "", regs[j]);
+                printf("]%s\n", i ? "" : ",");
+            }
+        }
+        else
+        {
+            printf(",\n    \"region\": \"%s\",\n", div.Region);
+            printf("    \"offset\": \"%08X\"\n", div.Offset);
+        }
+        printf("  }");
+    }
+    printf("\n}\n");
+
+    return lockstep.HasDiverged() ? 2 : 0;
+}
+#endif
+
+// throughput of several consoles stepped together on a BatchRunner
+static int runBatch(const BenchConfig& cfg, const std::string& romname)
+{
+    BatchRunner runner(cfg.NumThreads);
+    for (u32 i = 0; i < cfg.NumConsoles; i++)
+    {
+        auto nds = createConsole(cfg, romname, false);
+        if (!nds) return 1;
+        runner.AddConsole(std::move(nds));
+    }
+
+    std::vector<s16> audiobuf(2 * 1024);
+    auto drainAudio = [&]()
+    {
+        for (u32 i = 0; i < runner.GetNumConsoles(); i++)
+        {
+            while (runner.GetConsole(i).SPU.ReadOutput(audiobuf.data(), 1024) > 0);
+        }
+    };
+
+    for (u32 i = 0; i < cfg.WarmupFrames; i++)
+    {
+        runner.Step();
+        drainAudio();
+    }
+
+    using clock = std::chrono::steady_clock;
+    auto benchstart = clock::now();
+
+    for (u32 i = 0; i < cfg.Frames; i++)
+    {
+        runner.Step();
+        drainAudio();
+    }
+
+    double totalsecs = std::chrono::duration<double>(clock::now() - benchstart).count();
+    u64 totalframes = (u64)cfg.Frames * cfg.NumConsoles;
+
+    printf("{\n");
+    printf("  \"version\": \"%s\",\n", MELONDS_VERSION);
+    printf("  \"rom\": \"%s\",\n", jsonEscape(romname).c_str());
+    printf("  \"cpu\": \"%s\",\n", cfg.JIT ? "jit" : "interpreter");
+    printf("  \"consoles\": %u,\n", cfg.NumConsoles);
+    printf("  \"threads\": %u,\n", runner.GetNumThreads());
+    printf("  \"frames\": %u,\n", cfg.Frames);
+    printf("  \"total_seconds\": %.6f,\n", totalsecs);
+    printf("  \"steps_per_second\": %.3f,\n", totalsecs > 0 ? cfg.Frames / totalsecs : 0.0);
+    printf("  \"console_frames_per_second\": %.3f,\n", totalsecs > 0 ? totalframes / totalsecs : 0.0);
+    printf("  \"peak_rss_kb\": %llu\n", (unsigned long long)peakRSSKB());
+    printf("}\n");
+
+    return 0;
+}
+
+// cost of snapshotting and restoring the console, the way rewind and run-ahead do it
+static int runSavestates(const BenchConfig& cfg, const std::string& romname)
+{
+    auto nds = createConsole(cfg, romname, false);
+    if (!nds) return 1;
+
+    std::vector<s16> audiobuf(2 * 1024);
+    for (u32 i = 0; i < cfg.WarmupFrames && nds->IsRunning(); i++)
+    {
+        nds->RunFrame();
+        while (nds->SPU.ReadOutput(audiobuf.data(), 1024) > 0);
+    }
+
+    using clock = std::chrono::steady_clock;
+    using ms = std::chrono::duration<double, std::milli>;
+
+    // one arena reused for every snapshot, reloaded right after being saved
+    Savestate state;
+    double savetime = 0, reloadtime = 0;
+    for (u32 i = 0; i < cfg.SavestateRoundTrips; i++)
+    {
+        auto start = clock::now();
+        state.Rewind(true);
+        nds->DoSavestate(&state);
+        auto saved = clock::now();
+        state.Rewind(false);
+        nds->DoSavestate(&state);
+        auto loaded = clock::now();
+
+        if (state.Error)
+        {
+            Log(LogLevel::Error, "Savestate round-trip failed\n");
+            return 1;
+        }
+
+        savetime += ms(saved - start).count();
+        reloadtime += ms(loaded - saved).count();
+    }
+
+    // loading a snapshot kept elsewhere (ie. from the rewind buffer) goes through the regular checks
+    std::vector<u8> copy((u8*)state.Buffer(), (u8*)state.Buffer() + state.Length());
+    double loadtime = 0;
+    for (u32 i = 0; i < cfg.SavestateRoundTrips; i++)
+    {
+        auto start = clock::now();
+        Savestate load(copy.data(), copy.size(), false);
+        if (load.Error || !nds->DoSavestate(&load) || load.Error)
+        {
+            Log(LogLevel::Error, "Savestate load failed\n");
+            return 1;
+        }
+        loadtime += ms(clock::now() - start).count();
+    }
+
+    // rewind snapshots, taken a frame apart
+    RewindBuffer rewind(256 << 20);
+    double pushtime = 0;
+    for (u32 i = 0; i < cfg.SavestateRoundTrips && nds->IsRunning(); i++)
+    {
+        nds->RunFrame();
+        while (nds->SPU.ReadOutput(audiobuf.data(), 1024) > 0);
+
+        state.Rewind(true);
+        nds->DoSavestate(&state);
+        state.Finish();
+
+        auto start = clock::now();
+        rewind.Push(state, &nds->DirtyPages);
+        pushtime += ms(clock::now() - start).count();
+    }
+
+    double n = cfg.SavestateRoundTrips;
+    printf("{\n");
+    printf("  \"version\": \"%s\",\n", MELONDS_VERSION);
+    printf("  \"rom\": \"%s\",\n", jsonEscape(romname).c_str());
+    printf("  \"cpu\": \"%s\",\n", cfg.JIT ? "jit" : "interpreter");
+    printf("  \"state_bytes\": %u,\n", state.Length());
+    printf("  \"round_trips\": %u,\n", cfg.SavestateRoundTrips);
+    printf("  \"save_ms\": %.4f,\n", savetime / n);
+    printf("  \"reload_ms\": %.4f,\n", reloadtime / n);
+    printf("  \"load_ms\": %.4f,\n", loadtime / n);
+    printf("  \"rewind_push_ms\": %.4f,\n", pushtime / n);
+    printf("  \"rewind_bytes\": %llu,\n", (unsigned long long)rewind.GetMemoryUsage());
+    printf("  \"round_trips_per_second\": %.3f,\n", (savetime + reloadtime) > 0 ? n * 1000 / (savetime + reloadtime) : 0.0);
+    printf("  \"peak_rss_kb\": %llu\n", (unsigned long long)peakRSSKB());
+    printf("}\n");
+
+    return 0;
+}
+
+int main(int argc, char** argv)
+{
+    BenchConfig cfg;
+    if (!parseArgs(argc, argv, cfg))
+    {
+        printUsage(argv[0]);
+        return 1;
+    }
+
+#ifndef JIT_ENABLED
+    if (cfg.JIT)
+    {
+        Log(LogLevel::Error, "This build of melonDS does not include the JIT\n");
+        return 1;
+    }
+#endif
+
+    std::string romname = cfg.ROMPath.substr(cfg.ROMPath.find_last_of("/\\") + 1);
+
+    if (cfg.CheckDeterminism)
+        return checkDeterminism(cfg);
+#ifdef JIT_ENABLED
+    if (cfg.CheckJIT)
+        return checkJIT(cfg, romname);
+#endif
+    if (cfg.SavestateRoundTrips > 0)
+        return runSavestates(cfg, romname);
+    if (cfg.NumConsoles > 1)
+        return runBatch(cfg, romname);
+
+    auto nds = createConsole(cfg, romname, cfg.ThreadedARM7);
+    if (!nds) return 1;
+
+    // audio is pulled every frame like a regular frontend would, then thrown away
+    std::vector<s16> audiobuf(2 * 1024);
+    auto drainAudio = [&]()
+    {
+        while (nds->SPU.GetOutputSize() > 0)
+        {
+            if (nds->SPU.ReadOutput(audiobuf.data(), 1024) <= 0)
+                break;
+        }
+    };
+
+    InputMovie movie(*nds);
+    if (!cfg.MoviePath.empty() && !movie.StartPlayback(cfg.MoviePath))
+        return 1;
+    if (!cfg.RecordMoviePath.empty() && !movie.StartRecording(cfg.MovieHashInterval, false))
+        return 1;
+
+    // the bench has no input of its own, so recordings hold the idle input
+    // and are mostly useful for their state hashes
+    auto beginFrame = [&]()
+    {
+        if (movie.IsPlaying())
+            return movie.PlayInput();
+        if (movie.IsRecording())
+            movie.RecordInput({0xFFF, false, 0, 0, false});
+        return true;
+    };
+    bool movieended = false;
+
+    for (u32 i = 0; i < cfg.WarmupFrames && nds->IsRunning(); i++)
+    {
+        if (!beginFrame())
+        {
+            movieended = true;
+            break;
+        }
+        nds->RunFrame();
+        movie.EndFrame();
+        drainAudio();
+    }
+
+    std::vector<double> frametimes;
+    frametimes.reserve(cfg.Frames);
+
+    FrameProfile profile {};
+#ifdef PROFILER_ENABLED
+    if (!cfg.TracePath.empty())
+        nds->Profiler.StartTrace();
+#endif
+
+    using clock = std::chrono::steady_clock;
+    auto benchstart = clock::now();
+
+    for (u32 i = 0; i < cfg.Frames && nds->IsRunning() && !movieended; i++)
+    {
+        if (!beginFrame())
+            break;
+
+        auto framestart = clock::now();
+        nds->RunFrame();
+        movie.EndFrame();
+        drainAudio();
+        auto frameend = clock::now();
+
+        frametimes.push_back(std::chrono::duration<double, std::milli>(frameend - framestart).count());
+
+        if (const FrameProfile* frameprof = nds->GetFrameProfile())
+        {
+            for (u32 b = 0; b < Prof_MAX; b++)
+            {
+                profile.TimeNS[b] += frameprof->TimeNS[b];
+                profile.Cycles[b] += frameprof->Cycles[b];
+                profile.Calls[b] += frameprof->Calls[b];
+            }
+        }
+    }
+
+#ifdef PROFILER_ENABLED
+    if (!cfg.TracePath.empty())
+    {
+        nds->Profiler.StopTrace();
+        nds->Profiler.WriteTrace(cfg.TracePath);
+    }
+#endif
+
+    double totalsecs = std::chrono::duration<double>(clock::now() - benchstart).count();
+    bool stopped = !nds->IsRunning();
+
+    bool moviedesynced = movie.IsDesynced();
+    u32 moviedesyncframe = movie.GetDesyncFrame();
+    u32 movieframes = movie.GetFrame();
+    movie.Stop();
+    if (!cfg.RecordMoviePath.empty() && !movie.Save(cfg.RecordMoviePath))
+        return 1;
+    u32 numframes = (u32)frametimes.size();
+
+    std::vector<double> sorted = frametimes;
+    std::sort(sorted.begin(), sorted.end());
+
+    double mean = 0;
+    for (double t : sorted) mean += t;
+    if (numframes) mean /= numframes;
+
+    FILE* out = stdout;
+    if (!cfg.OutputPath.empty())
+    {
+        out = fopen(cfg.OutputPath.c_str(), "w");
+        if (!out)
+        {
+            Log(LogLevel::Error, "Failed to open %s for writing\n", cfg.OutputPath.c_str());
+            return 1;
+        }
+    }
+
+    fprintf(out, "{\n");
+    fprintf(out, "  \"version\": \"%s\",\n", MELONDS_VERSION);
+    fprintf(out, "  \"rom\": \"%s\",\n", jsonEscape(romname).c_str());
+    fprintf(out, "  \"cpu\": \"%s\",\n", cfg.JIT ? "jit" : "interpreter");
+    fprintf(out, "  \"renderer\": \"%s\",\n", cfg.Threaded ? "soft-threaded" : "soft");
+    if (cfg.ThreadedARM7)
+    {
+        fprintf(out, "  \"arm7_max_skew\": %u,\n", nds->GetARM7MaxSkew());
+        // the share of the cycles the ARM7 wasn't halted for which it could run
+        // alongside the ARM9, over the whole run like the JIT counts
+        u64 cycles = nds->ARM7ThreadCycles;
+        u64 halted = nds->ARM7ThreadHaltedCycles;
+        u64 concurrent = nds->ARM7ConcurrentCycles;
+        fprintf(out, "  \"arm7_thread\": {\n");
+        fprintf(out, "    \"cycles\": %llu,\n", (unsigned long long)cycles);
+        fprintf(out, "    \"halted_cycles\": %llu,\n", (unsigned long long)halted);
+        fprintf(out, "    \"concurrent_cycles\": %llu,\n", (unsigned long long)concurrent);
+        fprintf(out, "    \"concurrent_share\": %.4f\n", (cycles > halted) ? (double)concurrent / (cycles - halted) : 0.0);
+        fprintf(out, "  },\n");
+    }
+    fprintf(out, "  \"warmup_frames\": %u,\n", cfg.WarmupFrames);
+    fprintf(out, "  \"frames\": %u,\n", numframes);
+    fprintf(out, "  \"stopped_early\": %s,\n", stopped ? "true" : "false");
+    fprintf(out, "  \"total_seconds\": %.6f,\n", totalsecs);
+    fprintf(out, "  \"fps\": %.3f,\n", totalsecs > 0 ? numframes / totalsecs : 0.0);
+    if (!cfg.MoviePath.empty() || !cfg.RecordMoviePath.empty())
+    {
+        fprintf(out, "  \"movie\": {\n");
+        fprintf(out, "    \"mode\": \"%s\",\n", cfg.MoviePath.empty() ? "record" : "playback");
+        fprintf(out, "    \"frames\": %u,\n", movieframes);
+        if (moviedesynced)
+            fprintf(out, "    \"desync_frame\": %u\n", moviedesyncframe);
+        else
+            fprintf(out, "    \"desync_frame\": null\n");
+        fprintf(out, "  },\n");
+    }
+#ifdef JIT_ENABLED
+    if (cfg.JIT)
+    {
+        // these are over the whole run, warmup included
+        JITStats stats = nds->JIT.GetStats();
+        fprintf(out, "  \"jit_stats\": {\n");
+        fprintf(out, "    \"live_blocks\": %u,\n", stats.LiveBlocks);
+        fprintf(out, "    \"blocks_compiled\": %llu,\n", (unsigned long long)stats.BlocksCompiled);
+        fprintf(out, "    \"blocks_restored\": %llu,\n", (unsigned long long)stats.BlocksRestored);
+        fprintf(out, "    \"cache_resets\": %llu,\n", (unsigned long long)stats.CacheResets);
+        fprintf(out, "    \"code_memory_full\": %llu,\n", (unsigned long long)stats.CodeMemoryFull);
+        fprintf(out, "    \"fastmem_mappings\": %llu,\n", (unsigned long long)stats.FastMemMappings);
+        fprintf(out, "    \"fastmem_rewrites\": %llu,\n", (unsigned long long)stats.FastMemRewrites);
+
+        fprintf(out, "    \"invalidations\": {");
+        bool first = true;
+        for (int r = 0; r < ARMJIT_Memory::memregions_Count; r++)
+        {
+            if (!stats.Invalidations[r]) continue;
+            fprintf(out, "%s\n      \"%s\": %llu", first ? "" : ",",
+                ARMJIT_Memory::RegionName(r), (unsigned long long)stats.Invalidations[r]);
+            first = false;
+        }
+        fprintf(out, "%s},\n", first ? "" : "\n    ");
+
+        // by the kind numbers in ARM_InstrInfo.h
+        fprintf(out, "    \"interpreted_instrs\": {");
+        first = true;
+        for (int k = 0; k < ARMInstrInfo::ak_Count; k++)
+        {
+            if (!stats.InterpretedARM[k]) continue;
+            fprintf(out, "%s\n      \"ak_%d\": %llu", first ? "" : ",", k, (unsigned long long)stats.InterpretedARM[k]);
+            first = false;
+        }
+        for (int k = 0; k < ARMInstrInfo::tk_Count; k++)
+        {
+            if (!stats.InterpretedThumb[k]) continue;
+            fprintf(out, "%s\n      \"tk_%d\": %llu", first ? "" : ",", k, (unsigned long long)stats.InterpretedThumb[k]);
+            first = false;
+        }
+        fprintf(out, "%s}\n", first ? "" : "\n    ");
+        fprintf(out, "  },\n");
+    }
+#endif
+    fprintf(out, "  \"frame_time_ms\": {\n");
+    fprintf(out, "    \"min\": %.4f,\n", numframes ? sorted.front() : 0.0);
+    fprintf(out, "    \"mean\": %.4f,\n", mean);
+    fprintf(out, "    \"p50\": %.4f,\n", percentile(sorted, 0.50));
+    fprintf(out, "    \"p90\": %.4f,\n", percentile(sorted, 0.90));
+    fprintf(out, "    \"p99\": %.4f,\n", percentile(sorted, 0.99));
+    fprintf(out, "    \"max\": %.4f\n", numframes ? sorted.back() : 0.0);
+    fprintf(out, "  },\n");
+#ifdef PROFILER_ENABLED
+    if (cfg.Profile)
+    {
+        // totals over all measured frames
+        fprintf(out, "  \"profile\": {\n");
+        bool first = true;
+        for (u32 b = 0; b < Prof_MAX; b++)
+        {
+            if (!profile.Calls[b]) continue;
+            fprintf(out, "%s    \"%s\": {\"time_ms\": %.4f, \"cycles\": %llu, \"calls\": %u}",
+                first ? "" : ",\n",
+                Profiler::BucketName(b),
+                profile.TimeNS[b] / 1000000.0,
+                (unsigned long long)profile.Cycles[b],
+                profile.Calls[b]);
+            first = false;
+        }
+        fprintf(out, "\n  },\n");
+    }
+#endif
+    fprintf(out, "  \"peak_rss_kb\": %llu\n", (unsigned long long)peakRSSKB());
+    fprintf(out, "}\n");
+
+    if (out != stdout)
+        fclose(out);
+
+    return 0;
+}
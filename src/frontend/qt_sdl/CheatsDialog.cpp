@@ -55,7 +55,9 @@ CheatsDialog::CheatsDialog(QWidget* parent) : QDialog(parent), ui(new Ui::Cheats
 
     auto rom = emuInstance->getNDS()->NDSCartSlot.GetCart();
     gameCode = rom->GetHeader().GameCodeAsU32();
-    gameChecksum = ~CRC32(rom->GetROM(), 0x200, 0);
+    u8 romheader[0x200];
+    rom->ReadROM(0, 0x200, romheader, 0);
+    gameChecksum = ~CRC32(romheader, 0x200, 0);
 
     codeFile = emuInstance->getCheatFile();
 
@@ -57,12 +57,16 @@ DefaultList<int> DefaultInts =
     {"3D.GL.ScaleFactor", 1},
 #ifdef JIT_ENABLED
     {"JIT.MaxBlockSize", 32},
+    {"JIT.PerfMap", 0},
 #endif
     {"Instance*.Firmware.Language", 1},
     {"Instance*.Firmware.BirthdayMonth", 1},
     {"Instance*.Firmware.BirthdayDay", 1},
     {"MP.AudioMode", 1},
     {"MP.RecvTimeout", 25},
+    {"Rewind.Interval", 2},
+    {"Rewind.BudgetMB", 256},
+    {"RunAhead.Frames", 0},
     {"Instance*.Audio.Volume", 256},
     {"Mic.InputType", 1},
     {"Mouse.HideSeconds", 5},
@@ -72,11 +76,15 @@ DefaultList<int> DefaultInts =
     {"Instance*.Gdb.ARM9.Port", 3333},
 #endif
     {"LAN.HostNumPlayers", 16},
+    {"Netplay.Port", 8064},
+    {"Netplay.InputDelay", 2},
+    {"Netplay.MaxRollback", 8},
 };
 
 RangeList IntRanges =
 {
     {"Emu.ConsoleType", {0, 1}},
+    {"RunAhead.Frames", {0, 8}},
     {"3D.Renderer", {0, renderer3D_Max-1}},
     {"Screen.VSyncInterval", {1, 20}},
     {"3D.GL.ScaleFactor", {1, 16}},
@@ -91,6 +99,11 @@ RangeList IntRanges =
     {"Instance*.Window*.ScreenAspectBot", {0, AspectRatiosNum-1}},
     {"MP.AudioMode", {0, 2}},
     {"LAN.HostNumPlayers", {2, 16}},
+    {"Netplay.Port", {1, 65535}},
+    {"Netplay.InputDelay", {0, 16}},
+    {"Netplay.MaxRollback", {1, 16}},
+    {"Rewind.Interval", {1, 60}},
+    {"Rewind.BudgetMB", {16, 4096}},
 };
 
 DefaultList<bool> DefaultBools =
@@ -101,6 +114,8 @@ DefaultList<bool> DefaultBools =
     {"LimitFPS", true},
     {"Instance*.Window*.ShowOSD", true},
     {"Emu.DirectBoot", true},
+    {"Emu.EventCatchUp", false},
+    {"Rewind.Enabled", false},
     {"Instance*.DS.Battery.LevelOkay", true},
     {"Instance*.DSi.Battery.Charging", true},
 #ifdef JIT_ENABLED
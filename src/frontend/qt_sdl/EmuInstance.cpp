@@ -20,6 +20,7 @@
 #include <stdio.h>
 #include <string.h>
 
+#include <algorithm>
 #include <codecvt>
 #include <locale>
 #include <memory>
@@ -39,6 +40,8 @@
 #include "Platform.h"
 #include "Net.h"
 #include "MPInterface.h"
+#include "Netplay.h"
+#include "InputMovie.h"
 
 #include "NDS.h"
 #include "DSi.h"
@@ -124,6 +127,22 @@ EmuInstance::EmuInstance(int inst) : deleting(false),
     nds = nullptr;
     //updateConsole();
 
+    rewindInterval = 0;
+    rewindCounter = 0;
+    runAheadFrames = 0;
+    runningAhead = false;
+
+    netplay = std::make_unique<Netplay>();
+    movieDesyncShown = false;
+
+    stateWriter = std::make_unique<SavestateWriter>();
+    QObject::connect(stateWriter.get(), &SavestateWriter::stateWritten, stateWriter.get(), [this](int slot, bool success)
+    {
+        if (!success)      osdAddMessage(0xFFA0A0, "State save failed");
+        else if (slot > 0) osdAddMessage(0, "State saved to slot %d", slot);
+        else               osdAddMessage(0, "State saved to file");
+    });
+
     audioInit();
     inputInit();
 
@@ -160,6 +179,16 @@ EmuInstance::~EmuInstance()
     emuThread->wait();
     delete emuThread;
 
+    // pending states are written out before leaving
+    stateWriter = nullptr;
+
+    // the netplay game runs on the console, it has to go first
+    netplay = nullptr;
+
+    // a movie being recorded is saved on the way out
+    stopMovie();
+    movie = nullptr;
+
     net.UnregisterInstance(instanceID);
 
     audioDeInit();
@@ -712,6 +741,23 @@ bool EmuInstance::savestateExists(int slot)
 
 bool EmuInstance::loadState(const std::string& filename)
 {
+    // the other player's console wouldn't follow
+    if (netplay->IsRunning())
+    {
+        Platform::Log(Platform::LogLevel::Error, "Can't load a state during a netplay game\n");
+        return false;
+    }
+
+    // neither would the movie's input
+    if (movie && movie->GetMode() != InputMovie::Mode::Idle)
+    {
+        Platform::Log(Platform::LogLevel::Error, "Can't load a state while an input movie is recorded or played back\n");
+        return false;
+    }
+
+    // the state might still be getting written
+    stateWriter->WaitIdle();
+
     Platform::FileHandle* file = Platform::OpenFile(filename, Platform::FileMode::Read);
     if (file == nullptr)
     { // If we couldn't open the state file...
@@ -767,50 +813,34 @@ bool EmuInstance::loadState(const std::string& filename)
     return true;
 }
 
-bool EmuInstance::saveState(const std::string& filename)
+bool EmuInstance::saveState(const std::string& filename, int slot)
 {
-    Platform::FileHandle* file = Platform::OpenFile(filename, Platform::FileMode::Write);
-
-    if (file == nullptr)
-    { // If the file couldn't be opened...
-        return false;
-    }
-
-    Savestate state;
-    if (state.Error)
+    // Only the snapshot is taken here, the file is written by stateWriter,
+    // which reports completion through the OSD
+    std::unique_ptr<Savestate> state = stateWriter->GetState();
+    if (state->Error)
     { // If there was an error creating the state (and allocating its memory)...
-        Platform::CloseFile(file);
         return false;
     }
 
     // Write the savestate to the in-memory buffer
-    nds->DoSavestate(&state);
+    nds->DoSavestate(state.get());
+    state->Finish();
 
-    if (state.Error)
+    if (state->Error)
     {
-        Platform::CloseFile(file);
+        stateWriter->RecycleState(std::move(state));
         return false;
     }
 
-    if (Platform::FileWrite(state.Buffer(), state.Length(), 1, file) == 0)
-    { // Write the Savestate buffer to the file. If that fails...
-        Platform::Log(Platform::Error,
-                      "Failed to write %d-byte savestate to %s\n",
-                      state.Length(),
-                      filename.c_str()
-        );
-        Platform::CloseFile(file);
-        return false;
-    }
-
-    Platform::CloseFile(file);
-
+    stateWriter->QueueWrite(std::move(state), filename, slot, globalCfg.GetBool("Savestate.Compress"));
     return true;
 }
 
 void EmuInstance::undoStateLoad()
 {
     if (!savestateLoaded || !backupState) return;
+    if (movie && movie->GetMode() != InputMovie::Mode::Idle) return;
 
     // Rewind the backup state and put it in load mode
     backupState->Rewind(false);
@@ -821,6 +851,194 @@ void EmuInstance::undoStateLoad()
     nds->DoSavestate(backupState.get());
 }
 
+void EmuInstance::rewindReset()
+{
+    // settings are picked up here, ie. on reset or when booting a ROM
+    rewindCounter = 0;
+    if (!globalCfg.GetBool("Rewind.Enabled"))
+    {
+        rewindInterval = 0;
+        rewindBuffer = nullptr;
+        rewindState = nullptr;
+        return;
+    }
+
+    rewindInterval = std::max(globalCfg.GetInt("Rewind.Interval"), 1);
+    u64 budget = (u64)std::max(globalCfg.GetInt("Rewind.BudgetMB"), 1) << 20;
+
+    if (rewindBuffer)
+    {
+        rewindBuffer->Clear();
+        rewindBuffer->SetBudget(budget);
+    }
+    else
+    {
+        rewindBuffer = std::make_unique<RewindBuffer>(budget);
+        rewindState = std::make_unique<Savestate>();
+    }
+}
+
+void EmuInstance::rewindCapture()
+{
+    if (!rewindBuffer) return;
+
+    if (++rewindCounter < rewindInterval) return;
+    rewindCounter = 0;
+
+    rewindState->Rewind(true);
+    nds->DoSavestate(rewindState.get());
+    rewindState->Finish();
+
+    if (!rewindState->Error)
+        rewindBuffer->Push(*rewindState, &nds->DirtyPages);
+}
+
+bool EmuInstance::rewindStep()
+{
+    if (!rewindBuffer) return false;
+
+    u32 len;
+    const u8* data = rewindBuffer->Pop(len);
+    if (!data) return false;
+
+    // the snapshot is only read, the buffer stays owned by the rewind buffer
+    Savestate state((void*)data, len, false);
+    if (state.Error || !nds->DoSavestate(&state) || state.Error)
+    {
+        Log(LogLevel::Error, "Failed to load rewind snapshot\n");
+        rewindBuffer->Clear();
+        return false;
+    }
+
+    rewindCounter = 0;
+    return true;
+}
+
+u32 EmuInstance::runFrameAhead()
+{
+    // The real frame is only heard, the one shown is emulated further ahead
+    // with the current input, then thrown away
+    nds->GPU.SetSkipDrawing(true);
+    u32 nlines = nds->RunFrame();
+
+    if (!runAheadState)
+        runAheadState = std::make_unique<Savestate>();
+    else
+        runAheadState->Rewind(true);
+
+    nds->DoSavestate(runAheadState.get());
+    if (runAheadState->Error)
+    {
+        Log(LogLevel::Error, "Failed to snapshot the state for run-ahead, disabling it\n");
+        nds->GPU.SetSkipDrawing(false);
+        runAheadFrames = 0;
+        runAheadState = nullptr;
+        return nlines;
+    }
+
+    // The host's mic input and the wifi packets are left for the real frame,
+    // the Platform MP and Net functions don't send or receive anything meanwhile
+    bool micMuted = nds->Mic.IsMuted();
+    nds->Mic.SetMuted(true);
+    nds->SPU.SetOutputEnabled(false);
+    runningAhead = true;
+    for (int i = 0; i < runAheadFrames; i++)
+    {
+        nds->GPU.SetSkipDrawing(i < (runAheadFrames - 1));
+        nds->RunFrame();
+    }
+    runningAhead = false;
+    nds->SPU.SetOutputEnabled(true);
+    nds->Mic.SetMuted(micMuted);
+
+    runAheadState->Rewind(false);
+    nds->DoSavestate(runAheadState.get());
+
+    return nlines;
+}
+
+bool EmuInstance::startMovieRecording(const std::string& filename)
+{
+    if (!movie || netplay->IsRunning())
+        return false;
+
+    stopMovie();
+
+    // the movie always starts from a savestate, so it can be played back at any time
+    if (!movie->StartRecording(InputMovie::DefaultHashInterval, true))
+        return false;
+
+    moviePath = filename;
+    return true;
+}
+
+bool EmuInstance::startMoviePlayback(const std::string& filename)
+{
+    if (!movie || netplay->IsRunning())
+        return false;
+
+    stopMovie();
+
+    // playback starts from the movie's own state, so this is the same as loading one
+    backupState = nullptr;
+    savestateLoaded = false;
+    rewindReset();
+
+    if (!movie->StartPlayback(filename))
+        return false;
+
+    movieDesyncShown = false;
+    return true;
+}
+
+void EmuInstance::stopMovie()
+{
+    if (!movie || movie->GetMode() == InputMovie::Mode::Idle)
+        return;
+
+    bool recording = movie->IsRecording();
+    movie->Stop();
+
+    if (recording)
+    {
+        if (movie->Save(moviePath))
+            osdAddMessage(0, "Input movie saved (%u frames)", movie->GetLength());
+        else
+            osdAddMessage(0xFFA0A0, "Failed to save input movie");
+    }
+    else
+        osdAddMessage(0, "Input movie stopped");
+}
+
+u32 EmuInstance::runMovieFrame()
+{
+    if (movie->IsRecording())
+    {
+        InputMovie::Input input = {(u16)(inputMask & 0xFFF), isTouching, touchX, touchY, nds->IsLidClosed()};
+        movie->RecordInput(input);
+    }
+    else if (!movie->PlayInput())
+    {
+        if (movie->IsDesynced())
+            osdAddMessage(0xFFA0A0, "Input movie ended, diverged at frame %u", movie->GetDesyncFrame());
+        else
+            osdAddMessage(0, "Input movie ended");
+
+        return nds->RunFrame();
+    }
+
+    u32 nlines = nds->RunFrame();
+    movie->EndFrame();
+
+    if (movie->IsDesynced() && !movieDesyncShown)
+    {
+        osdAddMessage(0xFFA0A0, "Input movie diverged at frame %u", movie->GetDesyncFrame());
+        movieDesyncShown = true;
+    }
+
+    return nlines;
+}
+
 
 void EmuInstance::unloadCheats()
 {
@@ -1160,6 +1378,48 @@ ARCodeFile* EmuInstance::getCheatFile()
     return cheatFile.get();
 }
 
+void EmuInstance::logJITStats()
+{
+#ifdef JIT_ENABLED
+    if (!nds || !nds->IsJITEnabled())
+    {
+        Log(LogLevel::Info, "JIT stats: the JIT is off\n");
+        return;
+    }
+
+    JITStats stats = nds->JIT.GetStats();
+    Log(LogLevel::Info, "JIT stats: %u live blocks, %llu compiled, %llu restored\n",
+        stats.LiveBlocks, (unsigned long long)stats.BlocksCompiled, (unsigned long long)stats.BlocksRestored);
+    Log(LogLevel::Info, "JIT stats: %llu cache resets, %llu of them with the code memory full\n",
+        (unsigned long long)stats.CacheResets, (unsigned long long)stats.CodeMemoryFull);
+    Log(LogLevel::Info, "JIT stats: %llu fastmem mappings, %llu fastmem rewrites\n",
+        (unsigned long long)stats.FastMemMappings, (unsigned long long)stats.FastMemRewrites);
+
+    for (int r = 0; r < ARMJIT_Memory::memregions_Count; r++)
+    {
+        if (stats.Invalidations[r])
+            Log(LogLevel::Info, "JIT stats: %llu invalidations in %s\n",
+                (unsigned long long)stats.Invalidations[r], ARMJIT_Memory::RegionName(r));
+    }
+
+    // by the kind numbers in ARM_InstrInfo.h
+    for (int k = 0; k < ARMInstrInfo::ak_Count; k++)
+    {
+        if (stats.InterpretedARM[k])
+            Log(LogLevel::Info, "JIT stats: %llu interpreted ARM instructions of kind %d\n",
+                (unsigned long long)stats.InterpretedARM[k], k);
+    }
+    for (int k = 0; k < ARMInstrInfo::tk_Count; k++)
+    {
+        if (stats.InterpretedThumb[k])
+            Log(LogLevel::Info, "JIT stats: %llu interpreted Thumb instructions of kind %d\n",
+                (unsigned long long)stats.InterpretedThumb[k], k);
+    }
+#else
+    Log(LogLevel::Info, "JIT stats: this build has no JIT\n");
+#endif
+}
+
 void EmuInstance::setBatteryLevels()
 {
     if (consoleType == 1)
@@ -1263,6 +1523,7 @@ bool EmuInstance::updateConsole() noexcept
             jitopt.GetBool("LiteralOptimisations"),
             jitopt.GetBool("BranchOptimisations"),
             jitopt.GetBool("FastMemory"),
+            static_cast<JITPerfMap>(jitopt.GetInt("PerfMap")),
     };
     auto jitargs = jitopt.GetBool("Enable") ? std::make_optional(_jitargs) : std::nullopt;
 #else
@@ -1326,6 +1587,9 @@ bool EmuInstance::updateConsole() noexcept
     {
         if (nds)
         {
+            netplay->StopGame();
+            stopMovie();
+            movie = nullptr;
             saveRTCData();
             delete nds;
         }
@@ -1335,6 +1599,7 @@ bool EmuInstance::updateConsole() noexcept
         else
             nds = new NDS(std::move(ndsargs), this);
 
+        movie = std::make_unique<InputMovie>(*nds);
         nds->Reset();
         loadRTCData();
         emuThread->updateVideoRenderer();
@@ -1364,6 +1629,16 @@ bool EmuInstance::updateConsole() noexcept
         }
     }
 
+    rewindReset();
+    nds->SetEventCatchUp(globalCfg.GetBool("Emu.EventCatchUp"));
+    runAheadFrames = globalCfg.GetInt("RunAhead.Frames");
+    // every state load drops the JIT's blocks, they'd be compiled again for each frame shown
+    if (runAheadFrames > 0 && nds->IsJITEnabled())
+    {
+        Log(LogLevel::Warn, "Run-ahead doesn't work with the JIT, disabling it\n");
+        runAheadFrames = 0;
+    }
+
     // loads the carts later -- to be sure that everything else is initialized
     nds->SetNDSCart(std::move(nextndscart));
     if (consoleType == 1)
@@ -1380,6 +1655,16 @@ bool EmuInstance::updateConsole() noexcept
 
 void EmuInstance::reset()
 {
+    // the movie's input wouldn't match the restarted game
+    stopMovie();
+
+    // and the other player's console wouldn't restart along with this one
+    if (netplay->IsRunning())
+    {
+        netplay->StopGame();
+        osdAddMessage(0, "Netplay game stopped");
+    }
+
     updateConsole();
 
     if (consoleType == 1) ejectGBACart();
@@ -1850,11 +2135,33 @@ QString EmuInstance::getSavErrorString(std::string& filepath, bool gba)
 bool EmuInstance::loadROM(QStringList filepath, bool reset, QString& errorstr)
 {
     unique_ptr<u8[]> filedata = nullptr;
+    SharedROMData mappeddata = nullptr;
+    unique_ptr<CompressedROM> blockdata = nullptr;
     u32 filelen;
     std::string basepath;
     std::string romname;
 
-    if (!loadROMData(filepath, filedata, filelen, basepath, romname))
+    // plain ROM files which can't be written to are mapped and paged in as the game reads them
+    // block-compressed ROMs are decompressed as the game reads them
+    // other compressed ROMs and archives have to be extracted upfront
+    if (filepath.count() == 1 && !filepath.at(0).endsWith(".zst"))
+    {
+        std::string filename = filepath.at(0).toStdString();
+        blockdata = CompressedROM::Open(filename);
+        if (!blockdata)
+            mappeddata = MapROMFile(filename, filelen);
+
+        if (blockdata || mappeddata)
+        {
+            int pos = lastSep(filename);
+            if (pos != -1)
+                basepath = filename.substr(0, pos);
+
+            romname = filename.substr(pos+1);
+        }
+    }
+
+    if (!blockdata && !mappeddata && !loadROMData(filepath, filedata, filelen, basepath, romname))
     {
         errorstr = "Failed to load the DS ROM.";
         return false;
@@ -1909,7 +2216,13 @@ bool EmuInstance::loadROM(QStringList filepath, bool reset, QString& errorstr)
             .SRAMLength = savelen,
     };
 
-    auto cart = NDSCart::ParseROM(std::move(filedata), filelen, this, std::move(cartargs));
+    std::unique_ptr<NDSCart::CartCommon> cart;
+    if (blockdata)
+        cart = NDSCart::ParseROM(std::move(blockdata), this, std::move(cartargs));
+    else if (mappeddata)
+        cart = NDSCart::ParseROM(std::move(mappeddata), filelen, this, std::move(cartargs));
+    else
+        cart = NDSCart::ParseROM(std::move(filedata), filelen, this, std::move(cartargs));
     if (!cart)
     {
         // If we couldn't parse the ROM...
@@ -1945,6 +2258,7 @@ bool EmuInstance::loadROM(QStringList filepath, bool reset, QString& errorstr)
         {
             nds->SetNDSCart(std::move(cart));
             loadCheats();
+            rewindReset();
         }
         else
         {
@@ -1967,6 +2281,7 @@ void EmuInstance::ejectCart()
     {
         nds->EjectCart();
         unloadCheats();
+        rewindReset();
     }
     else
     {
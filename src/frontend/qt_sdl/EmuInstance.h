@@ -24,10 +24,18 @@
 #include "Platform.h"
 #include "main.h"
 #include "NDS.h"
+#include "RewindBuffer.h"
 #include "EmuThread.h"
 #include "Window.h"
 #include "Config.h"
 #include "SaveManager.h"
+#include "SavestateWriter.h"
+
+namespace melonDS
+{
+class Netplay;
+class InputMovie;
+}
 
 const int kMaxWindows = 4;
 
@@ -56,6 +64,7 @@ enum
     HK_GuitarGripRed,
     HK_GuitarGripYellow,
     HK_GuitarGripBlue,
+    HK_Rewind,
     HK_MAX
 };
 
@@ -89,8 +98,12 @@ public:
 
     int getInstanceID() { return instanceID; }
     int getConsoleType() { return consoleType; }
+    // set during the frames run-ahead throws away again
+    bool isRunningAhead() { return runningAhead; }
     EmuThread* getEmuThread() { return emuThread; }
     melonDS::NDS* getNDS() { return nds; }
+    melonDS::Netplay* getNetplay() { return netplay.get(); }
+    melonDS::InputMovie* getMovie() { return movie.get(); }
 
     MainWindow* getMainWindow() { return mainWindow; }
     int getNumWindows() { return numWindows; }
@@ -133,6 +146,9 @@ public:
     void enableCheats(bool enable);
     melonDS::ARCodeFile* getCheatFile();
 
+    // writes what the JIT has been doing to the log, see JITStats
+    void logJITStats();
+
     void romIcon(const melonDS::u8 (&data)[512],
                  const melonDS::u16 (&palette)[16],
                  melonDS::u32 (&iconRef)[32*32]);
@@ -184,8 +200,16 @@ private:
     std::string getSavestateName(int slot);
     bool savestateExists(int slot);
     bool loadState(const std::string& filename);
-    bool saveState(const std::string& filename);
+    bool saveState(const std::string& filename, int slot = 0);
     void undoStateLoad();
+    void rewindReset();
+    void rewindCapture();
+    bool rewindStep();
+    melonDS::u32 runFrameAhead();
+    bool startMovieRecording(const std::string& filename);
+    bool startMoviePlayback(const std::string& filename);
+    void stopMovie();
+    melonDS::u32 runMovieFrame();
     void unloadCheats();
     void loadCheats();
     std::unique_ptr<melonDS::ARM9BIOSImage> loadARM9BIOS() noexcept;
@@ -308,6 +332,22 @@ private:
 
     std::unique_ptr<melonDS::Savestate> backupState;
     bool savestateLoaded;
+    std::unique_ptr<SavestateWriter> stateWriter;
+
+    std::unique_ptr<melonDS::RewindBuffer> rewindBuffer;
+    std::unique_ptr<melonDS::Savestate> rewindState;
+    int rewindInterval;
+    int rewindCounter;
+
+    int runAheadFrames;
+    std::unique_ptr<melonDS::Savestate> runAheadState;
+    bool runningAhead;
+
+    std::unique_ptr<melonDS::Netplay> netplay;
+
+    std::unique_ptr<melonDS::InputMovie> movie;
+    std::string moviePath;
+    bool movieDesyncShown;
 
     std::unique_ptr<melonDS::ARCodeFile> cheatFile;
     bool cheatsOn;
@@ -77,6 +77,11 @@ EmuSettingsDialog::EmuSettingsDialog(QWidget* parent) : QDialog(parent), ui(new
     ui->cbxConsoleType->setCurrentIndex(cfg.GetInt("Emu.ConsoleType"));
 
     ui->chkDirectBoot->setChecked(cfg.GetBool("Emu.DirectBoot"));
+    ui->chkEventCatchUp->setChecked(cfg.GetBool("Emu.EventCatchUp"));
+
+    ui->chkRewindEnable->setChecked(cfg.GetBool("Rewind.Enabled"));
+    ui->spnRewindInterval->setValue(cfg.GetInt("Rewind.Interval"));
+    ui->spnRewindBudget->setValue(cfg.GetInt("Rewind.BudgetMB"));
 
 #ifdef JIT_ENABLED
     ui->chkEnableJIT->setChecked(cfg.GetBool("JIT.Enable"));
@@ -107,6 +112,7 @@ EmuSettingsDialog::EmuSettingsDialog(QWidget* parent) : QDialog(parent), ui(new
 #endif
 
     on_chkEnableJIT_toggled();
+    on_chkRewindEnable_toggled();
     on_cbGdbEnabled_toggled();
     on_chkExternalBIOS_toggled();
     on_chkDSiExternalBIOS_toggled();
@@ -303,6 +309,11 @@ void EmuSettingsDialog::done(int r)
 
             cfg.SetInt("Emu.ConsoleType", ui->cbxConsoleType->currentIndex());
             cfg.SetBool("Emu.DirectBoot", ui->chkDirectBoot->isChecked());
+            cfg.SetBool("Emu.EventCatchUp", ui->chkEventCatchUp->isChecked());
+
+            cfg.SetBool("Rewind.Enabled", ui->chkRewindEnable->isChecked());
+            cfg.SetInt("Rewind.Interval", ui->spnRewindInterval->value());
+            cfg.SetInt("Rewind.BudgetMB", ui->spnRewindBudget->value());
 
             Config::Save();
 
@@ -537,6 +548,13 @@ void EmuSettingsDialog::on_btnDSiSDFolderBrowse_clicked()
     ui->txtDSiSDFolder->setText(dir);
 }
 
+void EmuSettingsDialog::on_chkRewindEnable_toggled()
+{
+    bool disabled = !ui->chkRewindEnable->isChecked();
+    ui->spnRewindInterval->setDisabled(disabled);
+    ui->spnRewindBudget->setDisabled(disabled);
+}
+
 void EmuSettingsDialog::on_chkEnableJIT_toggled()
 {
     bool disabled = !ui->chkEnableJIT->isChecked();
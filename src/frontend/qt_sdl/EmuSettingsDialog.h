@@ -77,6 +77,7 @@ private slots:
     void on_btnDSiSDFolderBrowse_clicked();
 
     void on_chkEnableJIT_toggled();
+    void on_chkRewindEnable_toggled();
     void on_chkExternalBIOS_toggled();
     void on_chkDSiExternalBIOS_toggled();
 
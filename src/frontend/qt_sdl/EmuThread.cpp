@@ -38,12 +38,14 @@
 #include "Args.h"
 #include "NDS.h"
 #include "NDSCart.h"
+#include "InputMovie.h"
 #include "GBACart.h"
 #include "GPU.h"
 #include "SPU.h"
 #include "Wifi.h"
 #include "Platform.h"
 #include "LocalMP.h"
+#include "Netplay.h"
 #include "Config.h"
 #include "RTC.h"
 #include "DSi.h"
@@ -155,6 +157,9 @@ void EmuThread::run()
         if (emuInstance->instanceID == 0)
             MPInterface::Get().Process();
 
+        if (emuInstance->nds)
+            emuInstance->netplay->Process(*emuInstance->nds);
+
         emuInstance->inputProcess();
 
         if (emuInstance->hotkeyPressed(HK_FrameLimitToggle)) emit windowLimitFPSChange();
@@ -172,7 +177,11 @@ void EmuThread::run()
         {
             if (emuStatus == emuStatus_FrameStep) emuStatus = emuStatus_Paused;
 
-            if (emuInstance->hotkeyPressed(HK_SolarSensorDecrease))
+            // in netplay games, the console only takes what goes through the rollback input,
+            // the other player's console wouldn't see the sensors, buttons and lid changing
+            bool netplay = emuInstance->netplay->IsRunning();
+
+            if (!netplay && emuInstance->hotkeyPressed(HK_SolarSensorDecrease))
             {
                 int level = emuInstance->nds->GBACartSlot.SetInput(GBACart::Input_SolarSensorDown, true);
                 if (level != -1)
@@ -180,7 +189,7 @@ void EmuThread::run()
                     emuInstance->osdAddMessage(0, "Solar sensor level: %d", level);
                 }
             }
-            if (emuInstance->hotkeyPressed(HK_SolarSensorIncrease))
+            if (!netplay && emuInstance->hotkeyPressed(HK_SolarSensorIncrease))
             {
                 int level = emuInstance->nds->GBACartSlot.SetInput(GBACart::Input_SolarSensorUp, true);
                 if (level != -1)
@@ -189,7 +198,7 @@ void EmuThread::run()
                 }
             }
 
-            if (emuInstance->nds->ConsoleType == 1)
+            if (emuInstance->nds->ConsoleType == 1 && !netplay)
             {
                 DSi* dsi = static_cast<DSi*>(emuInstance->nds);
                 double currentTime = SDL_GetPerformanceCounter() * perfCountsSec;
@@ -252,14 +261,20 @@ void EmuThread::run()
             }
 
             // process input and hotkeys
-            emuInstance->nds->SetKeyMask(emuInstance->inputMask);
+            // input movies apply the input themselves, right before the frame
+            InputMovie* movie = emuInstance->getMovie();
+            bool movieActive = movie && movie->GetMode() != InputMovie::Mode::Idle;
+            if (!movieActive)
+            {
+                emuInstance->nds->SetKeyMask(emuInstance->inputMask);
 
-            if (emuInstance->isTouching)
-                emuInstance->nds->TouchScreen(emuInstance->touchX, emuInstance->touchY);
-            else
-                emuInstance->nds->ReleaseScreen();
+                if (emuInstance->isTouching)
+                    emuInstance->nds->TouchScreen(emuInstance->touchX, emuInstance->touchY);
+                else
+                    emuInstance->nds->ReleaseScreen();
+            }
 
-            if (emuInstance->hotkeyPressed(HK_Lid))
+            if (emuInstance->hotkeyPressed(HK_Lid) && !(movie && movie->IsPlaying()) && !netplay)
             {
                 bool lid = !emuInstance->nds->IsLidClosed();
                 emuInstance->nds->SetLidClosed(lid);
@@ -296,6 +311,12 @@ void EmuThread::run()
             }
 
 
+            // netplay games can't go back in time or ahead of the other player,
+            // and neither can input movies, which follow the frames one by one
+
+            // while rewinding, each frame starts from the previous snapshot instead of taking a new one
+            bool rewinding = !netplay && !movieActive && emuInstance->hotkeyDown(HK_Rewind) && emuInstance->rewindStep();
+
             // emulate
             u32 nlines;
             if (emuInstance->nds->GPU.GetRenderer().NeedsShaderCompile())
@@ -303,11 +324,28 @@ void EmuThread::run()
                 compileShaders();
                 nlines = 1;
             }
+            else if (netplay)
+            {
+                Rollback::Input input = {(u16)(emuInstance->inputMask & 0xFFF), emuInstance->isTouching,
+                                         emuInstance->touchX, emuInstance->touchY};
+                nlines = emuInstance->netplay->RunFrame(*emuInstance->nds, input);
+            }
+            else if (movieActive)
+            {
+                nlines = emuInstance->runMovieFrame();
+            }
+            else if (emuInstance->runAheadFrames > 0 && !rewinding)
+            {
+                nlines = emuInstance->runFrameAhead();
+            }
             else
             {
                 nlines = emuInstance->nds->RunFrame();
             }
 
+            if (!rewinding && !netplay && !movieActive)
+                emuInstance->rewindCapture();
+
             if (emuInstance->ndsSave)
                 emuInstance->ndsSave->CheckFlush();
 
@@ -614,7 +652,10 @@ void EmuThread::handleMessages()
             break;
 
         case msg_SaveState:
-            msgResult = emuInstance->saveState(msg.param.value<QString>().toStdString());
+            {
+                QVariantList params = msg.param.value<QVariantList>();
+                msgResult = emuInstance->saveState(params[0].toString().toStdString(), params[1].toInt());
+            }
             break;
 
         case msg_LoadState:
@@ -626,6 +667,18 @@ void EmuThread::handleMessages()
             msgResult = 1;
             break;
 
+        case msg_StartMovieRecording:
+            msgResult = emuInstance->startMovieRecording(msg.param.value<QString>().toStdString());
+            break;
+
+        case msg_StartMoviePlayback:
+            msgResult = emuInstance->startMoviePlayback(msg.param.value<QString>().toStdString());
+            break;
+
+        case msg_StopMovie:
+            emuInstance->stopMovie();
+            break;
+
         case msg_ImportSavefile:
             {
                 msgResult = 0;
@@ -649,6 +702,10 @@ void EmuThread::handleMessages()
         case msg_EnableCheats:
             emuInstance->enableCheats(msg.param.value<bool>());
             break;
+
+        case msg_LogJITStats:
+            emuInstance->logJITStats();
+            break;
         }
 
         msgSemaphore.release();
@@ -817,9 +874,9 @@ int EmuThread::insertGBAAddon(int type, QString& errorstr)
     return msgResult;
 }
 
-int EmuThread::saveState(const QString& filename)
+int EmuThread::saveState(const QString& filename, int slot)
 {
-    sendMessage({.type = msg_SaveState, .param = filename});
+    sendMessage({.type = msg_SaveState, .param = QVariantList{filename, slot}});
     waitMessage();
     return msgResult;
 }
@@ -838,6 +895,26 @@ int EmuThread::undoStateLoad()
     return msgResult;
 }
 
+int EmuThread::startMovieRecording(const QString& filename)
+{
+    sendMessage({.type = msg_StartMovieRecording, .param = filename});
+    waitMessage();
+    return msgResult;
+}
+
+int EmuThread::startMoviePlayback(const QString& filename)
+{
+    sendMessage({.type = msg_StartMoviePlayback, .param = filename});
+    waitMessage();
+    return msgResult;
+}
+
+void EmuThread::stopMovie()
+{
+    sendMessage(msg_StopMovie);
+    waitMessage();
+}
+
 int EmuThread::importSavefile(const QString& filename)
 {
     sendMessage(msg_EmuReset);
@@ -852,6 +929,12 @@ void EmuThread::enableCheats(bool enable)
     waitMessage();
 }
 
+void EmuThread::logJITStats()
+{
+    sendMessage(msg_LogJITStats);
+    waitMessage();
+}
+
 void EmuThread::updateRenderer()
 {
     auto nds = emuInstance->nds;
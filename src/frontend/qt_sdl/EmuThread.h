@@ -81,9 +81,15 @@ public:
         msg_SaveState,
         msg_UndoStateLoad,
 
+        msg_StartMovieRecording,
+        msg_StartMoviePlayback,
+        msg_StopMovie,
+
         msg_ImportSavefile,
 
         msg_EnableCheats,
+
+        msg_LogJITStats,
     };
 
     struct Message
@@ -119,14 +125,20 @@ public:
     void ejectCart(bool gba);
     int insertGBAAddon(int type, QString& errorstr);
 
-    int saveState(const QString& filename);
+    int saveState(const QString& filename, int slot = 0);
     int loadState(const QString& filename);
     int undoStateLoad();
 
+    int startMovieRecording(const QString& filename);
+    int startMoviePlayback(const QString& filename);
+    void stopMovie();
+
     int importSavefile(const QString& filename);
 
     void enableCheats(bool enable);
 
+    void logJITStats();
+
     bool emuIsRunning();
     bool emuIsActive();
 
@@ -55,6 +55,7 @@ static constexpr std::initializer_list<int> hk_general =
     HK_Pause,
     HK_Reset,
     HK_FrameStep,
+    HK_Rewind,
     HK_FastForward,
     HK_FastForwardToggle,
     HK_SlowMo,
@@ -76,6 +77,7 @@ static constexpr std::initializer_list<const char*> hk_general_labels =
     "Pause/resume",
     "Reset",
     "Frame step",
+    "Rewind",
     "Fast forward",
     "Toggle fast forward",
     "Slow mo",
@@ -17,25 +17,17 @@
 */
 
 #include <stdio.h>
-#include <stdlib.h>
 #include <string.h>
-#include <queue>
-
-#include <enet/enet.h>
+#include <vector>
 
 #include <QStandardItemModel>
-#include <QProcess>
+#include <QMessageBox>
 
-#include "NDS.h"
-#include "NDSCart.h"
-#include "main.h"
-//#include "IPC.h"
 #include "NetplayDialog.h"
-//#include "Input.h"
-//#include "ROMManager.h"
 #include "Config.h"
-#include "Savestate.h"
-#include "Platform.h"
+#include "main.h"
+#include "EmuInstance.h"
+#include "Netplay.h"
 
 #include "ui_NetplayStartHostDialog.h"
 #include "ui_NetplayStartClientDialog.h"
@@ -44,8 +36,13 @@
 using namespace melonDS;
 
 
-extern EmuThread* emuThread;
-NetplayDialog* netplayDlg;
+NetplayDialog* netplayDlg = nullptr;
+
+static Netplay* getNetplay(QObject* parent)
+{
+    EmuInstance* inst = ((MainWindow*)parent)->getEmuInstance();
+    return inst ? inst->getNetplay() : nullptr;
+}
 
 
 NetplayStartHostDialog::NetplayStartHostDialog(QWidget* parent) : QDialog(parent), ui(new Ui::NetplayStartHostDialog)
@@ -53,7 +50,12 @@ NetplayStartHostDialog::NetplayStartHostDialog(QWidget* parent) : QDialog(parent
     ui->setupUi(this);
     setAttribute(Qt::WA_DeleteOnClose);
 
-    ui->txtPort->setText("8064");
+    auto cfg = Config::GetGlobalTable();
+    ui->txtPlayerName->setText(cfg.GetQString("Netplay.PlayerName"));
+    ui->txtPort->setText(QString::number(cfg.GetInt("Netplay.Port")));
+
+    ui->sbInputDelay->setRange(0, Rollback::MaxInputDelay);
+    ui->sbInputDelay->setValue(cfg.GetInt("Netplay.InputDelay"));
 }
 
 NetplayStartHostDialog::~NetplayStartHostDialog()
@@ -63,7 +65,8 @@ NetplayStartHostDialog::~NetplayStartHostDialog()
 
 void NetplayStartHostDialog::done(int r)
 {
-    if (!((MainWindow*)parent())->getEmuInstance())
+    Netplay* netplay = getNetplay(parent());
+    if (!netplay)
     {
         QDialog::done(r);
         return;
@@ -71,14 +74,38 @@ void NetplayStartHostDialog::done(int r)
 
     if (r == QDialog::Accepted)
     {
+        if (ui->txtPlayerName->text().trimmed().isEmpty())
+        {
+            QMessageBox::warning(this, "melonDS", "Please enter a player name.");
+            return;
+        }
+
+        bool portok;
+        int port = ui->txtPort->text().toInt(&portok);
+        if (!portok || port < 1 || port > 65535)
+        {
+            QMessageBox::warning(this, "melonDS", "Please enter a valid port number.");
+            return;
+        }
+
+        auto cfg = Config::GetGlobalTable();
         std::string player = ui->txtPlayerName->text().toStdString();
-        int port = ui->txtPort->text().toInt();
+        Netplay::Settings settings;
+        settings.InputDelay = ui->sbInputDelay->value();
+        settings.MaxRollback = cfg.GetInt("Netplay.MaxRollback");
 
-        // TODO validate input!!
+        if (!netplay->StartHost(player.c_str(), port, settings))
+        {
+            QMessageBox::warning(this, "melonDS", "Failed to start netplay game.");
+            return;
+        }
 
         netplayDlg = NetplayDialog::openDlg(parentWidget());
 
-        Netplay::StartHost(player.c_str(), port);
+        cfg.SetString("Netplay.PlayerName", player);
+        cfg.SetInt("Netplay.Port", port);
+        cfg.SetInt("Netplay.InputDelay", settings.InputDelay);
+        Config::Save();
     }
 
     QDialog::done(r);
@@ -90,7 +117,10 @@ NetplayStartClientDialog::NetplayStartClientDialog(QWidget* parent) : QDialog(pa
     ui->setupUi(this);
     setAttribute(Qt::WA_DeleteOnClose);
 
-    ui->txtPort->setText("8064");
+    auto cfg = Config::GetGlobalTable();
+    ui->txtPlayerName->setText(cfg.GetQString("Netplay.PlayerName"));
+    ui->txtIPAddress->setText(cfg.GetQString("Netplay.HostAddress"));
+    ui->txtPort->setText(QString::number(cfg.GetInt("Netplay.Port")));
 }
 
 NetplayStartClientDialog::~NetplayStartClientDialog()
@@ -100,7 +130,8 @@ NetplayStartClientDialog::~NetplayStartClientDialog()
 
 void NetplayStartClientDialog::done(int r)
 {
-    if (!((MainWindow*)parent())->getEmuInstance())
+    Netplay* netplay = getNetplay(parent());
+    if (!netplay)
     {
         QDialog::done(r);
         return;
@@ -108,15 +139,40 @@ void NetplayStartClientDialog::done(int r)
 
     if (r == QDialog::Accepted)
     {
+        if (ui->txtPlayerName->text().trimmed().isEmpty())
+        {
+            QMessageBox::warning(this, "melonDS", "Please enter a player name.");
+            return;
+        }
+
+        bool portok;
+        int port = ui->txtPort->text().toInt(&portok);
+        if (!portok || port < 1 || port > 65535)
+        {
+            QMessageBox::warning(this, "melonDS", "Please enter a valid port number.");
+            return;
+        }
+
         std::string player = ui->txtPlayerName->text().toStdString();
-        std::string host = ui->txtIPAddress->text().toStdString();
-        int port = ui->txtPort->text().toInt();
+        std::string host = ui->txtIPAddress->text().trimmed().toStdString();
+
+        setEnabled(false);
+        bool res = netplay->StartClient(player.c_str(), host.c_str(), port);
+        setEnabled(true);
 
-        // TODO validate input!!
+        if (!res)
+        {
+            QMessageBox::warning(this, "melonDS", "Failed to connect to the host.");
+            return;
+        }
 
         netplayDlg = NetplayDialog::openDlg(parentWidget());
 
-        Netplay::StartClient(player.c_str(), host.c_str(), port);
+        auto cfg = Config::GetGlobalTable();
+        cfg.SetString("Netplay.PlayerName", player);
+        cfg.SetString("Netplay.HostAddress", host);
+        cfg.SetInt("Netplay.Port", port);
+        Config::Save();
     }
 
     QDialog::done(r);
@@ -130,64 +186,169 @@ NetplayDialog::NetplayDialog(QWidget* parent) : QDialog(parent), ui(new Ui::Netp
 
     QStandardItemModel* model = new QStandardItemModel();
     ui->tvPlayerList->setModel(model);
+    const QStringList header = {"#", "Player", "Status", "Ping", "IP"};
+    model->setHorizontalHeaderLabels(header);
 
-    connect(this, &NetplayDialog::sgUpdatePlayerList, this, &NetplayDialog::doUpdatePlayerList);
+    Netplay* netplay = getNetplay(parent);
+    ui->btnStartGame->setVisible(netplay && netplay->IsHost());
+
+    doUpdatePlayerList();
+    timerID = startTimer(1000);
 }
 
 NetplayDialog::~NetplayDialog()
 {
+    killTimer(timerID);
+
     delete ui;
+    netplayDlg = nullptr;
+}
+
+void NetplayDialog::on_btnStartGame_clicked()
+{
+    Netplay* netplay = getNetplay(parent());
+    if (!netplay) return;
+
+    if (netplay->IsRunning())
+    {
+        if (QMessageBox::warning(this, "melonDS", "Restart the game from the current state?",
+                                 QMessageBox::Yes | QMessageBox::No, QMessageBox::No) == QMessageBox::No)
+            return;
+    }
+
+    netplay->StartGame();
+}
+
+void NetplayDialog::on_btnLeaveGame_clicked()
+{
+    done(QDialog::Accepted);
 }
 
 void NetplayDialog::done(int r)
 {
-    // ???
+    Netplay* netplay = getNetplay(parent());
+    if (!netplay)
+    {
+        QDialog::done(r);
+        return;
+    }
+
+    if (netplay->IsRunning())
+    {
+        if (QMessageBox::warning(this, "melonDS", "Really leave this netplay game?",
+                                 QMessageBox::Yes | QMessageBox::No, QMessageBox::No) == QMessageBox::No)
+            return;
+    }
+
+    netplay->EndSession();
 
     QDialog::done(r);
 }
 
-void NetplayDialog::updatePlayerList(Netplay::Player* players, int num)
+void NetplayDialog::timerEvent(QTimerEvent *event)
 {
-    emit sgUpdatePlayerList(players, num);
+    doUpdatePlayerList();
 }
 
-void NetplayDialog::doUpdatePlayerList(Netplay::Player* players, int num)
+void NetplayDialog::doUpdatePlayerList()
 {
-    QStandardItemModel* model = (QStandardItemModel*)ui->tvPlayerList->model();
+    Netplay* netplay = getNetplay(parent());
+    if (!netplay) return;
 
-    model->clear();
-    model->setRowCount(num);
+    auto playerlist = netplay->GetPlayerList();
 
-    // TODO: remove IP column in final product
+    QString status;
+    if (netplay->IsRunning())
+    {
+        Rollback::Stats stats = netplay->GetStats();
+        status = QString("Game running. Rollbacks: %0, frames emulated again: %1, waits for the other player: %2")
+            .arg(stats.Rollbacks).arg(stats.FramesResimulated).arg(stats.Stalls);
+        if (netplay->IsDesynced())
+            status = "The consoles went out of sync, the game has to be restarted. " + status;
+    }
+    else if ((int)playerlist.size() < Rollback::MaxPlayers)
+        status = "Waiting for another player to join.";
+    else if (netplay->IsHost())
+        status = "Load the game and press Start game when ready.";
+    else
+        status = "Waiting for the host to start the game.";
+    ui->lblStatus->setText(status);
 
-    const QStringList header = {"#", "Player", "Status", "Ping", "IP"};
-    model->setHorizontalHeaderLabels(header);
+    ui->btnStartGame->setEnabled((int)playerlist.size() >= Rollback::MaxPlayers);
 
-    for (int i = 0; i < num; i++)
+    QStandardItemModel* model = (QStandardItemModel*)ui->tvPlayerList->model();
+    int curcount = model->rowCount();
+    int newcount = playerlist.size();
+    if (curcount > newcount)
+    {
+        model->removeRows(newcount, curcount-newcount);
+    }
+    else if (curcount < newcount)
     {
-        Netplay::Player* player = &players[i];
+        for (int i = curcount; i < newcount; i++)
+        {
+            QList<QStandardItem*> row;
+            row.append(new QStandardItem());
+            row.append(new QStandardItem());
+            row.append(new QStandardItem());
+            row.append(new QStandardItem());
+            row.append(new QStandardItem());
+            model->appendRow(row);
+        }
+    }
 
-        QString id = QString("%0").arg(player->ID+1);
-        model->setItem(i, 0, new QStandardItem(id));
+    int i = 0;
+    for (const auto& player : playerlist)
+    {
+        QString id = QString("%0").arg(player.ID+1);
+        model->item(i, 0)->setText(id);
 
-        QString name = player->Name;
-        model->setItem(i, 1, new QStandardItem(name));
+        QString name = player.Name;
+        model->item(i, 1)->setText(name);
 
-        QString status;
-        switch (player->Status)
+        QString status = "???";
+        switch (player.Status)
         {
-            case 1: status = ""; break;
-            case 2: status = "Host"; break;
-            default: status = "ded"; break;
+            case Netplay::Player_Client:
+                status = "Connected";
+                break;
+            case Netplay::Player_Host:
+                status = "Game host";
+                break;
+            case Netplay::Player_Connecting:
+                status = "Connecting";
+                break;
+            case Netplay::Player_Disconnected:
+                status = "Connection lost";
+                break;
+            case Netplay::Player_None:
+                break;
         }
-        model->setItem(i, 2, new QStandardItem(status));
+        model->item(i, 2)->setText(status);
 
-        // TODO: ping
-        model->setItem(i, 3, new QStandardItem("x"));
+        if (player.IsLocalPlayer)
+        {
+            model->item(i, 3)->setText("-");
+            model->item(i, 4)->setText("(local)");
+        }
+        else
+        {
+            if (player.Status == Netplay::Player_Client ||
+                player.Status == Netplay::Player_Host)
+            {
+                QString ping = QString("%0 ms").arg(player.Ping);
+                model->item(i, 3)->setText(ping);
+            }
+            else
+            {
+                model->item(i, 3)->setText("-");
+            }
+
+            u32 addr = player.Address;
+            QString ips = QString("%0.%1.%2.%3").arg(addr&0xFF).arg((addr>>8)&0xFF).arg((addr>>16)&0xFF).arg(addr>>24);
+            model->item(i, 4)->setText(ips);
+        }
 
-        char ip[32];
-        u32 addr = player->Address;
-        snprintf(ip, sizeof(ip), "%d.%d.%d.%d", addr&0xFF, (addr>>8)&0xFF, (addr>>16)&0xFF, addr>>24);
-        model->setItem(i, 4, new QStandardItem(ip));
+        i++;
     }
 }
@@ -22,7 +22,6 @@
 #include <QDialog>
 
 #include "types.h"
-#include "Netplay.h"
 
 namespace Ui
 {
@@ -94,18 +93,19 @@ public:
         return dlg;
     }
 
-    void updatePlayerList(Netplay::Player* players, int num);
-
-signals:
-    void sgUpdatePlayerList(Netplay::Player* players, int num);
+protected:
+    void timerEvent(QTimerEvent* event) override;
 
 private slots:
+    void on_btnStartGame_clicked();
+    void on_btnLeaveGame_clicked();
     void done(int r);
 
-    void doUpdatePlayerList(Netplay::Player* players, int num);
+    void doUpdatePlayerList();
 
 private:
     Ui::NetplayDialog* ui;
+    int timerID;
 };
 
 #endif // NETPLAYDIALOG_H
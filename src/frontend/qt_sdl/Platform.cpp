@@ -39,6 +39,7 @@
 #include "CameraManager.h"
 #include "Net.h"
 #include "MPInterface.h"
+#include "Netplay.h"
 #include "SPI_Firmware.h"
 
 #ifdef __WIN32__
@@ -413,9 +414,17 @@ u64 GetUSCount()
 }
 
 
+// the save memory of a netplay game comes from the host, it isn't the client's to keep
+static bool IsNetplayClient(EmuInstance* inst)
+{
+    Netplay* netplay = inst->getNetplay();
+    return netplay && netplay->IsRunning() && !netplay->IsHost();
+}
+
 void WriteNDSSave(const u8* savedata, u32 savelen, u32 writeoffset, u32 writelen, void* userdata)
 {
     EmuInstance* inst = (EmuInstance*)userdata;
+    if (IsNetplayClient(inst)) return;
     if (inst->ndsSave)
         inst->ndsSave->RequestFlush(savedata, savelen, writeoffset, writelen);
 }
@@ -423,6 +432,7 @@ void WriteNDSSave(const u8* savedata, u32 savelen, u32 writeoffset, u32 writelen
 void WriteGBASave(const u8* savedata, u32 savelen, u32 writeoffset, u32 writelen, void* userdata)
 {
     EmuInstance* inst = (EmuInstance*)userdata;
+    if (IsNetplayClient(inst)) return;
     if (inst->gbaSave)
         inst->gbaSave->RequestFlush(savedata, savelen, writeoffset, writelen);
 }
@@ -486,42 +496,56 @@ void MP_End(void* userdata)
 
 int MP_SendPacket(u8* data, int len, u64 timestamp, void* userdata)
 {
+    if (((EmuInstance*)userdata)->isRunningAhead())
+        return len;
     int inst = ((EmuInstance*)userdata)->getInstanceID();
     return MPInterface::Get().SendPacket(inst, data, len, timestamp);
 }
 
 int MP_RecvPacket(u8* data, u64* timestamp, void* userdata)
 {
+    if (((EmuInstance*)userdata)->isRunningAhead())
+        return 0;
     int inst = ((EmuInstance*)userdata)->getInstanceID();
     return MPInterface::Get().RecvPacket(inst, data, timestamp);
 }
 
 int MP_SendCmd(u8* data, int len, u64 timestamp, void* userdata)
 {
+    if (((EmuInstance*)userdata)->isRunningAhead())
+        return len;
     int inst = ((EmuInstance*)userdata)->getInstanceID();
     return MPInterface::Get().SendCmd(inst, data, len, timestamp);
 }
 
 int MP_SendReply(u8* data, int len, u64 timestamp, u16 aid, void* userdata)
 {
+    if (((EmuInstance*)userdata)->isRunningAhead())
+        return len;
     int inst = ((EmuInstance*)userdata)->getInstanceID();
     return MPInterface::Get().SendReply(inst, data, len, timestamp, aid);
 }
 
 int MP_SendAck(u8* data, int len, u64 timestamp, void* userdata)
 {
+    if (((EmuInstance*)userdata)->isRunningAhead())
+        return len;
     int inst = ((EmuInstance*)userdata)->getInstanceID();
     return MPInterface::Get().SendAck(inst, data, len, timestamp);
 }
 
 int MP_RecvHostPacket(u8* data, u64* timestamp, void* userdata)
 {
+    if (((EmuInstance*)userdata)->isRunningAhead())
+        return 0;
     int inst = ((EmuInstance*)userdata)->getInstanceID();
     return MPInterface::Get().RecvHostPacket(inst, data, timestamp);
 }
 
 u16 MP_RecvReplies(u8* data, u64 timestamp, u16 aidmask, void* userdata)
 {
+    if (((EmuInstance*)userdata)->isRunningAhead())
+        return 0;
     int inst = ((EmuInstance*)userdata)->getInstanceID();
     return MPInterface::Get().RecvReplies(inst, data, timestamp, aidmask);
 }
@@ -529,6 +553,8 @@ u16 MP_RecvReplies(u8* data, u64 timestamp, u16 aidmask, void* userdata)
 
 int Net_SendPacket(u8* data, int len, void* userdata)
 {
+    if (((EmuInstance*)userdata)->isRunningAhead())
+        return 0;
     int inst = ((EmuInstance*)userdata)->getInstanceID();
     net.SendPacket(data, len, inst);
     return 0;
@@ -536,6 +562,8 @@ int Net_SendPacket(u8* data, int len, void* userdata)
 
 int Net_RecvPacket(u8* data, void* userdata)
 {
+    if (((EmuInstance*)userdata)->isRunningAhead())
+        return 0;
     int inst = ((EmuInstance*)userdata)->getInstanceID();
     return net.RecvPacket(data, inst);
 }
@@ -70,6 +70,7 @@ struct ramInfo_RowData
     void SetValue(melonDS::NDS& nds, const melonDS::s32& value)
     {
         nds.MainRAM[Address&nds.MainRAMMask] = (melonDS::u32)value;
+        nds.DirtyPages.Mark(melonDS::DirtyRegion_MainRAM, Address&nds.MainRAMMask);
         Value = value;
     }
 };
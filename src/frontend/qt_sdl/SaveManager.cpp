@@ -105,6 +105,10 @@ void SaveManager::RequestFlush(const u8* savedata, u32 savelen, u32 writeoffset,
     }
     else
     {
+        // rewriting the same data (ie. when states are loaded) doesn't need a flush
+        if (writeoffset == 0 && writelen >= savelen && !memcmp(Buffer.get(), savedata, Length))
+            return;
+
         if ((writeoffset+writelen) > savelen)
         {
             u32 len = savelen - writeoffset;
@@ -0,0 +1,185 @@
+/*
+    Copyright 2016-2026 melonDS team
+
+    This file is part of melonDS.
+
+    melonDS is free software: you can redistribute it and/or modify it under
+    the terms of the GNU General Public License as published by the Free
+    Software Foundation, either version 3 of the License, or (at your option)
+    any later version.
+
+    melonDS is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+    FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with melonDS. If not, see http://www.gnu.org/licenses/.
+*/
+
+#include <QSaveFile>
+
+#include "SavestateWriter.h"
+#include "Savestate.h"
+#include "Platform.h"
+
+using namespace melonDS;
+using namespace melonDS::Platform;
+
+// states kept around for reuse, one being snapshotted while another is written is the common case
+const int kMaxFreeStates = 2;
+
+SavestateWriter::SavestateWriter() : QThread()
+{
+    Busy = false;
+    Quit = false;
+
+    CompressBuffer = nullptr;
+    CompressBufferLength = 0;
+
+    start();
+}
+
+SavestateWriter::~SavestateWriter()
+{
+    // pending states still get written out
+    Lock.lock();
+    Quit = true;
+    JobAvailable.wakeAll();
+    Lock.unlock();
+
+    wait();
+}
+
+std::unique_ptr<Savestate> SavestateWriter::GetState()
+{
+    Lock.lock();
+    std::unique_ptr<Savestate> state;
+    if (!FreeStates.empty())
+    {
+        state = std::move(FreeStates.back());
+        FreeStates.pop_back();
+    }
+    Lock.unlock();
+
+    if (state)
+        state->Rewind(true);
+    else
+        state = std::make_unique<Savestate>();
+
+    return state;
+}
+
+void SavestateWriter::RecycleState(std::unique_ptr<Savestate>&& state)
+{
+    if (!state || state->Error) return;
+
+    Lock.lock();
+    if (FreeStates.size() < kMaxFreeStates)
+        FreeStates.push_back(std::move(state));
+    Lock.unlock();
+}
+
+void SavestateWriter::QueueWrite(std::unique_ptr<Savestate>&& state, const std::string& filename, int slot, bool compress)
+{
+    Lock.lock();
+
+    // a state that hasn't started being written yet is superseded by the new one
+    for (auto it = Jobs.begin(); it != Jobs.end(); it++)
+    {
+        if (it->Filename == filename)
+        {
+            if (FreeStates.size() < kMaxFreeStates)
+                FreeStates.push_back(std::move(it->State));
+            Jobs.erase(it);
+            break;
+        }
+    }
+
+    Jobs.push_back({std::move(state), filename, slot, compress});
+    JobAvailable.wakeAll();
+    Lock.unlock();
+}
+
+void SavestateWriter::WaitIdle()
+{
+    Lock.lock();
+    while (Busy || !Jobs.empty())
+        JobsDone.wait(&Lock);
+    Lock.unlock();
+}
+
+void SavestateWriter::run()
+{
+    for (;;)
+    {
+        Lock.lock();
+        while (Jobs.empty() && !Quit)
+            JobAvailable.wait(&Lock);
+
+        if (Jobs.empty())
+        {
+            Lock.unlock();
+            return;
+        }
+
+        Job job = std::move(Jobs.front());
+        Jobs.pop_front();
+        Busy = true;
+        Lock.unlock();
+
+        bool success = WriteState(job);
+        emit stateWritten(job.Slot, success);
+
+        Lock.lock();
+        if (FreeStates.size() < kMaxFreeStates)
+            FreeStates.push_back(std::move(job.State));
+        Busy = false;
+        if (Jobs.empty())
+            JobsDone.wakeAll();
+        Lock.unlock();
+    }
+}
+
+bool SavestateWriter::WriteState(const Job& job)
+{
+    Savestate& state = *job.State;
+    const void* data = state.Buffer();
+    u32 len = state.Length();
+
+    if (job.Compress)
+    {
+        u32 bound = Savestate::CompressedBound(len);
+        if (CompressBufferLength < bound)
+        {
+            CompressBufferLength = bound;
+            CompressBuffer = std::make_unique<u8[]>(CompressBufferLength);
+        }
+
+        // compressed states are recognized when loading, nothing else to do there
+        u32 complen = state.Compress(CompressBuffer.get(), CompressBufferLength);
+        if (complen != 0)
+        {
+            data = CompressBuffer.get();
+            len = complen;
+        }
+    }
+
+    // the state is written to a temporary file that only replaces the target once committed
+    QSaveFile file(QString::fromStdString(job.Filename));
+    if (!file.open(QIODevice::WriteOnly))
+    {
+        Log(LogLevel::Error, "Failed to open %s for writing: %s\n",
+            job.Filename.c_str(), file.errorString().toStdString().c_str());
+        return false;
+    }
+
+    if (file.write((const char*)data, len) != len || !file.commit())
+    {
+        Log(LogLevel::Error, "Failed to write %d-byte savestate to %s: %s\n",
+            len, job.Filename.c_str(), file.errorString().toStdString().c_str());
+        return false;
+    }
+
+    Log(LogLevel::Info, "Wrote %d-byte savestate to %s\n", len, job.Filename.c_str());
+    return true;
+}
@@ -0,0 +1,91 @@
+/*
+    Copyright 2016-2026 melonDS team
+
+    This file is part of melonDS.
+
+    melonDS is free software: you can redistribute it and/or modify it under
+    the terms of the GNU General Public License as published by the Free
+    Software Foundation, either version 3 of the License, or (at your option)
+    any later version.
+
+    melonDS is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+    FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with melonDS. If not, see http://www.gnu.org/licenses/.
+*/
+
+#ifndef SAVESTATEWRITER_H
+#define SAVESTATEWRITER_H
+
+#include <deque>
+#include <memory>
+#include <string>
+#include <vector>
+#include <QThread>
+#include <QMutex>
+#include <QWaitCondition>
+
+#include "types.h"
+
+namespace melonDS
+{
+class Savestate;
+}
+
+// Writes savestates to disk in the background, so that saving a state only costs
+// the emulation thread the time it takes to snapshot the console into memory.
+//
+// States are compressed (if enabled) and written to a temporary file that replaces
+// the target once it's been fully written out, so an interrupted write never leaves
+// a truncated state behind.
+class SavestateWriter : public QThread
+{
+    Q_OBJECT
+    void run() override;
+
+public:
+    SavestateWriter();
+    ~SavestateWriter();
+
+    // Returns a state ready for saving, recycled from a previous write when possible.
+    std::unique_ptr<melonDS::Savestate> GetState();
+    // Gives back a state that won't be written.
+    void RecycleState(std::unique_ptr<melonDS::Savestate>&& state);
+
+    // Queues a finished state for writing. slot is only used for reporting.
+    void QueueWrite(std::unique_ptr<melonDS::Savestate>&& state, const std::string& filename, int slot, bool compress);
+
+    // Waits until all queued states have been written.
+    void WaitIdle();
+
+signals:
+    void stateWritten(int slot, bool success);
+
+private:
+    struct Job
+    {
+        std::unique_ptr<melonDS::Savestate> State;
+        std::string Filename;
+        int Slot;
+        bool Compress;
+    };
+
+    bool WriteState(const Job& job);
+
+    QMutex Lock;
+    QWaitCondition JobAvailable;
+    QWaitCondition JobsDone;
+    std::deque<Job> Jobs;
+    bool Busy;
+    bool Quit;
+
+    std::vector<std::unique_ptr<melonDS::Savestate>> FreeStates;
+
+    // only touched by the writer thread
+    std::unique_ptr<melonDS::u8[]> CompressBuffer;
+    melonDS::u32 CompressBufferLength;
+};
+
+#endif // SAVESTATEWRITER_H
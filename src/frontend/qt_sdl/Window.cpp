@@ -73,6 +73,7 @@
 #include "Savestate.h"
 #include "MPInterface.h"
 #include "LANDialog.h"
+#include "NetplayDialog.h"
 
 //#include "main_shaders.h"
 
@@ -92,7 +93,7 @@ extern bool camStarted[2];
 
 
 QString NdsRomMimeType = "application/x-nintendo-ds-rom";
-QStringList NdsRomExtensions { ".nds", ".srl", ".dsi", ".ids" };
+QStringList NdsRomExtensions { ".nds", ".srl", ".dsi", ".ids", ".ncr" };
 
 QString GbaRomMimeType = "application/x-gba-rom";
 QStringList GbaRomExtensions { ".gba", ".agb" };
@@ -387,6 +388,21 @@ MainWindow::MainWindow(int id, EmuInstance* inst, QWidget* parent) :
             actUndoStateLoad->setShortcut(QKeySequence(Qt::Key_F12));
             connect(actUndoStateLoad, &QAction::triggered, this, &MainWindow::onUndoStateLoad);
 
+            menu->addSeparator();
+
+            {
+                QMenu * submenu = menu->addMenu("Input movie");
+
+                actRecordMovie = submenu->addAction("Record...");
+                connect(actRecordMovie, &QAction::triggered, this, &MainWindow::onRecordMovie);
+
+                actPlayMovie = submenu->addAction("Play...");
+                connect(actPlayMovie, &QAction::triggered, this, &MainWindow::onPlayMovie);
+
+                actStopMovie = submenu->addAction("Stop");
+                connect(actStopMovie, &QAction::triggered, this, &MainWindow::onStopMovie);
+            }
+
             menu->addSeparator();
             actOpenConfig = menu->addAction("Open melonDS directory");
             connect(actOpenConfig, &QAction::triggered, this, [&]()
@@ -443,6 +459,11 @@ MainWindow::MainWindow(int id, EmuInstance* inst, QWidget* parent) :
                 actRAMInfo = menu->addAction("RAM search");
                 connect(actRAMInfo, &QAction::triggered, this, &MainWindow::onRAMInfo);
 
+#ifdef JIT_ENABLED
+                actLogJITStats = menu->addAction("Log JIT statistics");
+                connect(actLogJITStats, &QAction::triggered, this, &MainWindow::onLogJITStats);
+#endif
+
                 actTitleManager = menu->addAction("Manage DSi titles");
                 connect(actTitleManager, &QAction::triggered, this, &MainWindow::onOpenTitleManager);
             }
@@ -462,16 +483,13 @@ MainWindow::MainWindow(int id, EmuInstance* inst, QWidget* parent) :
                 actLANStartClient = submenu->addAction("Join LAN game");
                 connect(actLANStartClient, &QAction::triggered, this, &MainWindow::onLANStartClient);
 
-                /*submenu->addSeparator();
+                submenu->addSeparator();
 
-                actNPStartHost = submenu->addAction("NETPLAY HOST");
+                actNPStartHost = submenu->addAction("Host netplay game (shared controller)");
                 connect(actNPStartHost, &QAction::triggered, this, &MainWindow::onNPStartHost);
 
-                actNPStartClient = submenu->addAction("NETPLAY CLIENT");
+                actNPStartClient = submenu->addAction("Join netplay game (shared controller)");
                 connect(actNPStartClient, &QAction::triggered, this, &MainWindow::onNPStartClient);
-
-                actNPTest = submenu->addAction("NETPLAY GO");
-                connect(actNPTest, &QAction::triggered, this, &MainWindow::onNPTest);*/
             }
         }
         {
@@ -720,6 +738,10 @@ MainWindow::MainWindow(int id, EmuInstance* inst, QWidget* parent) :
         actUndoStateLoad->setEnabled(false);
         actImportSavefile->setEnabled(false);
 
+        actRecordMovie->setEnabled(false);
+        actPlayMovie->setEnabled(false);
+        actStopMovie->setEnabled(false);
+
         actPause->setEnabled(false);
         actReset->setEnabled(false);
         actStop->setEnabled(false);
@@ -1574,11 +1596,9 @@ void MainWindow::onSaveState()
             return;
     }
 
-    if (emuThread->saveState(filename))
+    // only queues the write, which reports its completion itself
+    if (emuThread->saveState(filename, slot))
     {
-        if (slot > 0) emuInstance->osdAddMessage(0, "State saved to slot %d", slot);
-        else          emuInstance->osdAddMessage(0, "State saved to file");
-
         actLoadState[slot]->setEnabled(true);
     }
     else
@@ -1637,6 +1657,45 @@ void MainWindow::onUndoStateLoad()
     emuInstance->osdAddMessage(0, "State load undone");
 }
 
+void MainWindow::onRecordMovie()
+{
+    emuThread->emuPause();
+    QString filename = QFileDialog::getSaveFileName(this,
+                                                    "Record input movie",
+                                                    globalCfg.GetQString("LastROMFolder"),
+                                                    "melonDS input movies (*.mlm);;Any file (*.*)");
+    emuThread->emuUnpause();
+    if (filename.isEmpty())
+        return;
+
+    if (emuThread->startMovieRecording(filename))
+        emuInstance->osdAddMessage(0, "Recording input movie");
+    else
+        emuInstance->osdAddMessage(0xFFA0A0, "Failed to start recording");
+}
+
+void MainWindow::onPlayMovie()
+{
+    emuThread->emuPause();
+    QString filename = QFileDialog::getOpenFileName(this,
+                                                    "Play input movie",
+                                                    globalCfg.GetQString("LastROMFolder"),
+                                                    "melonDS input movies (*.mlm);;Any file (*.*)");
+    emuThread->emuUnpause();
+    if (filename.isEmpty())
+        return;
+
+    if (emuThread->startMoviePlayback(filename))
+        emuInstance->osdAddMessage(0, "Playing input movie");
+    else
+        emuInstance->osdAddMessage(0xFFA0A0, "Failed to play input movie");
+}
+
+void MainWindow::onStopMovie()
+{
+    emuThread->stopMovie();
+}
+
 void MainWindow::onImportSavefile()
 {
     QString path = QFileDialog::getOpenFileName(this,
@@ -1764,6 +1823,13 @@ void MainWindow::onRAMInfo()
     RAMInfoDialog* dlg = RAMInfoDialog::openDlg(this);
 }
 
+void MainWindow::onLogJITStats()
+{
+    emuThread->logJITStats();
+
+    emuInstance->osdAddMessage(0, "JIT statistics written to the log");
+}
+
 void MainWindow::onOpenTitleManager()
 {
     TitleManagerDialog* dlg = TitleManagerDialog::openDlg(this);
@@ -1788,20 +1854,12 @@ void MainWindow::onLANStartClient()
 
 void MainWindow::onNPStartHost()
 {
-    //Netplay::StartHost();
-    //NetplayStartHostDialog::openDlg(this);
+    NetplayStartHostDialog::openDlg(this);
 }
 
 void MainWindow::onNPStartClient()
 {
-    //Netplay::StartClient();
-    //NetplayStartClientDialog::openDlg(this);
-}
-
-void MainWindow::onNPTest()
-{
-    // HAX
-    //Netplay::StartGame();
+    NetplayStartClientDialog::openDlg(this);
 }
 
 void MainWindow::updateMPInterface(MPInterfaceType type)
@@ -1814,9 +1872,8 @@ void MainWindow::updateMPInterface(MPInterfaceType type)
     actMPNewInstance->setEnabled(enable);
     actLANStartHost->setEnabled(enable);
     actLANStartClient->setEnabled(enable);
-    /*actNPStartHost->setEnabled(enable);
+    actNPStartHost->setEnabled(enable);
     actNPStartClient->setEnabled(enable);
-    actNPTest->setEnabled(enable);*/
 }
 
 bool MainWindow::lanWarning(bool host)
@@ -2245,6 +2302,10 @@ void MainWindow::onEmuStart()
     actLoadState[0]->setEnabled(true);
     actUndoStateLoad->setEnabled(false);
 
+    actRecordMovie->setEnabled(true);
+    actPlayMovie->setEnabled(true);
+    actStopMovie->setEnabled(true);
+
     actPause->setEnabled(true);
     actPause->setChecked(false);
     actReset->setEnabled(true);
@@ -2268,6 +2329,10 @@ void MainWindow::onEmuStop()
     }
     actUndoStateLoad->setEnabled(false);
 
+    actRecordMovie->setEnabled(false);
+    actPlayMovie->setEnabled(false);
+    actStopMovie->setEnabled(false);
+
     actPause->setEnabled(false);
     actReset->setEnabled(false);
     actStop->setEnabled(false);
@@ -114,6 +114,9 @@ private slots:
     void onSaveState();
     void onLoadState();
     void onUndoStateLoad();
+    void onRecordMovie();
+    void onPlayMovie();
+    void onStopMovie();
     void onImportSavefile();
     void onQuit();
 
@@ -128,13 +131,13 @@ private slots:
     void onCheatsDialogFinished(int res);
     void onROMInfo();
     void onRAMInfo();
+    void onLogJITStats();
     void onOpenTitleManager();
     void onMPNewInstance();
     void onLANStartHost();
     void onLANStartClient();
     void onNPStartHost();
     void onNPStartClient();
-    void onNPTest();
 
     void onOpenEmuSettings();
     void onEmuSettingsDialogFinished(int res);
@@ -239,6 +242,9 @@ public:
     QAction* actSaveState[9];
     QAction* actLoadState[9];
     QAction* actUndoStateLoad;
+    QAction* actRecordMovie;
+    QAction* actPlayMovie;
+    QAction* actStopMovie;
     QAction* actOpenConfig;
     QAction* actQuit;
 
@@ -252,13 +258,15 @@ public:
     QAction* actSetupCheats;
     QAction* actROMInfo;
     QAction* actRAMInfo;
+#ifdef JIT_ENABLED
+    QAction* actLogJITStats;
+#endif
     QAction* actTitleManager;
     QAction* actMPNewInstance;
     QAction* actLANStartHost;
     QAction* actLANStartClient;
     QAction* actNPStartHost;
     QAction* actNPStartClient;
-    QAction* actNPTest;
 
     QAction* actEmuSettings;
 #ifdef __APPLE__
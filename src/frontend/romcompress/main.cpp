@@ -0,0 +1,239 @@
+/*
+    Copyright 2016-2026 melonDS team
+
+    This file is part of melonDS.
+
+    melonDS is free software: you can redistribute it and/or modify it under
+    the terms of the GNU General Public License as published by the Free
+    Software Foundation, either version 3 of the License, or (at your option)
+    any later version.
+
+    melonDS is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+    FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with melonDS. If not, see http://www.gnu.org/licenses/.
+*/
+
+// melonDS-romcompress: converts NDS ROMs to and from the block-compressed
+// ROM format (see CompressedROM.h), which melonDS can boot directly.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <string>
+
+#include "CompressedROM.h"
+#include "Platform.h"
+#include "main.h"
+
+using namespace melonDS;
+using namespace melonDS::Platform;
+
+Platform::LogLevel minLogLevel = LogLevel::Warn;
+
+static void printUsage(const char* argv0)
+{
+    fprintf(stderr,
+        "usage: %s [options] <input> <output>\n"
+        "\n"
+        "Compresses an NDS ROM into a .ncr file, or decompresses one with -d.\n"
+        "\n"
+        "  -d, --decompress    turn a .ncr file back into a plain ROM\n"
+        "  --block-size N      size of the compressed blocks in bytes\n"
+        "                      (power of 2, 4096 to 1048576, default 65536)\n"
+        "  --verify            read the output back and compare it to the input\n",
+        argv0);
+}
+
+static std::unique_ptr<u8[]> loadFile(const std::string& path, u32& len)
+{
+    FileHandle* f = OpenFile(path, FileMode::Read);
+    if (!f) return nullptr;
+
+    u64 filelen = FileLength(f);
+    if (filelen == 0 || filelen > 0x40000000)
+    {
+        CloseFile(f);
+        return nullptr;
+    }
+
+    auto data = std::make_unique<u8[]>(filelen);
+    u64 nread = FileRead(data.get(), filelen, 1, f);
+    CloseFile(f);
+    if (nread != 1) return nullptr;
+
+    len = (u32)filelen;
+    return data;
+}
+
+static bool verify(const std::string& path, const u8* rom, u32 len)
+{
+    auto compressed = CompressedROM::Open(path);
+    if (!compressed || compressed->GetLength() != len)
+        return false;
+
+    auto buffer = std::make_unique<u8[]>(CompressedROM::DefaultBlockSize);
+    for (u32 pos = 0; pos < len; pos += CompressedROM::DefaultBlockSize)
+    {
+        u32 chunk = std::min(len - pos, CompressedROM::DefaultBlockSize);
+        compressed->Read(pos, chunk, buffer.get());
+        if (memcmp(buffer.get(), &rom[pos], chunk) != 0)
+            return false;
+    }
+
+    // read across the end of the ROM again after the other blocks went through
+    // the cache, so the last block lands in a buffer that held something else
+    u32 tail = len & (CompressedROM::DefaultBlockSize - 1);
+    if (tail == 0) tail = CompressedROM::DefaultBlockSize;
+    u32 tailpos = len - tail;
+    for (u32 pos = 0; pos < tailpos; pos += CompressedROM::DefaultBlockSize)
+        compressed->Read(pos, CompressedROM::DefaultBlockSize, buffer.get());
+
+    compressed->Read(tailpos, CompressedROM::DefaultBlockSize, buffer.get());
+    if (memcmp(buffer.get(), &rom[tailpos], tail) != 0)
+        return false;
+    for (u32 i = tail; i < CompressedROM::DefaultBlockSize; i++)
+    {
+        if (buffer[i] != 0)
+            return false;
+    }
+
+    return true;
+}
+
+static int compress(const std::string& inpath, const std::string& outpath, u32 blocksize, bool check)
+{
+    u32 len = 0;
+    auto rom = loadFile(inpath, len);
+    if (!rom)
+    {
+        fprintf(stderr, "Failed to read %s\n", inpath.c_str());
+        return 1;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+
+    FileHandle* out = OpenFile(outpath, FileMode::Write);
+    if (!out)
+    {
+        fprintf(stderr, "Failed to open %s for writing\n", outpath.c_str());
+        return 1;
+    }
+
+    bool ok = CompressedROM::Write(rom.get(), len, out, blocksize);
+    u64 outlen = FileLength(out);
+    CloseFile(out);
+    if (!ok)
+    {
+        fprintf(stderr, "Failed to write %s\n", outpath.c_str());
+        return 1;
+    }
+
+    double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    printf("%s: %u -> %llu bytes (%.1f%%) in %.2f s\n", outpath.c_str(), len,
+           (unsigned long long)outlen, (outlen * 100.0) / len, secs);
+
+    if (check)
+    {
+        if (!verify(outpath, rom.get(), len))
+        {
+            fprintf(stderr, "Verification of %s failed\n", outpath.c_str());
+            return 1;
+        }
+        printf("%s: verified\n", outpath.c_str());
+    }
+
+    return 0;
+}
+
+static int decompress(const std::string& inpath, const std::string& outpath)
+{
+    auto compressed = CompressedROM::Open(inpath);
+    if (!compressed)
+    {
+        fprintf(stderr, "%s is not a valid compressed ROM\n", inpath.c_str());
+        return 1;
+    }
+
+    FileHandle* out = OpenFile(outpath, FileMode::Write);
+    if (!out)
+    {
+        fprintf(stderr, "Failed to open %s for writing\n", outpath.c_str());
+        return 1;
+    }
+
+    u32 len = compressed->GetLength();
+    auto buffer = std::make_unique<u8[]>(CompressedROM::DefaultBlockSize);
+    bool ok = true;
+    for (u32 pos = 0; pos < len && ok; pos += CompressedROM::DefaultBlockSize)
+    {
+        u32 chunk = std::min(len - pos, CompressedROM::DefaultBlockSize);
+        compressed->Read(pos, chunk, buffer.get());
+        ok = FileWrite(buffer.get(), chunk, 1, out) == 1;
+    }
+    CloseFile(out);
+
+    if (!ok)
+    {
+        fprintf(stderr, "Failed to write %s\n", outpath.c_str());
+        return 1;
+    }
+
+    printf("%s: %u bytes\n", outpath.c_str(), len);
+    return 0;
+}
+
+int main(int argc, char** argv)
+{
+    bool decomp = false;
+    bool check = false;
+    u32 blocksize = CompressedROM::DefaultBlockSize;
+    std::string paths[2];
+    int numpaths = 0;
+
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if (arg == "-d" || arg == "--decompress")
+            decomp = true;
+        else if (arg == "--verify")
+            check = true;
+        else if (arg == "--block-size" && (i+1) < argc)
+            blocksize = strtoul(argv[++i], nullptr, 0);
+        else if (arg == "-h" || arg == "--help")
+        {
+            printUsage(argv[0]);
+            return 0;
+        }
+        else if (arg[0] != '-' && numpaths < 2)
+            paths[numpaths++] = arg;
+        else
+        {
+            printUsage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (numpaths != 2)
+    {
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    if (decomp)
+        return decompress(paths[0], paths[1]);
+
+    if (blocksize < 0x1000 || blocksize > 0x100000 || (blocksize & (blocksize - 1)))
+    {
+        fprintf(stderr, "Invalid block size %u\n", blocksize);
+        return 1;
+    }
+
+    return compress(paths[0], paths[1], blocksize, check);
+}
@@ -0,0 +1,102 @@
+/*
+    Copyright 2016-2026 melonDS team
+
+    This file is part of melonDS.
+
+    melonDS is free software: you can redistribute it and/or modify it under
+    the terms of the GNU General Public License as published by the Free
+    Software Foundation, either version 3 of the License, or (at your option)
+    any later version.
+
+    melonDS is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+    FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with melonDS. If not, see http://www.gnu.org/licenses/.
+*/
+
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "TestUtil.h"
+#include "Args.h"
+#include "SPI.h"
+#include "NDSCart.h"
+#include "GPU_Soft.h"
+
+using namespace melonDS;
+using namespace melonDS::Platform;
+
+LogLevel minLogLevel = LogLevel::Warn;
+
+static int numFailed = 0;
+
+void check(bool ok, const char* what)
+{
+    printf("%s: %s\n", ok ? "ok" : "FAILED", what);
+    if (!ok) numFailed++;
+}
+
+int finishTests()
+{
+    printf("%s\n", numFailed ? "FAILED" : "passed");
+    return numFailed ? 1 : 0;
+}
+
+std::vector<u8> makeTestROM(const char* title, const char* gamecode,
+    const u32* arm9code, size_t arm9len, const u32* arm7code, size_t arm7len)
+{
+    const u32 arm9offset = 0x200;
+    const u32 arm7offset = 0x400;
+    assert(arm9len <= 0x200 && arm7len <= 0x200);
+
+    std::vector<u8> rom(0x20000, 0xFF);
+    memset(&rom[0], 0, arm7offset + 0x200);
+    strncpy((char*)&rom[0x00], title, 12);
+    memcpy(&rom[0x0C], gamecode, 4);
+    memcpy(&rom[0x10], "01", 2);
+
+    auto put32 = [&](u32 offset, u32 val) { memcpy(&rom[offset], &val, 4); };
+    put32(0x20, arm9offset);
+    put32(0x24, 0x02000000);
+    put32(0x28, 0x02000000);
+    put32(0x2C, 0x200);
+    put32(0x30, arm7offset);
+    put32(0x34, 0x02380000);
+    put32(0x38, 0x02380000);
+    put32(0x3C, 0x200);
+    put32(0x80, arm7offset + 0x200);
+    put32(0x84, 0x200);
+
+    memcpy(&rom[arm9offset], arm9code, arm9len);
+    memcpy(&rom[arm7offset], arm7code, arm7len);
+
+    u16 crc = CRC16(&rom[0], 0x15E, 0xFFFF);
+    memcpy(&rom[0x15E], &crc, 2);
+    return rom;
+}
+
+std::unique_ptr<NDS> createTestConsole(const std::vector<u8>& rom, const char* romname, bool jit)
+{
+    auto cart = NDSCart::ParseROM(rom.data(), rom.size());
+    if (!cart)
+    {
+        Log(LogLevel::Error, "Failed to parse the generated ROM\n");
+        return nullptr;
+    }
+
+    NDSArgs args {};
+    if (!jit)
+        args.JIT = std::nullopt;
+
+    auto nds = std::make_unique<NDS>(std::move(args));
+    nds->SetRenderer(std::make_unique<SoftRenderer>(*nds));
+
+    nds->Reset();
+    nds->SetNDSCart(std::move(cart));
+    nds->SetupDirectBoot(romname);
+    nds->Start();
+    return nds;
+}
@@ -0,0 +1,51 @@
+/*
+    Copyright 2016-2026 melonDS team
+
+    This file is part of melonDS.
+
+    melonDS is free software: you can redistribute it and/or modify it under
+    the terms of the GNU General Public License as published by the Free
+    Software Foundation, either version 3 of the License, or (at your option)
+    any later version.
+
+    melonDS is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+    FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with melonDS. If not, see http://www.gnu.org/licenses/.
+*/
+
+#ifndef TESTUTIL_H
+#define TESTUTIL_H
+
+#include <stddef.h>
+
+#include <memory>
+#include <vector>
+
+#include "types.h"
+#include "NDS.h"
+
+// minLogLevel, defined in TestUtil.cpp
+#include "main.h"
+
+// what every test program has in common: each check prints a line,
+// and the program fails if any of them did
+
+void check(bool ok, const char* what);
+
+// prints the overall result
+// @return the exit code of the test program
+int finishTests();
+
+// a ROM whose ARM9 and ARM7 binaries are the given code, up to 0x200 bytes each,
+// loaded to 0x02000000 and 0x02380000 and started from there
+std::vector<melonDS::u8> makeTestROM(const char* title, const char* gamecode,
+    const melonDS::u32* arm9code, size_t arm9len, const melonDS::u32* arm7code, size_t arm7len);
+
+// a console running the ROM with the software renderer, booted directly
+// @return nullptr if the ROM can't be parsed
+std::unique_ptr<melonDS::NDS> createTestConsole(const std::vector<melonDS::u8>& rom, const char* romname, bool jit = false);
+
+#endif // TESTUTIL_H
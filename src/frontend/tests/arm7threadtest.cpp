@@ -0,0 +1,198 @@
+/*
+    Copyright 2016-2026 melonDS team
+
+    This file is part of melonDS.
+
+    melonDS is free software: you can redistribute it and/or modify it under
+    the terms of the GNU General Public License as published by the Free
+    Software Foundation, either version 3 of the License, or (at your option)
+    any later version.
+
+    melonDS is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+    FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with melonDS. If not, see http://www.gnu.org/licenses/.
+*/
+
+// melonDS-arm7threadtest: runs the same program on two consoles with the ARM7 on
+// its own thread (NDS::SetARM7Threaded) and on one without, and checks that all
+// three stay the same.
+// The ARM7 runs from its WRAM, where it can get ahead of the ARM9, and both CPUs
+// keep reading what the other one last wrote to main RAM, so any access that isn't
+// synced to the right point shows up as a different value.
+//
+// The threaded ARM7 only runs the slices of the single-threaded mode with the
+// smallest skew, and the program doesn't use IRQs, WRAMCNT or the GBA slot, whose
+// timing differs on purpose (see NDS::SetARM7Threaded()).
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "TestUtil.h"
+
+#include "types.h"
+#include "NDS.h"
+#include "Rollback.h"
+#include "Platform.h"
+
+using namespace melonDS;
+using namespace melonDS::Platform;
+
+struct TestConfig
+{
+    u32 Frames = 60;
+};
+
+// ARM9: counts, and mixes in what the ARM7 last wrote
+static const u32 ARM9Code[] =
+{
+    0xE3A04622,     // mov r4, #0x02200000
+    0xE3A05000,     // mov r5, #0
+                    // loop:
+    0xE2855001,     // add r5, r5, #1
+    0xE5946004,     // ldr r6, [r4, #4]         ; the ARM7's result
+    0xE0257006,     // eor r7, r5, r6
+    0xE5845000,     // str r5, [r4]
+    0xE584700C,     // str r7, [r4, #12]
+    0xE3A02020,     // mov r2, #32
+                    // w:
+    0xE2522001,     // subs r2, r2, #1
+    0x1AFFFFFD,     // bne w
+    0xEAFFFFF6,     // b loop
+};
+
+// ARM7: copies its loop to ARM7 WRAM and runs it there. the loop works on
+// registers for a while, then mixes in the ARM9's count and stores the result
+static const u32 ARM7Code[] =
+{
+    0xE28F0018,     // add r0, pc, #0x18        ; routine
+    0xE3A0150E,     // mov r1, #0x03800000
+    0xE3A0200E,     // mov r2, #14
+                    // copy:
+    0xE4903004,     // ldr r3, [r0], #4
+    0xE4813004,     // str r3, [r1], #4
+    0xE2522001,     // subs r2, r2, #1
+    0x1AFFFFFB,     // bne copy
+    0xE3A0F50E,     // mov pc, #0x03800000
+                    // routine:
+    0xE3A04622,     // mov r4, #0x02200000
+    0xE3A05000,     // mov r5, #0
+    0xE3A06000,     // mov r6, #0
+                    // loop:
+    0xE2855001,     // add r5, r5, #1
+    0xE3A02040,     // mov r2, #64
+                    // w:
+    0xE0866085,     // add r6, r6, r5, lsl #1
+    0xE02663E6,     // eor r6, r6, r6, ror #7
+    0xE2522001,     // subs r2, r2, #1
+    0x1AFFFFFB,     // bne w
+    0xE5947000,     // ldr r7, [r4]             ; the ARM9's count
+    0xE0866007,     // add r6, r6, r7
+    0xE5846004,     // str r6, [r4, #4]
+    0xE5845008,     // str r5, [r4, #8]
+    0xEAFFFFF4,     // b loop
+};
+
+static void printUsage(const char* argv0)
+{
+    fprintf(stderr,
+        "usage: %s [options]\n"
+        "\n"
+        "Runs two consoles with the ARM7 on its own thread and one without\n"
+        "side by side and checks that their state stays the same.\n"
+        "\n"
+        "  --frames N          frames each console emulates (default 60)\n"
+        "  --verbose           print core log output to stderr\n",
+        argv0);
+}
+
+static void testThreadedARM7(const std::vector<u8>& rom, const TestConfig& cfg)
+{
+    std::unique_ptr<NDS> reference = createTestConsole(rom, "arm7threadtest.nds");
+    std::unique_ptr<NDS> threaded[2] =
+    {
+        createTestConsole(rom, "arm7threadtest.nds"),
+        createTestConsole(rom, "arm7threadtest.nds"),
+    };
+    check(reference && threaded[0] && threaded[1], "consoles created");
+    if (!reference || !threaded[0] || !threaded[1])
+        return;
+
+    bool enabled = true;
+    for (auto& nds : threaded)
+    {
+        nds->SetARM7MaxSkew(0);
+        enabled = enabled && nds->SetARM7Threaded(true);
+    }
+    check(enabled, "threaded ARM7 enabled");
+    if (!enabled)
+        return;
+
+    u32 diff[2] = {0, 0};
+    for (u32 frame = 1; frame <= cfg.Frames; frame++)
+    {
+        reference->RunFrame();
+        u64 refsum = Rollback::Checksum(*reference);
+
+        for (int i = 0; i < 2; i++)
+        {
+            threaded[i]->RunFrame();
+            if (Rollback::Checksum(*threaded[i]) != refsum)
+            {
+                if (!diff[i])
+                    printf("  threaded run %d differs from frame %u\n", i+1, frame);
+                diff[i]++;
+            }
+        }
+    }
+
+    // both CPUs count their passes in main RAM
+    u32 arm9passes = *(u32*)&reference->MainRAM[0x200000];
+    u32 arm7passes = *(u32*)&reference->MainRAM[0x200008];
+    check(arm9passes >= cfg.Frames && arm7passes >= cfg.Frames, "both CPUs ran the program");
+    check(threaded[0]->ARM7ConcurrentCycles > 0, "the ARM7 ran alongside the ARM9");
+    check(diff[0] == 0 && diff[1] == 0, "memory and registers identical with and without the ARM7 thread");
+}
+
+int main(int argc, char** argv)
+{
+    TestConfig cfg;
+
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        bool hasval = (i+1) < argc;
+
+        if (arg == "--frames" && hasval)
+            cfg.Frames = strtoul(argv[++i], nullptr, 0);
+        else if (arg == "--verbose")
+            minLogLevel = LogLevel::Debug;
+        else if (arg == "-h" || arg == "--help")
+        {
+            printUsage(argv[0]);
+            return 0;
+        }
+        else
+        {
+            printUsage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (cfg.Frames == 0)
+    {
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    std::vector<u8> rom = makeTestROM("MELONARM7THR", "AMLT", ARM9Code, sizeof(ARM9Code), ARM7Code, sizeof(ARM7Code));
+    testThreadedARM7(rom, cfg);
+
+    return finishTests();
+}
@@ -0,0 +1,232 @@
+/*
+    Copyright 2016-2026 melonDS team
+
+    This file is part of melonDS.
+
+    melonDS is free software: you can redistribute it and/or modify it under
+    the terms of the GNU General Public License as published by the Free
+    Software Foundation, either version 3 of the License, or (at your option)
+    any later version.
+
+    melonDS is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+    FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with melonDS. If not, see http://www.gnu.org/licenses/.
+*/
+
+// melonDS-eventcatchuptest: runs the same program on a console with event catch-up
+// (NDS::SetEventCatchUp) and on one without, and checks that they can't be told apart.
+// The ARM7 plays a PSG tone with a different pitch and length each time, then stays
+// silent long enough for the SPU to be parked, and writes to the RTC and RCNT in
+// between, which catch up the RTC.
+//
+// Checked every frame are the audio output and the memory and registers of both
+// CPUs. Now and then catch-up is turned off for a moment, which replays the parked
+// events, so that whole savestates can be compared.
+//
+// The ARM9 stays halted: while it runs, regular scheduling only gets to a tick once
+// the ARM9 is done with its current instruction, which catch-up doesn't reproduce
+// (see NDS::ParkEvent()).
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "TestUtil.h"
+
+#include "types.h"
+#include "NDS.h"
+#include "Rollback.h"
+#include "Savestate.h"
+#include "Platform.h"
+#include "xxhash/xxhash.h"
+
+using namespace melonDS;
+using namespace melonDS::Platform;
+
+struct TestConfig
+{
+    u32 Frames = 600;
+    u32 StateInterval = 60;
+};
+
+// the ARM9 halts for good, as it isn't given any IRQ to wake up to
+static const u32 ARM9Code[] =
+{
+    0xE3A00000,     // mov r0, #0
+    0xEE070F90,     // mcr p15, 0, r0, c7, c0, 4   ; halt
+    0xEAFFFFFE,     // b .
+};
+
+// ARM7: starts a PSG tone on channel 8, stops it after a while, then writes to
+// RTC and RCNT and waits about four frames. How long both last depends on the pass.
+static const u32 ARM7Code[] =
+{
+    0xE3A04301,     // mov r4, #0x04000000
+    0xE2844B01,     // add r4, r4, #0x400
+    0xE2846C01,     // add r6, r4, #0x100
+    0xE3A00902,     // mov r0, #0x8000
+    0xE380007F,     // orr r0, r0, #0x7F
+    0xE1C600B0,     // strh r0, [r6]            ; SOUNDCNT: enabled, full volume
+    0xE3A07301,     // mov r7, #0x04000000
+    0xE2877C01,     // add r7, r7, #0x100
+    0xE3A08622,     // mov r8, #0x02200000
+    0xE3A05000,     // mov r5, #0
+                    // loop:
+    0xE205103F,     // and r1, r5, #0x3F
+    0xE3A00A0F,     // mov r0, #0xF000
+    0xE1800201,     // orr r0, r0, r1, lsl #4
+    0xE1C408B8,     // strh r0, [r4, #0x88]     ; SOUND8TMR
+    0xE59F003C,     // ldr r0, =0xE340007F
+    0xE5840080,     // str r0, [r4, #0x80]      ; SOUND8CNT: PSG, duty 4/8, started
+    0xE3A02901,     // mov r2, #0x4000
+    0xE0822401,     // add r2, r2, r1, lsl #8
+                    // w1:
+    0xE2522001,     // subs r2, r2, #1
+    0x1AFFFFFD,     // bne w1
+    0xE3A00000,     // mov r0, #0
+    0xE5840080,     // str r0, [r4, #0x80]      ; stop
+    0xE1C703B8,     // strh r0, [r7, #0x38]     ; RTC
+    0xE1C703B4,     // strh r0, [r7, #0x34]     ; RCNT
+    0xE3A02802,     // mov r2, #0x20000
+    0xE0822501,     // add r2, r2, r1, lsl #10
+                    // w2:
+    0xE2522001,     // subs r2, r2, #1
+    0x1AFFFFFD,     // bne w2
+    0xE2855001,     // add r5, r5, #1
+    0xE5885000,     // str r5, [r8]
+    0xEAFFFFEA,     // b loop
+    0xE340007F,
+};
+
+static void printUsage(const char* argv0)
+{
+    fprintf(stderr,
+        "usage: %s [options]\n"
+        "\n"
+        "Runs a console with event catch-up and one without side by side\n"
+        "and checks that their audio output and state stay the same.\n"
+        "\n"
+        "  --frames N          frames each console emulates (default 600)\n"
+        "  --state-interval N  frames between two savestate comparisons (default 60)\n"
+        "  --verbose           print core log output to stderr\n",
+        argv0);
+}
+
+static u64 audioHash(NDS& nds)
+{
+    std::vector<s16> samples(nds.SPU.GetOutputSize() * 2);
+    int num = nds.SPU.ReadOutput(samples.data(), samples.size() / 2);
+    return XXH3_64bits(samples.data(), num * 2 * sizeof(s16));
+}
+
+static std::unique_ptr<Savestate> saveState(NDS& nds)
+{
+    auto state = std::make_unique<Savestate>();
+    nds.DoSavestate(state.get());
+    return state;
+}
+
+static void testCatchUp(const std::vector<u8>& rom, const TestConfig& cfg)
+{
+    std::unique_ptr<NDS> strict = createTestConsole(rom, "eventcatchuptest.nds");
+    std::unique_ptr<NDS> lazy = createTestConsole(rom, "eventcatchuptest.nds");
+    check(strict && lazy, "consoles created");
+    if (!strict || !lazy)
+        return;
+
+    strict->SetEventCatchUp(false);
+    lazy->SetEventCatchUp(true);
+
+    u32 audiodiff = 0, statediff = 0, savediff = 0;
+    u32 numsaves = 0;
+    for (u32 frame = 1; frame <= cfg.Frames; frame++)
+    {
+        strict->RunFrame();
+        lazy->RunFrame();
+
+        if (audioHash(*strict) != audioHash(*lazy))
+        {
+            if (!audiodiff)
+                printf("  audio differs from frame %u\n", frame);
+            audiodiff++;
+        }
+        if (Rollback::Checksum(*strict) != Rollback::Checksum(*lazy))
+        {
+            if (!statediff)
+                printf("  memory or registers differ from frame %u\n", frame);
+            statediff++;
+        }
+
+        if ((frame % cfg.StateInterval) == 0)
+        {
+            // the parked events are saved as they are, catching them up
+            // is what makes the two states comparable
+            lazy->SetEventCatchUp(false);
+            std::unique_ptr<Savestate> a = saveState(*strict);
+            std::unique_ptr<Savestate> b = saveState(*lazy);
+            lazy->SetEventCatchUp(true);
+
+            numsaves++;
+            if (a->Error || b->Error || a->Length() != b->Length()
+                || memcmp(a->Buffer(), b->Buffer(), a->Length()) != 0)
+            {
+                if (!savediff)
+                    printf("  savestates differ from frame %u\n", frame);
+                savediff++;
+            }
+        }
+    }
+
+    // the program counts its passes at 0x02200000
+    u32 passes = *(u32*)&strict->MainRAM[0x200000];
+    check(passes >= cfg.Frames / 8, "the ARM7 program ran");
+    check(audiodiff == 0, "audio output identical with and without catch-up");
+    check(statediff == 0, "memory and registers identical with and without catch-up");
+    check(numsaves > 0 && savediff == 0, "savestates identical with and without catch-up");
+}
+
+int main(int argc, char** argv)
+{
+    TestConfig cfg;
+
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        bool hasval = (i+1) < argc;
+
+        if (arg == "--frames" && hasval)
+            cfg.Frames = strtoul(argv[++i], nullptr, 0);
+        else if (arg == "--state-interval" && hasval)
+            cfg.StateInterval = strtoul(argv[++i], nullptr, 0);
+        else if (arg == "--verbose")
+            minLogLevel = LogLevel::Debug;
+        else if (arg == "-h" || arg == "--help")
+        {
+            printUsage(argv[0]);
+            return 0;
+        }
+        else
+        {
+            printUsage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (cfg.Frames == 0 || cfg.StateInterval == 0)
+    {
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    std::vector<u8> rom = makeTestROM("MELONCATCHUP", "AMLC", ARM9Code, sizeof(ARM9Code), ARM7Code, sizeof(ARM7Code));
+    testCatchUp(rom, cfg);
+
+    return finishTests();
+}
@@ -0,0 +1,479 @@
+/*
+    Copyright 2016-2026 melonDS team
+
+    This file is part of melonDS.
+
+    melonDS is free software: you can redistribute it and/or modify it under
+    the terms of the GNU General Public License as published by the Free
+    Software Foundation, either version 3 of the License, or (at your option)
+    any later version.
+
+    melonDS is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+    FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with melonDS. If not, see http://www.gnu.org/licenses/.
+*/
+
+// melonDS-jittest: runs random operands through the ARM9 instructions the JIT
+// compiles natively instead of falling back to the interpreter, on one console
+// with the JIT and one without, and compares the results. It needs no ROM.
+//
+// Checked are the ARMv5TE DSP multiplies and saturating arithmetic, CP15 reads
+// and writes (including cache maintenance, which the JIT drops), SWI, and
+// coprocessor accesses from user mode, which raise an undefined instruction
+// exception.
+//
+// A generated program takes over the ARM9 right after boot. For each random
+// encoding, a loop loads R0-R7 and the NZCVQ flags from a table, runs the
+// instruction and stores R0-R7 and the CPSR to another table. Exceptions are
+// taken through handlers in the ITCM, which store the SPSR and return address
+// to a third table and return to system mode.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <iterator>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "TestUtil.h"
+
+#include "types.h"
+#include "NDS.h"
+#include "Platform.h"
+
+using namespace melonDS;
+using namespace melonDS::Platform;
+
+struct TestConfig
+{
+    u32 NumEncodings = 1024;
+    u32 Seed = 1;
+};
+
+// where the generated program and its tables go in main RAM
+constexpr u32 CodeAddr = 0x02100000;
+constexpr u32 InAddr = 0x02120000;
+constexpr u32 OutAddr = 0x021C0000;
+constexpr u32 ExceptionOutAddr = 0x02260000;
+constexpr u32 DoneAddr = 0x02370000;
+constexpr u32 DoneMagic = 0x600DD5B0;
+
+// handlers, reached from the low exception vectors
+constexpr u32 HandlerAddr = 0x100;
+
+constexpr u32 VectorsPerEncoding = 16;
+
+enum TestKind
+{
+    Test_DSP,
+    Test_MRC,
+    Test_MCR,
+    Test_CacheOp,
+    Test_SWI,
+    Test_UserSWI,
+    Test_UserCoprocessor,
+};
+
+struct TestType
+{
+    const char* Name;
+    TestKind Kind;
+    u32 Encoding;   // with cond = AL and all register fields zero
+    // for the DSP instructions
+    bool HasX;      // takes the bottom or top half of Rm
+    bool HasY;      // takes the bottom or top half of Rs
+    bool HasRn;     // accumulates Rn, or RdLo for SMLALxy
+};
+
+static const TestType TestTypes[] =
+{
+    {"SMLAxy",  Test_DSP, 0x01000080, true,  true,  true},
+    {"SMLAWy",  Test_DSP, 0x01200080, false, true,  true},
+    {"SMULWy",  Test_DSP, 0x012000A0, false, true,  false},
+    {"SMLALxy", Test_DSP, 0x01400080, true,  true,  true},
+    {"SMULxy",  Test_DSP, 0x01600080, true,  true,  false},
+    {"QADD",    Test_DSP, 0x01000050, false, false, true},
+    {"QSUB",    Test_DSP, 0x01200050, false, false, true},
+    {"QDADD",   Test_DSP, 0x01400050, false, false, true},
+    {"QDSUB",   Test_DSP, 0x01600050, false, false, true},
+    {"MRC",     Test_MRC, 0x0E100F10},
+    {"MCR",     Test_MCR, 0x0E000F10},
+    {"MCR cache maintenance", Test_CacheOp, 0x0E000F10},
+    {"SWI",     Test_SWI, 0x0F000000},
+    {"SWI from user mode", Test_UserSWI, 0x0F000000},
+    {"MRC/MCR from user mode", Test_UserCoprocessor, 0x0E000F10},
+};
+
+// CP15 registers as (CRn << 8) | (CRm << 4) | op2, covering the constants,
+// the registers the JIT loads directly and the ones it calls CP15Read for
+static const u16 ReadableCP15[] =
+{
+    0x000, 0x001, 0x002, 0x003, 0xF00,
+    0x100, 0x200, 0x201, 0x300, 0x502, 0x503,
+    0x600, 0x610, 0x620, 0x630, 0x640, 0x650, 0x660, 0x670,
+    0x910, 0x911, 0xD01,
+    0x500, 0x501, 0x601, 0x671,
+};
+
+// registers that can be written without moving memory around, since the
+// protection unit is off after boot. Each is read back right after
+static const u16 WritableCP15[] =
+{
+    0x200, 0x201, 0x300, 0x500, 0x501, 0x502, 0x503,
+    0x600, 0x630, 0x670, 0xD01,
+};
+
+// cache and write buffer maintenance, mostly dropped by the JIT
+static const u16 CacheOpCP15[] =
+{
+    0x750, 0x751, 0x761, 0x762, 0x7A1, 0x7A2, 0x7A4, 0x7E1, 0x7E2,
+};
+
+static u32 coprocessorEncoding(u32 base, u32 id, u32 rd)
+{
+    return base | (((id >> 8) & 0xF) << 16) | (rd << 12) | ((id & 0x7) << 5) | ((id >> 4) & 0xF);
+}
+
+// ARM operand2 for an immediate, if it can be encoded as one
+static bool armImm(u32 val, u32& imm12)
+{
+    for (u32 rot = 0; rot < 16; rot++)
+    {
+        u32 imm8 = rot ? ((val << (rot * 2)) | (val >> (32 - rot * 2))) : val;
+        if (imm8 < 0x100)
+        {
+            imm12 = (rot << 8) | imm8;
+            return true;
+        }
+    }
+    return false;
+}
+
+static u32 randomOperand(std::mt19937& rng)
+{
+    // saturation and the Q flag mostly happen around the edges
+    static const u32 edges32[] = {0, 1, 0xFFFFFFFF, 0x7FFFFFFF, 0x80000000, 0x40000000, 0xC0000000, 0x3FFFFFFF};
+    static const u16 edges16[] = {0, 1, 0xFFFF, 0x7FFF, 0x8000, 0x4000, 0xC000};
+
+    switch (rng() % 4)
+    {
+    case 0: return edges32[rng() % std::size(edges32)];
+    case 1: return (edges16[rng() % std::size(edges16)] << 16) | edges16[rng() % std::size(edges16)];
+    default: return rng();
+    }
+}
+
+struct Program
+{
+    std::vector<u32> Code;
+    std::vector<u32> Encodings;
+    std::vector<u32> EncodingTypes;
+    std::vector<u32> Inputs;
+};
+
+static Program makeProgram(const TestConfig& cfg)
+{
+    Program prog;
+    std::mt19937 rng(cfg.Seed);
+    std::vector<u32>& code = prog.Code;
+
+    auto loadImm = [&](u32 rd, u32 val)
+    {
+        // MOV then ORR the remaining bytes in
+        u32 imm12;
+        code.push_back(0xE3A00000 | (rd << 12));
+        for (int shift = 0; shift < 32; shift += 8)
+        {
+            u32 part = val & (0xFF << shift);
+            if (part && armImm(part, imm12))
+                code.push_back(0xE3800000 | (rd << 16) | (rd << 12) | imm12);
+        }
+    };
+
+    code.push_back(0xE321F0DF); // MSR CPSR_c, #0xDF: system mode, no IRQs
+    loadImm(12, InAddr);
+    loadImm(11, OutAddr);
+    loadImm(9, ExceptionOutAddr);
+
+    for (u32 i = 0; i < cfg.NumEncodings; i++)
+    {
+        u32 typeidx = rng() % std::size(TestTypes);
+        const TestType& type = TestTypes[typeidx];
+
+        // mostly unconditional, sometimes depending on the random flags.
+        // What runs in user mode has to run, only an exception gets back out of it
+        bool usermode = type.Kind == Test_UserSWI || type.Kind == Test_UserCoprocessor;
+        u32 cond = (usermode || (rng() % 4)) ? 0xE : (rng() % 15);
+        u32 rd = rng() % 8, rn = rng() % 8, rm = rng() % 8, rs = rng() % 8;
+
+        u32 instrs[2];
+        u32 numinstrs = 1;
+        switch (type.Kind)
+        {
+        case Test_DSP:
+            instrs[0] = (cond << 28) | type.Encoding | rm;
+            if (type.Encoding & 0x80)
+            {
+                // multiplies: Rd in 16-19, Rn or RdLo in 12-15, Rs in 8-11
+                if (type.Encoding == 0x01400080)
+                {
+                    while (rn == rd) rn = rng() % 8;
+                }
+                instrs[0] |= (rd << 16) | (rs << 8);
+                if (type.HasRn) instrs[0] |= (rn << 12);
+                if (type.HasX) instrs[0] |= (rng() & 1) << 5;
+                if (type.HasY) instrs[0] |= (rng() & 1) << 6;
+            }
+            else
+            {
+                // saturating arithmetic: Rn in 16-19, Rd in 12-15
+                instrs[0] |= (rn << 16) | (rd << 12);
+            }
+            break;
+
+        case Test_MRC:
+            instrs[0] = (cond << 28) | coprocessorEncoding(type.Encoding,
+                ReadableCP15[rng() % std::size(ReadableCP15)], rd);
+            break;
+
+        case Test_MCR:
+            {
+                // write, then read back into another register
+                u32 id = WritableCP15[rng() % std::size(WritableCP15)];
+                while (rn == rd) rn = rng() % 8;
+                instrs[0] = (cond << 28) | coprocessorEncoding(type.Encoding, id, rd);
+                instrs[1] = (cond << 28) | coprocessorEncoding(0x0E100F10, id, rn);
+                numinstrs = 2;
+            }
+            break;
+
+        case Test_CacheOp:
+            instrs[0] = (cond << 28) | coprocessorEncoding(type.Encoding,
+                CacheOpCP15[rng() % std::size(CacheOpCP15)], rd);
+            break;
+
+        case Test_SWI:
+        case Test_UserSWI:
+            instrs[0] = (cond << 28) | type.Encoding | (rng() & 0xFFFFFF);
+            break;
+
+        case Test_UserCoprocessor:
+            {
+                u32 id = ReadableCP15[rng() % std::size(ReadableCP15)];
+                instrs[0] = 0xE0000000 | coprocessorEncoding((rng() & 1) ? 0x0E100F10 : 0x0E000F10, id, rd);
+            }
+            break;
+        }
+        prog.Encodings.push_back(instrs[0]);
+        prog.EncodingTypes.push_back(typeidx);
+
+        code.push_back(0xE3A0A000 | VectorsPerEncoding);   // MOV R10, #count
+        u32 loop = CodeAddr + code.size() * 4;
+        code.push_back(0xE8BC01FF);                         // LDMIA R12!, {R0-R8}
+        code.push_back(0xE128F008);                         // MSR CPSR_f, R8
+        if (usermode)
+            code.push_back(0xE321F090);                     // MSR CPSR_c, #0x90: user mode, no IRQs
+        for (u32 j = 0; j < numinstrs; j++)
+            code.push_back(instrs[j]);
+        code.push_back(0xE10F8000);                         // MRS R8, CPSR
+        code.push_back(0xE8AB01FF);                         // STMIA R11!, {R0-R8}
+        code.push_back(0xE25AA001);                         // SUBS R10, R10, #1
+        u32 here = CodeAddr + code.size() * 4;
+        code.push_back(0x1A000000 | (((loop - (here + 8)) >> 2) & 0xFFFFFF)); // BNE loop
+
+        for (u32 j = 0; j < VectorsPerEncoding; j++)
+        {
+            for (int r = 0; r < 8; r++)
+                prog.Inputs.push_back(randomOperand(rng));
+            prog.Inputs.push_back(rng() & 0xF8000000);
+        }
+    }
+
+    loadImm(0, DoneMagic);
+    loadImm(1, DoneAddr);
+    code.push_back(0xE8810A01); // STMIA R1, {R0, R9, R11}
+    code.push_back(0xEAFFFFFE); // B .
+
+    return prog;
+}
+
+// stores the SPSR and return address, then returns to system mode
+// with the flags and interrupt state from before
+static const u32 HandlerCode[] =
+{
+    0xE14F8000,     // mrs r8, spsr
+    0xE8A94100,     // stmia r9!, {r8, lr}
+    0xE388801F,     // orr r8, r8, #0x1F
+    0xE16FF008,     // msr spsr_fsxc, r8
+    0xE1B0F00E,     // movs pc, lr
+};
+
+// loads the program and runs it until it's done
+static bool runProgram(NDS& nds, const Program& prog)
+{
+    for (u32 i = 0; i < prog.Code.size(); i++)
+        nds.ARM9Write32(CodeAddr + i*4, prog.Code[i]);
+    for (u32 i = 0; i < prog.Inputs.size(); i++)
+        nds.ARM9Write32(InAddr + i*4, prog.Inputs[i]);
+    nds.ARM9Write32(DoneAddr, 0);
+
+    // the exceptions go to the low vectors in the ITCM,
+    // which nothing has run from yet
+    auto putITCM = [&](u32 addr, u32 val) { memcpy(&nds.ARM9.ITCM[addr], &val, 4); };
+    for (u32 vector : {0x04u, 0x08u})
+        putITCM(vector, 0xEA000000 | (((HandlerAddr - (vector + 8)) >> 2) & 0xFFFFFF));
+    for (u32 i = 0; i < std::size(HandlerCode); i++)
+        putITCM(HandlerAddr + i*4, HandlerCode[i]);
+    nds.ARM9.CP15Write(0x100, nds.ARM9.CP15Read(0x100) & ~(1<<13));
+
+    nds.ARM9.JumpTo(CodeAddr);
+
+    std::vector<s16> audiobuf(2 * 1024);
+    for (u32 f = 0; f < 120; f++)
+    {
+        nds.RunFrame();
+        while (nds.SPU.ReadOutput(audiobuf.data(), 1024) > 0);
+
+        if (nds.ARM9Read32(DoneAddr) == DoneMagic)
+            return true;
+    }
+    return false;
+}
+
+static void printUsage(const char* argv0)
+{
+    fprintf(stderr,
+        "usage: %s [options]\n"
+        "\n"
+        "Runs random operands through the instructions the JIT compiles natively,\n"
+        "with and without the JIT, and checks that the results are the same.\n"
+        "\n"
+        "  --encodings N       number of random encodings (default 1024)\n"
+        "  --seed N            seed for the encodings and operands (default 1)\n"
+        "  --verbose           print core log output to stderr\n",
+        argv0);
+}
+
+int main(int argc, char** argv)
+{
+    TestConfig cfg;
+
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        bool hasval = (i+1) < argc;
+
+        if (arg == "--encodings" && hasval)
+            cfg.NumEncodings = strtoul(argv[++i], nullptr, 0);
+        else if (arg == "--seed" && hasval)
+            cfg.Seed = strtoul(argv[++i], nullptr, 0);
+        else if (arg == "--verbose")
+            minLogLevel = LogLevel::Debug;
+        else if (arg == "-h" || arg == "--help")
+        {
+            printUsage(argv[0]);
+            return 0;
+        }
+        else
+        {
+            printUsage(argv[0]);
+            return 1;
+        }
+    }
+
+    Program prog = makeProgram(cfg);
+    // every test can take an exception
+    u32 numtests = cfg.NumEncodings * VectorsPerEncoding;
+    if (cfg.NumEncodings == 0 || CodeAddr + prog.Code.size() * 4 > InAddr
+        || InAddr + prog.Inputs.size() * 4 > OutAddr || OutAddr + numtests * 9 * 4 > ExceptionOutAddr
+        || ExceptionOutAddr + numtests * 2 * 4 > DoneAddr)
+    {
+        fprintf(stderr, "%u encodings don't fit into main RAM, up to %u do\n",
+            cfg.NumEncodings, (OutAddr - InAddr) / (VectorsPerEncoding * 9 * 4));
+        return 1;
+    }
+
+    // both CPUs only wait, the ARM9 is taken over once booted
+    static const u32 waitCode[] = {0xEAFFFFFE};  // b .
+    std::vector<u8> rom = makeTestROM("MELONJITTEST", "AMLJ", waitCode, sizeof(waitCode), waitCode, sizeof(waitCode));
+    std::unique_ptr<NDS> consoles[2] = {createTestConsole(rom, "jittest.nds", true), createTestConsole(rom, "jittest.nds", false)};
+    if (!consoles[0] || !consoles[1])
+        return 1;
+
+    bool done[2];
+    for (int c = 0; c < 2; c++)
+        done[c] = runProgram(*consoles[c], prog);
+    check(done[0] && done[1], "the program ran to the end with and without the JIT");
+    if (!done[0] || !done[1])
+        return finishTests();
+
+    auto read = [&](int c, u32 addr) { return consoles[c]->ARM9Read32(addr); };
+
+    // R0-R8 after each test
+    u32 typetests[std::size(TestTypes)] {};
+    u32 typemismatches[std::size(TestTypes)] {};
+    u32 qset = 0;
+    s64 mismatch = -1;
+    for (u32 t = 0; t < numtests; t++)
+    {
+        bool same = true;
+        for (u32 r = 0; r < 9; r++)
+            same &= read(0, OutAddr + (t * 9 + r) * 4) == read(1, OutAddr + (t * 9 + r) * 4);
+
+        u32 type = prog.EncodingTypes[t / VectorsPerEncoding];
+        typetests[type]++;
+        if (!same)
+        {
+            typemismatches[type]++;
+            if (mismatch < 0)
+                mismatch = t;
+        }
+        if (TestTypes[type].Kind == Test_DSP && !(prog.Inputs[t * 9 + 8] & (1<<27))
+            && (read(1, OutAddr + (t * 9 + 8) * 4) & (1<<27)))
+            qset++;
+    }
+
+    for (u32 i = 0; i < std::size(TestTypes); i++)
+    {
+        std::string desc = std::string(TestTypes[i].Name) + " (" + std::to_string(typetests[i]) + " tests)";
+        check(typetests[i] > 0 && typemismatches[i] == 0, desc.c_str());
+    }
+    check(qset > 0, "the DSP tests saturated at least once");
+
+    // the SPSR and return address of each exception taken
+    u32 exceptionend[2];
+    for (int c = 0; c < 2; c++)
+        exceptionend[c] = read(c, DoneAddr + 4);
+    bool exceptionssame = exceptionend[0] == exceptionend[1] && exceptionend[0] > ExceptionOutAddr
+        && exceptionend[0] <= DoneAddr;
+    for (u32 addr = ExceptionOutAddr; exceptionssame && addr < exceptionend[0]; addr += 4)
+        exceptionssame = read(0, addr) == read(1, addr);
+    std::string desc = "the same " + std::to_string((exceptionend[1] - ExceptionOutAddr) / 8)
+        + " exceptions were taken";
+    check(exceptionssame, desc.c_str());
+
+    if (mismatch >= 0)
+    {
+        u32 t = (u32)mismatch;
+        printf("first mismatch: %08X\n", prog.Encodings[t / VectorsPerEncoding]);
+        printf("  input:      ");
+        for (u32 r = 0; r < 9; r++)
+            printf(" %08X", prog.Inputs[t * 9 + r]);
+        printf("\n");
+        for (int c = 0; c < 2; c++)
+        {
+            printf("  %s:", c ? "interpreter" : "jit        ");
+            for (u32 r = 0; r < 9; r++)
+                printf(" %08X", read(c, OutAddr + (t * 9 + r) * 4));
+            printf("\n");
+        }
+    }
+
+    return finishTests();
+}
@@ -0,0 +1,354 @@
+/*
+    Copyright 2016-2026 melonDS team
+
+    This file is part of melonDS.
+
+    melonDS is free software: you can redistribute it and/or modify it under
+    the terms of the GNU General Public License as published by the Free
+    Software Foundation, either version 3 of the License, or (at your option)
+    any later version.
+
+    melonDS is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+    FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with melonDS. If not, see http://www.gnu.org/licenses/.
+*/
+
+// melonDS-lztest: checks the LZ codec used for compressed ROMs, savestates and movies.
+//
+// Checked are round trips of data that compresses in different ways, that the
+// compressed data keeps to the LZ4 block format (so that other LZ4 decoders can
+// read it), hand-made LZ4 blocks, and that neither side ever writes past the
+// buffer it's given, whether the buffer is too small or the input is malformed.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "TestUtil.h"
+
+#include "types.h"
+#include "LZ.h"
+#include "Platform.h"
+
+using namespace melonDS;
+using namespace melonDS::Platform;
+
+// bytes after each output buffer, which must never be written
+constexpr u32 GuardSize = 64;
+constexpr u8 GuardByte = 0xA5;
+
+static bool guardIntact(const std::vector<u8>& buf, u32 cap)
+{
+    for (u32 i = cap; i < buf.size(); i++)
+    {
+        if (buf[i] != GuardByte)
+            return false;
+    }
+    return true;
+}
+
+static s32 decompressGuarded(const std::vector<u8>& comp, u32 dstcap, std::vector<u8>& out, bool& guardok)
+{
+    out.assign(dstcap + GuardSize, GuardByte);
+    s32 ret = LZ::Decompress(comp.data(), comp.size(), out.data(), dstcap);
+    guardok = guardIntact(out, dstcap);
+    return ret;
+}
+
+static std::vector<u8> compress(const std::vector<u8>& data)
+{
+    std::vector<u8> comp(LZ::CompressBound(data.size()));
+    u32 len = LZ::Compress(data.data(), data.size(), comp.data(), comp.size());
+    comp.resize(len);
+    return comp;
+}
+
+// walks the sequences of an LZ4 block, checking the rules the format sets
+// for the end of a block: the last sequence has only literals, covering at
+// least the last 5 bytes, and no match starts in the last 12 bytes
+static bool followsBlockFormat(const std::vector<u8>& comp, u32 srclen)
+{
+    u32 ip = 0, op = 0;
+    auto readlen = [&](u32 len) -> s64
+    {
+        if (len != 15) return len;
+        u8 b;
+        do
+        {
+            if (ip >= comp.size()) return -1;
+            b = comp[ip++];
+            len += b;
+        }
+        while (b == 255);
+        return len;
+    };
+
+    while (ip < comp.size())
+    {
+        u8 token = comp[ip++];
+        s64 litlen = readlen(token >> 4);
+        if (litlen < 0 || litlen > (s64)(comp.size() - ip)) return false;
+        ip += litlen;
+        op += litlen;
+
+        if (ip == comp.size())
+            return op == srclen && (srclen < 13 || litlen >= 5);
+
+        if (op + 12 > srclen) return false;
+        if (comp.size() - ip < 2) return false;
+        ip += 2;
+        s64 matchlen = readlen(token & 0xF);
+        if (matchlen < 0) return false;
+        op += matchlen + 4;
+        if (op + 5 > srclen) return false;
+    }
+    return false;
+}
+
+static void testRoundTrip(const char* what, const std::vector<u8>& data)
+{
+    std::vector<u8> comp = compress(data);
+    bool ok = !comp.empty() && comp.size() <= LZ::CompressBound(data.size());
+    ok = ok && followsBlockFormat(comp, data.size());
+
+    std::vector<u8> out;
+    bool guardok;
+    s32 len = decompressGuarded(comp, data.size(), out, guardok);
+    ok = ok && guardok && len == (s32)data.size() && std::equal(data.begin(), data.end(), out.begin());
+
+    std::string desc = std::string("round trip: ") + what + " (" + std::to_string(data.size()) + " -> "
+        + std::to_string(comp.size()) + " bytes)";
+    check(ok, desc.c_str());
+}
+
+static void testRoundTrips()
+{
+    std::mt19937 rng(1);
+
+    // the smallest inputs are stored as literals only
+    for (u32 len : {0u, 1u, 4u, 12u, 13u, 16u})
+        testRoundTrip("short", std::vector<u8>(len, 'x'));
+
+    testRoundTrip("zeroes", std::vector<u8>(1 << 20, 0));
+
+    std::vector<u8> noise(300000);
+    for (u8& b : noise) b = rng();
+    testRoundTrip("random bytes", noise);
+
+    // matches shorter than their offset as well as overlapping ones
+    for (u32 period : {1u, 2u, 3u, 7u, 64u, 1000u})
+    {
+        std::vector<u8> data(50000);
+        for (u32 i = 0; i < data.size(); i++)
+            data[i] = (i % period) * 37;
+        std::string desc = "pattern every " + std::to_string(period) + " bytes";
+        testRoundTrip(desc.c_str(), data);
+    }
+
+    // repeats only found further back than a match can reach
+    std::vector<u8> far(200000);
+    for (u32 i = 0; i < far.size(); i++)
+        far[i] = (i < 70000) ? noise[i] : far[i - 70000];
+    testRoundTrip("repeats 70000 bytes apart", far);
+
+    // noise interrupted by runs, giving long literal runs between long matches
+    std::vector<u8> mixed;
+    for (int i = 0; i < 40; i++)
+    {
+        u32 litlen = rng() % 2000;
+        mixed.insert(mixed.end(), noise.begin() + i * 2000, noise.begin() + i * 2000 + litlen);
+        mixed.insert(mixed.end(), rng() % 3000, (u8)i);
+    }
+    testRoundTrip("runs between random bytes", mixed);
+
+    // something closer to the state of a console: words, mostly small
+    std::vector<u8> words(1 << 18);
+    for (u32 i = 0; i < words.size(); i += 4)
+    {
+        u32 val = (rng() % 8) ? (rng() % 256) : rng();
+        memcpy(&words[i], &val, 4);
+    }
+    testRoundTrip("sparse words", words);
+}
+
+static void testKnownBlocks()
+{
+    struct KnownBlock
+    {
+        const char* What;
+        std::vector<u8> Comp;
+        std::string Expected;
+    };
+
+    const KnownBlock blocks[] =
+    {
+        {"only a token", {0x00}, ""},
+        {"literals only", {0x50, 'h', 'e', 'l', 'l', 'o'}, "hello"},
+        // 'a', then a match one byte back five bytes long, then five literals
+        {"overlapping match", {0x11, 'a', 0x01, 0x00, 0x50, 'b', 'b', 'b', 'b', 'b'}, "aaaaaabbbbb"},
+        // 3 literals, a match three back of 4+15+2 bytes, then five literals
+        {"match length byte", {0x3F, 'a', 'b', 'c', 0x03, 0x00, 0x02, 0x50, 'v', 'w', 'x', 'y', 'z'},
+            "abcabcabcabcabcabcabcabcvwxyz"},
+    };
+
+    for (const KnownBlock& block : blocks)
+    {
+        std::vector<u8> out;
+        bool guardok;
+        s32 len = decompressGuarded(block.Comp, 256, out, guardok);
+        bool ok = guardok && len == (s32)block.Expected.size()
+            && !memcmp(out.data(), block.Expected.data(), block.Expected.size());
+        std::string desc = std::string("known block: ") + block.What;
+        check(ok, desc.c_str());
+    }
+
+    // 15 + 255 + 10 literals, with the length spread over two extra bytes
+    std::vector<u8> comp = {0xF0, 255, 10};
+    std::string expected;
+    for (u32 i = 0; i < 15 + 255 + 10; i++)
+        expected += (char)('a' + (i % 26));
+    comp.insert(comp.end(), expected.begin(), expected.end());
+
+    std::vector<u8> out;
+    bool guardok;
+    s32 len = decompressGuarded(comp, 1024, out, guardok);
+    check(guardok && len == (s32)expected.size() && !memcmp(out.data(), expected.data(), expected.size()),
+          "known block: literal length bytes");
+}
+
+static void testSmallBuffers()
+{
+    std::mt19937 rng(2);
+    std::vector<u8> data(20000);
+    for (u32 i = 0; i < data.size(); i++)
+        data[i] = (rng() % 4) ? (i / 100) : rng();
+
+    std::vector<u8> comp = compress(data);
+    if (comp.empty())
+    {
+        check(false, "compressed the data for the small buffer checks");
+        return;
+    }
+
+    // compressing into less space than it needs fails without going past the end
+    bool ok = true;
+    std::vector<u8> out;
+    for (u32 cap = 0; cap < comp.size(); cap += 1 + cap / 16)
+    {
+        out.assign(cap + GuardSize, GuardByte);
+        u32 len = LZ::Compress(data.data(), data.size(), out.data(), cap);
+        ok = ok && len == 0 && guardIntact(out, cap);
+    }
+    out.assign(comp.size() + GuardSize, GuardByte);
+    ok = ok && LZ::Compress(data.data(), data.size(), out.data(), comp.size()) == comp.size()
+        && guardIntact(out, comp.size());
+    check(ok, "compressing fails cleanly when the output doesn't fit");
+
+    // likewise for decompressing
+    ok = true;
+    for (u32 cap = 0; cap < data.size(); cap += 1 + cap / 16)
+    {
+        bool guardok;
+        ok = ok && decompressGuarded(comp, cap, out, guardok) == -1 && guardok;
+    }
+    check(ok, "decompressing fails cleanly when the output doesn't fit");
+}
+
+static void testMalformed()
+{
+    std::vector<u8> out;
+    bool guardok;
+
+    struct BadBlock
+    {
+        const char* What;
+        std::vector<u8> Comp;
+    };
+
+    const BadBlock blocks[] =
+    {
+        {"literals past the end of the input", {0x50, 'a', 'b'}},
+        {"literal length cut off", {0xF0, 255}},
+        {"offset cut off", {0x11, 'a', 0x01}},
+        {"offset of zero", {0x11, 'a', 0x00, 0x00, 0x00}},
+        {"offset before the start of the output", {0x11, 'a', 0x02, 0x00, 0x00}},
+        {"match length cut off", {0x1F, 'a', 0x01, 0x00, 255}},
+    };
+
+    for (const BadBlock& block : blocks)
+    {
+        s32 len = decompressGuarded(block.Comp, 256, out, guardok);
+        std::string desc = std::string("malformed: ") + block.What;
+        check(len == -1 && guardok, desc.c_str());
+    }
+
+    // every cut-off or damaged version of a valid block is either rejected
+    // or decoded without going out of bounds
+    std::mt19937 rng(3);
+    std::vector<u8> data(8000);
+    for (u32 i = 0; i < data.size(); i++)
+        data[i] = (rng() % 8) ? (i / 50) : rng();
+    std::vector<u8> comp = compress(data);
+
+    bool ok = !comp.empty();
+    for (u32 len = 0; len < comp.size() && ok; len++)
+    {
+        std::vector<u8> cut(comp.begin(), comp.begin() + len);
+        s32 ret = decompressGuarded(cut, data.size(), out, guardok);
+        ok = guardok && ret <= (s32)data.size();
+    }
+    check(ok, "malformed: every truncation of a valid block");
+
+    ok = !comp.empty();
+    for (int i = 0; i < 20000 && ok; i++)
+    {
+        std::vector<u8> bad = comp;
+        int numflips = 1 + rng() % 4;
+        for (int n = 0; n < numflips; n++)
+            bad[rng() % bad.size()] ^= 1 << (rng() % 8);
+
+        s32 ret = decompressGuarded(bad, data.size(), out, guardok);
+        ok = guardok && ret <= (s32)data.size();
+    }
+    check(ok, "malformed: bit flips in a valid block");
+
+    ok = true;
+    for (int i = 0; i < 20000 && ok; i++)
+    {
+        std::vector<u8> garbage(rng() % 256);
+        for (u8& b : garbage) b = rng();
+
+        s32 ret = decompressGuarded(garbage, 4096, out, guardok);
+        ok = guardok && ret <= 4096;
+    }
+    check(ok, "malformed: random bytes");
+}
+
+int main(int argc, char** argv)
+{
+    if (argc > 1)
+    {
+        fprintf(stderr,
+            "usage: %s\n"
+            "\n"
+            "Checks the LZ codec: round trips, the LZ4 block format, and bounds\n"
+            "checking with small buffers and malformed input.\n",
+            argv[0]);
+        return (argc == 2 && (!strcmp(argv[1], "-h") || !strcmp(argv[1], "--help"))) ? 0 : 1;
+    }
+
+    testRoundTrips();
+    testKnownBlocks();
+    testSmallBuffers();
+    testMalformed();
+
+    return finishTests();
+}
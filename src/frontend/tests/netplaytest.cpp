@@ -0,0 +1,462 @@
+/*
+    Copyright 2016-2026 melonDS team
+
+    This file is part of melonDS.
+
+    melonDS is free software: you can redistribute it and/or modify it under
+    the terms of the GNU General Public License as published by the Free
+    Software Foundation, either version 3 of the License, or (at your option)
+    any later version.
+
+    melonDS is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+    FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with melonDS. If not, see http://www.gnu.org/licenses/.
+*/
+
+// melonDS-netplaytest: runs a netplay game between two instances in one process,
+// connected over ENet on the loopback interface. Each instance has its own console
+// and thread, and drives Netplay the way the emulator thread does, with scripted
+// input and random delays between frames so that the consoles drift apart and
+// have to roll back. Without a ROM, a small generated one is played.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "TestUtil.h"
+
+#include "types.h"
+#include "Args.h"
+#include "NDS.h"
+#include "NDSCart.h"
+#include "GPU_Soft.h"
+#include "SharedROM.h"
+#include "Rollback.h"
+#include "Netplay.h"
+#include "Platform.h"
+
+using namespace melonDS;
+using namespace melonDS::Platform;
+
+struct TestConfig
+{
+    std::string ROMPath;
+    u32 Frames = 1200;
+    int Port = 8064;
+    int InputDelay = 2;
+    int MaxRollback = 8;
+    u32 JitterMS = 8;
+    u32 TimeoutSecs = 120;
+};
+
+struct Peer
+{
+    const char* Name = nullptr;
+    bool IsHost = false;
+    std::unique_ptr<NDS> Console;
+    Netplay Net;
+
+    // set by the instance's thread, read by the main thread once it's done
+    std::atomic<u32> FramesRun = 0;
+    std::atomic<bool> Failed = false;
+    std::string Error;
+};
+
+static void printUsage(const char* argv0)
+{
+    fprintf(stderr,
+        "usage: %s [options] [rom.nds]\n"
+        "\n"
+        "Runs a netplay game between two instances over ENet on 127.0.0.1\n"
+        "and checks that their consoles stay the same. Without a ROM, a\n"
+        "generated one which mixes the keys held into main RAM is played.\n"
+        "\n"
+        "  --frames N          frames each instance emulates (default 1200)\n"
+        "  --port N            port the host listens on (default 8064)\n"
+        "  --input-delay N     frames of input delay, 1 to 16 (default 2)\n"
+        "  --max-rollback N    most frames rolled back at once (default 8)\n"
+        "  --jitter MS         most time waited between frames (default 8)\n"
+        "  --timeout SECS      give up after this long (default 120)\n"
+        "  --verbose           print core log output to stderr\n",
+        argv0);
+}
+
+static std::unique_ptr<u8[]> loadFile(const std::string& path, u32& len)
+{
+    FileHandle* f = OpenFile(path, FileMode::Read);
+    if (!f) return nullptr;
+
+    u64 filelen = FileLength(f);
+    if (filelen == 0 || filelen > 0x40000000)
+    {
+        CloseFile(f);
+        return nullptr;
+    }
+
+    auto data = std::make_unique<u8[]>(filelen);
+    u64 nread = FileRead(data.get(), filelen, 1, f);
+    CloseFile(f);
+    if (nread != 1) return nullptr;
+
+    len = (u32)filelen;
+    return data;
+}
+
+// ARM9: mixes KEYINPUT into a hash kept in main RAM and stores
+// the hash at an address picked by the keys held
+static const u32 ARM9Code[] =
+{
+    0xE3A06621,     // mov r6, #0x02100000
+    0xE59F7028,     // ldr r7, =0x04000130
+    0xE3A02000,     // mov r2, #0
+                    // loop:
+    0xE1D710B0,     // ldrh r1, [r7]
+    0xE5960000,     // ldr r0, [r6]
+    0xE0200001,     // eor r0, r0, r1
+    0xE0800280,     // add r0, r0, r0, lsl #5
+    0xE0800002,     // add r0, r0, r2
+    0xE5860000,     // str r0, [r6]
+    0xE20130FF,     // and r3, r1, #0xFF
+    0xE7860103,     // str r0, [r6, r3, lsl #2]
+    0xE2822001,     // add r2, r2, #1
+    0xEAFFFFF5,     // b loop
+    0x04000130,
+};
+
+// ARM7: counts in main RAM
+static const u32 ARM7Code[] =
+{
+    0xE3A00000,     // mov r0, #0
+                    // loop:
+    0xE2800001,     // add r0, r0, #1
+    0xE3A01622,     // mov r1, #0x02200000
+    0xE5810000,     // str r0, [r1]
+    0xEAFFFFFB,     // b loop
+};
+
+static std::unique_ptr<NDS> createConsole(const std::string& rompath)
+{
+    // ROMs which can be written to aren't mapped, they're read in instead
+    u32 romlen = 0;
+    std::unique_ptr<NDSCart::CartCommon> cart;
+    if (rompath.empty())
+    {
+        std::vector<u8> rom = makeTestROM("MELONNETPLAY", "AMLN", ARM9Code, sizeof(ARM9Code), ARM7Code, sizeof(ARM7Code));
+        cart = NDSCart::ParseROM(rom.data(), rom.size());
+    }
+    else if (SharedROMData mapped = MapROMFile(rompath, romlen))
+    {
+        cart = NDSCart::ParseROM(std::move(mapped), romlen, nullptr);
+    }
+    else
+    {
+        auto romdata = loadFile(rompath, romlen);
+        if (!romdata)
+        {
+            Log(LogLevel::Error, "Failed to load ROM %s\n", rompath.c_str());
+            return nullptr;
+        }
+
+        cart = NDSCart::ParseROM(std::move(romdata), romlen, nullptr);
+    }
+    if (!cart)
+    {
+        Log(LogLevel::Error, "Failed to parse ROM %s\n", rompath.c_str());
+        return nullptr;
+    }
+
+    NDSArgs args {};
+    args.JIT = std::nullopt;
+
+    auto nds = std::make_unique<NDS>(std::move(args));
+    nds->SetRenderer(std::make_unique<SoftRenderer>(*nds));
+
+    nds->Reset();
+    nds->SetNDSCart(std::move(cart));
+
+    std::string romname = rompath.empty() ? "netplaytest.nds" : rompath.substr(rompath.find_last_of("/\\") + 1);
+    if (nds->NeedsDirectBoot())
+        nds->SetupDirectBoot(romname);
+
+    nds->Start();
+    return nds;
+}
+
+// each player holds a key for a few frames, then moves on to another one,
+// and now and then touches the screen
+static Rollback::Input scriptedInput(int player, u32 frame)
+{
+    u32 seed = ((frame / 12) + 1) * 2654435761u + (player + 1) * 40503u;
+    seed ^= seed >> 15;
+    seed *= 0x85EBCA6B;
+    seed ^= seed >> 13;
+
+    Rollback::Input input = Rollback::NoInput;
+    input.KeyMask = 0xFFF & ~(1 << (seed % 12));
+    if (((seed >> 8) & 3) == 0)
+    {
+        input.Touching = 1;
+        input.TouchX = (seed >> 12) % 256;
+        input.TouchY = (seed >> 20) % 192;
+    }
+    return input;
+}
+
+static bool clientJoined(Netplay& net)
+{
+    for (const Netplay::Player& player : net.GetPlayerList())
+    {
+        if (player.Status == Netplay::Player_Client)
+            return true;
+    }
+    return false;
+}
+
+// what the emulator thread does for every frame of a netplay game
+static void runPeer(Peer& peer, const TestConfig& cfg, std::atomic<bool>& abort)
+{
+    std::mt19937 rng(peer.IsHost ? 1 : 2);
+    int player = peer.IsHost ? 0 : 1;
+    bool started = false;
+
+    while (peer.FramesRun < cfg.Frames && !abort)
+    {
+        peer.Net.Process(*peer.Console);
+
+        if (!peer.Net.IsRunning())
+        {
+            if (started)
+            {
+                peer.Error = "the game stopped early";
+                peer.Failed = true;
+                return;
+            }
+
+            if (peer.IsHost && clientJoined(peer.Net))
+                peer.Net.StartGame();
+
+            Sleep(1000);
+            continue;
+        }
+        started = true;
+
+        u32 nlines = peer.Net.RunFrame(*peer.Console, scriptedInput(player, peer.FramesRun));
+        if (nlines)
+            peer.FramesRun++;
+        else
+            Sleep(500); // waiting for the other instance
+
+        if (cfg.JitterMS)
+            Sleep(rng() % (cfg.JitterMS * 1000));
+    }
+
+    if (peer.FramesRun < cfg.Frames)
+    {
+        peer.Error = "timed out";
+        peer.Failed = true;
+        return;
+    }
+
+    // the other instance may still need what this one has to send
+    while (!abort)
+    {
+        peer.Net.Process(*peer.Console);
+        Sleep(1000);
+    }
+}
+
+static void processBoth(Peer& host, Peer& client, u32 ms)
+{
+    auto end = std::chrono::steady_clock::now() + std::chrono::milliseconds(ms);
+    while (std::chrono::steady_clock::now() < end)
+    {
+        host.Net.Process(*host.Console);
+        client.Net.Process(*client.Console);
+        Sleep(1000);
+    }
+}
+
+static void printPeer(const Peer& peer, Rollback::Stats stats, bool last)
+{
+    printf("  \"%s\": {\n", peer.IsHost ? "host" : "client");
+    printf("    \"frames\": %u,\n", peer.FramesRun.load());
+    printf("    \"rollbacks\": %u,\n", stats.Rollbacks);
+    printf("    \"frames_resimulated\": %u,\n", stats.FramesResimulated);
+    printf("    \"max_depth\": %u,\n", stats.MaxDepth);
+    printf("    \"stalls\": %u,\n", stats.Stalls);
+    printf("    \"desynced\": %s,\n", peer.Net.IsDesynced() ? "true" : "false");
+    if (!peer.Failed)
+        printf("    \"error\": null\n");
+    else
+        printf("    \"error\": \"%s\"\n", peer.Error.c_str());
+    printf("  }%s\n", last ? "" : ",");
+}
+
+static int runTest(const TestConfig& cfg)
+{
+    Peer host, client;
+    host.Name = "Host";
+    host.IsHost = true;
+    client.Name = "Client";
+
+    host.Console = createConsole(cfg.ROMPath);
+    client.Console = createConsole(cfg.ROMPath);
+    if (!host.Console || !client.Console)
+        return 1;
+
+    // the client's console starts out elsewhere, it's the state
+    // sent by the host that makes the two match
+    for (int i = 0; i < 30; i++)
+        client.Console->RunFrame();
+
+    if (!host.Net.StartHost(host.Name, cfg.Port, {cfg.InputDelay, cfg.MaxRollback}))
+    {
+        fprintf(stderr, "Failed to host on port %d\n", cfg.Port);
+        return 1;
+    }
+
+    std::atomic<bool> abort = false;
+    std::thread hostthread([&]() { runPeer(host, cfg, abort); });
+
+    // connecting waits for the host to answer, which it does from its own thread
+    if (!client.Net.StartClient(client.Name, "127.0.0.1", cfg.Port))
+    {
+        fprintf(stderr, "Failed to connect to the host\n");
+        abort = true;
+        hostthread.join();
+        return 1;
+    }
+
+    std::thread clientthread([&]() { runPeer(client, cfg, abort); });
+
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(cfg.TimeoutSecs);
+    while ((host.FramesRun < cfg.Frames || client.FramesRun < cfg.Frames)
+        && !host.Failed && !client.Failed
+        && std::chrono::steady_clock::now() < deadline)
+    {
+        Sleep(10000);
+    }
+    abort = true;
+    hostthread.join();
+    clientthread.join();
+
+    bool ok = !host.Failed && !client.Failed;
+
+    // by now each side has sent its input for the frame after the last one,
+    // so one more frame has both consoles roll back as needed and end up
+    // at the same point with nothing predicted
+    bool match = false;
+    if (ok)
+    {
+        processBoth(host, client, 300);
+
+        u32 hostlines = host.Net.RunFrame(*host.Console, scriptedInput(0, host.FramesRun));
+        u32 clientlines = client.Net.RunFrame(*client.Console, scriptedInput(1, client.FramesRun));
+        if (hostlines && clientlines)
+        {
+            host.FramesRun++;
+            client.FramesRun++;
+            match = Rollback::Checksum(*host.Console) == Rollback::Checksum(*client.Console);
+        }
+
+        // let the last checksums through
+        processBoth(host, client, 300);
+    }
+
+    Rollback::Stats hoststats = host.Net.GetStats();
+    Rollback::Stats clientstats = client.Net.GetStats();
+
+    // resetting a console stops the game on both sides
+    bool stopped = false;
+    if (ok)
+    {
+        host.Net.StopGame();
+        auto end = std::chrono::steady_clock::now() + std::chrono::seconds(2);
+        while (client.Net.IsRunning() && std::chrono::steady_clock::now() < end)
+        {
+            client.Net.Process(*client.Console);
+            Sleep(1000);
+        }
+        stopped = !host.Net.IsRunning() && !client.Net.IsRunning();
+    }
+
+    client.Net.EndSession();
+    host.Net.EndSession();
+
+    bool desynced = host.Net.IsDesynced() || client.Net.IsDesynced();
+    bool pass = ok && match && stopped && !desynced;
+
+    printf("{\n");
+    printf("  \"frames\": %u,\n", cfg.Frames);
+    printf("  \"input_delay\": %d,\n", cfg.InputDelay);
+    printf("  \"max_rollback\": %d,\n", cfg.MaxRollback);
+    printf("  \"jitter_ms\": %u,\n", cfg.JitterMS);
+    printPeer(host, hoststats, false);
+    printPeer(client, clientstats, false);
+    printf("  \"final_state_matches\": %s,\n", match ? "true" : "false");
+    printf("  \"stop_reached_client\": %s,\n", stopped ? "true" : "false");
+    printf("  \"passed\": %s\n", pass ? "true" : "false");
+    printf("}\n");
+
+    return pass ? 0 : 1;
+}
+
+int main(int argc, char** argv)
+{
+    TestConfig cfg;
+
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        bool hasval = (i+1) < argc;
+
+        if (arg == "--frames" && hasval)
+            cfg.Frames = strtoul(argv[++i], nullptr, 0);
+        else if (arg == "--port" && hasval)
+            cfg.Port = atoi(argv[++i]);
+        else if (arg == "--input-delay" && hasval)
+            cfg.InputDelay = atoi(argv[++i]);
+        else if (arg == "--max-rollback" && hasval)
+            cfg.MaxRollback = atoi(argv[++i]);
+        else if (arg == "--jitter" && hasval)
+            cfg.JitterMS = strtoul(argv[++i], nullptr, 0);
+        else if (arg == "--timeout" && hasval)
+            cfg.TimeoutSecs = strtoul(argv[++i], nullptr, 0);
+        else if (arg == "--verbose")
+            minLogLevel = LogLevel::Debug;
+        else if (arg == "-h" || arg == "--help")
+        {
+            printUsage(argv[0]);
+            return 0;
+        }
+        else if (arg[0] != '-' && cfg.ROMPath.empty())
+            cfg.ROMPath = arg;
+        else
+        {
+            printUsage(argv[0]);
+            return 1;
+        }
+    }
+
+    // the final comparison needs the input of the frame after the last one
+    if (cfg.Frames == 0
+        || cfg.InputDelay < 1 || cfg.InputDelay > Rollback::MaxInputDelay
+        || cfg.MaxRollback < 1 || cfg.MaxRollback > Rollback::MaxFrames)
+    {
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    return runTest(cfg);
+}
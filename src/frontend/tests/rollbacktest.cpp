@@ -0,0 +1,509 @@
+/*
+    Copyright 2016-2026 melonDS team
+
+    This file is part of melonDS.
+
+    melonDS is free software: you can redistribute it and/or modify it under
+    the terms of the GNU General Public License as published by the Free
+    Software Foundation, either version 3 of the License, or (at your option)
+    any later version.
+
+    melonDS is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+    FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with melonDS. If not, see http://www.gnu.org/licenses/.
+*/
+
+// melonDS-rollbacktest: runs two Rollback sessions against each other in one thread,
+// over an in-memory link that delays what goes through it like a network would.
+// It needs neither a network library nor a ROM: the consoles run a tiny generated
+// game whose memory depends on every key pressed, so that any input applied to the
+// wrong frame shows up in the state.
+//
+// Checked are the start state handshake (state transfer, other game, other header
+// CRC, malformed data), a game with changes of input delay on both sides whose final
+// state has to match a console fed the same input without any rollback, and the
+// detection of consoles that diverge.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <deque>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "TestUtil.h"
+
+#include "types.h"
+#include "NDS.h"
+#include "Rollback.h"
+#include "Platform.h"
+
+using namespace melonDS;
+using namespace melonDS::Platform;
+
+struct TestConfig
+{
+    u32 Frames = 900;
+    u32 MaxLatency = 6;
+    u32 Seed = 1;
+};
+
+// ARM9: mixes KEYINPUT into a hash kept in main RAM and stores
+// the hash at an address picked by the keys held
+static const u32 ARM9Code[] =
+{
+    0xE3A06621,     // mov r6, #0x02100000
+    0xE59F7028,     // ldr r7, =0x04000130
+    0xE3A02000,     // mov r2, #0
+                    // loop:
+    0xE1D710B0,     // ldrh r1, [r7]
+    0xE5960000,     // ldr r0, [r6]
+    0xE0200001,     // eor r0, r0, r1
+    0xE0800280,     // add r0, r0, r0, lsl #5
+    0xE0800002,     // add r0, r0, r2
+    0xE5860000,     // str r0, [r6]
+    0xE20130FF,     // and r3, r1, #0xFF
+    0xE7860103,     // str r0, [r6, r3, lsl #2]
+    0xE2822001,     // add r2, r2, #1
+    0xEAFFFFF5,     // b loop
+    0x04000130,
+};
+
+// ARM7: counts in main RAM
+static const u32 ARM7Code[] =
+{
+    0xE3A00000,     // mov r0, #0
+                    // loop:
+    0xE2800001,     // add r0, r0, #1
+    0xE3A01622,     // mov r1, #0x02200000
+    0xE5810000,     // str r0, [r1]
+    0xEAFFFFFB,     // b loop
+};
+
+static std::vector<u8> makeROM(const char* title, const char* gamecode)
+{
+    return makeTestROM(title, gamecode, ARM9Code, sizeof(ARM9Code), ARM7Code, sizeof(ARM7Code));
+}
+
+static std::unique_ptr<NDS> createConsole(const std::vector<u8>& rom)
+{
+    return createTestConsole(rom, "rollbacktest.nds");
+}
+
+// each player holds a key for a few frames, then moves on to another one,
+// and now and then touches the screen
+static Rollback::Input scriptedInput(int player, u32 frame)
+{
+    u32 seed = ((frame / 12) + 1) * 2654435761u + (player + 1) * 40503u;
+    seed ^= seed >> 15;
+    seed *= 0x85EBCA6B;
+    seed ^= seed >> 13;
+
+    Rollback::Input input = Rollback::NoInput;
+    input.KeyMask = 0xFFF & ~(1 << (seed % 12));
+    if (((seed >> 8) & 3) == 0)
+    {
+        input.Touching = 1;
+        input.TouchX = (seed >> 12) % 256;
+        input.TouchY = (seed >> 20) % 192;
+    }
+    return input;
+}
+
+// one direction of the link: what's sent arrives in order, some ticks later
+struct Link
+{
+    struct Message
+    {
+        u32 ArrivesAt;
+        bool IsChecksum;
+        u32 Frame;
+        Rollback::Input Input;
+        u64 Checksum;
+    };
+
+    std::deque<Message> Queue;
+    u32 LastArrival = 0;
+};
+
+struct Peer
+{
+    int Player = 0;
+    std::unique_ptr<NDS> Console;
+    std::unique_ptr<Rollback> Session;
+
+    // every input this peer sent, indexed by frame
+    std::vector<Rollback::Input> SentInputs;
+};
+
+static void sendAll(Peer& peer, Link& link, u32 now, u32 latency)
+{
+    u32 arrival = std::max(link.LastArrival, now + latency);
+    link.LastArrival = arrival;
+
+    Link::Message msg = {};
+    msg.ArrivesAt = arrival;
+    while (peer.Session->PopLocalInput(msg.Frame, msg.Input))
+    {
+        if (peer.SentInputs.size() <= msg.Frame)
+            peer.SentInputs.resize(msg.Frame + 1, Rollback::NoInput);
+        peer.SentInputs[msg.Frame] = msg.Input;
+
+        msg.IsChecksum = false;
+        link.Queue.push_back(msg);
+    }
+    while (peer.Session->PopLocalChecksum(msg.Frame, msg.Checksum))
+    {
+        msg.IsChecksum = true;
+        link.Queue.push_back(msg);
+    }
+}
+
+static bool receive(Peer& peer, int from, Link& link, u32 now)
+{
+    while (!link.Queue.empty() && link.Queue.front().ArrivesAt <= now)
+    {
+        const Link::Message& msg = link.Queue.front();
+        if (msg.IsChecksum)
+            peer.Session->AddRemoteChecksum(msg.Frame, msg.Checksum);
+        else if (!peer.Session->AddRemoteInput(from, msg.Frame, msg.Input))
+        {
+            fprintf(stderr, "player %d rejected input for frame %u\n", peer.Player, msg.Frame);
+            return false;
+        }
+        link.Queue.pop_front();
+    }
+    return true;
+}
+
+// the host saves the start state, the client starts from it
+static bool startSession(Peer& host, Peer& client, int inputdelay, int maxframes, u32 checksuminterval)
+{
+    std::vector<u8> startstate;
+    if (!Rollback::SaveStartState(*host.Console, inputdelay, maxframes, startstate))
+        return false;
+
+    int clientdelay = -1, clientmaxframes = -1;
+    if (Rollback::LoadStartState(*client.Console, startstate.data(), startstate.size(),
+                                 clientdelay, clientmaxframes) != Rollback::Start_OK)
+        return false;
+    if (clientdelay != inputdelay || clientmaxframes != maxframes)
+        return false;
+
+    host.Player = 0;
+    client.Player = 1;
+    host.Session = std::make_unique<Rollback>(*host.Console, 0, 2, inputdelay, maxframes, checksuminterval);
+    client.Session = std::make_unique<Rollback>(*client.Console, 1, 2, clientdelay, clientmaxframes, checksuminterval);
+    host.SentInputs.clear();
+    client.SentInputs.clear();
+    return true;
+}
+
+static void testStartState(const std::vector<u8>& rom)
+{
+    auto host = createConsole(rom);
+    auto client = createConsole(rom);
+    if (!host || !client)
+    {
+        check(false, "consoles created");
+        return;
+    }
+
+    // the consoles start out at different points
+    for (int i = 0; i < 20; i++)
+        host->RunFrame();
+    for (int i = 0; i < 45; i++)
+        client->RunFrame();
+
+    std::vector<u8> startstate;
+    check(Rollback::SaveStartState(*host, 3, 7, startstate), "start state saved");
+
+    // neither a wrong game nor malformed data may touch the console
+    u64 before = Rollback::Checksum(*client);
+    int inputdelay = -1, maxframes = -1;
+
+    std::vector<u8> truncated(startstate.begin(), startstate.end() - 1);
+    check(Rollback::LoadStartState(*client, truncated.data(), truncated.size(), inputdelay, maxframes) == Rollback::Start_Malformed,
+          "truncated start state rejected");
+    check(Rollback::LoadStartState(*client, startstate.data(), 4, inputdelay, maxframes) == Rollback::Start_Malformed,
+          "start state without a header rejected");
+
+    std::vector<u8> baddelay = startstate;
+    baddelay[6] = Rollback::MaxInputDelay + 1;
+    check(Rollback::LoadStartState(*client, baddelay.data(), baddelay.size(), inputdelay, maxframes) == Rollback::Start_Malformed,
+          "start state with an out of range input delay rejected");
+
+    auto othergame = createConsole(makeROM("MELONROLLBK", "AMLD"));
+    auto othercrc = createConsole(makeROM("MELONROLLBX", "AMLR"));
+    if (othergame && othercrc)
+    {
+        u64 othergamebefore = Rollback::Checksum(*othergame);
+        check(Rollback::LoadStartState(*othergame, startstate.data(), startstate.size(), inputdelay, maxframes) == Rollback::Start_WrongGame
+              && Rollback::Checksum(*othergame) == othergamebefore,
+              "start state from another game code rejected");
+
+        u64 othercrcbefore = Rollback::Checksum(*othercrc);
+        check(Rollback::LoadStartState(*othercrc, startstate.data(), startstate.size(), inputdelay, maxframes) == Rollback::Start_WrongGame
+              && Rollback::Checksum(*othercrc) == othercrcbefore,
+              "start state from another header CRC rejected");
+    }
+    else
+        check(false, "consoles with other games created");
+
+    check(inputdelay == -1 && maxframes == -1 && Rollback::Checksum(*client) == before,
+          "rejected start states leave the console alone");
+
+    check(Rollback::LoadStartState(*client, startstate.data(), startstate.size(), inputdelay, maxframes) == Rollback::Start_OK
+          && inputdelay == 3 && maxframes == 7,
+          "start state loaded with the host's settings");
+    check(Rollback::Checksum(*client) == Rollback::Checksum(*host), "start state matches the host's console");
+
+    // both consoles have to go on the same way from there
+    for (int i = 0; i < 30; i++)
+    {
+        host->RunFrame();
+        client->RunFrame();
+    }
+    check(Rollback::Checksum(*client) == Rollback::Checksum(*host), "consoles stay the same after the start state");
+}
+
+static void testGame(const std::vector<u8>& rom, const TestConfig& cfg)
+{
+    Peer host, client;
+    host.Console = createConsole(rom);
+    client.Console = createConsole(rom);
+    auto reference = createConsole(rom);
+    if (!host.Console || !client.Console || !reference)
+    {
+        check(false, "consoles created");
+        return;
+    }
+
+    for (int i = 0; i < 10; i++)
+        host.Console->RunFrame();
+
+    // the reference console starts from the same state as the others,
+    // and gets the same silence on its mic
+    reference->Mic.SetMuted(true);
+    std::vector<u8> startstate;
+    int refdelay, refmaxframes;
+    if (!Rollback::SaveStartState(*host.Console, 2, 8, startstate)
+        || Rollback::LoadStartState(*reference, startstate.data(), startstate.size(), refdelay, refmaxframes) != Rollback::Start_OK
+        || !startSession(host, client, 2, 8, 30))
+    {
+        check(false, "game started");
+        return;
+    }
+
+    // the delay grows and shrinks on both sides, at different times
+    struct DelayChange
+    {
+        Peer* Who;
+        u32 Frame;
+        int Delay;
+    };
+    const DelayChange changes[] =
+    {
+        {&host, cfg.Frames * 2 / 9, 6},
+        {&client, cfg.Frames * 3 / 9, 0},
+        {&host, cfg.Frames * 5 / 9, 1},
+        {&client, cfg.Frames * 6 / 9, 9},
+        {&client, cfg.Frames * 8 / 9, 3},
+    };
+
+    std::mt19937 rng(cfg.Seed);
+    Link tohost, toclient;
+    Peer* peers[2] = {&host, &client};
+    Link* outgoing[2] = {&toclient, &tohost};
+    Link* incoming[2] = {&tohost, &toclient};
+    u32 frames[2] = {0, 0};
+    bool ok = true;
+
+    // each tick, each side runs up to two frames, so that one gets ahead of the other
+    u32 maxticks = cfg.Frames * 8;
+    for (u32 now = 0; now < maxticks && ok && (frames[0] < cfg.Frames || frames[1] < cfg.Frames); now++)
+    {
+        for (int i = 0; i < 2 && ok; i++)
+        {
+            Peer& peer = *peers[i];
+            ok = receive(peer, peer.Player ^ 1, *incoming[i], now);
+
+            int torun = rng() % 3;
+            for (int n = 0; n < torun && frames[i] < cfg.Frames; n++)
+            {
+                for (const DelayChange& change : changes)
+                {
+                    if (change.Who == &peer && change.Frame == frames[i])
+                        peer.Session->SetInputDelay(change.Delay);
+                }
+
+                if (!peer.Session->RunFrame(scriptedInput(peer.Player, frames[i])))
+                    break; // waiting for the other side
+                frames[i]++;
+            }
+
+            sendAll(peer, *outgoing[i], now, cfg.MaxLatency ? (rng() % (cfg.MaxLatency + 1)) : 0);
+        }
+    }
+    check(ok && frames[0] == cfg.Frames && frames[1] == cfg.Frames, "both sides ran every frame");
+    if (!ok || frames[0] != cfg.Frames || frames[1] != cfg.Frames)
+        return;
+
+    // with everything delivered, one more frame has both sides roll back as needed
+    // and end up at the same point with nothing predicted
+    for (int i = 0; i < 2; i++)
+        ok = ok && receive(*peers[i], peers[i]->Player ^ 1, *incoming[i], 0xFFFFFFFF);
+    for (int i = 0; i < 2; i++)
+    {
+        ok = ok && peers[i]->Session->RunFrame(scriptedInput(peers[i]->Player, frames[i]));
+        sendAll(*peers[i], *outgoing[i], 0, 0);
+    }
+    for (int i = 0; i < 2; i++)
+        ok = ok && receive(*peers[i], peers[i]->Player ^ 1, *incoming[i], 0xFFFFFFFF);
+    check(ok, "final frame run with all input known");
+
+    u64 hostsum = Rollback::Checksum(*host.Console);
+    u64 clientsum = Rollback::Checksum(*client.Console);
+    check(hostsum == clientsum, "both consoles end up the same");
+
+    // the reference console gets each frame's input right away, the players sharing
+    // the console the way Rollback does it: a key is down if any of them holds it,
+    // the touchscreen goes to the first one touching it
+    u32 numframes = cfg.Frames + 1;
+    for (u32 f = 0; f < numframes; f++)
+    {
+        Rollback::Input inputs[2];
+        for (int i = 0; i < 2; i++)
+        {
+            const std::vector<Rollback::Input>& sent = peers[i]->SentInputs;
+            inputs[i] = (f < sent.size()) ? sent[f] : Rollback::NoInput;
+        }
+
+        reference->SetKeyMask(inputs[0].KeyMask & inputs[1].KeyMask);
+        if (inputs[0].Touching)
+            reference->TouchScreen(inputs[0].TouchX, inputs[0].TouchY);
+        else if (inputs[1].Touching)
+            reference->TouchScreen(inputs[1].TouchX, inputs[1].TouchY);
+        else
+            reference->ReleaseScreen();
+        reference->RunFrame();
+    }
+    check(Rollback::Checksum(*reference) == hostsum, "consoles match one run without rollback");
+
+    bool delaysapplied = host.Session->GetInputDelay() == 1 && client.Session->GetInputDelay() == 3;
+    check(delaysapplied, "input delay changed on both sides");
+    check(!host.Session->IsDesynced() && !client.Session->IsDesynced(), "no desync reported");
+
+    const Rollback::Stats& hoststats = host.Session->GetStats();
+    const Rollback::Stats& clientstats = client.Session->GetStats();
+    check(hoststats.Rollbacks > 0 && clientstats.Rollbacks > 0, "both sides rolled back");
+
+    printf("  host: %u rollbacks, %u frames resimulated, max depth %u, %u stalls\n",
+           hoststats.Rollbacks, hoststats.FramesResimulated, hoststats.MaxDepth, hoststats.Stalls);
+    printf("  client: %u rollbacks, %u frames resimulated, max depth %u, %u stalls\n",
+           clientstats.Rollbacks, clientstats.FramesResimulated, clientstats.MaxDepth, clientstats.Stalls);
+}
+
+static void testDesync(const std::vector<u8>& rom)
+{
+    Peer host, client;
+    host.Console = createConsole(rom);
+    client.Console = createConsole(rom);
+    if (!host.Console || !client.Console || !startSession(host, client, 2, 8, 20))
+    {
+        check(false, "game started");
+        return;
+    }
+
+    // the sides take turns and everything arrives right away, so nothing
+    // is rolled back past the frame the client's console is changed at
+    const u32 corruptframe = 70;
+    const u32 numframes = 200;
+    Link tohost, toclient;
+    bool ok = true;
+    for (u32 f = 0; f < numframes && ok; f++)
+    {
+        ok = host.Session->RunFrame(scriptedInput(0, f)) != 0;
+        sendAll(host, toclient, 0, 0);
+        ok = ok && receive(client, 0, toclient, 0);
+
+        if (f == corruptframe)
+            client.Console->MainRAM[0x300000] ^= 0x5A;
+
+        ok = ok && client.Session->RunFrame(scriptedInput(1, f)) != 0;
+        sendAll(client, tohost, 0, 0);
+        ok = ok && receive(host, 1, tohost, 0);
+    }
+    check(ok, "both sides ran every frame");
+
+    check(host.Session->IsDesynced() && client.Session->IsDesynced(), "desync reported on both sides");
+    check(host.Session->GetDesyncFrame() > corruptframe && host.Session->GetDesyncFrame() <= corruptframe + 20
+          && client.Session->GetDesyncFrame() == host.Session->GetDesyncFrame(),
+          "desync reported at the first checksum after it");
+}
+
+static void printUsage(const char* argv0)
+{
+    fprintf(stderr,
+        "usage: %s [options]\n"
+        "\n"
+        "Runs two rollback sessions against each other over an in-memory link\n"
+        "and checks that their consoles stay the same.\n"
+        "\n"
+        "  --frames N          frames each side emulates (default 900)\n"
+        "  --latency N         most ticks input takes to arrive (default 6)\n"
+        "  --seed N            seed for the frame pacing and latency (default 1)\n"
+        "  --verbose           print core log output to stderr\n",
+        argv0);
+}
+
+int main(int argc, char** argv)
+{
+    TestConfig cfg;
+
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        bool hasval = (i+1) < argc;
+
+        if (arg == "--frames" && hasval)
+            cfg.Frames = strtoul(argv[++i], nullptr, 0);
+        else if (arg == "--latency" && hasval)
+            cfg.MaxLatency = strtoul(argv[++i], nullptr, 0);
+        else if (arg == "--seed" && hasval)
+            cfg.Seed = strtoul(argv[++i], nullptr, 0);
+        else if (arg == "--verbose")
+            minLogLevel = LogLevel::Debug;
+        else if (arg == "-h" || arg == "--help")
+        {
+            printUsage(argv[0]);
+            return 0;
+        }
+        else
+        {
+            printUsage(argv[0]);
+            return 1;
+        }
+    }
+
+    // the delay changes need some room between them
+    if (cfg.Frames < 90)
+    {
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    std::vector<u8> rom = makeROM("MELONROLLBK", "AMLR");
+
+    testStartState(rom);
+    testGame(rom, cfg);
+    testDesync(rom);
+
+    return finishTests();
+}
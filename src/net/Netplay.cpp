@@ -17,1072 +17,757 @@
 */
 
 #include <stdio.h>
-#include <stdlib.h>
 #include <string.h>
-#include <queue>
-
-#include <enet/enet.h>
 
 #include "NDS.h"
-#include "NDSCart.h"
-//#include "IPC.h"
 #include "Netplay.h"
-//#include "Input.h"
-//#include "ROMManager.h"
-//#include "Config.h"
-#include "Savestate.h"
-#include "Platform.h"
 
-using namespace melonDS;
 
-namespace Netplay
+namespace melonDS
 {
+using Platform::Log;
+using Platform::LogLevel;
 
-bool Active;
-bool IsHost;
-bool IsMirror;
-
-ENetHost* Host;
-ENetHost* MirrorHost;
-
-Player Players[16];
-int NumPlayers;
+const u32 kNetplayMagic = 0x504C504E; // NPLP
+const u32 kProtocolVersion = 1;
 
-Player MyPlayer;
-u32 HostAddress;
-bool Lag;
+const u32 kLocalhost = 0x0100007F;
 
-int NumMirrorClients;
-
-struct InputFrame
+// everything goes over the one channel, so that input can't overtake
+// the state the game starts from
+enum
 {
-    u32 FrameNum;
-    u32 KeyMask;
-    u32 Touching;
-    u32 TouchX, TouchY;
+    Chan_Cmd = 0,
 };
 
-std::queue<InputFrame> InputQueue;
-
 enum
 {
-    Blob_CartROM = 0,
-    Blob_CartSRAM,
-    Blob_InitState,
-
-    Blob_MAX
+    Cmd_ClientInit = 1,     // 01 -- host->client -- init new client and assign ID
+    Cmd_PlayerInfo,         // 02 -- client->host -- send client player info to host
+    Cmd_PlayerList,         // 03 -- host->client -- broadcast updated player list
+    Cmd_StartGame,          // 04 -- host->client -- start the game from the given state
+    Cmd_StopGame,           // 05 -- both -- the game can't go on
+    Cmd_Input,              // 06 -- both -- input for the frames following the last ones sent
+    Cmd_Checksum,           // 07 -- both -- console state checksum of a frame
 };
 
-const u32 kChunkSize = 0x10000;
-u8 ChunkBuffer[0x10 + kChunkSize];
-u8* Blobs[Blob_MAX];
-u32 BlobLens[Blob_MAX];
-int CurBlobType;
-u32 CurBlobLen;
+// most input frames sent at once, ie. after a stall
+const int kMaxInputBatch = 32;
 
 
-bool Init()
+Netplay::Netplay() noexcept : Inited(false)
 {
+    PlayersMutex = Platform::Mutex_Create();
+    SessionMutex = Platform::Mutex_Create();
+
     Active = false;
-    IsHost = false;
-    IsMirror = false;
+    IsHostSession = false;
+    Running = false;
+    Desynced = false;
+    StartRequested = false;
+
     Host = nullptr;
-    MirrorHost = nullptr;
-    Lag = false;
+    RemotePeer = nullptr;
 
     memset(Players, 0, sizeof(Players));
     NumPlayers = 0;
+    memset(&MyPlayer, 0, sizeof(MyPlayer));
+    SessionSettings = {2, 8};
 
-    NumMirrorClients = 0;
-
-    for (int i = 0; i < Blob_MAX; i++)
+    if (enet_initialize() != 0)
     {
-        Blobs[i] = nullptr;
-        BlobLens[i] = 0;
+        Log(LogLevel::Error, "Netplay: failed to initialize enet\n");
+        return;
     }
-    CurBlobType = -1;
-    CurBlobLen = 0;
 
-    /*if (enet_initialize() != 0)
+    Inited = true;
+}
+
+Netplay::~Netplay() noexcept
+{
+    EndSession();
+
+    if (Inited)
+        enet_deinitialize();
+    Inited = false;
+
+    Platform::Mutex_Free(PlayersMutex);
+    Platform::Mutex_Free(SessionMutex);
+}
+
+
+std::vector<Netplay::Player> Netplay::GetPlayerList()
+{
+    Platform::Mutex_Lock(PlayersMutex);
+
+    std::vector<Player> ret;
+    for (int i = 0; i < Rollback::MaxPlayers; i++)
     {
-        printf("enet shat itself :(\n");
-        return false;
+        if (Players[i].Status == Player_None) continue;
+
+        // make a copy of the player entry, fix up the address field
+        Player newp = Players[i];
+        if (newp.ID == MyPlayer.ID)
+        {
+            newp.IsLocalPlayer = true;
+            newp.Address = kLocalhost;
+        }
+        else
+        {
+            newp.IsLocalPlayer = false;
+            if (RemotePeer)
+                newp.Ping = RemotePeer->roundTripTime;
+        }
+
+        ret.push_back(newp);
     }
 
-    printf("enet init OK\n");*/
-    return true;
+    Platform::Mutex_Unlock(PlayersMutex);
+    return ret;
 }
 
-void DeInit()
+Rollback::Stats Netplay::GetStats()
 {
-    // TODO: cleanup resources properly!!
+    Rollback::Stats ret = {};
+
+    Platform::Mutex_Lock(SessionMutex);
+    if (Session)
+        ret = Session->GetStats();
+    Platform::Mutex_Unlock(SessionMutex);
 
-    //enet_deinitialize();
+    return ret;
 }
 
 
-void StartHost(const char* playername, int port)
+bool Netplay::StartHost(const char* playername, int port, const Settings& settings)
 {
+    if (!Inited || Active) return false;
+
     ENetAddress addr;
     addr.host = ENET_HOST_ANY;
     addr.port = port;
 
-    Host = enet_host_create(&addr, 16, 1, 0, 0);
+    Host = enet_host_create(&addr, Rollback::MaxPlayers - 1, 1, 0, 0);
     if (!Host)
     {
-        printf("host shat itself :(\n");
-        return;
+        Log(LogLevel::Error, "Netplay: failed to listen on port %d\n", port);
+        return false;
     }
 
+    Platform::Mutex_Lock(PlayersMutex);
+
+    memset(Players, 0, sizeof(Players));
     Player* player = &Players[0];
-    memset(player, 0, sizeof(Player));
     player->ID = 0;
     strncpy(player->Name, playername, 31);
-    player->Status = 2;
-    player->Address = 0x0100007F;
+    player->Status = Player_Host;
+    player->Address = kLocalhost;
     NumPlayers = 1;
     memcpy(&MyPlayer, player, sizeof(Player));
 
-    HostAddress = 0x0100007F;
-
-    NumMirrorClients = 0;
+    Platform::Mutex_Unlock(PlayersMutex);
 
-    ENetAddress mirroraddr;
-    mirroraddr.host = ENET_HOST_ANY;
-    mirroraddr.port = port + 1;
-printf("host mirror host connecting to %08X:%d\n", mirroraddr.host, mirroraddr.port);
-    MirrorHost = enet_host_create(&mirroraddr, 16, 2, 0, 0);
-    if (!MirrorHost)
-    {
-        printf("mirror host shat itself :(\n");
-        return;
-    }
+    SessionSettings = settings;
+    RemotePeer = nullptr;
 
+    IsHostSession = true;
     Active = true;
-    IsHost = true;
-    IsMirror = false;
-
-    //netplayDlg->updatePlayerList(Players, NumPlayers);
+    return true;
 }
 
-void StartClient(const char* playername, const char* host, int port)
+bool Netplay::StartClient(const char* playername, const char* host, int port)
 {
+    if (!Inited || Active) return false;
+
     Host = enet_host_create(nullptr, 1, 1, 0, 0);
     if (!Host)
     {
-        printf("client shat itself :(\n");
-        return;
+        return false;
     }
 
-    printf("client created, connecting (%s, %s:%d)\n", playername, host, port);
-
     ENetAddress addr;
     enet_address_set_host(&addr, host);
     addr.port = port;
     ENetPeer* peer = enet_host_connect(Host, &addr, 1, 0);
     if (!peer)
     {
-        printf("connect shat itself :(\n");
-        return;
+        enet_host_destroy(Host);
+        Host = nullptr;
+        return false;
     }
 
+    Platform::Mutex_Lock(PlayersMutex);
+
+    memset(Players, 0, sizeof(Players));
+    Player* player = &MyPlayer;
+    memset(player, 0, sizeof(Player));
+    strncpy(player->Name, playername, 31);
+    player->Status = Player_Connecting;
+
+    Platform::Mutex_Unlock(PlayersMutex);
+
     ENetEvent event;
-    bool conn = false;
-    if (enet_host_service(Host, &event, 5000) > 0)
-    {
-        if (event.type == ENET_EVENT_TYPE_CONNECT)
+    int conn = 0;
+    u32 starttick = (u32)Platform::GetMSCount();
+    const int conntimeout = 5000;
+    for (;;)
+    {
+        u32 curtick = (u32)Platform::GetMSCount();
+        if (curtick < starttick) break;
+        int timeout = conntimeout - (int)(curtick - starttick);
+        if (timeout < 0) break;
+        if (enet_host_service(Host, &event, timeout) > 0)
         {
-            printf("connected!\n");
-            conn = true;
+            if (conn == 0 && event.type == ENET_EVENT_TYPE_CONNECT)
+            {
+                conn = 1;
+            }
+            else if (conn == 1 && event.type == ENET_EVENT_TYPE_RECEIVE)
+            {
+                u8* data = event.packet->data;
+                bool valid = (event.packet->dataLength == 10) && (data[0] == Cmd_ClientInit);
+                if (valid)
+                {
+                    u32 magic, version;
+                    memcpy(&magic, &data[1], 4);
+                    memcpy(&version, &data[5], 4);
+                    valid = (magic == kNetplayMagic) && (version == kProtocolVersion)
+                        && (data[9] < Rollback::MaxPlayers);
+                }
+
+                if (valid)
+                {
+                    // send player information
+                    MyPlayer.ID = data[9];
+                    u8 cmd[9+sizeof(Player)];
+                    cmd[0] = Cmd_PlayerInfo;
+                    memcpy(&cmd[1], &kNetplayMagic, 4);
+                    memcpy(&cmd[5], &kProtocolVersion, 4);
+                    memcpy(&cmd[9], &MyPlayer, sizeof(Player));
+                    ENetPacket* pkt = enet_packet_create(cmd, 9+sizeof(Player), ENET_PACKET_FLAG_RELIABLE);
+                    enet_peer_send(event.peer, Chan_Cmd, pkt);
+
+                    conn = 2;
+                }
+
+                enet_packet_destroy(event.packet);
+                if (conn == 2) break;
+            }
+            else if (event.type == ENET_EVENT_TYPE_DISCONNECT)
+            {
+                conn = 0;
+                break;
+            }
         }
+        else
+            break;
     }
 
-    if (!conn)
+    if (conn != 2)
     {
-        printf("connection failed\n");
+        Log(LogLevel::Error, "Netplay: failed to connect to %s:%d\n", host, port);
         enet_peer_reset(peer);
-        return;
+        enet_host_destroy(Host);
+        Host = nullptr;
+        return false;
     }
 
-    Player* player = &MyPlayer;
-    memset(player, 0, sizeof(Player));
-    player->ID = 0;
-    strncpy(player->Name, playername, 31);
-    player->Status = 3;
-
-    HostAddress = addr.host;
+    RemotePeer = peer;
 
+    IsHostSession = false;
     Active = true;
-    IsHost = false;
-    IsMirror = false;
+    return true;
 }
 
-void StartMirror(const Player* player)
+void Netplay::EndSession()
 {
-    for (int i = 0; i < Blob_MAX; i++)
-    {
-        Blobs[i] = nullptr;
-        BlobLens[i] = 0;
-    }
-    CurBlobType = -1;
-    CurBlobLen = 0;
+    if (!Active) return;
 
-    MirrorHost = enet_host_create(nullptr, 1, 2, 0, 0);
-    if (!MirrorHost)
-    {
-        printf("mirror shat itself :(\n");
-        return;
-    }
+    Platform::Mutex_Lock(SessionMutex);
 
-    printf("mirror created, connecting\n");
-
-    ENetAddress addr;
-    addr.host = player->Address;
-    addr.port = 8064+1 + player->ID; // FIXME!!!!!!!!!!
-    printf("mirror client connecting to %08X:%d\n", addr.host, addr.port);
-    ENetPeer* peer = enet_host_connect(MirrorHost, &addr, 2, 0);
-    if (!peer)
-    {
-        printf("connect shat itself :(\n");
-        return;
-    }
-
-    ENetEvent event;
-    bool conn = false;
-    if (enet_host_service(MirrorHost, &event, 5000) > 0)
-    {
-        if (event.type == ENET_EVENT_TYPE_CONNECT)
-        {
-            printf("connected!\n");
-            conn = true;
-        }
-    }
+    Active = false;
+    StartRequested = false;
+    EndGame();
 
-    if (!conn)
+    if (RemotePeer)
     {
-        printf("connection failed\n");
-        enet_peer_reset(peer);
-        return;
+        enet_peer_disconnect(RemotePeer, 0);
+        enet_host_flush(Host);
+        RemotePeer = nullptr;
     }
 
-    memcpy(&MyPlayer, player, sizeof(Player));
+    enet_host_destroy(Host);
+    Host = nullptr;
+    IsHostSession = false;
 
-    HostAddress = addr.host;
+    Platform::Mutex_Lock(PlayersMutex);
+    memset(Players, 0, sizeof(Players));
+    NumPlayers = 0;
+    Platform::Mutex_Unlock(PlayersMutex);
 
-    Active = true;
-    IsHost = false;
-    IsMirror = true;
+    Platform::Mutex_Unlock(SessionMutex);
 }
 
-
-u32 PlayerAddress(int id)
+void Netplay::StartGame()
 {
-    if (id < 0 || id > 16) return 0;
-
-    u32 ret = Players[id].Address;
-    if (ret == 0x0100007F) ret = HostAddress;
-    return ret;
+    if (!Active || !IsHostSession) return;
+    StartRequested = true;
 }
 
 
-bool SpawnMirrorInstance(Player player)
+void Netplay::UpdatePlayerList()
 {
-#if 0
-    u16 curmask = IPC::GetInstanceBitmask();
-
-    QProcess newinst;
-    newinst.setProgram(QApplication::applicationFilePath());
-    newinst.setArguments(QApplication::arguments().mid(1, QApplication::arguments().length()-1));
+    u8 cmd[2+sizeof(Players)];
+    cmd[0] = Cmd_PlayerList;
+    cmd[1] = (u8)NumPlayers;
+    memcpy(&cmd[2], Players, sizeof(Players));
+    ENetPacket* pkt = enet_packet_create(cmd, 2+sizeof(Players), ENET_PACKET_FLAG_RELIABLE);
+    enet_host_broadcast(Host, Chan_Cmd, pkt);
+}
 
-#ifdef __WIN32__
-    newinst.setCreateProcessArgumentsModifier([] (QProcess::CreateProcessArguments *args)
+void Netplay::HostStartGame(melonDS::NDS& nds)
+{
+    if (!RemotePeer || Players[1].Status != Player_Client)
     {
-        args->flags |= CREATE_NEW_CONSOLE;
-    });
-#endif
-
-    if (!newinst.startDetached())
-        return false;
+        Log(LogLevel::Warn, "Netplay: can't start the game without another player\n");
+        return;
+    }
 
-    // try to determine the ID of the new instance
+    EndGame();
 
-    int newid = -1;
-    for (int tries = 0; tries < 10; tries++)
+    std::vector<u8> startstate;
+    if (!Rollback::SaveStartState(nds, SessionSettings.InputDelay, SessionSettings.MaxRollback, startstate))
     {
-        QThread::usleep(100 * 1000);
-
-        u16 newmask = IPC::GetInstanceBitmask();
-        if (newmask == curmask) continue;
-
-        newmask &= ~curmask;
-        for (int id = 0; id < 16; id++)
-        {
-            if (newmask & (1 << id))
-            {
-                newid = id;
-                break;
-            }
-        }
+        Log(LogLevel::Error, "Netplay: failed to save the state to start from\n");
+        return;
     }
 
-    if (newid == -1) return false;
-
-    // setup that instance
-    printf("netplay: spawned mirror instance for player %d with ID %d, configuring\n", player.ID, newid);
+    ENetPacket* pkt = enet_packet_create(nullptr, 1 + startstate.size(), ENET_PACKET_FLAG_RELIABLE);
+    pkt->data[0] = Cmd_StartGame;
+    memcpy(&pkt->data[1], startstate.data(), startstate.size());
+    enet_peer_send(RemotePeer, Chan_Cmd, pkt);
+    enet_host_flush(Host);
 
-    //std::string rompath = ROMManager::FullROMPath.join('|').toStdString();
-    //IPC::SendCommandStr(1<<newid, IPC::Cmd_LoadROM, rompath);
+    Session = std::make_unique<Rollback>(nds, MyPlayer.ID, Rollback::MaxPlayers,
+                                         SessionSettings.InputDelay, SessionSettings.MaxRollback);
+    Running = true;
+    Desynced = false;
 
-    if (player.Address == 0x0100007F) player.Address = HostAddress;
-    // calls Netplay::StartMirror()
-    //IPC::SendCommand(1<<newid, IPC::Cmd_SetupNetplayMirror, sizeof(Player), &player);
-#endif
-    return true;
+    Log(LogLevel::Info, "Netplay: game started, %u bytes of state sent\n", (u32)startstate.size());
 }
 
-bool SendBlobToMirrorClients(int type, u32 len, u8* data)
+bool Netplay::ClientStartGame(melonDS::NDS& nds, const u8* data, u32 len)
 {
-    u8* buf = ChunkBuffer;
+    Rollback::StartResult res = Rollback::CheckStartState(nds, data, len);
+    if (res == Rollback::Start_WrongGame)
+        Log(LogLevel::Error, "Netplay: the host is playing a different game\n");
+    if (res != Rollback::Start_OK)
+        return false;
 
-    buf[0] = 0x01;
-    buf[1] = type & 0xFF;
-    buf[2] = 0;
-    buf[3] = 0;
-    *(u32*)&buf[4] = len;
+    EndGame();
 
-    ENetPacket* pkt = enet_packet_create(buf, 8, ENET_PACKET_FLAG_RELIABLE);
-    enet_host_broadcast(MirrorHost, 1, pkt);
+    // the game counts as running from here, so that what the state holds is known to be the host's
+    Running = true;
 
-    if (len > 0)
+    int inputdelay, maxrollback;
+    if (Rollback::LoadStartState(nds, data, len, inputdelay, maxrollback) != Rollback::Start_OK)
     {
-        buf[0] = 0x02;
-        *(u32*)&buf[12] = 0;
-
-        for (u32 pos = 0; pos < len; pos += kChunkSize)
-        {
-            u32 chunklen = kChunkSize;
-            if ((pos + chunklen) > len)
-                chunklen = len - pos;
-
-            *(u32*)&buf[8] = pos;
-            memcpy(&buf[16], &data[pos], chunklen);
-
-            ENetPacket* pkt = enet_packet_create(buf, 16+chunklen, ENET_PACKET_FLAG_RELIABLE);
-            enet_host_broadcast(MirrorHost, 1, pkt);
-            //enet_host_flush(MirrorHost);
-        }
+        Log(LogLevel::Error, "Netplay: failed to load the state sent by the host\n");
+        Running = false;
+        return false;
     }
 
-    buf[0] = 0x03;
-
-    pkt = enet_packet_create(buf, 8, ENET_PACKET_FLAG_RELIABLE);
-    enet_host_broadcast(MirrorHost, 1, pkt);
+    Session = std::make_unique<Rollback>(nds, MyPlayer.ID, Rollback::MaxPlayers, inputdelay, maxrollback);
+    Desynced = false;
 
+    Log(LogLevel::Info, "Netplay: game started, input delay %d frames\n", inputdelay);
     return true;
 }
 
-void RecvBlobFromMirrorHost(ENetPeer* peer, ENetPacket* pkt)
+void Netplay::StopGame()
 {
-    u8* buf = pkt->data;
-    if (buf[0] == 0x01)
-    {
-        if (CurBlobType != -1) return;
-        if (pkt->dataLength != 8) return;
-
-        int type = buf[1];
-        if (type > Blob_MAX) return;
+    if (!Active) return;
 
-        u32 len = *(u32*)&buf[4];
-        if (len > 0x40000000) return;
+    Platform::Mutex_Lock(SessionMutex);
 
-        if (Blobs[type] != nullptr) return;
-        if (BlobLens[type] != 0) return;
-printf("[MC] start blob type=%d len=%d\n", type, len);
-        if (len) Blobs[type] = new u8[len];
-        BlobLens[type] = len;
-
-        CurBlobType = type;
-        CurBlobLen = len;
-
-        ENetEvent evt;
-        while (enet_host_service(MirrorHost, &evt, 5000) > 0)
-        {
-            if (evt.type == ENET_EVENT_TYPE_RECEIVE && evt.channelID == 1)
-            {
-                RecvBlobFromMirrorHost(evt.peer, evt.packet);
-                if (evt.packet->dataLength >= 1 && evt.packet->data[0] == 0x03)
-                {
-                    printf("[MC] blob done while in fast recv loop\n");
-                    break;
-                }
-            }
-            else
-            {
-                printf("[MC] fast recv loop aborted because evt %d ch %d\n", evt.type, evt.channelID);
-                break;
-            }
-        }
-    }
-    else if (buf[0] == 0x02)
+    if (Running && RemotePeer)
     {
-        if (CurBlobType < 0 || CurBlobType > Blob_MAX) return;
-        if (pkt->dataLength > (16+kChunkSize)) return;
+        u8 cmd = Cmd_StopGame;
+        enet_peer_send(RemotePeer, Chan_Cmd, enet_packet_create(&cmd, 1, ENET_PACKET_FLAG_RELIABLE));
+        enet_host_flush(Host);
+    }
+    EndGame();
 
-        int type = buf[1];
-        if (type != CurBlobType) return;
+    Platform::Mutex_Unlock(SessionMutex);
+}
 
-        u32 len = *(u32*)&buf[4];
-        if (len != CurBlobLen) return;
+void Netplay::EndGame()
+{
+    Session = nullptr;
+    Running = false;
+}
 
-        u32 pos = *(u32*)&buf[8];
-        if (pos >= len) return;
-        if ((pos + (pkt->dataLength-16)) > len) return;
 
-        u8* dst = Blobs[type];
-        if (!dst) return;
-        if (BlobLens[type] != len) return;
-        printf("[MC] recv blob data, type=%d pos=%08X len=%08X data=%08lX\n", type, pos, len, pkt->dataLength-16);
-        memcpy(&dst[pos], &buf[16], pkt->dataLength-16);
-    }
-    else if (buf[0] == 0x03)
-    {
-        if (CurBlobType < 0 || CurBlobType > Blob_MAX) return;
-        if (pkt->dataLength != 8) return;
+void Netplay::SendGameData()
+{
+    if (!RemotePeer) return;
 
-        int type = buf[1];
-        if (type != CurBlobType) return;
+    u8 cmd[7 + kMaxInputBatch*sizeof(Rollback::Input)];
+    u32 frame;
+    Rollback::Input input;
 
-        u32 len = *(u32*)&buf[4];
-        if (len != CurBlobLen) return;
-printf("[MC] finish blob type=%d len=%d\n", type, len);
-        CurBlobType = -1;
-        CurBlobLen = 0;
-    }
-    else if (buf[0] == 0x04)
+    // input goes out in batches of consecutive frames
+    int count = 0;
+    while (Session->PopLocalInput(frame, input))
     {
-        if (pkt->dataLength != 2) return;
-
-        bool res = false;
-#if 0
-        // reset
-        NDS::SetConsoleType(buf[1]);
-        NDS::EjectCart();
-        NDS::Reset();
-        //SetBatteryLevels();
-
-        if (Blobs[Blob_CartROM])
+        if (count == 0)
         {
-            res = NDS::LoadCart(Blobs[Blob_CartROM], BlobLens[Blob_CartROM],
-                                Blobs[Blob_CartSRAM], BlobLens[Blob_CartSRAM]);
-            if (!res)
-            {
-                printf("!!!! FAIL!!\n");
-                return;
-            }
+            cmd[0] = Cmd_Input;
+            cmd[1] = (u8)MyPlayer.ID;
+            memcpy(&cmd[2], &frame, 4);
         }
 
-        if (res)
-        {
-            ROMManager::CartType = 0;
-            //ROMManager::NDSSave = new SaveManager(savname);
+        memcpy(&cmd[7 + count*sizeof(Rollback::Input)], &input, sizeof(Rollback::Input));
+        count++;
 
-            //LoadCheats();
-        }
-#endif
-        // load initial state
-        // TODO: terrible hack!!
-        #if 0
-        FILE* f = Platform::OpenFile("netplay2.mln", "wb");
-        fwrite(Blobs[Blob_InitState], BlobLens[Blob_InitState], 1, f);
-        fclose(f);
-        Savestate* state = new Savestate("netplay2.mln", false);
-        NDS::DoSavestate(state);
-        delete state;
-
-        for (int i = 0; i < Blob_MAX; i++)
+        if (count == kMaxInputBatch)
         {
-            if (Blobs[i]) delete[] Blobs[i];
-            Blobs[i] = nullptr;
-            BlobLens[i] = 0;
+            cmd[6] = (u8)count;
+            enet_peer_send(RemotePeer, Chan_Cmd, enet_packet_create(cmd, 7 + count*sizeof(Rollback::Input), ENET_PACKET_FLAG_RELIABLE));
+            count = 0;
         }
-
-        /*Savestate* zorp = new Savestate("netplay3.mln", true);
-        NDS::DoSavestate(zorp);
-        delete zorp;*/
-
-printf("[MC] state loaded, PC=%08X/%08X\n", NDS::GetPC(0), NDS::GetPC(1));
-        ENetPacket* resp = enet_packet_create(buf, 1, ENET_PACKET_FLAG_RELIABLE);
-        enet_peer_send(peer, 1, resp);
-        #endif
     }
-    else if (buf[0] == 0x05)
+    if (count)
     {
-        printf("[MIRROR CLIENT] start\n");
-        StartLocal();
+        cmd[6] = (u8)count;
+        enet_peer_send(RemotePeer, Chan_Cmd, enet_packet_create(cmd, 7 + count*sizeof(Rollback::Input), ENET_PACKET_FLAG_RELIABLE));
     }
-}
 
-void SyncMirrorClients()
-{
-    printf("[MIRROR HOST] syncing clients\n");
-
-#if 0
-    SendBlobToMirrorClients(Blob_CartSRAM, NDSCart::GetSaveMemoryLength(), NDSCart::GetSaveMemory());
-
-    // send initial state
-    // TODO: this is a terrible hack!
-    /*printf("[MH] state start\n");
-    Savestate* state = new Savestate("netplay.mln", true);
-    NDS::DoSavestate(state);
-    delete state;
-    printf("[MH] state taken: PC=%08X/%08X\n", NDS::GetPC(0), NDS::GetPC(1));
-    FILE* f = Platform::OpenLocalFile("netplay.mln", "rb");
-    printf("[MH] state=%d\n", f?1:0);
-    fseek(f, 0, SEEK_END);
-    u32 flen = ftell(f);
-    fseek(f, 0, SEEK_SET);
-    u8* statebuf = new u8[flen];
-    fread(statebuf, flen, 1, f);
-    fclose(f);
-    printf("[MH] state read, len=%d\n", flen);
-    SendBlobToMirrorClients(Blob_InitState, flen, statebuf);
-    printf("[MH] state sent\n");
-    delete[] statebuf;*/
-
-    u8 data[2];
-    data[0] = 0x04;
-    data[1] = (u8)Config::ConsoleType;
-    ENetPacket* pkt = enet_packet_create(&data, 2, ENET_PACKET_FLAG_RELIABLE);
-    enet_host_broadcast(MirrorHost, 1, pkt);
-    //enet_host_flush(MirrorHost);
-
-    // wait for all clients to have caught up
-    int ngood = 0;
-    ENetEvent evt;
-    while (enet_host_service(MirrorHost, &evt, 300000) > 0)
-    {printf("EVENT %d CH %d\n", evt.type, evt.channelID);
-        if (evt.type == ENET_EVENT_TYPE_RECEIVE && evt.channelID == 1)
-        {
-            if (evt.packet->dataLength == 1 && evt.packet->data[0] == 0x04)
-                ngood++;
-        }
-        else
-            break;
-
-        if (ngood >= (NumPlayers-1))
-            break;
+    u64 checksum;
+    while (Session->PopLocalChecksum(frame, checksum))
+    {
+        cmd[0] = Cmd_Checksum;
+        memcpy(&cmd[1], &frame, 4);
+        memcpy(&cmd[5], &checksum, 8);
+        enet_peer_send(RemotePeer, Chan_Cmd, enet_packet_create(cmd, 13, ENET_PACKET_FLAG_RELIABLE));
     }
 
-    if (ngood != (NumPlayers-1))
-        printf("!!! BAD!! %d %d\n", ngood, NumPlayers);
-
-    printf("[MIRROR HOST] clients synced\n");
-
-    // start
-
-    data[0] = 0x05;
-    pkt = enet_packet_create(&data, 1, ENET_PACKET_FLAG_RELIABLE);
-    enet_host_broadcast(MirrorHost, 1, pkt);
-    //enet_host_flush(MirrorHost);
-
-    StartLocal();
-#endif
+    // the other side is waiting on this
+    enet_host_flush(Host);
 }
 
-void StartGame()
+void Netplay::ProcessGameData(const u8* data, u32 len)
 {
-    if (!IsHost)
-    {
-        printf("?????\n");
-        return;
-    }
+    if (!Session) return;
 
-    // spawn mirror instances as needed
-    for (int i = 1; i < NumPlayers; i++)
+    switch (data[0])
     {
-        SpawnMirrorInstance(Players[i]);
-    }
-
-    //SyncMirrorClients();
+    case Cmd_Input:
+        {
+            if (len < 7) break;
 
-    // tell remote peers to start game
-    u8 cmd[1] = {0x04};
-    ENetPacket* pkt = enet_packet_create(cmd, sizeof(cmd), ENET_PACKET_FLAG_RELIABLE);
-    enet_host_broadcast(Host, 0, pkt);
+            int player = data[1];
+            u32 frame;
+            memcpy(&frame, &data[2], 4);
+            u32 count = data[6];
+            if (len != (7 + count*sizeof(Rollback::Input))) break;
 
-    // tell other mirror instances to start the game
-    //IPC::SendCommand(0xFFFF, IPC::Cmd_Start, 0, nullptr);
+            for (u32 i = 0; i < count; i++)
+            {
+                Rollback::Input input;
+                memcpy(&input, &data[7 + i*sizeof(Rollback::Input)], sizeof(Rollback::Input));
+                if (!Session->AddRemoteInput(player, frame + i, input))
+                {
+                    Log(LogLevel::Error, "Netplay: received unexpected input for frame %u\n", frame + i);
+                    break;
+                }
+            }
+        }
+        break;
 
-    // TO START MIRROR CLIENT SHITO
-                        //
-                        // 1. NDS::Reset()
-                        // 2. load ROM
-                        // 3. load state
+    case Cmd_Checksum:
+        {
+            if (len != 13) break;
 
-    // start game locally
-    //StartLocal();
+            u32 frame;
+            u64 checksum;
+            memcpy(&frame, &data[1], 4);
+            memcpy(&checksum, &data[5], 8);
+            Session->AddRemoteChecksum(frame, checksum);
+        }
+        break;
+    }
 }
 
-void StartLocal()
+void Netplay::ProcessHostEvent(melonDS::NDS& nds, ENetEvent& event)
 {
-    for (int i = 0; i < 4; i++)
+    switch (event.type)
     {
-        InputFrame frame;
-        frame.FrameNum = i;
-        frame.KeyMask = 0xFFF;
-        frame.Touching = 0;
-        frame.TouchX = 0;
-        frame.TouchY = 0;
-        InputQueue.push(frame);
-    }
+    case ENET_EVENT_TYPE_CONNECT:
+        {
+            if (RemotePeer || Running)
+            {
+                // game is full, reject connection
+                enet_peer_disconnect(event.peer, 0);
+                break;
+            }
 
-    //NDS::Start();
-    //emuThread->emuRun();
-}
+            u8 cmd[10];
+            cmd[0] = Cmd_ClientInit;
+            memcpy(&cmd[1], &kNetplayMagic, 4);
+            memcpy(&cmd[5], &kProtocolVersion, 4);
+            cmd[9] = 1;
+            ENetPacket* pkt = enet_packet_create(cmd, 10, ENET_PACKET_FLAG_RELIABLE);
+            enet_peer_send(event.peer, Chan_Cmd, pkt);
 
+            Platform::Mutex_Lock(PlayersMutex);
 
-void ProcessHost()
-{
-    if (!Host) return;
+            Players[1].ID = 1;
+            Players[1].Status = Player_Connecting;
+            Players[1].Address = event.peer->address.host;
+            NumPlayers = 2;
 
-    ENetEvent event;
-    while (enet_host_service(Host, &event, 0) > 0)
-    {
-        switch (event.type)
-        {
-        case ENET_EVENT_TYPE_CONNECT:
-            {
-                // client connected; assign player number
+            Platform::Mutex_Unlock(PlayersMutex);
 
-                int id;
-                for (id = 0; id < 16; id++)
-                {
-                    if (id >= NumPlayers) break;
-                    if (Players[id].Status == 0) break;
-                }
+            RemotePeer = event.peer;
+        }
+        break;
 
-                if (id < 16)
-                {
-                    u8 cmd[2];
-                    cmd[0] = 0x01;
-                    cmd[1] = (u8)id;
-                    ENetPacket* pkt = enet_packet_create(cmd, 2, ENET_PACKET_FLAG_RELIABLE);
-                    enet_peer_send(event.peer, 0, pkt);
-
-                    Players[id].ID = id;
-                    Players[id].Status = 3;
-                    Players[id].Address = event.peer->address.host;
-                    event.peer->data = &Players[id];
-                    NumPlayers++;
-                }
-            }
-            break;
+    case ENET_EVENT_TYPE_DISCONNECT:
+        {
+            if (event.peer != RemotePeer) break;
 
-        case ENET_EVENT_TYPE_DISCONNECT:
+            if (Running)
             {
-                // TODO
-                printf("disco\n");
+                Log(LogLevel::Warn, "Netplay: the other player left\n");
+                EndGame();
             }
-            break;
 
-        case ENET_EVENT_TYPE_RECEIVE:
-            {
-                if (event.packet->dataLength < 1) break;
+            Platform::Mutex_Lock(PlayersMutex);
 
-                u8* data = (u8*)event.packet->data;
-                switch (data[0])
-                {
-                case 0x02: // client sending player info
-                    {
-                        if (event.packet->dataLength != (1+sizeof(Player))) break;
-
-                        Player player;
-                        memcpy(&player, &data[1], sizeof(Player));
-                        player.Name[31] = '\0';
-
-                        Player* hostside = (Player*)event.peer->data;
-                        if (player.ID != hostside->ID)
-                        {
-                            printf("what??? %d =/= %d\n", player.ID, hostside->ID);
-                            // TODO: disconnect
-                            break;
-                        }
-
-                        player.Status = 1;
-                        player.Address = event.peer->address.host;
-                        memcpy(hostside, &player, sizeof(Player));
-
-                        // broadcast updated player list
-                        u8 cmd[2+sizeof(Players)];
-                        cmd[0] = 0x03;
-                        cmd[1] = (u8)NumPlayers;
-                        memcpy(&cmd[2], Players, sizeof(Players));
-                        ENetPacket* pkt = enet_packet_create(cmd, 2+sizeof(Players), ENET_PACKET_FLAG_RELIABLE);
-                        enet_host_broadcast(Host, 0, pkt);
-
-                        //netplayDlg->updatePlayerList(Players, NumPlayers);
-                    }
-                    break;
-                }
-            }
-            break;
-        case ENET_EVENT_TYPE_NONE:
-            break;
-        }
-    }
-}
+            memset(&Players[1], 0, sizeof(Player));
+            NumPlayers = 1;
 
-void ProcessClient()
-{
-    if (!Host) return;
+            Platform::Mutex_Unlock(PlayersMutex);
 
-    ENetEvent event;
-    while (enet_host_service(Host, &event, 0) > 0)
-    {
-        switch (event.type)
-        {
-        case ENET_EVENT_TYPE_CONNECT:
-            printf("schmo\n");
-            break;
+            RemotePeer = nullptr;
+        }
+        break;
 
-        case ENET_EVENT_TYPE_DISCONNECT:
+    case ENET_EVENT_TYPE_RECEIVE:
+        {
+            if (event.packet->dataLength < 1 || event.peer != RemotePeer)
             {
-                // TODO
-                printf("shma\n");
+                enet_packet_destroy(event.packet);
+                break;
             }
-            break;
 
-        case ENET_EVENT_TYPE_RECEIVE:
+            u8* data = (u8*)event.packet->data;
+            u32 len = event.packet->dataLength;
+            switch (data[0])
             {
-                if (event.packet->dataLength < 1) break;
-
-                u8* data = (u8*)event.packet->data;
-                switch (data[0])
+            case Cmd_PlayerInfo: // client sending player info
                 {
-                case 0x01: // host sending player ID
+                    if (len != (9+sizeof(Player))) break;
+
+                    u32 magic, version;
+                    memcpy(&magic, &data[1], 4);
+                    memcpy(&version, &data[5], 4);
+                    if ((magic != kNetplayMagic) || (version != kProtocolVersion))
                     {
-                        if (event.packet->dataLength != 2) break;
-
-                        NumMirrorClients = 0;
-
-                        // create mirror host
-                        ENetAddress mirroraddr;
-                        mirroraddr.host = ENET_HOST_ANY;
-                        mirroraddr.port = 8064+1 + data[1]; // FIXME!!!!
-printf("client mirror host connecting to %08X:%d\n", mirroraddr.host, mirroraddr.port);
-                        MirrorHost = enet_host_create(&mirroraddr, 16, 2, 0, 0);
-                        if (!MirrorHost)
-                        {
-                            printf("mirror host shat itself :(\n");
-                            break;
-                        }
-
-                        // send player information
-                        MyPlayer.ID = data[1];
-                        u8 cmd[1+sizeof(Player)];
-                        cmd[0] = 0x02;
-                        memcpy(&cmd[1], &MyPlayer, sizeof(Player));
-                        ENetPacket* pkt = enet_packet_create(cmd, 1+sizeof(Player), ENET_PACKET_FLAG_RELIABLE);
-                        enet_peer_send(event.peer, 0, pkt);
+                        enet_peer_disconnect(event.peer, 0);
+                        break;
                     }
-                    break;
 
-                case 0x03: // host sending player list
-                    {
-                        if (event.packet->dataLength != (2+sizeof(Players))) break;
-                        if (data[1] > 16) break;
+                    Player player;
+                    memcpy(&player, &data[9], sizeof(Player));
+                    player.Name[31] = '\0';
 
-                        NumPlayers = data[1];
-                        memcpy(Players, &data[2], sizeof(Players));
-                        for (int i = 0; i < 16; i++)
-                        {
-                            Players[i].Name[31] = '\0';
-                        }
+                    Platform::Mutex_Lock(PlayersMutex);
 
-                        //netplayDlg->updatePlayerList(Players, NumPlayers);
-                    }
-                    break;
+                    player.ID = 1;
+                    player.Status = Player_Client;
+                    player.Address = event.peer->address.host;
+                    memcpy(&Players[1], &player, sizeof(Player));
 
-                case 0x04: // start game
-                    {
-                        // spawn mirror instances as needed
-                        for (int i = 0; i < NumPlayers; i++)
-                        {
-                            if (i != MyPlayer.ID)
-                                SpawnMirrorInstance(Players[i]);
-                        }
-
-                        //SyncMirrorClients();
-printf("bourf\n");
-                        // tell other mirror instances to start the game
-                        //IPC::SendCommand(0xFFFF, IPC::Cmd_Start, 0, nullptr);
-printf("birf\n");
-                        // start game locally
-                        //StartLocal();
-                    }
-                    break;
+                    Platform::Mutex_Unlock(PlayersMutex);
+
+                    // broadcast updated player list
+                    UpdatePlayerList();
+                }
+                break;
+
+            case Cmd_StopGame:
+                {
+                    if (!Running) break;
+
+                    Log(LogLevel::Warn, "Netplay: the other player stopped the game\n");
+                    EndGame();
                 }
+                break;
+
+            default:
+                ProcessGameData(data, len);
+                break;
             }
-            break;
-        case ENET_EVENT_TYPE_NONE:
-            break;
+
+            enet_packet_destroy(event.packet);
         }
+        break;
+
+    case ENET_EVENT_TYPE_NONE:
+        break;
     }
 }
 
-void ProcessMirrorHost()
+void Netplay::ProcessClientEvent(melonDS::NDS& nds, ENetEvent& event)
 {
-    if (!MirrorHost) return;
-#if 0
-    bool block = false;
-    ENetEvent event;
-    while (enet_host_service(MirrorHost, &event, block ? 5000 : 0) > 0)
+    switch (event.type)
     {
-        switch (event.type)
-        {
-        case ENET_EVENT_TYPE_CONNECT:
-            printf("[MIRROR HOST] mirror client connected\n");
-            NumMirrorClients++;
-            event.peer->data = (void*)0;
+    case ENET_EVENT_TYPE_CONNECT:
+        break;
 
-            if (NumMirrorClients >= NumPlayers)
+    case ENET_EVENT_TYPE_DISCONNECT:
+        {
+            if (Running)
             {
-                printf("??????\n");
+                Log(LogLevel::Warn, "Netplay: the host left\n");
+                EndGame();
             }
-            else if (NumMirrorClients == (NumPlayers-1))
+
+            Platform::Mutex_Lock(PlayersMutex);
+
+            for (int i = 0; i < Rollback::MaxPlayers; i++)
             {
-                // all mirror clients are connected, we're ready to go
-                SyncMirrorClients();
-                //StartLocal();
+                if (Players[i].Status == Player_Host)
+                    Players[i].Status = Player_Disconnected;
             }
-            break;
 
-        case ENET_EVENT_TYPE_DISCONNECT:
+            Platform::Mutex_Unlock(PlayersMutex);
+
+            RemotePeer = nullptr;
+        }
+        break;
+
+    case ENET_EVENT_TYPE_RECEIVE:
+        {
+            if (event.packet->dataLength < 1)
             {
-                // TODO
-                printf("[MIRROR HOST] mirror client disconnected\n");
-                NumMirrorClients--;
+                enet_packet_destroy(event.packet);
+                break;
             }
-            break;
 
-        case ENET_EVENT_TYPE_RECEIVE:
-            if (event.channelID == 0)
+            u8* data = (u8*)event.packet->data;
+            u32 len = event.packet->dataLength;
+            switch (data[0])
             {
-                if (event.packet->dataLength != 4) break;
-                /*u8* data = (u8*)event.packet->data;
-
-                if (data[0])
+            case Cmd_PlayerList: // host sending player list
                 {
-                    event.peer->data = (void*)1;
-                    block = true;
-                }
-                else
-                {
-                    event.peer->data = (void*)0;
-                    block = false;
+                    if (len != (2+sizeof(Players))) break;
+                    if (data[1] > Rollback::MaxPlayers) break;
 
-                    for (int i = 0; i < MirrorHost->peerCount; i++)
-                    {
-                        ENetPeer* peer = &(MirrorHost->peers[i]);
-                        if (peer->state != ENET_PEER_STATE_CONNECTED) continue;
-                        if (peer->data != (void*)0)
-                        {
-                            block = true;
-                            break;
-                        }
-                    }
-                }*/
-                s32 clientframes = *(s32*)event.packet->data;
-//printf("[SYNC] HOST=%d CLIENT=%d\n", NDS::NumFrames, clientframes);
-                if (clientframes < (((s32)NDS::NumFrames) - 16))
-                {
-                    event.peer->data = (void*)1;
-                    block = true;
+                    Platform::Mutex_Lock(PlayersMutex);
+
+                    NumPlayers = data[1];
+                    memcpy(Players, &data[2], sizeof(Players));
+                    for (int i = 0; i < Rollback::MaxPlayers; i++)
+                        Players[i].Name[31] = '\0';
+
+                    Platform::Mutex_Unlock(PlayersMutex);
                 }
-                else
-                {
-                    event.peer->data = (void*)0;
-                    block = false;
+                break;
 
-                    for (int i = 0; i < MirrorHost->peerCount; i++)
+            case Cmd_StartGame:
+                {
+                    if (!ClientStartGame(nds, &data[1], len - 1))
                     {
-                        ENetPeer* peer = &(MirrorHost->peers[i]);
-                        if (peer->state != ENET_PEER_STATE_CONNECTED) continue;
-                        if (peer->data != (void*)0)
-                        {
-                            block = true;
-                            break;
-                        }
+                        // let the host know this side won't follow
+                        u8 cmd = Cmd_StopGame;
+                        enet_peer_send(event.peer, Chan_Cmd, enet_packet_create(&cmd, 1, ENET_PACKET_FLAG_RELIABLE));
                     }
                 }
-            }
-            break;
-        }
-    }
-#endif
-}
+                break;
 
-void ProcessMirrorClient()
-{
-    if (!MirrorHost) return;
-#if 0
-    bool block = false;
-    if (emuThread->emuIsRunning())// && NDS::NumFrames > 4)
-    {
-        if (InputQueue.empty())
-            block = true;
-    }
+            case Cmd_StopGame:
+                {
+                    if (!Running) break;
 
-    ENetEvent event;
-    while (enet_host_service(MirrorHost, &event, block ? 5000 : 0) > 0)
-    {
-        switch (event.type)
-        {
-        case ENET_EVENT_TYPE_CONNECT:
-            printf("schmu\n");
-            Lag = false;
-            break;
+                    Log(LogLevel::Warn, "Netplay: the host stopped the game\n");
+                    EndGame();
+                }
+                break;
 
-        case ENET_EVENT_TYPE_DISCONNECT:
-            {
-                // TODO
-                printf("shmz\n");
+            default:
+                ProcessGameData(data, len);
+                break;
             }
-            break;
-
-        case ENET_EVENT_TYPE_RECEIVE://printf("RX %d %d\n", event.channelID, event.packet->dataLength);
-            if (event.channelID == 0)
-            {
-                if (event.packet->dataLength != sizeof(InputFrame)) break;
-
-                u8* data = (u8*)event.packet->data;
-                InputFrame frame;
-                memcpy(&frame, data, sizeof(InputFrame));
-                InputQueue.push(frame);
 
-                /*bool lag = (InputQueue.size() > 4*2);
-                if (lag != Lag)
-                {
-                    // let the mirror host know they are running too fast for us
-printf("mirror client lag notify: %d\n", lag);
-                    u8 data = lag ? 1 : 0;
-                    ENetPacket* pkt = enet_packet_create(&data, 1, ENET_PACKET_FLAG_RELIABLE);
-                    enet_peer_send(event.peer, 0, pkt);
-
-                    Lag = lag;
-                }*/
-                {
-                    ENetPacket* pkt = enet_packet_create(&NDS::NumFrames, 4, ENET_PACKET_FLAG_RELIABLE);
-                    enet_peer_send(event.peer, 0, pkt);
-                    //enet_host_flush(MirrorHost);
-                }
-            }
-            else if (event.channelID == 1)
-            {
-                RecvBlobFromMirrorHost(event.peer, event.packet);
-            }
-            break;
+            enet_packet_destroy(event.packet);
         }
+        break;
 
-        if (block) break;
+    case ENET_EVENT_TYPE_NONE:
+        break;
     }
-#endif
 }
 
-void ProcessFrame()
+void Netplay::Process(melonDS::NDS& nds)
 {
-    if (IsMirror)
-    {
-        ProcessMirrorClient();
-    }
-    else
+    if (!Active) return;
+
+    Platform::Mutex_Lock(SessionMutex);
+
+    if (Host)
     {
-        if (IsHost)
-        {
-            ProcessHost();
-        }
-        else
+        if (IsHostSession && StartRequested.exchange(false))
+            HostStartGame(nds);
+
+        ENetEvent event;
+        while (enet_host_service(Host, &event, 0) > 0)
         {
-            ProcessClient();
+            if (IsHostSession)
+                ProcessHostEvent(nds, event);
+            else
+                ProcessClientEvent(nds, event);
         }
-
-        ProcessMirrorHost();
     }
+
+    Platform::Mutex_Unlock(SessionMutex);
 }
 
-void ProcessInput()
+u32 Netplay::RunFrame(melonDS::NDS& nds, const Rollback::Input& input)
 {
-    // netplay input processing
-    //
-    // N = current frame #
-    // L = amount of lag frames
-    //
-    // host side:
-    // we take the current input (normally meant for frame N)
-    // and delay it to frame N+L
-    //
-    // client side:
-    // we receive input from the host
-    // apply each input to the frame it's assigned to
-    // before running a frame, we need to wait to have received input for it
-    // TODO: alert host if we are running too far behind
-#if 0
-    if (!IsMirror)
-    {
-        u32 lag = 4; // TODO: make configurable!!
-
-        InputFrame frame;
-        frame.FrameNum = NDS::NumFrames + lag;
-        frame.KeyMask = Input::InputMask;
-        frame.Touching = Input::Touching ? 1:0;
-        frame.TouchX = Input::TouchX;
-        frame.TouchY = Input::TouchY;
-        // TODO: other shit! (some hotkeys for example?)
-
-        InputQueue.push(frame);
-
-        u8 cmd[sizeof(InputFrame)];
-        memcpy(cmd, &frame, sizeof(InputFrame));
-        ENetPacket* pkt = enet_packet_create(cmd, sizeof(cmd), ENET_PACKET_FLAG_RELIABLE);
-        enet_host_broadcast(MirrorHost, 0, pkt);
-        //enet_host_flush(MirrorHost);
-    }
+    u32 nlines = 0;
 
-    if (InputQueue.empty())
-    {
-        //if (NDS::NumFrames > 4)
-            printf("Netplay: BAD! INPUT QUEUE EMPTY\n");
-        return;
-    }
+    Platform::Mutex_Lock(SessionMutex);
 
-    InputFrame& frame = InputQueue.front();
-
-    if (frame.FrameNum < NDS::NumFrames)
+    if (Session && (&Session->GetNDS() != &nds))
     {
-        // TODO: this situation is a desync
-        printf("Netplay: BAD! LAGGING BEHIND\n");
-        while (frame.FrameNum < NDS::NumFrames)
+        // the console was replaced, ie. by booting another game
+        Log(LogLevel::Warn, "Netplay: the console changed, stopping the game\n");
+        EndGame();
+
+        if (RemotePeer)
         {
-            if (InputQueue.size() < 2) break;
-            InputQueue.pop();
-            frame = InputQueue.front();
+            u8 cmd = Cmd_StopGame;
+            enet_peer_send(RemotePeer, Chan_Cmd, enet_packet_create(&cmd, 1, ENET_PACKET_FLAG_RELIABLE));
         }
     }
 
-    if (frame.FrameNum > NDS::NumFrames)
+    if (Session)
     {
-        // frame in the future, ignore
-        return;
-    }
+        nlines = Session->RunFrame(input);
+        SendGameData();
 
-    // apply this input frame
-    if (frame.KeyMask != 0xFFF) printf("[%08d] INPUT=%08X (%08d) (backlog=%d)\n", NDS::NumFrames, frame.KeyMask, frame.FrameNum, InputQueue.size());
-    NDS::SetKeyMask(frame.KeyMask);
-    if (frame.Touching) NDS::TouchScreen(frame.TouchX, frame.TouchY);
-    else                NDS::ReleaseScreen();
+        if (Session->IsDesynced() && !Desynced)
+        {
+            Log(LogLevel::Error, "Netplay: desync at frame %u, the consoles no longer match\n", Session->GetDesyncFrame());
+            Desynced = true;
+        }
+    }
 
-    InputQueue.pop();
-#endif
+    Platform::Mutex_Unlock(SessionMutex);
+    return nlines;
 }
 
 }
@@ -19,39 +19,128 @@
 #ifndef NETPLAY_H
 #define NETPLAY_H
 
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <enet/enet.h>
+
 #include "types.h"
+#include "Platform.h"
+#include "Rollback.h"
 
-namespace Netplay
+namespace melonDS
 {
-
-struct Player
+class NDS;
+
+/// Rollback netplay between two machines sharing one console.
+///
+/// The host sends its console state to the client when the game starts, from then on
+/// each side runs its own copy of the console through a \c Rollback session, and
+/// they send each other their input and state checksums.
+///
+/// The session is set up from the UI thread, everything else happens on the emulator
+/// thread: \c Process services the network and \c RunFrame replaces \c NDS::RunFrame.
+class Netplay
 {
-    int ID;
-    char Name[32];
-    int Status; // 0=no player 1=normal 2=host 3=connecting
-    melonDS::u32 Address;
+public:
+    Netplay() noexcept;
+    Netplay(const Netplay&) = delete;
+    Netplay& operator=(const Netplay&) = delete;
+    Netplay(Netplay&& other) = delete;
+    Netplay& operator=(Netplay&& other) = delete;
+    ~Netplay() noexcept;
+
+    enum PlayerStatus
+    {
+        Player_None = 0,        // no player in this entry
+        Player_Client,          // game client
+        Player_Host,            // game host
+        Player_Connecting,      // player still connecting
+        Player_Disconnected,    // player disconnected
+    };
+
+    struct Player
+    {
+        int ID;
+        char Name[32];
+        PlayerStatus Status;
+        u32 Address;
+
+        bool IsLocalPlayer;
+        u32 Ping;
+    };
+
+    struct Settings
+    {
+        int InputDelay;
+        int MaxRollback;
+    };
+
+    bool StartHost(const char* player, int port, const Settings& settings);
+    bool StartClient(const char* player, const char* host, int port);
+    void EndSession();
+
+    /// Has the game start for everyone from the host's current console state.
+    /// The state is sent by the next call to \c Process.
+    void StartGame();
+
+    /// Stops the game for everyone, ie. before the console it runs on goes away.
+    void StopGame();
+
+    std::vector<Player> GetPlayerList();
+    int GetNumPlayers() { return NumPlayers; }
+
+    [[nodiscard]] bool IsActive() const noexcept { return Active; }
+    [[nodiscard]] bool IsHost() const noexcept { return IsHostSession; }
+    [[nodiscard]] bool IsRunning() const noexcept { return Running; }
+    [[nodiscard]] bool IsDesynced() const noexcept { return Desynced; }
+
+    /// Sends and receives what's pending. Called by the emulator thread once per frame.
+    void Process(melonDS::NDS& nds);
+
+    /// Emulates the next frame with the local input.
+    /// @return The number of scanlines emulated, 0 if waiting for the other player.
+    u32 RunFrame(melonDS::NDS& nds, const Rollback::Input& input);
+
+    /// @return The statistics of the running game, all zero if none is running.
+    Rollback::Stats GetStats();
+
+private:
+    bool Inited;
+    std::atomic<bool> Active;
+    bool IsHostSession;
+    std::atomic<bool> Running;
+    std::atomic<bool> Desynced;
+    std::atomic<bool> StartRequested;
+
+    ENetHost* Host;
+    ENetPeer* RemotePeer;
+
+    Player Players[Rollback::MaxPlayers];
+    int NumPlayers;
+    Platform::Mutex* PlayersMutex;
+
+    Player MyPlayer;
+    Settings SessionSettings;
+
+    // held while the session is used by the emulator thread, so it can't be torn down meanwhile
+    Platform::Mutex* SessionMutex;
+    std::unique_ptr<Rollback> Session;
+
+    void UpdatePlayerList();
+
+    void HostStartGame(melonDS::NDS& nds);
+    bool ClientStartGame(melonDS::NDS& nds, const u8* data, u32 len);
+
+    void ProcessHostEvent(melonDS::NDS& nds, ENetEvent& event);
+    void ProcessClientEvent(melonDS::NDS& nds, ENetEvent& event);
+    void ProcessGameData(const u8* data, u32 len);
+    void SendGameData();
+    void EndGame();
 };
 
-
-extern bool Active;
-
-bool Init();
-void DeInit();
-
-void StartHost(const char* player, int port);
-void StartClient(const char* player, const char* host, int port);
-void StartMirror(const Player* player);
-
-melonDS::u32 PlayerAddress(int id);
-
-void StartGame();
-void StartLocal();
-
-void StartGame();
-
-void ProcessFrame();
-void ProcessInput();
-
 }
 
 #endif // NETPLAY_H